@@ -28,7 +28,7 @@ ActionClass_execute(ActionClass *a, OctetString *caller_gid)
 		|| type == ElementaryAction_quit)
 			error("ActionClass: ignoring %s in OnStartup/OnCloseDown actions", ElementaryAction_name(&list->item));
 		else
-			ElementaryAction_execute(&list->item, caller_gid);
+			ElementaryAction_execute(&list->item, caller_gid, NULL);
 		list = list->next;
 	}
 
@@ -41,21 +41,28 @@
 /*
  * caller_gid should be the group identifier of the object containing the ElementaryAction
  * it is used to resolve the Generic references in the ElementaryAction parameters
+ * target is the object the action applies to, if it has already been looked up (see LinkClass_compile())
+ * if target is NULL, it is looked up here
  */
 
 void
-ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
+ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid, RootClass *target)
 {
+	GenericObjectReference *g;
 	ObjectReference *ref;
 	RootClass *obj;
 	int op;
 
+	if((obj = target) == NULL
+	&& (g = ElementaryAction_target(e)) != NULL
+	&& (ref = GenericObjectReference_getObjectReference(g, caller_gid)) != NULL)
+		obj = MHEGEngine_findObjectReference(ref, caller_gid);
+
 	switch(e->choice)
 	{
 	case ElementaryAction_activate:
 		verbose("ElementaryAction_activate");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.activate, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_LinkClass)
 				LinkClass_Activate((LinkClass *) obj);
@@ -66,8 +73,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_add:
 		verbose("ElementaryAction_add");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.add.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VariableClass
 			&& VariableClass_type((VariableClass *) obj) == OriginalValue_integer)
@@ -79,8 +85,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_add_item:
 		verbose("ElementaryAction_add_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.add_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_AddItem((ListGroupClass *) obj, &e->u.add_item, caller_gid);
@@ -91,8 +96,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_append:
 		verbose("ElementaryAction_append");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.append.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VariableClass
 			&& VariableClass_type((VariableClass *) obj) == OriginalValue_octetstring)
@@ -104,8 +108,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_bring_to_front:
 		verbose("ElementaryAction_bring_to_front");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.bring_to_front, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_BringToFront((BitmapClass *) obj);
@@ -130,8 +133,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_call:
 		verbose("ElementaryAction_call");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.call.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			/* UK MHEG Profile says we dont need to support Remote or InterchangedProgramClass */
 			if(obj->inst.rtti == RTTI_ResidentProgramClass)
@@ -143,8 +145,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_call_action_slot:
 		verbose("ElementaryAction_call_action_slot");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.call_action_slot.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_CallActionSlot((ListGroupClass *) obj, &e->u.call_action_slot, caller_gid);
@@ -157,8 +158,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_clear:
 		verbose("ElementaryAction_clear");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.clear, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_Clear((DynamicLineArtClass *) obj);
@@ -169,8 +169,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_clone:
 		verbose("ElementaryAction_clone");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.clone.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_Clone((BitmapClass *) obj, &e->u.clone, caller_gid);
@@ -203,8 +202,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_close_connection:
 		verbose("ElementaryAction_close_connection");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.close_connection.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_CloseConnection((ApplicationClass *) obj, &e->u.close_connection, caller_gid);
@@ -215,8 +213,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_deactivate:
 		verbose("ElementaryAction_deactivate");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.deactivate, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_LinkClass)
 				LinkClass_Deactivate((LinkClass *) obj);
@@ -227,8 +224,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_del_item:
 		verbose("ElementaryAction_del_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.del_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_DelItem((ListGroupClass *) obj, &e->u.del_item, caller_gid);
@@ -239,8 +235,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_deselect:
 		verbose("ElementaryAction_deselect");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.deselect, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_HotspotClass)
 				HotspotClass_Deselect((HotspotClass *) obj);
@@ -255,8 +250,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_deselect_item:
 		verbose("ElementaryAction_deselect_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.deselect_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_DeselectItem((ListGroupClass *) obj, &e->u.deselect_item, caller_gid);
@@ -267,8 +261,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_divide:
 		verbose("ElementaryAction_divide");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.divide.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VariableClass
 			&& VariableClass_type((VariableClass *) obj) == OriginalValue_integer)
@@ -280,8 +273,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_draw_arc:
 		verbose("ElementaryAction_draw_arc");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.draw_arc.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_DrawArc((DynamicLineArtClass *) obj, &e->u.draw_arc, caller_gid);
@@ -292,8 +284,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_draw_line:
 		verbose("ElementaryAction_draw_line");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.draw_line.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_DrawLine((DynamicLineArtClass *) obj, &e->u.draw_line, caller_gid);
@@ -304,8 +295,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_draw_oval:
 		verbose("ElementaryAction_draw_oval");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.draw_oval.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_DrawOval((DynamicLineArtClass *) obj, &e->u.draw_oval, caller_gid);
@@ -316,8 +306,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_draw_polygon:
 		verbose("ElementaryAction_draw_polygon");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.draw_polygon.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_DrawPolygon((DynamicLineArtClass *) obj, &e->u.draw_polygon, caller_gid);
@@ -328,8 +317,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_draw_polyline:
 		verbose("ElementaryAction_draw_polyline");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.draw_polyline.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_DrawPolyline((DynamicLineArtClass *) obj, &e->u.draw_polyline, caller_gid);
@@ -340,8 +328,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_draw_rectangle:
 		verbose("ElementaryAction_draw_rectangle");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.draw_rectangle.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_DrawRectangle((DynamicLineArtClass *) obj, &e->u.draw_rectangle, caller_gid);
@@ -352,8 +339,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_draw_sector:
 		verbose("ElementaryAction_draw_sector");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.draw_sector.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_DrawSector((DynamicLineArtClass *) obj, &e->u.draw_sector, caller_gid);
@@ -364,8 +350,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_fork:
 		verbose("ElementaryAction_fork");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.fork.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			/* UK MHEG Profile says we dont need to support Remote or InterchangedProgramClass */
 			if(obj->inst.rtti == RTTI_ResidentProgramClass)
@@ -377,8 +362,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_availability_status:
 		verbose("ElementaryAction_get_availability_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_availability_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			RootClass_GetAvailabilityStatus(obj, &e->u.get_availability_status.availability_status_var, caller_gid);
 		}
@@ -386,8 +370,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_box_size:
 		verbose("ElementaryAction_get_box_size");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_box_size.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_GetBoxSize((BitmapClass *) obj, &e->u.get_box_size, caller_gid);
@@ -412,8 +395,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_cell_item:
 		verbose("ElementaryAction_get_cell_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_cell_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_GetCellItem((ListGroupClass *) obj, &e->u.get_cell_item, caller_gid);
@@ -424,8 +406,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_cursor_position:
 		verbose("ElementaryAction_get_cursor_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_cursor_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SceneClass)
 				SceneClass_GetCursorPosition((SceneClass *) obj, &e->u.get_cursor_position, caller_gid);
@@ -436,8 +417,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_engine_support:
 		verbose("ElementaryAction_get_engine_support");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_engine_support.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_GetEngineSupport((ApplicationClass *) obj, &e->u.get_engine_support, caller_gid);
@@ -448,8 +428,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_entry_point:
 		verbose("ElementaryAction_get_entry_point");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_entry_point.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_GetEntryPoint((EntryFieldClass *) obj, &e->u.get_entry_point, caller_gid);
@@ -460,8 +439,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_fill_colour:
 		verbose("ElementaryAction_get_fill_colour");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_fill_colour.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_GetFillColour((DynamicLineArtClass *) obj, &e->u.get_fill_colour, caller_gid);
@@ -472,8 +450,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_first_item:
 		verbose("ElementaryAction_get_first_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_first_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_GetFirstItem((ListGroupClass *) obj, &e->u.get_first_item, caller_gid);
@@ -484,8 +461,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_highlight_status:
 		verbose("ElementaryAction_get_highlight_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_highlight_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_GetHighlightStatus((EntryFieldClass *) obj, &e->u.get_highlight_status, caller_gid);
@@ -500,8 +476,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_interaction_status:
 		verbose("ElementaryAction_get_interaction_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_interaction_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_GetInteractionStatus((EntryFieldClass *) obj, &e->u.get_interaction_status, caller_gid);
@@ -516,8 +491,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_item_status:
 		verbose("ElementaryAction_get_item_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_item_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_GetItemStatus((ListGroupClass *) obj, &e->u.get_item_status, caller_gid);
@@ -528,8 +502,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_label:
 		verbose("ElementaryAction_get_label");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_label.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_PushButtonClass)
 				PushButtonClass_GetLabel((PushButtonClass *) obj, &e->u.get_label, caller_gid);
@@ -542,8 +515,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_last_anchor_fired:
 		verbose("ElementaryAction_get_last_anchor_fired");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_last_anchor_fired.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_HyperTextClass)
 				HyperTextClass_GetLastAnchorFired((HyperTextClass *) obj, &e->u.get_last_anchor_fired, caller_gid);
@@ -554,8 +526,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_line_colour:
 		verbose("ElementaryAction_get_line_colour");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_line_colour.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_GetLineColour((DynamicLineArtClass *) obj, &e->u.get_line_colour, caller_gid);
@@ -566,8 +537,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_line_style:
 		verbose("ElementaryAction_get_line_style");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_line_style.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_GetLineStyle((DynamicLineArtClass *) obj, &e->u.get_line_style, caller_gid);
@@ -578,8 +548,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_line_width:
 		verbose("ElementaryAction_get_line_width");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_line_width.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_GetLineWidth((DynamicLineArtClass *) obj, &e->u.get_line_width, caller_gid);
@@ -590,8 +559,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_list_item:
 		verbose("ElementaryAction_get_list_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_list_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_GetListItem((ListGroupClass *) obj, &e->u.get_list_item, caller_gid);
@@ -602,8 +570,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_list_size:
 		verbose("ElementaryAction_get_list_size");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_list_size.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_GetListSize((ListGroupClass *) obj, &e->u.get_list_size, caller_gid);
@@ -614,8 +581,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_overwrite_mode:
 		verbose("ElementaryAction_get_overwrite_mode");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_overwrite_mode.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_GetOverwriteMode((EntryFieldClass *) obj, &e->u.get_overwrite_mode, caller_gid);
@@ -626,8 +592,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_portion:
 		verbose("ElementaryAction_get_portion");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_portion.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SliderClass)
 				SliderClass_GetPortion((SliderClass *) obj, &e->u.get_portion, caller_gid);
@@ -638,8 +603,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_position:
 		verbose("ElementaryAction_get_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_GetPosition((BitmapClass *) obj, &e->u.get_position, caller_gid);
@@ -664,8 +628,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_running_status:
 		verbose("ElementaryAction_get_running_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_running_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			RootClass_GetRunningStatus(obj, &e->u.get_running_status.running_status_var, caller_gid);
 		}
@@ -673,8 +636,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_selection_status:
 		verbose("ElementaryAction_get_selection_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_selection_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SwitchButtonClass)
 				SwitchButtonClass_GetSelectionStatus((SwitchButtonClass *) obj, &e->u.get_selection_status, caller_gid);
@@ -685,8 +647,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_slider_value:
 		verbose("ElementaryAction_get_slider_value");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_slider_value.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SliderClass)
 				SliderClass_GetSliderValue((SliderClass *) obj, &e->u.get_slider_value, caller_gid);
@@ -697,8 +658,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_text_content:
 		verbose("ElementaryAction_get_text_content");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_text_content.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_GetTextContent((EntryFieldClass *) obj, &e->u.get_text_content, caller_gid);
@@ -713,8 +673,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_text_data:
 		verbose("ElementaryAction_get_text_data");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_text_data.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_TextClass)
 				TextClass_GetTextData((TextClass *) obj, &e->u.get_text_data, caller_gid);
@@ -729,8 +688,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_token_position:
 		verbose("ElementaryAction_get_token_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_token_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_GetTokenPosition((ListGroupClass *) obj, &e->u.get_token_position, caller_gid);
@@ -743,8 +701,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_volume:
 		verbose("ElementaryAction_get_volume");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_volume.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_AudioClass)
 				AudioClass_GetVolume((AudioClass *) obj, &e->u.get_volume, caller_gid);
@@ -760,8 +717,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_lock_screen:
 		verbose("ElementaryAction_lock_screen");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.lock_screen, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_LockScreen((ApplicationClass *) obj);
@@ -772,8 +728,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_modulo:
 		verbose("ElementaryAction_modulo");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.modulo.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VariableClass
 			&& VariableClass_type((VariableClass *) obj) == OriginalValue_integer)
@@ -785,8 +740,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_move:
 		verbose("ElementaryAction_move");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.move.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_Move((ListGroupClass *) obj, &e->u.move, caller_gid);
@@ -799,8 +753,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_move_to:
 		verbose("ElementaryAction_move_to");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.move_to.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_MoveTo((ListGroupClass *) obj, &e->u.move_to, caller_gid);
@@ -813,8 +766,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_multiply:
 		verbose("ElementaryAction_multiply");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.multiply.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VariableClass
 			&& VariableClass_type((VariableClass *) obj) == OriginalValue_integer)
@@ -826,8 +778,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_open_connection:
 		verbose("ElementaryAction_open_connection");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.open_connection.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_OpenConnection((ApplicationClass *) obj, &e->u.open_connection, caller_gid);
@@ -838,8 +789,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_preload:
 		verbose("ElementaryAction_preload");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.preload, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_AudioClass)
 				AudioClass_Preparation((AudioClass *) obj);
@@ -878,8 +828,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_put_before:
 		verbose("ElementaryAction_put_before");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.put_before.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_PutBefore((BitmapClass *) obj, &e->u.put_before, caller_gid);
@@ -904,8 +853,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_put_behind:
 		verbose("ElementaryAction_put_behind");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.put_behind.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_PutBehind((BitmapClass *) obj, &e->u.put_behind, caller_gid);
@@ -930,8 +878,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_quit:
 		verbose("ElementaryAction_quit");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.quit, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_Quit((ApplicationClass *) obj);
@@ -942,8 +889,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_read_persistent:
 		verbose("ElementaryAction_read_persistent");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.read_persistent.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_ReadPersistent((ApplicationClass *) obj, &e->u.read_persistent, caller_gid);
@@ -954,8 +900,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_run:
 		verbose("ElementaryAction_run");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.run, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_AudioClass)
 				AudioClass_Activation((AudioClass *) obj);
@@ -996,8 +941,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_scale_bitmap:
 		verbose("ElementaryAction_scale_bitmap");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.scale_bitmap.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_ScaleBitmap((BitmapClass *) obj, &e->u.scale_bitmap, caller_gid);
@@ -1008,8 +952,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_scale_video:
 		verbose("ElementaryAction_scale_video");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.scale_video.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VideoClass)
 				VideoClass_ScaleVideo((VideoClass *) obj, &e->u.scale_video, caller_gid);
@@ -1020,8 +963,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_scroll_items:
 		verbose("ElementaryAction_scroll_items");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.scroll_items.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_ScrollItems((ListGroupClass *) obj, &e->u.scroll_items, caller_gid);
@@ -1032,8 +974,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_select:
 		verbose("ElementaryAction_select");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.select, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_HotspotClass)
 				HotspotClass_Select((HotspotClass *) obj);
@@ -1048,8 +989,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_select_item:
 		verbose("ElementaryAction_select_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.select_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_SelectItem((ListGroupClass *) obj, &e->u.select_item, caller_gid);
@@ -1060,8 +1000,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_send_event:
 		verbose("ElementaryAction_send_event");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.send_event.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SceneClass)
 				SceneClass_SendEvent((SceneClass *) obj, &e->u.send_event, caller_gid);
@@ -1072,8 +1011,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_send_to_back:
 		verbose("ElementaryAction_send_to_back");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.send_to_back, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_SendToBack((BitmapClass *) obj);
@@ -1098,8 +1036,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_box_size:
 		verbose("ElementaryAction_set_box_size");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_box_size.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_SetBoxSize((BitmapClass *) obj, &e->u.set_box_size, caller_gid);
@@ -1124,8 +1061,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_cache_priority:
 		verbose("ElementaryAction_set_cache_priority");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_cache_priority.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_SetCachePriority((ApplicationClass *) obj, &e->u.set_cache_priority, caller_gid);
@@ -1138,8 +1074,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_counter_end_position:
 		verbose("ElementaryAction_set_counter_end_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_counter_end_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_StreamClass)
 				StreamClass_SetCounterEndPosition((StreamClass *) obj, &e->u.set_counter_end_position, caller_gid);
@@ -1150,8 +1085,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_counter_position:
 		verbose("ElementaryAction_set_counter_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_counter_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_StreamClass)
 				StreamClass_SetCounterPosition((StreamClass *) obj, &e->u.set_counter_position, caller_gid);
@@ -1162,8 +1096,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_counter_trigger:
 		verbose("ElementaryAction_set_counter_trigger");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_counter_trigger.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_StreamClass)
 				StreamClass_SetCounterTrigger((StreamClass *) obj, &e->u.set_counter_trigger, caller_gid);
@@ -1174,8 +1107,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_cursor_position:
 		verbose("ElementaryAction_set_cursor_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_cursor_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SceneClass)
 				SceneClass_SetCursorPosition((SceneClass *) obj, &e->u.set_cursor_position, caller_gid);
@@ -1186,8 +1118,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_cursor_shape:
 		verbose("ElementaryAction_set_cursor_shape");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_cursor_shape.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SceneClass)
 				SceneClass_SetCursorShape((SceneClass *) obj, &e->u.set_cursor_shape, caller_gid);
@@ -1198,8 +1129,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_data:
 		verbose("ElementaryAction_set_data");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_data.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_SetData((BitmapClass *) obj, &e->u.set_data, caller_gid);
@@ -1218,8 +1148,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_entry_point:
 		verbose("ElementaryAction_set_entry_point");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_entry_point.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetEntryPoint((EntryFieldClass *) obj, &e->u.set_entry_point, caller_gid);
@@ -1230,8 +1159,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_fill_colour:
 		verbose("ElementaryAction_set_fill_colour");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_fill_colour.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_SetFillColour((DynamicLineArtClass *) obj, &e->u.set_fill_colour, caller_gid);
@@ -1244,8 +1172,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_first_item:
 		verbose("ElementaryAction_set_first_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_first_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_SetFirstItem((ListGroupClass *) obj, &e->u.set_first_item, caller_gid);
@@ -1256,8 +1183,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_font_ref:
 		verbose("ElementaryAction_set_font_ref");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_font_ref.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetFontRef((EntryFieldClass *) obj, &e->u.set_font_ref, caller_gid);
@@ -1272,8 +1198,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_highlight_status:
 		verbose("ElementaryAction_set_highlight_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_highlight_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetHighlightStatus((EntryFieldClass *) obj, &e->u.set_highlight_status, caller_gid);
@@ -1288,8 +1213,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_interaction_status:
 		verbose("ElementaryAction_set_interaction_status");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_interaction_status.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetInteractionStatus((EntryFieldClass *) obj, &e->u.set_interaction_status, caller_gid);
@@ -1304,8 +1228,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_label:
 		verbose("ElementaryAction_set_label");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_label.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_PushButtonClass)
 				PushButtonClass_SetLabel((PushButtonClass *) obj, &e->u.set_label, caller_gid);
@@ -1318,8 +1241,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_line_colour:
 		verbose("ElementaryAction_set_line_colour");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_line_colour.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_SetLineColour((DynamicLineArtClass *) obj, &e->u.set_line_colour, caller_gid);
@@ -1332,8 +1254,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_line_style:
 		verbose("ElementaryAction_set_line_style");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_line_style.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_SetLineStyle((DynamicLineArtClass *) obj, &e->u.set_line_style, caller_gid);
@@ -1346,8 +1267,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_line_width:
 		verbose("ElementaryAction_set_line_width");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_line_width.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_DynamicLineArtClass)
 				DynamicLineArtClass_SetLineWidth((DynamicLineArtClass *) obj, &e->u.set_line_width, caller_gid);
@@ -1360,8 +1280,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_overwrite_mode:
 		verbose("ElementaryAction_set_overwrite_mode");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_overwrite_mode.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetOverwriteMode((EntryFieldClass *) obj, &e->u.set_overwrite_mode, caller_gid);
@@ -1372,8 +1291,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_palette_ref:
 		verbose("ElementaryAction_set_palette_ref");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_palette_ref.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_SetPaletteRef((BitmapClass *) obj, &e->u.set_palette_ref, caller_gid);
@@ -1396,8 +1314,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_portion:
 		verbose("ElementaryAction_set_portion");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_portion.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SliderClass)
 				SliderClass_SetPortion((SliderClass *) obj, &e->u.set_portion, caller_gid);
@@ -1408,8 +1325,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_position:
 		verbose("ElementaryAction_set_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_SetPosition((BitmapClass *) obj, &e->u.set_position, caller_gid);
@@ -1434,8 +1350,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_slider_value:
 		verbose("ElementaryAction_set_slider_value");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_slider_value.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SliderClass)
 				SliderClass_SetSliderValue((SliderClass *) obj, &e->u.set_slider_value, caller_gid);
@@ -1446,8 +1361,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_speed:
 		verbose("ElementaryAction_set_speed");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_speed.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_StreamClass)
 				StreamClass_SetSpeed((StreamClass *) obj, &e->u.set_speed, caller_gid);
@@ -1458,8 +1372,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_timer:
 		verbose("ElementaryAction_set_timer");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_timer.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_SetTimer((ApplicationClass *) obj, &e->u.set_timer, caller_gid);
@@ -1472,8 +1385,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_transparency:
 		verbose("ElementaryAction_set_transparency");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_transparency.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_SetTransparency((BitmapClass *) obj, &e->u.set_transparency, caller_gid);
@@ -1484,8 +1396,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_variable:
 		verbose("ElementaryAction_set_variable");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_variable.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VariableClass)
 				VariableClass_SetVariable((VariableClass *) obj, &e->u.set_variable.new_variable_value, caller_gid);
@@ -1496,8 +1407,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_volume:
 		verbose("ElementaryAction_set_volume");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_volume.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_AudioClass)
 				AudioClass_SetVolume((AudioClass *) obj, &e->u.set_volume, caller_gid);
@@ -1513,8 +1423,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_step:
 		verbose("ElementaryAction_step");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.step.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SliderClass)
 				SliderClass_Step((SliderClass *) obj, &e->u.step, caller_gid);
@@ -1525,8 +1434,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_stop:
 		verbose("ElementaryAction_stop");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.stop, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_RemoteProgramClass)
 				RemoteProgramClass_Deactivation((RemoteProgramClass *) obj);
@@ -1573,8 +1481,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_store_persistent:
 		verbose("ElementaryAction_store_persistent");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.store_persistent.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_StorePersistent((ApplicationClass *) obj, &e->u.store_persistent, caller_gid);
@@ -1585,8 +1492,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_subtract:
 		verbose("ElementaryAction_subtract");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.subtract.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VariableClass
 			&& VariableClass_type((VariableClass *) obj) == OriginalValue_integer)
@@ -1598,8 +1504,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_test_variable:
 		verbose("ElementaryAction_test_variable");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.test_variable.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			op = GenericInteger_getInteger(&e->u.test_variable.operator, caller_gid);
 			if(obj->inst.rtti == RTTI_VariableClass)
@@ -1611,8 +1516,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_toggle:
 		verbose("ElementaryAction_toggle");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.toggle, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SwitchButtonClass)
 				SwitchButtonClass_Toggle((SwitchButtonClass *) obj);
@@ -1623,8 +1527,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_toggle_item:
 		verbose("ElementaryAction_toggle_item");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.toggle_item.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_ToggleItem((ListGroupClass *) obj, &e->u.toggle_item, caller_gid);
@@ -1640,8 +1543,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_unload:
 		verbose("ElementaryAction_unload");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.unload, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_RemoteProgramClass)
 				RemoteProgramClass_Destruction((RemoteProgramClass *) obj);
@@ -1698,8 +1600,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_unlock_screen:
 		verbose("ElementaryAction_unlock_screen");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.unlock_screen, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ApplicationClass)
 				ApplicationClass_UnlockScreen((ApplicationClass *) obj);
@@ -1710,8 +1611,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_background_colour:
 		verbose("ElementaryAction_set_background_colour");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_background_colour.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetBackgroundColour((EntryFieldClass *) obj, &e->u.set_background_colour, caller_gid);
@@ -1726,8 +1626,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_cell_position:
 		verbose("ElementaryAction_set_cell_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_cell_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_ListGroupClass)
 				ListGroupClass_SetCellPosition((ListGroupClass *) obj, &e->u.set_cell_position, caller_gid);
@@ -1738,8 +1637,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_input_register:
 		verbose("ElementaryAction_set_input_register");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_input_register.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SceneClass)
 				SceneClass_SetInputRegister((SceneClass *) obj, &e->u.set_input_register, caller_gid);
@@ -1750,8 +1648,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_text_colour:
 		verbose("ElementaryAction_set_text_colour");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_text_colour.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetTextColour((EntryFieldClass *) obj, &e->u.set_text_colour, caller_gid);
@@ -1766,8 +1663,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_font_attributes:
 		verbose("ElementaryAction_set_font_attributes");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_font_attributes.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_EntryFieldClass)
 				EntryFieldClass_SetFontAttributes((EntryFieldClass *) obj, &e->u.set_font_attributes, caller_gid);
@@ -1782,8 +1678,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_video_decode_offset:
 		verbose("ElementaryAction_set_video_decode_offset");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_video_decode_offset.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VideoClass)
 				VideoClass_SetVideoDecodeOffset((VideoClass *) obj, &e->u.set_video_decode_offset, caller_gid);
@@ -1794,8 +1689,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_video_decode_offset:
 		verbose("ElementaryAction_get_video_decode_offset");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_video_decode_offset.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_VideoClass)
 				VideoClass_GetVideoDecodeOffset((VideoClass *) obj, &e->u.get_video_decode_offset, caller_gid);
@@ -1806,8 +1700,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_focus_position:
 		verbose("ElementaryAction_get_focus_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_focus_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_HyperTextClass)
 				HyperTextClass_GetFocusPosition((HyperTextClass *) obj, &e->u.get_focus_position, caller_gid);
@@ -1818,8 +1711,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_focus_position:
 		verbose("ElementaryAction_set_focus_position");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_focus_position.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_HyperTextClass)
 				HyperTextClass_SetFocusPosition((HyperTextClass *) obj, &e->u.set_focus_position, caller_gid);
@@ -1830,8 +1722,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_bitmap_decode_offset:
 		verbose("ElementaryAction_set_bitmap_decode_offset");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_bitmap_decode_offset.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_SetBitmapDecodeOffset((BitmapClass *) obj, &e->u.set_bitmap_decode_offset, caller_gid);
@@ -1842,8 +1733,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_get_bitmap_decode_offset:
 		verbose("ElementaryAction_get_bitmap_decode_offset");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.get_bitmap_decode_offset.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_BitmapClass)
 				BitmapClass_GetBitmapDecodeOffset((BitmapClass *) obj, &e->u.get_bitmap_decode_offset, caller_gid);
@@ -1854,8 +1744,7 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 
 	case ElementaryAction_set_slider_parameters:
 		verbose("ElementaryAction_set_slider_parameters");
-		if(((ref = GenericObjectReference_getObjectReference(&e->u.set_slider_parameters.target, caller_gid)) != NULL)
-		&& ((obj = MHEGEngine_findObjectReference(ref, caller_gid)) != NULL))
+		if(obj != NULL)
 		{
 			if(obj->inst.rtti == RTTI_SliderClass)
 				SliderClass_SetSliderParameters((SliderClass *) obj, &e->u.set_slider_parameters, caller_gid);
@@ -1872,6 +1761,379 @@ ElementaryAction_execute(ElementaryAction *e, OctetString *caller_gid)
 	return;
 }
 
+/*
+ * returns the reference to the object the action applies to
+ * returns NULL if the action does not have a target object
+ */
+
+GenericObjectReference *
+ElementaryAction_target(ElementaryAction *e)
+{
+	switch(e->choice)
+	{
+	case ElementaryAction_activate:
+		return &e->u.activate;
+
+	case ElementaryAction_add:
+		return &e->u.add.target;
+
+	case ElementaryAction_add_item:
+		return &e->u.add_item.target;
+
+	case ElementaryAction_append:
+		return &e->u.append.target;
+
+	case ElementaryAction_bring_to_front:
+		return &e->u.bring_to_front;
+
+	case ElementaryAction_call:
+		return &e->u.call.target;
+
+	case ElementaryAction_call_action_slot:
+		return &e->u.call_action_slot.target;
+
+	case ElementaryAction_clear:
+		return &e->u.clear;
+
+	case ElementaryAction_clone:
+		return &e->u.clone.target;
+
+	case ElementaryAction_close_connection:
+		return &e->u.close_connection.target;
+
+	case ElementaryAction_deactivate:
+		return &e->u.deactivate;
+
+	case ElementaryAction_del_item:
+		return &e->u.del_item.target;
+
+	case ElementaryAction_deselect:
+		return &e->u.deselect;
+
+	case ElementaryAction_deselect_item:
+		return &e->u.deselect_item.target;
+
+	case ElementaryAction_divide:
+		return &e->u.divide.target;
+
+	case ElementaryAction_draw_arc:
+		return &e->u.draw_arc.target;
+
+	case ElementaryAction_draw_line:
+		return &e->u.draw_line.target;
+
+	case ElementaryAction_draw_oval:
+		return &e->u.draw_oval.target;
+
+	case ElementaryAction_draw_polygon:
+		return &e->u.draw_polygon.target;
+
+	case ElementaryAction_draw_polyline:
+		return &e->u.draw_polyline.target;
+
+	case ElementaryAction_draw_rectangle:
+		return &e->u.draw_rectangle.target;
+
+	case ElementaryAction_draw_sector:
+		return &e->u.draw_sector.target;
+
+	case ElementaryAction_fork:
+		return &e->u.fork.target;
+
+	case ElementaryAction_get_availability_status:
+		return &e->u.get_availability_status.target;
+
+	case ElementaryAction_get_box_size:
+		return &e->u.get_box_size.target;
+
+	case ElementaryAction_get_cell_item:
+		return &e->u.get_cell_item.target;
+
+	case ElementaryAction_get_cursor_position:
+		return &e->u.get_cursor_position.target;
+
+	case ElementaryAction_get_engine_support:
+		return &e->u.get_engine_support.target;
+
+	case ElementaryAction_get_entry_point:
+		return &e->u.get_entry_point.target;
+
+	case ElementaryAction_get_fill_colour:
+		return &e->u.get_fill_colour.target;
+
+	case ElementaryAction_get_first_item:
+		return &e->u.get_first_item.target;
+
+	case ElementaryAction_get_highlight_status:
+		return &e->u.get_highlight_status.target;
+
+	case ElementaryAction_get_interaction_status:
+		return &e->u.get_interaction_status.target;
+
+	case ElementaryAction_get_item_status:
+		return &e->u.get_item_status.target;
+
+	case ElementaryAction_get_label:
+		return &e->u.get_label.target;
+
+	case ElementaryAction_get_last_anchor_fired:
+		return &e->u.get_last_anchor_fired.target;
+
+	case ElementaryAction_get_line_colour:
+		return &e->u.get_line_colour.target;
+
+	case ElementaryAction_get_line_style:
+		return &e->u.get_line_style.target;
+
+	case ElementaryAction_get_line_width:
+		return &e->u.get_line_width.target;
+
+	case ElementaryAction_get_list_item:
+		return &e->u.get_list_item.target;
+
+	case ElementaryAction_get_list_size:
+		return &e->u.get_list_size.target;
+
+	case ElementaryAction_get_overwrite_mode:
+		return &e->u.get_overwrite_mode.target;
+
+	case ElementaryAction_get_portion:
+		return &e->u.get_portion.target;
+
+	case ElementaryAction_get_position:
+		return &e->u.get_position.target;
+
+	case ElementaryAction_get_running_status:
+		return &e->u.get_running_status.target;
+
+	case ElementaryAction_get_selection_status:
+		return &e->u.get_selection_status.target;
+
+	case ElementaryAction_get_slider_value:
+		return &e->u.get_slider_value.target;
+
+	case ElementaryAction_get_text_content:
+		return &e->u.get_text_content.target;
+
+	case ElementaryAction_get_text_data:
+		return &e->u.get_text_data.target;
+
+	case ElementaryAction_get_token_position:
+		return &e->u.get_token_position.target;
+
+	case ElementaryAction_get_volume:
+		return &e->u.get_volume.target;
+
+	case ElementaryAction_lock_screen:
+		return &e->u.lock_screen;
+
+	case ElementaryAction_modulo:
+		return &e->u.modulo.target;
+
+	case ElementaryAction_move:
+		return &e->u.move.target;
+
+	case ElementaryAction_move_to:
+		return &e->u.move_to.target;
+
+	case ElementaryAction_multiply:
+		return &e->u.multiply.target;
+
+	case ElementaryAction_open_connection:
+		return &e->u.open_connection.target;
+
+	case ElementaryAction_preload:
+		return &e->u.preload;
+
+	case ElementaryAction_put_before:
+		return &e->u.put_before.target;
+
+	case ElementaryAction_put_behind:
+		return &e->u.put_behind.target;
+
+	case ElementaryAction_quit:
+		return &e->u.quit;
+
+	case ElementaryAction_read_persistent:
+		return &e->u.read_persistent.target;
+
+	case ElementaryAction_run:
+		return &e->u.run;
+
+	case ElementaryAction_scale_bitmap:
+		return &e->u.scale_bitmap.target;
+
+	case ElementaryAction_scale_video:
+		return &e->u.scale_video.target;
+
+	case ElementaryAction_scroll_items:
+		return &e->u.scroll_items.target;
+
+	case ElementaryAction_select:
+		return &e->u.select;
+
+	case ElementaryAction_select_item:
+		return &e->u.select_item.target;
+
+	case ElementaryAction_send_event:
+		return &e->u.send_event.target;
+
+	case ElementaryAction_send_to_back:
+		return &e->u.send_to_back;
+
+	case ElementaryAction_set_box_size:
+		return &e->u.set_box_size.target;
+
+	case ElementaryAction_set_cache_priority:
+		return &e->u.set_cache_priority.target;
+
+	case ElementaryAction_set_counter_end_position:
+		return &e->u.set_counter_end_position.target;
+
+	case ElementaryAction_set_counter_position:
+		return &e->u.set_counter_position.target;
+
+	case ElementaryAction_set_counter_trigger:
+		return &e->u.set_counter_trigger.target;
+
+	case ElementaryAction_set_cursor_position:
+		return &e->u.set_cursor_position.target;
+
+	case ElementaryAction_set_cursor_shape:
+		return &e->u.set_cursor_shape.target;
+
+	case ElementaryAction_set_data:
+		return &e->u.set_data.target;
+
+	case ElementaryAction_set_entry_point:
+		return &e->u.set_entry_point.target;
+
+	case ElementaryAction_set_fill_colour:
+		return &e->u.set_fill_colour.target;
+
+	case ElementaryAction_set_first_item:
+		return &e->u.set_first_item.target;
+
+	case ElementaryAction_set_font_ref:
+		return &e->u.set_font_ref.target;
+
+	case ElementaryAction_set_highlight_status:
+		return &e->u.set_highlight_status.target;
+
+	case ElementaryAction_set_interaction_status:
+		return &e->u.set_interaction_status.target;
+
+	case ElementaryAction_set_label:
+		return &e->u.set_label.target;
+
+	case ElementaryAction_set_line_colour:
+		return &e->u.set_line_colour.target;
+
+	case ElementaryAction_set_line_style:
+		return &e->u.set_line_style.target;
+
+	case ElementaryAction_set_line_width:
+		return &e->u.set_line_width.target;
+
+	case ElementaryAction_set_overwrite_mode:
+		return &e->u.set_overwrite_mode.target;
+
+	case ElementaryAction_set_palette_ref:
+		return &e->u.set_palette_ref.target;
+
+	case ElementaryAction_set_portion:
+		return &e->u.set_portion.target;
+
+	case ElementaryAction_set_position:
+		return &e->u.set_position.target;
+
+	case ElementaryAction_set_slider_value:
+		return &e->u.set_slider_value.target;
+
+	case ElementaryAction_set_speed:
+		return &e->u.set_speed.target;
+
+	case ElementaryAction_set_timer:
+		return &e->u.set_timer.target;
+
+	case ElementaryAction_set_transparency:
+		return &e->u.set_transparency.target;
+
+	case ElementaryAction_set_variable:
+		return &e->u.set_variable.target;
+
+	case ElementaryAction_set_volume:
+		return &e->u.set_volume.target;
+
+	case ElementaryAction_step:
+		return &e->u.step.target;
+
+	case ElementaryAction_stop:
+		return &e->u.stop;
+
+	case ElementaryAction_store_persistent:
+		return &e->u.store_persistent.target;
+
+	case ElementaryAction_subtract:
+		return &e->u.subtract.target;
+
+	case ElementaryAction_test_variable:
+		return &e->u.test_variable.target;
+
+	case ElementaryAction_toggle:
+		return &e->u.toggle;
+
+	case ElementaryAction_toggle_item:
+		return &e->u.toggle_item.target;
+
+	case ElementaryAction_unload:
+		return &e->u.unload;
+
+	case ElementaryAction_unlock_screen:
+		return &e->u.unlock_screen;
+
+	case ElementaryAction_set_background_colour:
+		return &e->u.set_background_colour.target;
+
+	case ElementaryAction_set_cell_position:
+		return &e->u.set_cell_position.target;
+
+	case ElementaryAction_set_input_register:
+		return &e->u.set_input_register.target;
+
+	case ElementaryAction_set_text_colour:
+		return &e->u.set_text_colour.target;
+
+	case ElementaryAction_set_font_attributes:
+		return &e->u.set_font_attributes.target;
+
+	case ElementaryAction_set_video_decode_offset:
+		return &e->u.set_video_decode_offset.target;
+
+	case ElementaryAction_get_video_decode_offset:
+		return &e->u.get_video_decode_offset.target;
+
+	case ElementaryAction_get_focus_position:
+		return &e->u.get_focus_position.target;
+
+	case ElementaryAction_set_focus_position:
+		return &e->u.set_focus_position.target;
+
+	case ElementaryAction_set_bitmap_decode_offset:
+		return &e->u.set_bitmap_decode_offset.target;
+
+	case ElementaryAction_get_bitmap_decode_offset:
+		return &e->u.get_bitmap_decode_offset.target;
+
+	case ElementaryAction_set_slider_parameters:
+		return &e->u.set_slider_parameters.target;
+
+	default:
+		/* Launch, Spawn and TransitionTo */
+		return NULL;
+	}
+}
+
 char *
 ElementaryAction_name(ElementaryAction *e)
 {
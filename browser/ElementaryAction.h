@@ -7,7 +7,8 @@
 
 #include "ISO13522-MHEG-5.h"
 
-void ElementaryAction_execute(ElementaryAction *, OctetString *);
+void ElementaryAction_execute(ElementaryAction *, OctetString *, RootClass *);
+GenericObjectReference *ElementaryAction_target(ElementaryAction *);
 char *ElementaryAction_name(ElementaryAction *);
 
 #endif	/* __ELEMENTARYACTION_H__ */
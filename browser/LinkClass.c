@@ -3,20 +3,27 @@
  */
 
 #include <stdbool.h>
+#include <string.h>
 
 #include "MHEGEngine.h"
 #include "LinkClass.h"
 #include "RootClass.h"
 #include "EventType.h"
 #include "ExternalReference.h"
+#include "ElementaryAction.h"
 #include "der_decode.h"
+#include "utils.h"
 
 void
 LinkClass_Preparation(LinkClass *t)
 {
 	verbose("LinkClass: %s; Preparation", ExternalReference_name(&t->rootClass.inst.ref));
 
-	RootClass_Preparation(&t->rootClass);
+	/* returns false if it is already prepared */
+	if(!RootClass_Preparation(&t->rootClass))
+		return;
+
+	LinkClass_compile(t);
 
 	return;
 }
@@ -79,6 +86,12 @@ LinkClass_Destruction(LinkClass *t)
 	 * until free_InterchangedObject is called on the whole app or scene
 	 */
 
+	/* it will be compiled again if it is prepared again */
+	safe_free(t->inst.actions);
+	t->inst.actions = NULL;
+	t->inst.nactions = 0;
+	t->inst.compiled = false;
+
 	/* generate an IsDeleted event */
 	t->rootClass.inst.AvailabilityStatus = false;
 	MHEGEngine_generateEvent(&t->rootClass.inst.ref, EventType_is_deleted, NULL);
@@ -125,22 +138,86 @@ LinkClass_Deactivate(LinkClass *l)
 }
 
 /*
- * returns true if the given src/type/data match the LinkCondition for this LinkClass
+ * look up the object each of the link_effect actions applies to now, rather than every time the link fires
+ * indirect references are left until the action is executed, as they depend on the value of an ObjectRefVariable
+ * the targets stay valid until an object is freed, ie until MHEGEngine_objectGeneration() changes
  */
 
-bool
-LinkClass_conditionMet(LinkClass *l, ExternalReference *src, EventType type, EventData *data)
+void
+LinkClass_compile(LinkClass *l)
 {
-	ExternalReference *link_ref;
-	ObjectReference *link_src;
+	OctetString *gid = &l->rootClass.inst.ref.group_identifier;
+	LIST_TYPE(ElementaryAction) *list;
+	GenericObjectReference *target;
+	CompiledAction *compiled;
+	unsigned int n;
+
+	n = 0;
+	for(list=l->link_effect; list; list=list->next)
+		n ++;
+
+	l->inst.actions = safe_realloc(l->inst.actions, n * sizeof(CompiledAction));
+	l->inst.nactions = n;
+
+	compiled = l->inst.actions;
+	for(list=l->link_effect; list; list=list->next)
+	{
+		compiled->action = &list->item;
+		compiled->target = NULL;
+		if((target = ElementaryAction_target(&list->item)) != NULL
+		&& target->choice == GenericObjectReference_direct_reference)
+			compiled->target = MHEGEngine_lookupObjectReference(&target->u.direct_reference, gid);
+		compiled ++;
+	}
+
+	l->inst.generation = MHEGEngine_objectGeneration();
+	l->inst.compiled = true;
+
+	return;
+}
+
+/*
+ * returns the absolute group ID of the LinkCondition's event source, and its object number in *num
+ * if the group id is not specified in the link condition, it defaults to the enclosing app/scene
+ * the return value may be a ptr to a static string that will be overwritten by the next call to this routine
+ * returns NULL if the event source is invalid
+ */
+
+OctetString *
+LinkClass_eventSource(LinkClass *l, unsigned int *num)
+{
+	static OctetString absolute;
+	ObjectReference *link_src = &l->link_condition.event_source;
 	char *fullname;
-	OctetString absolute;
-	OctetString *link_gid;
 
-	/* easiest first */
-	if(l->link_condition.event_type != type)
-		return false;
+	switch(link_src->choice)
+	{
+	case ObjectReference_internal_reference:
+		*num = link_src->u.internal_reference;
+		return &l->rootClass.inst.ref.group_identifier;
 
+	case ObjectReference_external_reference:
+		/* make sure it is an absolute group id (ie starts with ~//) */
+		*num = link_src->u.external_reference.object_number;
+		fullname = MHEGEngine_absoluteFilename(&link_src->u.external_reference.group_identifier);
+		absolute.size = strlen(fullname);
+		absolute.data = (unsigned char *) fullname;
+		return &absolute;
+
+	default:
+		error("Unknown ObjectReference type: %d", link_src->choice);
+		return NULL;
+	}
+}
+
+/*
+ * returns true if the given event data matches the LinkCondition for this LinkClass
+ * the event source and type are matched by the engine's active link index, see MHEGEngine_addActiveLink()
+ */
+
+bool
+LinkClass_eventDataMatches(LinkClass *l, EventData *data)
+{
 	/* shouldn't happen, event type determines if there is any data or not, but just in case */
 	if(l->link_condition.have_event_data && data == NULL)
 		return false;
@@ -174,38 +251,6 @@ LinkClass_conditionMet(LinkClass *l, ExternalReference *src, EventType type, Eve
 		}
 	}
 
-	/*
-	 * check the source group id and object number
-	 * if the group id is not specified in the link condition, it defaults to the enclosing app/scene (ie link_ref)
-	 */
-	link_ref = &l->rootClass.inst.ref;
-	link_src = &l->link_condition.event_source;
-	switch(link_src->choice)
-	{
-	case ObjectReference_internal_reference:
-		if(OctetString_cmp(&src->group_identifier, &link_ref->group_identifier) != 0
-		|| src->object_number != link_src->u.internal_reference)
-			return false;
-		break;
-
-	case ObjectReference_external_reference:
-		/* make sure the event src is an absolute group id (ie starts with ~//) */
-		fullname = MHEGEngine_absoluteFilename(&link_src->u.external_reference.group_identifier);
-		absolute.size = strlen(fullname);
-		absolute.data = (unsigned char *) fullname;
-		link_gid = &absolute;
-		if(OctetString_cmp(&src->group_identifier, link_gid) != 0
-		|| src->object_number != link_src->u.external_reference.object_number)
-			return false;
-		break;
-
-	default:
-		error("Unknown ObjectReference type: %d", link_src->choice);
-		return false;
-	}
-
-	verbose("LinkCondition met: %s; %s", ExternalReference_name(src), EventType_name(type));
-
 	return true;
 }
 
@@ -16,7 +16,9 @@ void LinkClass_Clone(LinkClass *, Clone *, OctetString *);
 void LinkClass_Activate(LinkClass *);
 void LinkClass_Deactivate(LinkClass *);
 
-bool LinkClass_conditionMet(LinkClass *, ExternalReference *, EventType, EventData *);
+void LinkClass_compile(LinkClass *);
+OctetString *LinkClass_eventSource(LinkClass *, unsigned int *);
+bool LinkClass_eventDataMatches(LinkClass *, EventData *);
 
 #endif	/* __LINKCLASS_H__ */
 
@@ -47,8 +47,8 @@ MHEGApp_fini(MHEGApp *m)
 ApplicationClass *
 MHEGApp_loadApplication(MHEGApp *m, OctetString *derfile)
 {
-	FILE *der;
-	int len;
+	OctetString data;
+	der_buffer der;
 	int rc;
 
 	/* assert */
@@ -61,7 +61,7 @@ MHEGApp_loadApplication(MHEGApp *m, OctetString *derfile)
 		m->app = safe_malloc(sizeof(InterchangedObject));
 	bzero(m->app, sizeof(InterchangedObject));
 
-	if((der = MHEGEngine_openFile(derfile)) == NULL)
+	if(!MHEGEngine_loadFile(derfile, &data))
 	{
 		error("Unable to open '%.*s'", derfile->size, derfile->data);
 		safe_free(m->app);
@@ -71,12 +71,10 @@ MHEGApp_loadApplication(MHEGApp *m, OctetString *derfile)
 
 	/* so all the ObjectReferences get resolved to the current file */
 	MHEGEngine_setDERObject(derfile);
-	/* DER decode it */
-	fseek(der, 0, SEEK_END);
-	len = ftell(der);
-	rewind(der);
-	rc = der_decode_InterchangedObject(der, m->app, len);
-	fclose(der);
+	/* DER decode it straight from memory */
+	der_buffer_init(&der, data.data, data.size);
+	rc = der_decode_InterchangedObject(&der, m->app, data.size);
+	free_OctetString(&data);
 
 	if(rc < 0 || m->app->choice != InterchangedObject_application)
 	{
@@ -102,8 +100,8 @@ MHEGApp_loadApplication(MHEGApp *m, OctetString *derfile)
 SceneClass *
 MHEGApp_loadScene(MHEGApp *m, OctetString *derfile)
 {
-	FILE *der;
-	int len;
+	OctetString data;
+	der_buffer der;
 	int rc;
 
 	/* assert */
@@ -116,7 +114,7 @@ MHEGApp_loadScene(MHEGApp *m, OctetString *derfile)
 		m->scene = safe_malloc(sizeof(InterchangedObject));
 	bzero(m->scene, sizeof(InterchangedObject));
 
-	if((der = MHEGEngine_openFile(derfile)) == NULL)
+	if(!MHEGEngine_loadFile(derfile, &data))
 	{
 		error("Unable to open '%.*s'", derfile->size, derfile->data);
 		safe_free(m->scene);
@@ -126,12 +124,10 @@ MHEGApp_loadScene(MHEGApp *m, OctetString *derfile)
 
 	/* so all the ObjectReferences get resolved to the current file */
 	MHEGEngine_setDERObject(derfile);
-	/* DER decode it */
-	fseek(der, 0, SEEK_END);
-	len = ftell(der);
-	rewind(der);
-	rc = der_decode_InterchangedObject(der, m->scene, len);
-	fclose(der);
+	/* DER decode it straight from memory */
+	der_buffer_init(&der, data.data, data.size);
+	rc = der_decode_InterchangedObject(&der, m->scene, data.size);
+	free_OctetString(&data);
 
 	if(rc < 0 || m->scene->choice != InterchangedObject_scene)
 	{
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -18,7 +19,14 @@
 
 /* internal functions */
 static FILE *remote_command(MHEGBackend *, bool, char *);
+static bool remote_closed(FILE *);
 static unsigned int remote_response(FILE *);
+static unsigned int remote_fd_response(int);
+
+static unsigned int multi_command(char *, size_t, char *, unsigned int, ContentReference **);
+static MHEGPrefetchedFile *find_prefetched(MHEGBackend *, OctetString *);
+static void remove_prefetched(MHEGBackend *, MHEGPrefetchedFile *);
+static void free_prefetched(MHEGBackend *);
 
 static MHEGStream *open_stream(MHEGBackend *, int, bool, int *, int *, bool, int *, int *);
 static void close_stream(MHEGBackend *, MHEGStream *);
@@ -35,16 +43,18 @@ static char *external_filename(MHEGBackend *, OctetString *);
 
 /* local backend funcs */
 bool local_checkContentRef(MHEGBackend *, ContentReference *);
+void local_checkContentRefs(MHEGBackend *, unsigned int, ContentReference **, bool *);
+int local_watchContentRefs(MHEGBackend *, unsigned int, ContentReference **);
 bool local_loadFile(MHEGBackend *, OctetString *, OctetString *);
-FILE *local_openFile(MHEGBackend *, OctetString *);
 void local_retune(MHEGBackend *, OctetString *);
 bool local_isServiceAvailable(MHEGBackend *, OctetString *);
 
 static struct MHEGBackendFns local_backend_fns =
 {
 	local_checkContentRef,		/* checkContentRef */
+	local_checkContentRefs,		/* checkContentRefs */
+	local_watchContentRefs,		/* watchContentRefs */
 	local_loadFile,			/* loadFile */
-	local_openFile,			/* openFile */
 	open_stream,			/* openStream */
 	close_stream,			/* closeStream */
 	local_retune,			/* retune */
@@ -54,16 +64,18 @@ static struct MHEGBackendFns local_backend_fns =
 
 /* remote backend funcs */
 bool remote_checkContentRef(MHEGBackend *, ContentReference *);
+void remote_checkContentRefs(MHEGBackend *, unsigned int, ContentReference **, bool *);
+int remote_watchContentRefs(MHEGBackend *, unsigned int, ContentReference **);
 bool remote_loadFile(MHEGBackend *, OctetString *, OctetString *);
-FILE *remote_openFile(MHEGBackend *, OctetString *);
 void remote_retune(MHEGBackend *, OctetString *);
 bool remote_isServiceAvailable(MHEGBackend *, OctetString *);
 
 static struct MHEGBackendFns remote_backend_fns =
 {
 	remote_checkContentRef,		/* checkContentRef */
+	remote_checkContentRefs,	/* checkContentRefs */
+	remote_watchContentRefs,	/* watchContentRefs */
 	remote_loadFile,		/* loadFile */
-	remote_openFile,		/* openFile */
 	open_stream,			/* openStream */
 	close_stream,			/* closeStream */
 	remote_retune,			/* retune */
@@ -85,6 +97,11 @@ MHEGBackend_init(MHEGBackend *b, bool remote, char *srg_loc, int net_id)
 
 	/* no connection to the backend yet */
 	b->be_sock = NULL;
+	b->watch_sock = NULL;
+
+	/* no files fetched yet */
+	b->nprefetched = 0;
+	b->prefetched = NULL;
 
 	/* don't know rec://svc/def yet */
 	b->rec_svc_def.size = 0;
@@ -132,6 +149,11 @@ MHEGBackend_fini(MHEGBackend *b)
 	&& remote_command(b, true, "quit\n") != NULL)
 		fclose(b->be_sock);
 
+	if(b->watch_sock != NULL)
+		fclose(b->watch_sock);
+
+	free_prefetched(b);
+
 	safe_free(b->base_dir);
 
 	safe_free(b->rec_svc_def.data);
@@ -155,8 +177,15 @@ remote_command(MHEGBackend *t, bool reuse, char *cmd)
 	/* can we use the existing connection */
 	if(reuse && t->be_sock != NULL)
 	{
-		fputs(cmd, t->be_sock);
-		return t->be_sock;
+		if(!remote_closed(t->be_sock))
+		{
+			fputs(cmd, t->be_sock);
+			return t->be_sock;
+		}
+		/* the backend has closed it (eg it has retuned), so reconnect */
+		verbose("Backend closed the connection, reconnecting");
+		fclose(t->be_sock);
+		t->be_sock = NULL;
 	}
 
 	/* need to connect to the backend */
@@ -191,6 +220,27 @@ remote_command(MHEGBackend *t, bool reuse, char *cmd)
 	return file;
 }
 
+/*
+ * returns true if the backend has closed the connection
+ * we should not have any unread data on it, so if it is readable it must be EOF
+ */
+
+static bool
+remote_closed(FILE *sock)
+{
+	struct pollfd pfd;
+	char c;
+
+	pfd.fd = fileno(sock);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	if(poll(&pfd, 1, 0) <= 0)
+		return false;
+
+	return (recv(pfd.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0);
+}
+
 /*
  * read the backend response from the given socket FILE
  * returns the OK/error code
@@ -214,6 +264,29 @@ remote_response(FILE *file)
 	return rc;
 }
 
+/*
+ * read the backend response straight from the socket fd
+ * reads one byte at a time, so nothing after the response line is read
+ * returns the OK/error code
+ */
+
+static unsigned int
+remote_fd_response(int fd)
+{
+	char buf[1024];
+	size_t len;
+
+	/* read upto \n */
+	len = 0;
+	while(len < sizeof(buf) - 1
+	   && read(fd, &buf[len], 1) == 1
+	   && buf[len] != '\n')
+		len ++;
+	buf[len] = '\0';
+
+	return atoi(buf);
+}
+
 /*
  * return a read-only FILE handle for an MPEG Transport Stream (in MHEGStream->ts)
  * the TS will contain an audio stream (if have_audio is true) and a video stream (if have_video is true)
@@ -534,6 +607,27 @@ local_checkContentRef(MHEGBackend *t, ContentReference *name)
 	return found;
 }
 
+void
+local_checkContentRefs(MHEGBackend *t, unsigned int nnames, ContentReference **names, bool *found)
+{
+	unsigned int i;
+
+	for(i=0; i<nnames; i++)
+		found[i] = local_checkContentRef(t, names[i]);
+
+	return;
+}
+
+/*
+ * we have no way to be told when a local file appears, so the engine has to keep polling
+ */
+
+int
+local_watchContentRefs(MHEGBackend *t, unsigned int nnames, ContentReference **names)
+{
+	return -1;
+}
+
 /*
  * file contents are stored in out (out->data will need to be free'd)
  * returns false if it can't load the file (out will be {0,NULL})
@@ -574,19 +668,6 @@ local_loadFile(MHEGBackend *t, OctetString *name, OctetString *out)
 	return (out->data != NULL);
 }
 
-/*
- * return a read-only FILE handle for the given carousel file
- * returns NULL on error
- */
-
-FILE *
-local_openFile(MHEGBackend *t, OctetString *name)
-{
-	char *external = external_filename(t, name);
-
-	return fopen(external, "r");
-}
-
 /*
  * retune the backend to the given service
  * service should be in the form "dvb://<network_id>..<service_id>", eg "dvb://233a..4C80"
@@ -695,6 +776,10 @@ remote_checkContentRef(MHEGBackend *t, ContentReference *name)
 	FILE *sock;
 	bool exists;
 
+	/* did checkContentRefs fetch it */
+	if(find_prefetched(t, name) != NULL)
+		return true;
+
 	snprintf(cmd, sizeof(cmd), "check %s\n", MHEGEngine_absoluteFilename(name));
 
 	if((sock = remote_command(t, true, cmd)) == NULL)
@@ -705,6 +790,250 @@ remote_checkContentRef(MHEGBackend *t, ContentReference *name)
 	return exists;
 }
 
+/*
+ * ask the backend for all the files in one go with "mfile" commands
+ * all the commands are sent before we read any of the responses
+ * the files that exist are kept until loadFile asks for them,
+ * or until the next time we are called
+ */
+
+/* keep the commands well under the backend's max command length */
+#define MAX_MFILE_LEN	(4 * 1024)
+/* and under its max number of arguments */
+#define MAX_MFILE_NAMES	32
+
+void
+remote_checkContentRefs(MHEGBackend *t, unsigned int nnames, ContentReference **names, bool *found)
+{
+	char cmd[MAX_MFILE_LEN + PATH_MAX];
+	FILE *sock = NULL;
+	bool *use_check;
+	unsigned int start;
+	unsigned int n;
+	unsigned int i;
+	unsigned int id;
+	unsigned int rc;
+	unsigned int size;
+	size_t nread;
+	bool lost;
+	MHEGPrefetchedFile *file;
+
+	/* anything we fetched last time and has not been loaded is out of date now */
+	free_prefetched(t);
+
+	for(i=0; i<nnames; i++)
+		found[i] = false;
+
+	if(nnames == 0)
+		return;
+
+	/* send all the requests */
+	for(start=0; start<nnames; start+=n)
+	{
+		n = multi_command(cmd, sizeof(cmd), "mfile", nnames - start, &names[start]);
+		if((sock = remote_command(t, true, cmd)) == NULL)
+			return;
+	}
+	fflush(sock);
+
+	t->prefetched = safe_malloc(nnames * sizeof(MHEGPrefetchedFile));
+
+	/* if the backend does not understand "mfile", we need to check these one at a time */
+	use_check = safe_malloc(nnames * sizeof(bool));
+	bzero(use_check, nnames * sizeof(bool));
+
+	/* read the responses, this needs to split the names up in the same way as above */
+	for(start=0; start<nnames; start+=n)
+	{
+		n = multi_command(cmd, sizeof(cmd), "mfile", nnames - start, &names[start]);
+		if(remote_response(sock) != BACKEND_RESPONSE_OK)
+		{
+			for(i=start; i<start+n; i++)
+				use_check[i] = true;
+			/* an old backend just says it does not know "mfile", anything else means the connection has gone */
+			lost = (feof(sock) || ferror(sock));
+		}
+		else
+		{
+			/*
+			 * "<id> <rc> [Length <size>]" for each file, then "."
+			 * if we can't understand it, or don't get it all, we don't know where the next response starts
+			 */
+			lost = true;
+			while(fgets(cmd, sizeof(cmd), sock) != NULL)
+			{
+				if(strcmp(cmd, ".\n") == 0)
+				{
+					lost = false;
+					break;
+				}
+				if(sscanf(cmd, "%u %u", &id, &rc) != 2 || id >= n)
+					break;
+				if(rc != BACKEND_RESPONSE_OK)
+					continue;
+				if(sscanf(cmd, "%*u %*u Length %u", &size) != 1)
+					break;
+				file = &t->prefetched[t->nprefetched];
+				file->data.size = size;
+				file->data.data = safe_malloc(size);
+				nread = 0;
+				while(!feof(sock) && !ferror(sock) && nread < size)
+					nread += fread(file->data.data + nread, 1, size - nread, sock);
+				if(nread < size)
+				{
+					safe_free(file->data.data);
+					break;
+				}
+				file->name = safe_strdup(MHEGEngine_absoluteFilename(names[start + id]));
+				t->nprefetched ++;
+				found[start + id] = true;
+			}
+		}
+		/* the rest of the responses are no use, so get a new connection and check the remaining files one at a time */
+		if(lost)
+		{
+			error("Lost track of responses from backend");
+			fclose(t->be_sock);
+			t->be_sock = NULL;
+			for(i=start; i<nnames; i++)
+				use_check[i] = !found[i];
+			break;
+		}
+	}
+
+	/* old backends need to use "check" */
+	for(i=0; i<nnames; i++)
+	{
+		if(use_check[i])
+			found[i] = remote_checkContentRef(t, names[i]);
+	}
+
+	safe_free(use_check);
+
+	return;
+}
+
+/*
+ * ask the backend to tell us when any of the files arrive with a "watch" command on a new connection
+ * the backend sends a line as each file arrives, so the fd we return becomes readable when there is something to check for
+ * if there are too many names for one command, we only watch the first few, the others are checked when we wake up
+ * any previous watch is cancelled, nnames=0 just cancels it
+ * returns -1 if the backend does not understand "watch"
+ */
+
+int
+remote_watchContentRefs(MHEGBackend *t, unsigned int nnames, ContentReference **names)
+{
+	char cmd[MAX_MFILE_LEN + PATH_MAX];
+	FILE *sock;
+
+	/* closing the connection tells the backend we are not interested any more */
+	if(t->watch_sock != NULL)
+	{
+		fclose(t->watch_sock);
+		t->watch_sock = NULL;
+	}
+
+	if(nnames == 0)
+		return -1;
+
+	(void) multi_command(cmd, sizeof(cmd), "watch", nnames, names);
+
+	if((sock = remote_command(t, false, cmd)) == NULL)
+		return -1;
+	fflush(sock);
+
+	/* the caller reads the rest of the connection straight from the fd, so don't let stdio buffer any of it */
+	if(remote_fd_response(fileno(sock)) != BACKEND_RESPONSE_OK)
+	{
+		fclose(sock);
+		return -1;
+	}
+
+	t->watch_sock = sock;
+
+	return fileno(sock);
+}
+
+/*
+ * put an "mfile" etc command for as many of the names as will fit in cmd
+ * returns the number of names used
+ */
+
+static unsigned int
+multi_command(char *cmd, size_t max, char *verb, unsigned int nnames, ContentReference **names)
+{
+	size_t len;
+	char *name;
+	unsigned int i;
+
+	len = snprintf(cmd, max, "%s", verb);
+	for(i=0; i<nnames && i<MAX_MFILE_NAMES; i++)
+	{
+		name = MHEGEngine_absoluteFilename(names[i]);
+		/* always add at least one name */
+		if(i > 0 && len + 1 + strlen(name) > MAX_MFILE_LEN)
+			break;
+		len += snprintf(&cmd[len], max - len, " %s", name);
+	}
+	snprintf(&cmd[len], max - len, "\n");
+
+	return i;
+}
+
+static MHEGPrefetchedFile *
+find_prefetched(MHEGBackend *t, OctetString *name)
+{
+	char *absolute;
+	unsigned int i;
+
+	if(t->nprefetched == 0)
+		return NULL;
+
+	absolute = MHEGEngine_absoluteFilename(name);
+	for(i=0; i<t->nprefetched; i++)
+	{
+		if(strcmp(t->prefetched[i].name, absolute) == 0)
+			return &t->prefetched[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * the data is not freed, the caller must have taken it
+ */
+
+static void
+remove_prefetched(MHEGBackend *t, MHEGPrefetchedFile *file)
+{
+	safe_free(file->name);
+
+	/* move the last one into its place */
+	t->nprefetched --;
+	*file = t->prefetched[t->nprefetched];
+
+	return;
+}
+
+static void
+free_prefetched(MHEGBackend *t)
+{
+	unsigned int i;
+
+	for(i=0; i<t->nprefetched; i++)
+	{
+		safe_free(t->prefetched[i].name);
+		safe_free(t->prefetched[i].data.data);
+	}
+
+	safe_free(t->prefetched);
+	t->prefetched = NULL;
+	t->nprefetched = 0;
+
+	return;
+}
+
 /*
  * file contents are stored in out (out->data will need to be free'd)
  * returns false if it can't load the file (out will be {0,NULL})
@@ -718,6 +1047,16 @@ remote_loadFile(MHEGBackend *t, OctetString *name, OctetString *out)
 	FILE *sock;
 	unsigned int size;
 	size_t nread;
+	MHEGPrefetchedFile *file;
+
+	/* did checkContentRefs fetch it */
+	if((file = find_prefetched(t, name)) != NULL)
+	{
+		verbose("Loading '%.*s' (prefetched)", name->size, name->data);
+		*out = file->data;
+		remove_prefetched(t, file);
+		return true;
+	}
 
 	snprintf(cmd, sizeof(cmd), "file %s\n", MHEGEngine_absoluteFilename(name));
 
@@ -755,56 +1094,6 @@ remote_loadFile(MHEGBackend *t, OctetString *name, OctetString *out)
 	return true;
 }
 
-/*
- * return a read-only FILE handle for the given carousel file
- * returns NULL on error
- */
-
-FILE *
-remote_openFile(MHEGBackend *t, OctetString *name)
-{
-	char cmd[PATH_MAX];
-	FILE *sock;
-	unsigned int size;
-	char buf[8 * 1024];
-	size_t nread;
-	FILE *out;
-
-	snprintf(cmd, sizeof(cmd), "file %s\n", MHEGEngine_absoluteFilename(name));
-
-	if((sock = remote_command(t, true, cmd)) == NULL)
-		return NULL;
-
-	/* if it exists, read the file size */
-	if(remote_response(sock) != BACKEND_RESPONSE_OK
-	|| fgets(cmd, sizeof(cmd), sock) == NULL
-	|| sscanf(cmd, "Length %u", &size) != 1)
-	{
-		return NULL;
-	}
-
-	/* tmpfile() will delete the file when we fclose() it */
-	out = tmpfile();
-	while(out != NULL && size > 0)
-	{
-		nread = (size < sizeof(buf)) ? size : sizeof(buf);
-		nread = fread(buf, 1, nread, sock);
-		if(fwrite(buf, 1, nread, out) != nread)
-		{
-			error("Unable to write to local file");
-			fclose(out);
-			out = NULL;
-		}
-		size -= nread;
-	}
-
-	/* rewind the file */
-	if(out != NULL)
-		rewind(out);
-
-	return out;
-}
-
 /*
  * retune the backend to the given service
  * service should be in the form "dvb://<network_id>..<service_id>", eg "dvb://233a..4C80"
@@ -820,6 +1109,9 @@ remote_retune(MHEGBackend *t, OctetString *service)
 	if(service->size < 6 || strncmp((char *) service->data, "dvb://", 6) != 0)
 		fatal("remote_retune: unable to tune to '%.*s'", service->size, service->data);
 
+	/* anything we have fetched is from the old carousel */
+	free_prefetched(t);
+
 	snprintf(cmd, sizeof(cmd), "retune %u\n", si_get_service_id(service));
 
 	if((sock = remote_command(t, true, cmd)) == NULL
@@ -835,6 +1127,9 @@ remote_retune(MHEGBackend *t, OctetString *service)
 		t->be_sock = NULL;
 	}
 
+	/* we are not waiting for files from the old carousel any more */
+	remote_watchContentRefs(t, 0, NULL);
+
 	/* update rec://svc/def */
 	remote_set_service_url(t);
 
@@ -21,6 +21,13 @@ typedef struct
 	FILE *demux;	/* private */
 } MHEGStream;
 
+/* a file the remote backend has sent us before we asked to load it */
+typedef struct
+{
+	char *name;		/* absolute filename */
+	OctetString data;
+} MHEGPrefetchedFile;
+
 typedef struct MHEGBackend
 {
 	OctetString rec_svc_def;	/* service we are downloading the carousel from */
@@ -28,15 +35,20 @@ typedef struct MHEGBackend
 	char network_id[16];		/* local Network ID (maybe blank if you don't care) */
 	struct sockaddr_in addr;	/* remote backend IP and port */
 	FILE *be_sock;			/* connection to remote backend */
+	FILE *watch_sock;		/* connection waiting for missing files, NULL if none */
+	unsigned int nprefetched;	/* files fetched by checkContentRefs, but not loaded yet */
+	MHEGPrefetchedFile *prefetched;
 	/* function pointers */
 	struct MHEGBackendFns
 	{
 		/* check a carousel file exists */
 		bool (*checkContentRef)(struct MHEGBackend *, ContentReference *);
+		/* check several carousel files exist, a remote backend also fetches the ones that do */
+		void (*checkContentRefs)(struct MHEGBackend *, unsigned int, ContentReference **, bool *);
+		/* returns an fd that becomes readable when any of the files arrive, -1 if we have to poll for them */
+		int (*watchContentRefs)(struct MHEGBackend *, unsigned int, ContentReference **);
 		/* load a carousel file */
 		bool (*loadFile)(struct MHEGBackend *, OctetString *, OctetString *);
-		/* open a carousel file */
-		FILE *(*openFile)(struct MHEGBackend *, OctetString *);
 		/* open an MPEG Transport Stream */
 		MHEGStream *(*openStream)(struct MHEGBackend *, int, bool, int *, int *, bool, int *, int *);
 		/* close an MPEG Transport Stream */
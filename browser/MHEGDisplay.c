@@ -271,6 +271,30 @@ MHEGDisplay_fini(MHEGDisplay *d)
 	return;
 }
 
+/*
+ * callbacks for Xt timers and inputs don't get us out of a block in XtAppNextEvent
+ * but they may generate events the engine needs to process
+ * so generate a fake event, just to end XtAppNextEvent and get back to the engine main loop
+ */
+
+void
+MHEGDisplay_wakeUp(MHEGDisplay *d)
+{
+	XEvent ev;
+
+	ev.xexpose.type = Expose;
+	ev.xexpose.display = d->dpy;
+	ev.xexpose.window = d->win;
+	ev.xexpose.x = 0;
+	ev.xexpose.y = 0;
+	ev.xexpose.width = 0;
+	ev.xexpose.height = 0;
+	ev.xexpose.count = 0;
+	XSendEvent(d->dpy, d->win, False, 0, &ev);
+
+	return;
+}
+
 /*
  * process the next GUI event
  * if block is false and no events are pending, return immediately
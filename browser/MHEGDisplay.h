@@ -60,6 +60,7 @@ void MHEGDisplay_init(MHEGDisplay *, bool, char *, int);
 void MHEGDisplay_fini(MHEGDisplay *);
 
 bool MHEGDisplay_processEvents(MHEGDisplay *, bool);
+void MHEGDisplay_wakeUp(MHEGDisplay *);
 
 void MHEGDisplay_refresh(MHEGDisplay *, XYPosition *, OriginalBoxSize *);
 
@@ -2,6 +2,7 @@
  * MHEGEngine.c
  */
 
+#include <unistd.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
@@ -86,83 +87,33 @@ free_PersistentDataListItem(LIST_TYPE(PersistentData) *p)
 	return;
 }
 
-LIST_TYPE(MHEGAsyncEvent) *
-new_MHEGAsyncEventListItem(ExternalReference *src, EventType type, EventData *data)
-{
-	LIST_TYPE(MHEGAsyncEvent) *event;
-
-	event = safe_malloc(sizeof(LIST_TYPE(MHEGAsyncEvent)));
-	bzero(event, sizeof(LIST_TYPE(MHEGAsyncEvent)));
-
-	/* take a copy of the source in case it disappears before we process the event */
-	ExternalReference_dup(&event->item.src, src);
-
-	/* remember the type */
-	event->item.type = type;
-
-	/* take a copy of the data in case it disappears before we process the event */
-	if(data != NULL)
-	{
-		event->item.data = safe_malloc(sizeof(EventData));
-		EventData_dup(event->item.data, data);
-	}
-	else
-	{
-		event->item.data = NULL;
-	}
-
-	return event;
-}
-
-void
-free_MHEGAsyncEventListItem(LIST_TYPE(MHEGAsyncEvent) *event)
-{
-	/* free the source */
-	safe_free(event->item.src.group_identifier.data);
-
-	/* free any event data */
-	if(event->item.data != NULL)
-	{
-		free_EventData(event->item.data);
-		safe_free(event->item.data);
-	}
-
-	safe_free(event);
-
-	return;
-}
-
-/*
- * the group ID and action must remain valid until we execute the action
- */
-
-LIST_TYPE(MHEGAction) *
-new_MHEGActionListItem(OctetString *group_id, ElementaryAction *action)
-{
-	LIST_TYPE(MHEGAction) *item;
-
-	item = safe_malloc(sizeof(LIST_TYPE(MHEGAction)));
-
-	item->item.group_id = group_id;
-	item->item.action = action;
-
-	return item;
-}
-
-void
-free_MHEGActionListItem(LIST_TYPE(MHEGAction) *item)
-{
-	safe_free(item);
-
-	return;
-}
-
 /*
  * rather than passing a ptr to this to every function we write
  * let's be naughty and make it global (to this file)
  */
 static MHEGEngine engine;
 
+/* internal functions */
+static void watch_missing_content(void);
+static void stop_watching(void);
+static void watch_cb(XtPointer, int *, XtInputId *);
+static void watch_timeout_cb(XtPointer, XtIntervalId *);
+
+static int intern_group_id(ObjectRegistry *, OctetString *, bool);
+static void free_object_registry(ObjectRegistry *);
+static RootClass *find_object(ObjectReference *, OctetString *, bool);
+static void free_active_links(ActiveLinks *);
+
+static void add_async_event(ExternalReference *, EventType, EventData *);
+static EventData *async_event_data(MHEGAsyncEvent *);
+static void remove_async_event(void);
+static void remove_scene_events(OctetString *);
+static void add_action(MHEGActionQueue *, OctetString *, ElementaryAction *, RootClass *);
+static void grow_action_queue(MHEGActionQueue *, unsigned int);
+static void move_temp_actions(void);
+static void remove_scene_actions(MHEGActionQueue *, OctetString *);
+static void empty_event_queues(void);
+
 void
 MHEGEngine_init(MHEGEngineOptions *opts)
 {
@@ -171,6 +122,9 @@ MHEGEngine_init(MHEGEngineOptions *opts)
 	engine.verbose = opts->verbose;
 	engine.timeout = opts->timeout;
 
+	/* not waiting for any files yet */
+	engine.watch_fd = -1;
+
 	MHEGDisplay_init(&engine.display, opts->fullscreen, opts->keymap, opts->verbose);
 
 	engine.audio_dev = safe_strdup(opts->audio_dev);
@@ -243,8 +197,9 @@ MHEGEngine_run(void)
 				 * if we are polling for missing content,
 				 * or if we need to quit the current app
 				 * don't block waiting for the next GUI event
+				 * if the backend is watching the missing content for us, it will wake us up
 				 */
-				block = (engine.missing_content == NULL && engine.quit_reason == QuitReason_DontQuit);
+				block = ((engine.missing_content == NULL || engine.watch_fd != -1) && engine.quit_reason == QuitReason_DontQuit);
 				/* process any GUI events */
 				if(MHEGDisplay_processEvents(&engine.display, block))
 					engine.quit_reason = QuitReason_GUIQuit;
@@ -259,12 +214,11 @@ MHEGEngine_run(void)
 			ApplicationClass_Destruction(app);
 			/* clean up */
 			MHEGApp_fini(&engine.active_app);
-			LIST_FREE(&engine.objects, RootClassPtr, safe_free);
+			free_object_registry(&engine.objects);
 			LIST_FREE(&engine.missing_content, MissingContent, free_MissingContentListItem);
-			LIST_FREE(&engine.active_links, LinkClassPtr, safe_free);
-			LIST_FREE(&engine.async_eventq, MHEGAsyncEvent, free_MHEGAsyncEventListItem);
-			LIST_FREE(&engine.main_actionq, MHEGAction, free_MHEGActionListItem);
-			LIST_FREE(&engine.temp_actionq, MHEGAction, free_MHEGActionListItem);
+			stop_watching();
+			free_active_links(&engine.active_links);
+			empty_event_queues();
 			/* do we need to run a new app */
 			switch(engine.quit_reason)
 			{
@@ -313,6 +267,11 @@ MHEGEngine_fini(void)
 
 	free_OctetString(&engine.quit_data);
 
+	empty_event_queues();
+	safe_free(engine.async_eventq.events);
+	safe_free(engine.main_actionq.actions);
+	safe_free(engine.temp_actionq.actions);
+
 	return;
 }
 
@@ -354,8 +313,6 @@ MHEGEngine_TransitionTo(TransitionTo *to, OctetString *caller_gid)
 	SceneClass *current_scene;
 	ApplicationClass *current_app;
 	OctetString *app_gid;
-	LIST_TYPE(MHEGAsyncEvent) *ev, *next_ev;
-	LIST_TYPE(MHEGAction) *act, *next_act;
 	LIST_TYPE(GroupItem) *gi;
 	LIST_TYPE(GroupItem) *gi_tail;
 
@@ -427,42 +384,9 @@ MHEGEngine_TransitionTo(TransitionTo *to, OctetString *caller_gid)
 		 * keep events and actions associated with the app
 		 */
 		app_gid = &current_app->rootClass.inst.ref.group_identifier;
-		/* async event queue */
-		ev = engine.async_eventq;
-		while(ev)
-		{
-			next_ev = ev->next;
-			if(OctetString_cmp(&ev->item.src.group_identifier, app_gid) != 0)
-			{
-				LIST_REMOVE(&engine.async_eventq, ev);
-				free_MHEGAsyncEventListItem(ev);
-			}
-			ev = next_ev;
-		}
-		/* main action queue */
-		act = engine.main_actionq;
-		while(act)
-		{
-			next_act = act->next;
-			if(OctetString_cmp(act->item.group_id, app_gid) != 0)
-			{
-				LIST_REMOVE(&engine.main_actionq, act);
-				free_MHEGActionListItem(act);
-			}
-			act = next_act;
-		}
-		/* temp action queue */
-		act = engine.temp_actionq;
-		while(act)
-		{
-			next_act = act->next;
-			if(OctetString_cmp(act->item.group_id, app_gid) != 0)
-			{
-				LIST_REMOVE(&engine.temp_actionq, act);
-				free_MHEGActionListItem(act);
-			}
-			act = next_act;
-		}
+		remove_scene_events(app_gid);
+		remove_scene_actions(&engine.main_actionq, app_gid);
+		remove_scene_actions(&engine.temp_actionq, app_gid);
 		/* load the new scene (also free's the old one if we have one) */
 		if((current_scene = MHEGApp_loadScene(&engine.active_app, &scene_id)) != NULL)
 		{
@@ -492,9 +416,7 @@ MHEGEngine_quit(QuitReason reason, OctetString *data)
 	OctetString_copy(&engine.quit_data, data);
 
 	/* empty the Async event queue and any pending actions */
-	LIST_FREE(&engine.async_eventq, MHEGAsyncEvent, free_MHEGAsyncEventListItem);
-	LIST_FREE(&engine.main_actionq, MHEGAction, free_MHEGActionListItem);
-	LIST_FREE(&engine.temp_actionq, MHEGAction, free_MHEGActionListItem);
+	empty_event_queues();
 
 	return;
 }
@@ -764,38 +686,87 @@ MHEGEngine_redrawArea(XYPosition *pos, OriginalBoxSize *box)
 	return;
 }
 
+static LinkEntry **
+link_bucket(EventType type, unsigned int gid, unsigned int num)
+{
+	return &engine.active_links.hash[((((gid * 31) + num) * 31) + type) & (LINK_HASH_SIZE - 1)];
+}
+
 /*
- * adds a ptr to the given LinkClass to the active links list
+ * adds a ptr to the given LinkClass to the active links index
  * the ptr to the LinkClass data must remain valid until it is removed with MHEGEngine_removeActiveLink()
+ * the LinkCondition's event source is resolved now, so events don't need to do it
  */
 
 void
 MHEGEngine_addActiveLink(LinkClass *link)
 {
-	LIST_TYPE(LinkClassPtr) *list;
+	LinkEntry *entry;
+	LinkEntry **bucket;
+	OctetString *gid;
+	unsigned int num;
 
-	list = safe_malloc(sizeof(LIST_TYPE(LinkClassPtr)));
-	list->item = link;
+	if((gid = LinkClass_eventSource(link, &num)) == NULL)
+		return;
 
-	LIST_APPEND(&engine.active_links, list);
+	entry = safe_malloc(sizeof(LinkEntry));
+	entry->type = link->link_condition.event_type;
+	entry->gid = intern_group_id(&engine.objects, gid, true);
+	entry->num = num;
+	entry->link = link;
+	entry->next = NULL;
+
+	/* add it to the end, so links fire in the order they were activated */
+	bucket = link_bucket(entry->type, entry->gid, entry->num);
+	while(*bucket)
+		bucket = &(*bucket)->next;
+	*bucket = entry;
 
 	return;
 }
 
+/*
+ * returns false if link is not in the given bucket
+ */
+
+static bool
+remove_link_entry(LinkEntry **bucket, LinkClass *link)
+{
+	LinkEntry *entry;
+
+	while((entry = *bucket) != NULL)
+	{
+		if(entry->link == link)
+		{
+			*bucket = entry->next;
+			safe_free(entry);
+			return true;
+		}
+		bucket = &entry->next;
+	}
+
+	return false;
+}
+
 void
 MHEGEngine_removeActiveLink(LinkClass *link)
 {
-	LIST_TYPE(LinkClassPtr) *list = engine.active_links;
+	OctetString *gid;
+	unsigned int num;
+	int index;
+	unsigned int i;
 
-	while(list)
+	/* it should be in the bucket it was added to */
+	if((gid = LinkClass_eventSource(link, &num)) != NULL
+	&& (index = intern_group_id(&engine.objects, gid, false)) != -1
+	&& remove_link_entry(link_bucket(link->link_condition.event_type, index, num), link))
+		return;
+
+	/* a relative event source may resolve differently now the active app has changed */
+	for(i=0; i<LINK_HASH_SIZE; i++)
 	{
-		if(list->item == link)
-		{
-			LIST_REMOVE(&engine.active_links, list);
-			safe_free(list);
+		if(remove_link_entry(&engine.active_links.hash[i], link))
 			return;
-		}
-		list = list->next;
 	}
 
 	error("Active link not found: %s", ExternalReference_name(&link->rootClass.inst.ref));
@@ -803,6 +774,25 @@ MHEGEngine_removeActiveLink(LinkClass *link)
 	return;
 }
 
+static void
+free_active_links(ActiveLinks *links)
+{
+	LinkEntry *entry, *next;
+	unsigned int i;
+
+	for(i=0; i<LINK_HASH_SIZE; i++)
+	{
+		for(entry=links->hash[i]; entry; entry=next)
+		{
+			next = entry->next;
+			safe_free(entry);
+		}
+		links->hash[i] = NULL;
+	}
+
+	return;
+}
+
 /*
  * key should be one of the MHEGKey_xxx constants
  */
@@ -904,32 +894,36 @@ MHEGEngine_findPersistentData(OctetString *filename, bool create)
 void
 MHEGEngine_generateEvent(ExternalReference *src, EventType type, EventData *data)
 {
-	LIST_TYPE(LinkClassPtr) *link;
-	LIST_TYPE(ElementaryAction) *link_action;
-	LIST_TYPE(MHEGAction) *temp_action;
+	LinkEntry *entry;
+	LinkClass *link;
 	OctetString *gid;
+	unsigned int i;
+	int index;
 
 	verbose("Generated event: %s; %s", ExternalReference_name(src), EventType_name(type));
 
-	/* see if any of the active links match this event */
-	link = engine.active_links;
-	while(link)
+	/* if no object in the source's group has been loaded, no link can be waiting for it */
+	if((index = intern_group_id(&engine.objects, &src->group_identifier, false)) == -1)
+		return;
+
+	/* only the links waiting for this type of event from this source are in its bucket */
+	for(entry=*link_bucket(type, index, src->object_number); entry; entry=entry->next)
 	{
-		/* if it matches, add the actions to the temp action queue */
-		if(LinkClass_conditionMet(link->item, src, type, data))
-		{
-			/* add a ptr to each ElementaryAction to temp_actionq */
-			link_action = link->item->link_effect;
-			while(link_action)
-			{
-				/* remember the group id of the link that caused the action */
-				gid = &link->item->rootClass.inst.ref.group_identifier;
-				temp_action = new_MHEGActionListItem(gid, &link_action->item);
-				LIST_APPEND(&engine.temp_actionq, temp_action);
-				link_action = link_action->next;
-			}
-		}
-		link = link->next;
+		if(entry->type != type
+		|| entry->gid != (unsigned int) index
+		|| entry->num != src->object_number
+		|| !LinkClass_eventDataMatches(entry->link, data))
+			continue;
+		verbose("LinkCondition met: %s; %s", ExternalReference_name(src), EventType_name(type));
+		/* look up the targets of the link actions again if any objects have been freed since we last did it */
+		link = entry->link;
+		if(!link->inst.compiled || link->inst.generation != engine.objects.generation)
+			LinkClass_compile(link);
+		/* remember the group id of the link that caused the action */
+		gid = &link->rootClass.inst.ref.group_identifier;
+		/* add each ElementaryAction to temp_actionq */
+		for(i=0; i<link->inst.nactions; i++)
+			add_action(&engine.temp_actionq, gid, link->inst.actions[i].action, link->inst.actions[i].target);
 	}
 
 	return;
@@ -945,13 +939,9 @@ MHEGEngine_generateEvent(ExternalReference *src, EventType type, EventData *data
 void
 MHEGEngine_generateAsyncEvent(ExternalReference *src, EventType type, EventData *data)
 {
-	LIST_TYPE(MHEGAsyncEvent) *event;
-
 	verbose("Generated asynchronous event: %s; %s", ExternalReference_name(src), EventType_name(type));
 
-	event = new_MHEGAsyncEventListItem(src, type, data);
-
-	LIST_APPEND(&engine.async_eventq, event);
+	add_async_event(src, type, data);
 
 	return;
 }
@@ -963,28 +953,31 @@ MHEGEngine_generateAsyncEvent(ExternalReference *src, EventType type, EventData
 void
 MHEGEngine_processMHEGEvents(void)
 {
+	MHEGAction action;
+	RootClass *target;
+
 	/* assert */
-	if(engine.main_actionq != NULL)
+	if(engine.main_actionq.count != 0)
 		fatal("Outstanding actions on the main action queue");
 
 	/* process the next asynchronous event (if there is one) */
-	while(engine.async_eventq)
+	while(engine.async_eventq.count != 0)
 	{
 		/* adds any resulting actions to temp_actionq */
 		MHEGEngine_processNextAsyncEvent();
 		/* process MHEG event queue as described in UK MHEG Profile */
-		engine.main_actionq = engine.temp_actionq;
-		engine.temp_actionq = NULL;
-		while(engine.main_actionq)
+		move_temp_actions();
+		while(engine.main_actionq.count != 0)
 		{
+			/* remove the action from the main_actionq before executing it, in case it empties the queue */
+			engine.main_actionq.count --;
+			action = engine.main_actionq.actions[engine.main_actionq.count];
+			/* the target we looked up when it was queued is stale if an object has been freed since then */
+			target = (action.generation == engine.objects.generation) ? action.target : NULL;
 			/* execute the action - adds any resulting actions to temp_actionq */
-			ElementaryAction_execute(engine.main_actionq->item.action, engine.main_actionq->item.group_id);
-			/* remove the action we just executed from the main_actionq */
-			LIST_FREE_HEAD(&engine.main_actionq, MHEGAction, free_MHEGActionListItem);
+			ElementaryAction_execute(action.action, action.group_id, target);
 			/* prepend any temp_actionq actions it generated to the main_actionq */
-			LIST_CONCAT(&engine.temp_actionq, MHEGAction, engine.main_actionq);
-			engine.main_actionq = engine.temp_actionq;
-			engine.temp_actionq = NULL;
+			move_temp_actions();
 		}
 	}
 
@@ -1001,14 +994,14 @@ MHEGEngine_processNextAsyncEvent(void)
 {
 	MHEGAsyncEvent *event;
 
-	if(engine.async_eventq)
+	if(engine.async_eventq.count != 0)
 	{
 		verbose("Processing next asynchronous event");
-		event = &engine.async_eventq->item;
+		event = &engine.async_eventq.events[engine.async_eventq.head];
 		/* match it against any active links */
-		MHEGEngine_generateEvent(&event->src, event->type, event->data);
+		MHEGEngine_generateEvent(&event->src, event->type, async_event_data(event));
 		/* remove the event we just processed */
-		LIST_FREE_HEAD(&engine.async_eventq, MHEGAsyncEvent, free_MHEGAsyncEventListItem);
+		remove_async_event();
 	}
 
 	return;
@@ -1022,20 +1015,232 @@ void
 MHEGEngine_addToTempActionQ(ActionClass *action, OctetString *caller_gid)
 {
 	LIST_TYPE(ElementaryAction) *list = *action;
-	LIST_TYPE(MHEGAction) *temp_action;
 
 	/* add a ptr to each ElementaryAction to temp_actionq */
 	while(list)
 	{
 		/* remember the group id of the object that caused the action */
-		temp_action = new_MHEGActionListItem(caller_gid, &list->item);
-		LIST_APPEND(&engine.temp_actionq, temp_action);
+		add_action(&engine.temp_actionq, caller_gid, &list->item, NULL);
 		list = list->next;
 	}
 
 	return;
 }
 
+/*
+ * the event queues are arrays that grow as needed and are reused, so processing an event does not allocate anything
+ */
+
+static void
+add_async_event(ExternalReference *src, EventType type, EventData *data)
+{
+	MHEGAsyncEventQueue *q = &engine.async_eventq;
+	MHEGAsyncEvent *event;
+	OctetString *str;
+	unsigned char *copy;
+	int index;
+
+	/* make room at the end of the queue */
+	if(q->head + q->count == q->size)
+	{
+		if(q->head != 0)
+		{
+			memmove(&q->events[0], &q->events[q->head], q->count * sizeof(MHEGAsyncEvent));
+			q->head = 0;
+		}
+		else
+		{
+			q->size = (q->size != 0) ? q->size * 2 : EVENT_QUEUE_INIT_SIZE;
+			q->events = safe_realloc(q->events, q->size * sizeof(MHEGAsyncEvent));
+		}
+	}
+
+	event = &q->events[q->head + q->count];
+	q->count ++;
+
+	/* the interned group ID stays valid until the app is freed, and the queue is emptied before then */
+	index = intern_group_id(&engine.objects, &src->group_identifier, true);
+	event->src.group_identifier = engine.objects.gids[index].gid;
+	event->src.object_number = src->object_number;
+
+	event->type = type;
+
+	/* take a copy of the data in case it disappears before we process the event */
+	event->have_data = (data != NULL);
+	event->heap_data = NULL;
+	if(data != NULL)
+	{
+		event->data = *data;
+		if(data->choice == EventData_octetstring)
+		{
+			str = &data->u.octetstring;
+			if(str->size > ASYNC_EVENT_DATA_LEN)
+				event->heap_data = safe_malloc(str->size);
+			copy = (event->heap_data != NULL) ? event->heap_data : event->inline_data;
+			if(str->size != 0)
+				memcpy(copy, str->data, str->size);
+		}
+	}
+
+	return;
+}
+
+/*
+ * the event may have moved in the array since it was added
+ * so any OctetString data is pointed at its current location here
+ */
+
+static EventData *
+async_event_data(MHEGAsyncEvent *event)
+{
+	if(!event->have_data)
+		return NULL;
+
+	if(event->data.choice == EventData_octetstring)
+		event->data.u.octetstring.data = (event->heap_data != NULL) ? event->heap_data : event->inline_data;
+
+	return &event->data;
+}
+
+static void
+remove_async_event(void)
+{
+	MHEGAsyncEventQueue *q = &engine.async_eventq;
+
+	safe_free(q->events[q->head].heap_data);
+
+	q->head ++;
+	q->count --;
+
+	/* start at the beginning of the array again */
+	if(q->count == 0)
+		q->head = 0;
+
+	return;
+}
+
+/*
+ * remove all the events that are not from app_gid
+ */
+
+static void
+remove_scene_events(OctetString *app_gid)
+{
+	MHEGAsyncEventQueue *q = &engine.async_eventq;
+	MHEGAsyncEvent *event;
+	unsigned int i;
+	unsigned int keep = 0;
+
+	for(i=0; i<q->count; i++)
+	{
+		event = &q->events[q->head + i];
+		if(OctetString_cmp(&event->src.group_identifier, app_gid) != 0)
+			safe_free(event->heap_data);
+		else
+			q->events[q->head + keep++] = *event;
+	}
+
+	q->count = keep;
+	if(q->count == 0)
+		q->head = 0;
+
+	return;
+}
+
+/*
+ * the group ID and action must remain valid until we execute the action
+ * target may be NULL, if not it is only used if no objects are freed before we execute the action
+ */
+
+static void
+add_action(MHEGActionQueue *q, OctetString *group_id, ElementaryAction *action, RootClass *target)
+{
+	grow_action_queue(q, q->count + 1);
+
+	q->actions[q->count].group_id = group_id;
+	q->actions[q->count].action = action;
+	q->actions[q->count].target = target;
+	q->actions[q->count].generation = engine.objects.generation;
+	q->count ++;
+
+	return;
+}
+
+static void
+grow_action_queue(MHEGActionQueue *q, unsigned int count)
+{
+	if(count <= q->size)
+		return;
+
+	if(q->size == 0)
+		q->size = EVENT_QUEUE_INIT_SIZE;
+	while(q->size < count)
+		q->size *= 2;
+
+	q->actions = safe_realloc(q->actions, q->size * sizeof(MHEGAction));
+
+	return;
+}
+
+/*
+ * prepend temp_actionq to main_actionq and empty temp_actionq
+ * main_actionq is stored in reverse order, so this just adds temp_actionq backwards to the end of it
+ */
+
+static void
+move_temp_actions(void)
+{
+	MHEGActionQueue *main_q = &engine.main_actionq;
+	MHEGActionQueue *temp_q = &engine.temp_actionq;
+	unsigned int i;
+
+	grow_action_queue(main_q, main_q->count + temp_q->count);
+
+	for(i=temp_q->count; i>0; i--)
+		main_q->actions[main_q->count++] = temp_q->actions[i - 1];
+
+	temp_q->count = 0;
+
+	return;
+}
+
+/*
+ * remove all the actions that were not caused by app_gid
+ */
+
+static void
+remove_scene_actions(MHEGActionQueue *q, OctetString *app_gid)
+{
+	unsigned int i;
+	unsigned int keep = 0;
+
+	for(i=0; i<q->count; i++)
+	{
+		if(OctetString_cmp(q->actions[i].group_id, app_gid) == 0)
+			q->actions[keep++] = q->actions[i];
+	}
+
+	q->count = keep;
+
+	return;
+}
+
+/*
+ * empties the queues, but keeps the arrays to use again
+ */
+
+static void
+empty_event_queues(void)
+{
+	while(engine.async_eventq.count != 0)
+		remove_async_event();
+
+	engine.main_actionq.count = 0;
+	engine.temp_actionq.count = 0;
+
+	return;
+}
+
 /*
  * sets the group identifier that will be used in MHEGEngine_resolveDERObjectReference()
  * should be an absolute group ID, ie start with ~//
@@ -1084,6 +1289,83 @@ MHEGEngine_resolveDERObjectReference(ObjectReference *ref, ExternalReference *ou
 	return;
 }
 
+/*
+ * the group IDs are interned when the objects are added
+ * so finding an object only needs the group ID hashing and comparing with the few groups we have loaded
+ */
+
+static unsigned int
+group_id_hash(OctetString *gid)
+{
+	unsigned int hash = 2166136261u;
+	unsigned int i;
+
+	/* FNV-1a */
+	for(i=0; i<gid->size; i++)
+		hash = (hash ^ gid->data[i]) * 16777619u;
+
+	return hash;
+}
+
+/*
+ * returns the index of the given absolute group ID
+ * returns -1 if it is not interned and add is false
+ */
+
+static int
+intern_group_id(ObjectRegistry *reg, OctetString *gid, bool add)
+{
+	unsigned int hash = group_id_hash(gid);
+	unsigned int i;
+
+	for(i=0; i<reg->ngids; i++)
+	{
+		if(reg->gids[i].hash == hash
+		&& OctetString_cmp(&reg->gids[i].gid, gid) == 0)
+			return i;
+	}
+
+	if(!add)
+		return -1;
+
+	reg->gids = safe_realloc(reg->gids, (reg->ngids + 1) * sizeof(InternedGroupID));
+	reg->gids[reg->ngids].hash = hash;
+	OctetString_dup(&reg->gids[reg->ngids].gid, gid);
+
+	return reg->ngids ++;
+}
+
+static ObjectEntry **
+object_bucket(ObjectRegistry *reg, unsigned int gid, unsigned int num)
+{
+	return &reg->hash[((gid * 31) + num) & (OBJECT_HASH_SIZE - 1)];
+}
+
+static void
+free_object_registry(ObjectRegistry *reg)
+{
+	ObjectEntry *entry, *next;
+	unsigned int i;
+
+	for(i=0; i<OBJECT_HASH_SIZE; i++)
+	{
+		for(entry=reg->hash[i]; entry; entry=next)
+		{
+			next = entry->next;
+			safe_free(entry);
+		}
+		reg->hash[i] = NULL;
+	}
+
+	for(i=0; i<reg->ngids; i++)
+		safe_free(reg->gids[i].gid.data);
+	safe_free(reg->gids);
+	reg->gids = NULL;
+	reg->ngids = 0;
+
+	return;
+}
+
 /*
  * stores the ptr, so it must remain valid until MHEGEngine_removeObjectReference() is called
  */
@@ -1091,11 +1373,20 @@ MHEGEngine_resolveDERObjectReference(ObjectReference *ref, ExternalReference *ou
 void
 MHEGEngine_addObjectReference(RootClass *obj)
 {
-	LIST_TYPE(RootClassPtr) *list = safe_malloc(sizeof(LIST_TYPE(RootClassPtr)));
+	ObjectEntry *entry = safe_malloc(sizeof(ObjectEntry));
+	ObjectEntry **bucket;
 
-	list->item = obj;
+	/* the group ID is always absolute, see MHEGEngine_resolveDERObjectReference() */
+	entry->gid = intern_group_id(&engine.objects, &obj->inst.ref.group_identifier, true);
+	entry->num = obj->inst.ref.object_number;
+	entry->obj = obj;
+	entry->next = NULL;
 
-	LIST_APPEND(&engine.objects, list);
+	/* add it to the end, so if an object number is used twice we find the first one */
+	bucket = object_bucket(&engine.objects, entry->gid, entry->num);
+	while(*bucket)
+		bucket = &(*bucket)->next;
+	*bucket = entry;
 
 	return;
 }
@@ -1103,17 +1394,25 @@ MHEGEngine_addObjectReference(RootClass *obj)
 void
 MHEGEngine_removeObjectReference(RootClass *obj)
 {
-	LIST_TYPE(RootClassPtr) *list = engine.objects;
+	ObjectEntry **bucket;
+	ObjectEntry *entry;
+	int gid;
 
-	while(list)
+	if((gid = intern_group_id(&engine.objects, &obj->inst.ref.group_identifier, false)) != -1)
 	{
-		if(list->item == obj)
+		bucket = object_bucket(&engine.objects, gid, obj->inst.ref.object_number);
+		while((entry = *bucket) != NULL)
 		{
-			LIST_REMOVE(&engine.objects, list);
-			safe_free(list);
-			return;
+			if(entry->obj == obj)
+			{
+				*bucket = entry->next;
+				safe_free(entry);
+				/* any ptrs to it that have been looked up are now invalid */
+				engine.objects.generation ++;
+				return;
+			}
+			bucket = &entry->next;
 		}
-		list = list->next;
 	}
 
 	/* assert */
@@ -1131,12 +1430,38 @@ MHEGEngine_removeObjectReference(RootClass *obj)
 RootClass *
 MHEGEngine_findObjectReference(ObjectReference *ref, OctetString *caller_gid)
 {
-	LIST_TYPE(RootClassPtr) *list = engine.objects;
+	return find_object(ref, caller_gid, true);
+}
+
+/*
+ * as MHEGEngine_findObjectReference(), but does not print an error if the object is not found
+ */
+
+RootClass *
+MHEGEngine_lookupObjectReference(ObjectReference *ref, OctetString *caller_gid)
+{
+	return find_object(ref, caller_gid, false);
+}
+
+/*
+ * object ptrs returned by MHEGEngine_findObjectReference() are valid until this value changes
+ */
+
+unsigned int
+MHEGEngine_objectGeneration(void)
+{
+	return engine.objects.generation;
+}
+
+static RootClass *
+find_object(ObjectReference *ref, OctetString *caller_gid, bool report)
+{
 	OctetString *gid = NULL;	/* keep the compiler happy */
 	unsigned int num = 0;		/* keep the compiler happy */
 	char *fullname;
 	OctetString absolute;
-	RootClass *obj;
+	ObjectEntry *entry;
+	int index;
 
 	/* find the group id we need */
 	switch(ref->choice)
@@ -1156,24 +1481,27 @@ MHEGEngine_findObjectReference(ObjectReference *ref, OctetString *caller_gid)
 		break;
 	}
 
-	/* get the absolute group ID */
-	fullname = MHEGEngine_absoluteFilename(gid);
-	absolute.size = strlen(fullname);
-	absolute.data = (unsigned char *) fullname;
-	gid = &absolute;
+	/* get the absolute group ID, the caller's group ID always is, so we don't need to copy it */
+	if(gid->size < 3 || strncmp((char *) gid->data, "~//", 3) != 0)
+	{
+		fullname = MHEGEngine_absoluteFilename(gid);
+		absolute.size = strlen(fullname);
+		absolute.data = (unsigned char *) fullname;
+		gid = &absolute;
+	}
 
-	while(list)
+	/* if no object has this group ID, it can't be loaded */
+	if((index = intern_group_id(&engine.objects, gid, false)) != -1)
 	{
-		obj = list->item;
-		if(OctetString_cmp(gid, &obj->inst.ref.group_identifier) == 0
-		&& num == obj->inst.ref.object_number)
+		for(entry=*object_bucket(&engine.objects, index, num); entry; entry=entry->next)
 		{
-			return list->item;
+			if(entry->gid == (unsigned int) index && entry->num == num)
+				return entry->obj;
 		}
-		list = list->next;
 	}
 
-	error("ObjectReference not found: %.*s %u", gid->size, gid->data, num);
+	if(report)
+		error("ObjectReference not found: %.*s %u", gid->size, gid->data, num);
 
 	return NULL;
 }
@@ -1293,6 +1621,7 @@ MHEGEngine_addMissingContent(RootClass *obj, OctetString *file)
 	/* add it to the list */
 	missing = new_MissingContentListItem(obj, file);
 	LIST_APPEND(&engine.missing_content, missing);
+	engine.missing_changed = true;
 
 	return;
 }
@@ -1311,6 +1640,7 @@ MHEGEngine_removeMissingContent(RootClass *obj)
 		{
 			LIST_REMOVE(&engine.missing_content, list);
 			free_MissingContentListItem(list);
+			engine.missing_changed = true;
 			return;
 		}
 		list = list->next;
@@ -1328,14 +1658,37 @@ MHEGEngine_pollMissingContent(void)
 {
 	ApplicationClass *app = MHEGEngine_getActiveApplication();
 	LIST_TYPE(MissingContent) *missing, *next;
+	unsigned int nmissing;
+	ContentReference **names;
+	bool *found;
+	unsigned int i;
 	bool remove;
 	struct timeval now;
 
+	/* check them all in one go, a remote backend can do this in one round trip */
+	nmissing = 0;
+	for(missing=engine.missing_content; missing; missing=missing->next)
+		nmissing ++;
+	if(nmissing == 0)
+		return;
+	names = safe_malloc(nmissing * sizeof(ContentReference *));
+	found = safe_malloc(nmissing * sizeof(bool));
+	i = 0;
+	for(missing=engine.missing_content; missing; missing=missing->next)
+		names[i++] = &missing->item.file;
+	MHEGEngine_checkContentRefs(nmissing, names, found);
+	/* contentAvailable may change the list, so remember the results in the list items */
+	i = 0;
+	for(missing=engine.missing_content; missing; missing=missing->next)
+		missing->item.available = found[i++];
+	safe_free(names);
+	safe_free(found);
+
 	missing = engine.missing_content;
 	while(missing)
 	{
 		remove = false;
-		if(MHEGEngine_checkContentRef(&missing->item.file))
+		if(missing->item.available)
 		{
 			RootClass_contentAvailable(missing->item.obj, &missing->item.file);
 			/* remove it from the list */
@@ -1365,6 +1718,7 @@ MHEGEngine_pollMissingContent(void)
 			next = missing->next;
 			LIST_REMOVE(&engine.missing_content, missing);
 			free_MissingContentListItem(missing);
+			engine.missing_changed = true;
 			missing = next;
 		}
 		else
@@ -1373,6 +1727,112 @@ MHEGEngine_pollMissingContent(void)
 		}
 	}
 
+	/* ask the backend to tell us when the rest arrive, rather than polling for them */
+	watch_missing_content();
+
+	return;
+}
+
+/*
+ * if the list of missing content has changed, ask the backend to watch the new list
+ * if the backend can't do that, engine.watch_fd is -1 and the main loop has to keep polling
+ */
+
+static void
+watch_missing_content(void)
+{
+	LIST_TYPE(MissingContent) *missing;
+	ContentReference **names;
+	unsigned int nmissing;
+	unsigned int i;
+	time_t expires;
+	struct timeval now;
+
+	if(!engine.missing_changed)
+		return;
+	engine.missing_changed = false;
+
+	stop_watching();
+
+	nmissing = 0;
+	for(missing=engine.missing_content; missing; missing=missing->next)
+		nmissing ++;
+	if(nmissing == 0)
+		return;
+
+	names = safe_malloc(nmissing * sizeof(ContentReference *));
+	i = 0;
+	expires = engine.missing_content->item.requested;
+	for(missing=engine.missing_content; missing; missing=missing->next)
+	{
+		names[i++] = &missing->item.file;
+		expires = MIN(expires, missing->item.requested);
+	}
+	engine.watch_fd = (*(engine.backend.fns->watchContentRefs))(&engine.backend, nmissing, names);
+	safe_free(names);
+
+	if(engine.watch_fd == -1)
+		return;
+
+	engine.watch_input = XtAppAddInput(engine.display.app, engine.watch_fd, (XtPointer) XtInputReadMask, watch_cb, NULL);
+
+	/* wake up in time to generate a ContentRefError for the oldest one */
+	expires += engine.timeout;
+	gettimeofday(&now, NULL);
+	engine.watch_timeout = XtAppAddTimeOut(engine.display.app, (expires > now.tv_sec) ? (expires - now.tv_sec) * 1000 : 0, watch_timeout_cb, NULL);
+
+	return;
+}
+
+static void
+stop_watching(void)
+{
+	if(engine.watch_fd != -1)
+	{
+		XtRemoveInput(engine.watch_input);
+		(void) (*(engine.backend.fns->watchContentRefs))(&engine.backend, 0, NULL);
+		engine.watch_fd = -1;
+	}
+
+	if(engine.watch_timeout != 0)
+	{
+		XtRemoveTimeOut(engine.watch_timeout);
+		engine.watch_timeout = 0;
+	}
+
+	return;
+}
+
+/*
+ * the backend says some of the missing content has arrived
+ * MHEGEngine_pollMissingContent() will find out which when we get back to the main loop
+ */
+
+static void
+watch_cb(XtPointer usr_data, int *fd, XtInputId *id)
+{
+	char buf[1024];
+
+	/* EOF => they have all arrived, or the backend has gone away, either way we need a new watch */
+	if(read(*fd, buf, sizeof(buf)) <= 0)
+	{
+		stop_watching();
+		engine.missing_changed = true;
+	}
+
+	MHEGDisplay_wakeUp(&engine.display);
+
+	return;
+}
+
+static void
+watch_timeout_cb(XtPointer usr_data, XtIntervalId *id)
+{
+	/* Xt has removed it */
+	engine.watch_timeout = 0;
+
+	MHEGDisplay_wakeUp(&engine.display);
+
 	return;
 }
 
@@ -1386,6 +1846,19 @@ MHEGEngine_checkContentRef(ContentReference *name)
 	return (*(engine.backend.fns->checkContentRef))(&engine.backend, name);
 }
 
+/*
+ * sets found[i] to true if names[i] exists on the carousel
+ * the backend may also fetch the files that exist, so loading them does not need another request
+ */
+
+void
+MHEGEngine_checkContentRefs(unsigned int nnames, ContentReference **names, bool *found)
+{
+	(*(engine.backend.fns->checkContentRefs))(&engine.backend, nnames, names, found);
+
+	return;
+}
+
 /*
  * file contents are stored in out (out->data will need to be free'd)
  * returns false if it can't load the file (out will be {0,NULL})
@@ -1409,17 +1882,6 @@ MHEGEngine_loadFile(OctetString *name, OctetString *out)
 	return (*(engine.backend.fns->loadFile))(&engine.backend, name, out);
 }
 
-/*
- * returns a read-only FILE handle for the given carousel file
- * returns NULL on error
- */
-
-FILE *
-MHEGEngine_openFile(OctetString *name)
-{
-	return (*(engine.backend.fns->openFile))(&engine.backend, name);
-}
-
 /*
  * return a read-only FILE handle for an MPEG Transport Stream
  * the TS will contain an audio stream (if have_audio is true) and a video stream (if have_video is true)
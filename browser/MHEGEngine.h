@@ -101,6 +101,7 @@ typedef struct
 	RootClass *obj;
 	OctetString file;
 	time_t requested;	/* when we first asked for the file (used to timeout requests) */
+	bool available;		/* set by MHEGEngine_pollMissingContent */
 } MissingContent;
 
 DEFINE_LIST_OF(MissingContent);
@@ -109,6 +110,38 @@ DEFINE_LIST_OF(MissingContent);
 LIST_TYPE(MissingContent) *new_MissingContentListItem(RootClass *, OctetString *);
 void free_MissingContentListItem(LIST_TYPE(MissingContent) *);
 
+/*
+ * all the currently loaded objects, so we can find them from their ObjectReference
+ * each absolute group ID is stored once, objects refer to it by its index
+ * objects are hashed on (group ID index, object number)
+ * the generation changes whenever an object is removed, so any object ptrs looked up before then may be stale
+ */
+
+/* number of hash buckets, must be a power of 2 */
+#define OBJECT_HASH_SIZE	1024
+
+typedef struct ObjectEntry
+{
+	struct ObjectEntry *next;	/* next entry in this hash bucket */
+	unsigned int gid;		/* index into the interned group IDs */
+	unsigned int num;		/* object number */
+	RootClass *obj;
+} ObjectEntry;
+
+typedef struct
+{
+	unsigned int hash;		/* hash of the group ID */
+	OctetString gid;		/* absolute group ID */
+} InternedGroupID;
+
+typedef struct
+{
+	unsigned int ngids;
+	InternedGroupID *gids;
+	ObjectEntry *hash[OBJECT_HASH_SIZE];
+	unsigned int generation;
+} ObjectRegistry;
+
 /* persistent storage */
 typedef struct
 {
@@ -122,39 +155,79 @@ LIST_TYPE(PersistentData) *new_PersistentDataListItem(OctetString *);
 void free_PersistentDataListItem(LIST_TYPE(PersistentData) *);
 
 /*
- * asynchronous events list
+ * asynchronous events queue
  * these are events generated by objects while processing an action
  * async events are processed when the action has finished
  * rather than at the time they are generated (like synchronous events)
+ *
+ * the queue is an array that is reused for every event, so queueing an event does not allocate anything
+ * the source group ID points to the interned copy in the ObjectRegistry
+ * OctetString event data up to ASYNC_EVENT_DATA_LEN bytes is stored in the event itself
  */
+#define ASYNC_EVENT_DATA_LEN	64
+
+/* number of events or actions the queues start with, they double in size when full */
+#define EVENT_QUEUE_INIT_SIZE	32
+
 typedef struct
 {
-	ExternalReference src;
+	ExternalReference src;		/* group_identifier is the interned group ID */
 	EventType type;
-	EventData *data;
+	bool have_data;
+	EventData data;			/* an OctetString is in inline_data unless heap_data is not NULL */
+	unsigned char inline_data[ASYNC_EVENT_DATA_LEN];
+	unsigned char *heap_data;	/* OctetString data that is too big to store inline */
 } MHEGAsyncEvent;
 
-DEFINE_LIST_OF(MHEGAsyncEvent);
-
-LIST_TYPE(MHEGAsyncEvent) *new_MHEGAsyncEventListItem(ExternalReference *, EventType, EventData *);
-void free_MHEGAsyncEventListItem(LIST_TYPE(MHEGAsyncEvent) *);
+typedef struct
+{
+	unsigned int head;		/* index of the next event to process */
+	unsigned int count;		/* number of events in the queue */
+	unsigned int size;		/* number of events allocated */
+	MHEGAsyncEvent *events;
+} MHEGAsyncEventQueue;
 
-/* a list of actions that need performing */
+/* a queue of actions that need performing */
 typedef struct
 {
 	OctetString *group_id;		/* group identifier of the object that caused this action */
 	ElementaryAction *action;	/* the action */
+	RootClass *target;		/* object the action applies to, NULL => look it up when we execute it */
+	unsigned int generation;	/* target is only valid if the ObjectRegistry generation has not changed */
 } MHEGAction;
 
-DEFINE_LIST_OF(MHEGAction);
+/*
+ * main_actionq is stored in reverse order, the next action to execute is the last one in the array
+ * so we can prepend the actions each action generates without moving the rest of the queue
+ */
+typedef struct
+{
+	unsigned int count;		/* number of actions in the queue */
+	unsigned int size;		/* number of actions allocated */
+	MHEGAction *actions;
+} MHEGActionQueue;
+
+/*
+ * the active links, hashed on the event type and source their LinkCondition needs
+ * so an event is only matched against the links that are waiting for it
+ */
 
-LIST_TYPE(MHEGAction) *new_MHEGActionListItem(OctetString *, ElementaryAction *);
-void free_MHEGActionListItem(LIST_TYPE(MHEGAction) *);
+/* number of hash buckets, must be a power of 2 */
+#define LINK_HASH_SIZE		256
 
-/* a list of active links */
-typedef LinkClass *LinkClassPtr;
+typedef struct LinkEntry
+{
+	struct LinkEntry *next;		/* next entry in this hash bucket */
+	EventType type;			/* from the LinkCondition */
+	unsigned int gid;		/* interned group ID of the event source, see ObjectRegistry */
+	unsigned int num;		/* object number of the event source */
+	LinkClass *link;
+} LinkEntry;
 
-DEFINE_LIST_OF(LinkClassPtr);
+typedef struct
+{
+	LinkEntry *hash[LINK_HASH_SIZE];
+} ActiveLinks;
 
 /* reasons for stopping the current app */
 typedef enum
@@ -181,12 +254,16 @@ typedef struct
 	QuitReason quit_reason;				/* do we need to stop the current app */
 	OctetString quit_data;				/* new app to Launch or Spawn, or channel to Retune to */
 	OctetString *der_object;			/* DER object we are currently decoding */
-	LIST_OF(RootClassPtr) *objects;			/* all currently loaded MHEG objects */
+	ObjectRegistry objects;				/* all currently loaded MHEG objects */
 	LIST_OF(MissingContent) *missing_content;	/* files we are waiting for */
-	LIST_OF(LinkClassPtr) *active_links;		/* currently active LinkClass objects */
-	LIST_OF(MHEGAsyncEvent) *async_eventq;		/* asynchronous events that need processing */
-	LIST_OF(MHEGAction) *main_actionq;		/* UK MHEG Profile event processing method */
-	LIST_OF(MHEGAction) *temp_actionq;		/* UK MHEG Profile event processing method */
+	bool missing_changed;				/* missing_content has changed since we started watching it */
+	int watch_fd;					/* readable when missing content may have arrived, -1 => polling */
+	XtInputId watch_input;				/* calls us when watch_fd is readable */
+	XtIntervalId watch_timeout;			/* wakes us up when the oldest missing content times out, 0 => none */
+	ActiveLinks active_links;			/* currently active LinkClass objects */
+	MHEGAsyncEventQueue async_eventq;		/* asynchronous events that need processing */
+	MHEGActionQueue main_actionq;			/* UK MHEG Profile event processing method */
+	MHEGActionQueue temp_actionq;			/* UK MHEG Profile event processing method */
 	LIST_OF(PersistentData) *persistent;		/* persistent files */
 } MHEGEngine;
 
@@ -235,6 +312,8 @@ void MHEGEngine_resolveDERObjectReference(ObjectReference *, ExternalReference *
 void MHEGEngine_addObjectReference(RootClass *);
 void MHEGEngine_removeObjectReference(RootClass *);
 RootClass *MHEGEngine_findObjectReference(ObjectReference *, OctetString *);
+RootClass *MHEGEngine_lookupObjectReference(ObjectReference *, OctetString *);
+unsigned int MHEGEngine_objectGeneration(void);
 
 RootClass *MHEGEngine_findGroupObject(OctetString *);
 unsigned int MHEGEngine_getUnusedObjectNumber(RootClass *);
@@ -244,8 +323,8 @@ void MHEGEngine_removeMissingContent(RootClass *);
 void MHEGEngine_pollMissingContent(void);
 
 bool MHEGEngine_checkContentRef(ContentReference *);
+void MHEGEngine_checkContentRefs(unsigned int, ContentReference **, bool *);
 bool MHEGEngine_loadFile(OctetString *, OctetString *);
-FILE *MHEGEngine_openFile(OctetString *);
 MHEGStream *MHEGEngine_openStream(int, bool, int *, int *, bool, int *, int *);
 void MHEGEngine_closeStream(MHEGStream *);
 void MHEGEngine_retune(OctetString *);
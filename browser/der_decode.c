@@ -8,20 +8,34 @@
 
 #include "der_decode.h"
 
+/*
+ * the data is not copied, so it must remain valid until we have finished decoding it
+ */
+
+void
+der_buffer_init(der_buffer *der, unsigned char *data, unsigned int size)
+{
+	der->data = data;
+	der->size = size;
+	der->offset = 0;
+
+	return;
+}
+
 /* DER does not allow indefinite lengths */
 
 int
-der_decode_Tag(FILE *der, der_tag *tag)
+der_decode_Tag(der_buffer *der, der_tag *tag)
 {
 	unsigned int type;
 	unsigned int len;
-	unsigned char byte;
+	unsigned char byte = 0;
 	unsigned int longtype;
 	int nlens;
 	int nbytes = 0;
 
 	/* type */
-	if(der_read_file(der, 1, &byte) != 1)
+	if(der_read_buffer(der, 1, &byte) != 1)
 		return der_error("DER tag");
 	nbytes ++;
 	type = byte;
@@ -31,7 +45,7 @@ der_decode_Tag(FILE *der, der_tag *tag)
 		/* multi byte type */
 		do
 		{
-			if(der_read_file(der, 1, &byte) != 1)
+			if(der_read_buffer(der, 1, &byte) != 1)
 				return der_error("DER tag");
 			nbytes ++;
 			longtype <<= 7;
@@ -43,7 +57,7 @@ der_decode_Tag(FILE *der, der_tag *tag)
 	tag->number = ((type & 0x1f) == 0x1f) ? longtype : type & 0x1f;
 
 	/* length */
-	if(der_read_file(der, 1, &byte) != 1)
+	if(der_read_buffer(der, 1, &byte) != 1)
 		return der_error("DER tag");
 	nbytes ++;
 	len = byte;
@@ -62,7 +76,7 @@ der_decode_Tag(FILE *der, der_tag *tag)
 		len = 0;
 		while(nlens > 0)
 		{
-			if(der_read_file(der, 1, &byte) != 1)
+			if(der_read_buffer(der, 1, &byte) != 1)
 				return der_error("DER tag");
 			nbytes ++;
 			len <<= 8;
@@ -76,24 +90,24 @@ der_decode_Tag(FILE *der, der_tag *tag)
 }
 
 /*
- * read the tag, but don't advance the FILE offset
+ * read the tag, but don't advance the buffer offset
  */
 
 int
-der_peek_Tag(FILE *der, der_tag *tag)
+der_peek_Tag(der_buffer *der, der_tag *tag)
 {
-	long pretag = ftell(der);
+	unsigned int pretag = der->offset;
 	int length;
 
 	length = der_decode_Tag(der, tag);
 
-	fseek(der, pretag, SEEK_SET);
+	der->offset = pretag;
 
 	return length;
 }
 
 int
-der_decode_Null(FILE *der, Null *type, int length)
+der_decode_Null(der_buffer *der, Null *type, int length)
 {
 	if(length != 0)
 		return der_error("Null: length=%d", length);
@@ -106,14 +120,14 @@ der_decode_Null(FILE *der, Null *type, int length)
 }
 
 int
-der_decode_Boolean(FILE *der, bool *type, int length)
+der_decode_Boolean(der_buffer *der, bool *type, int length)
 {
-	unsigned char val;
+	unsigned char val = 0;
 
 	if(length != 1)
 		return der_error("Boolean: length=%d", length);
 
-	if(der_read_file(der, length, &val) < 0)
+	if(der_read_buffer(der, length, &val) != length)
 		return der_error("Boolean");
 
 	*type = (val == 0) ? false : true;
@@ -126,9 +140,9 @@ der_decode_Boolean(FILE *der, bool *type, int length)
 }
 
 int
-der_decode_Integer(FILE *der, int *type, int length)
+der_decode_Integer(der_buffer *der, int *type, int length)
 {
-	unsigned char byte;
+	unsigned char byte = 0;
 	unsigned int uval;
 	bool negative;
 	int i;
@@ -137,7 +151,7 @@ der_decode_Integer(FILE *der, int *type, int length)
 		return der_error("Integer: length=%d", length);
 
 	/* is it -ve */
-	if(der_read_file(der, 1, &byte) < 0)
+	if(der_read_buffer(der, 1, &byte) != 1)
 		return der_error("Integer");
 	negative = ((byte & 0x80) == 0x80);
 
@@ -145,7 +159,7 @@ der_decode_Integer(FILE *der, int *type, int length)
 	uval = byte;
 	for(i=1; i<length; i++)
 	{
-		if(der_read_file(der, 1, &byte) < 0)
+		if(der_read_buffer(der, 1, &byte) != 1)
 			return der_error("Integer");
 		uval <<= 8;
 		uval += byte;
@@ -171,7 +185,7 @@ der_decode_Integer(FILE *der, int *type, int length)
 /* DER does not allow constructed OCTET-STRINGs */
 
 int
-der_decode_OctetString(FILE *der, OctetString *type, int length)
+der_decode_OctetString(der_buffer *der, OctetString *type, int length)
 {
 	bzero(type, sizeof(OctetString));
 
@@ -185,7 +199,7 @@ der_decode_OctetString(FILE *der, OctetString *type, int length)
 	/* only set the length after we are sure the alloc worked */
 	type->size = length;
 
-	if(der_read_file(der, length, type->data) < 0)
+	if(der_read_buffer(der, length, type->data) != length)
 		return der_error("OctetString");
 
 #ifdef DER_VERBOSE
@@ -310,14 +324,16 @@ OctetString_dup(OctetString *dst, OctetString *src)
 }
 
 int
-der_read_file(FILE *in, unsigned int nbytes, void *buf)
+der_read_buffer(der_buffer *der, unsigned int nbytes, void *buf)
 {
-	int nread;
+	/* der_seek() may have moved the offset past the end */
+	if(der->offset > der->size || nbytes > der->size - der->offset)
+		return der_error("Unexpected end of data");
 
-	if((nread = fread(buf, 1, nbytes, in)) != nbytes)
-		return der_error("Unexpected EOF");
+	memcpy(buf, &der->data[der->offset], nbytes);
+	der->offset += nbytes;
 
-	return nread;
+	return nbytes;
 }
 
 int
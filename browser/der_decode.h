@@ -16,6 +16,17 @@
 #define der_realloc(P, N)	safe_realloc(P, N)
 #define der_free(P)		safe_free(P)
 
+/* the DER encoded data we are decoding, it must all be in memory */
+typedef struct der_buffer
+{
+	unsigned char *data;
+	unsigned int size;
+	unsigned int offset;	/* next byte to decode */
+} der_buffer;
+
+/* move the offset forwards, or backwards if N is -ve */
+#define der_seek(BUF, N)	((BUF)->offset += (N))
+
 typedef struct der_tag
 {
 	unsigned char class;
@@ -37,16 +48,18 @@ typedef struct OctetString
 	unsigned char *data;
 } OctetString;
 
-int der_decode_Tag(FILE *, der_tag *);
-int der_peek_Tag(FILE *, der_tag *);
+void der_buffer_init(der_buffer *, unsigned char *, unsigned int);
+
+int der_decode_Tag(der_buffer *, der_tag *);
+int der_peek_Tag(der_buffer *, der_tag *);
 
-int der_decode_Boolean(FILE *, bool *, int);
+int der_decode_Boolean(der_buffer *, bool *, int);
 
-int der_decode_Integer(FILE *, int *, int);
+int der_decode_Integer(der_buffer *, int *, int);
 
-int der_decode_Null(FILE *, Null *, int);
+int der_decode_Null(der_buffer *, Null *, int);
 
-int der_decode_OctetString(FILE *, OctetString *, int);
+int der_decode_OctetString(der_buffer *, OctetString *, int);
 void free_OctetString(OctetString *);
 
 int OctetString_cmp(OctetString *, OctetString *);
@@ -56,7 +69,7 @@ int OctetString_strncmp(OctetString *, char *, size_t);
 bool OctetString_copy(OctetString *, OctetString *);
 void OctetString_dup(OctetString *, OctetString *);
 
-int der_read_file(FILE *, unsigned int, void *);
+int der_read_buffer(der_buffer *, unsigned int, void *);
 
 int der_error(char *, ...);
 
@@ -10,7 +10,9 @@ main(int argc, char *argv[])
 {
 	char *dername;
 	FILE *derfile;
+	unsigned char *data;
 	int len;
+	der_buffer der;
 	InterchangedObject obj;
 
 	if(argc != 2)
@@ -29,12 +31,21 @@ main(int argc, char *argv[])
 	fseek(derfile, 0, SEEK_END);
 	len = ftell(derfile);
 	rewind(derfile);
-	if(der_decode_InterchangedObject(derfile, &obj, len) < 0)
+	data = safe_malloc(len);
+	if(fread(data, 1, len, derfile) != len)
+	{
+		printf("fread: unable to read %s\n", dername);
+		exit(1);
+	}
+	fclose(derfile);
+
+	der_buffer_init(&der, data, len);
+	if(der_decode_InterchangedObject(&der, &obj, len) < 0)
 		printf("failed\n");
 
 	free_InterchangedObject(&obj);
 
-	fclose(derfile);
+	safe_free(data);
 
 	return 0;
 }
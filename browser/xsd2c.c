@@ -1006,7 +1006,7 @@ output_typedef(FILE *src, FILE *hdr, struct typeinfo *t, struct typeinfo *types)
 	fprintf(hdr, "DEFINE_LIST_OF(%s);\n\n", t->name);
 
 	/* function prototypes */
-	fprintf(hdr, "int der_decode_%s(FILE *, %s *, int);\n", t->name, t->name);
+	fprintf(hdr, "int der_decode_%s(der_buffer *, %s *, int);\n", t->name, t->name);
 	fprintf(hdr, "/* only free's the contents, not the type itself */\n");
 	fprintf(hdr, "void free_%s(%s *);\n\n", t->name, t->name);
 
@@ -1170,7 +1170,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 	int indent;
 
 	fprintf(src, "int\n");
-	fprintf(src, "der_decode_%s(FILE *der, %s *type, int length)\n", t->name, t->name);
+	fprintf(src, "der_decode_%s(der_buffer *der, %s *type, int length)\n", t->name, t->name);
 	fprintf(src, "{\n");
 	fprintf(src, "\tint left = length;\n");
 	fprintf(src, "\tint sublen;\n");
@@ -1229,7 +1229,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 			fprintf(src, "\t\t/* %s */\n", st->name);
 			/* is the subtype also a CHOICE type => it needs the tag included */
 			if(need_tag)
-				fprintf(src, "\t\tfseek(der, -sublen, SEEK_CUR);\n");
+				fprintf(src, "\t\tder_seek(der, -sublen);\n");
 			else
 				fprintf(src, "\t\tleft -= sublen;\n");
 			/* set choice value */
@@ -1270,7 +1270,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 		fprintf(src, "))\n");
 		fprintf(src, "\t\t\treturn der_error(\"%s: unexpected tag %%u\", tag.number);\n", t->name);
 		if(need_tag)
-			fprintf(src, "\t\tfseek(der, -sublen, SEEK_CUR);\n");
+			fprintf(src, "\t\tder_seek(der, -sublen);\n");
 		else
 			fprintf(src, "\t\tleft -= sublen;\n");
 		/* extend the elements array */
@@ -1337,7 +1337,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 				/* does the subtype decoder need the tag */
 				print_indent(src, indent + 1);
 				if(need_tag)
-					fprintf(src, "fseek(der, -sublen, SEEK_CUR);\n");
+					fprintf(src, "der_seek(der, -sublen);\n");
 				else
 					fprintf(src, "seqtag.length -= sublen;\n");
 				/* extend the array */
@@ -1380,7 +1380,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 					/* if the subtype decoder doesnt need the tag, skip over it */
 					if(!need_tag)
 					{
-						fprintf(src, "\t\t\tfseek(der, sublen, SEEK_CUR);\n");
+						fprintf(src, "\t\t\tder_seek(der, sublen);\n");
 						fprintf(src, "\t\t\tleft -= sublen;\n");
 					}
 					/* set the have_ flag if is OPTIONAL (not DEFAULT) */
@@ -1404,7 +1404,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 					fprintf(src, "\t\treturn der_error(\"%s: unexpected tag %%u\", tag.number);\n", t->name);
 					/* does the subtype decoder need the tag */
 					if(need_tag)
-						fprintf(src, "\tfseek(der, -sublen, SEEK_CUR);\n");
+						fprintf(src, "\tder_seek(der, -sublen);\n");
 					else
 						fprintf(src, "\tleft -= sublen;\n");
 					/* decode the type */
@@ -1458,7 +1458,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 				fprintf(src, "\t\t\t\t\treturn der_error(\"%s: unexpected tag %%u\", tag.number);\n", t->name);
 				/* does the subtype decoder need the tag */
 				if(need_tag)
-					fprintf(src, "\t\t\t\tfseek(der, -sublen, SEEK_CUR);\n");
+					fprintf(src, "\t\t\t\tder_seek(der, -sublen);\n");
 				else
 					fprintf(src, "\t\t\t\tseqlen -= sublen;\n");
 				/* extend the array */
@@ -1477,7 +1477,7 @@ output_decodefunc(FILE *src, struct typeinfo *t, struct typeinfo *types)
 			{
 				/* does the subtype decoder need the tag */
 				if(need_tag)
-					fprintf(src, "\t\t\tfseek(der, -sublen, SEEK_CUR);\n");
+					fprintf(src, "\t\t\tder_seek(der, -sublen);\n");
 				else
 					fprintf(src, "\t\t\tleft -= sublen;\n");
 				/* if its optional set the have_ flag */
@@ -98,14 +98,14 @@ process_biop(struct carousel *car, struct module *mod, struct BIOPMessageHeader
 			/* a directory */
 			verbose("DSM::Directory");
 			dirname = make_dir((char *) kind.data, car->current_pid, mod->download_id, mod->module_id, (char *) key.data, key.size);
-			process_biop_dir(data->byte_order, dirname, car, body.data, body.size);
+			process_biop_dir(data->byte_order, dirname, car, body.data, body.size, false);
 		}
 		else if(strcmp((char *) kind.data, BIOP_SERVICEGATEWAY) == 0)
 		{
 			/* the service gateway is the root directory */
 			verbose("DSM::ServiceGateway");
 			dirname = make_dir((char *) kind.data, car->current_pid, mod->download_id, mod->module_id, (char *) key.data, key.size);
-			process_biop_dir(data->byte_order, dirname, car, body.data, body.size);
+			process_biop_dir(data->byte_order, dirname, car, body.data, body.size, true);
 		}
 		else if(strcmp((char *) kind.data, BIOP_FILE) == 0)
 		{
@@ -149,12 +149,38 @@ process_biop(struct carousel *car, struct module *mod, struct BIOPMessageHeader
 	return true;
 }
 
+/*
+ * the files in the service gateway the browser looks for when it starts
+ */
+
+static char *_boot_files[] = { "a", "startup", NULL };
+
+static bool
+is_boot_file(struct biop_sequence *name)
+{
+	size_t len;
+	unsigned int i;
+
+	/* the name may or may not include a \0 terminator */
+	len = strnlen((char *) name->data, name->size);
+
+	for(i=0; _boot_files[i]!=NULL; i++)
+	{
+		if(strlen(_boot_files[i]) == len
+		&& strncmp((char *) name->data, _boot_files[i], len) == 0)
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * process the DSM::Directory message body
+ * gateway is true if it is the service gateway
  */
 
 void
-process_biop_dir(uint8_t byte_order, char *dirname, struct carousel *car, unsigned char *data, uint32_t size)
+process_biop_dir(uint8_t byte_order, char *dirname, struct carousel *car, unsigned char *data, uint32_t size, bool gateway)
 {
 	uint16_t nbindings;
 	uint16_t i;
@@ -178,6 +204,10 @@ process_biop_dir(uint8_t byte_order, char *dirname, struct carousel *car, unsign
 		data += 1;
 		vverbose(" nameComponents: %u", nnames);
 		/* only expecting 1 name, so just use the last one */
+		name.size = 0;
+		name.data = NULL;
+		kind.size = 0;
+		kind.data = NULL;
 		for(j=0; j<nnames; j++)
 		{
 			data += biop_sequence255(data, &name);
@@ -201,7 +231,18 @@ process_biop_dir(uint8_t byte_order, char *dirname, struct carousel *car, unsign
 		 */
 		if(pid != 0)
 			add_dsmcc_pid(car, pid);
-		add_dir_entry(dirname, (char *) name.data, name.size, (char *) kind.data, pid, ior.carousel_id, ior.module_id, (char *) ior.key.data, ior.key.size);
+		/* can't do anything with a binding that has no name */
+		if(name.data == NULL)
+		{
+			error("Ignoring directory entry with no name");
+		}
+		else
+		{
+			add_dir_entry(dirname, (char *) name.data, name.size, (char *) kind.data, pid, ior.carousel_id, ior.module_id, (char *) ior.key.data, ior.key.size);
+			/* get the boot application before anything else */
+			if(gateway && is_boot_file(&name))
+				set_module_priority(car, ior.carousel_id, ior.module_id, PRIORITY_BOOT);
+		}
 		/* objectInfo */
 		data += biop_sequence65535(byte_order, data, &info);
 		vverbose(" objectInfo:");
@@ -216,7 +257,7 @@ process_biop_dir(uint8_t byte_order, char *dirname, struct carousel *car, unsign
  */
 
 uint16_t
-process_biop_service_gateway_info(uint16_t service_id, struct assoc *assoc, unsigned char *data, uint16_t size)
+process_biop_service_gateway_info(struct carousel *car, uint16_t service_id, unsigned char *data, uint16_t size)
 {
 	struct biop_iop_ior ior;
 	uint16_t elementary_pid;
@@ -226,7 +267,10 @@ process_biop_service_gateway_info(uint16_t service_id, struct assoc *assoc, unsi
 
 	data += process_iop_ior(BIOP_BIGENDIAN, data, &ior);
 
-	elementary_pid = stream2pid(assoc, ior.association_tag);
+	elementary_pid = stream2pid(&car->assoc, ior.association_tag);
+
+	/* the browser can't do anything until it has the service gateway */
+	set_module_priority(car, ior.carousel_id, ior.module_id, PRIORITY_BOOT);
 
 	make_service_root(service_id, BIOP_SERVICEGATEWAY, elementary_pid, ior.carousel_id, ior.module_id, (char *) ior.key.data, ior.key.size);
 
@@ -101,9 +101,9 @@ struct biop_iop_ior
 
 /* functions */
 bool process_biop(struct carousel *, struct module *, struct BIOPMessageHeader *, uint32_t);
-void process_biop_dir(uint8_t, char *, struct carousel *, unsigned char *, uint32_t);
+void process_biop_dir(uint8_t, char *, struct carousel *, unsigned char *, uint32_t, bool);
 uint32_t process_iop_ior(uint8_t, unsigned char *, struct biop_iop_ior *);
-uint16_t process_biop_service_gateway_info(uint16_t, struct assoc *, unsigned char *, uint16_t);
+uint16_t process_biop_service_gateway_info(struct carousel *, uint16_t, unsigned char *, uint16_t);
 
 uint16_t biop_uint16(uint8_t, unsigned char *);
 uint32_t biop_uint32(uint8_t, unsigned char *);
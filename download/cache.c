@@ -23,103 +23,429 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
-#include <dirent.h>
+#include <stdint.h>
 #include <errno.h>
-#include <unistd.h>
-#include <sys/stat.h>
-#include <sys/types.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "cache.h"
 #include "table.h"
 #include "utils.h"
 
 /*
- * can't just cache tables in memory because the PMTs are mostly read when we
+ * can't just cache tables in our own memory because the PMTs are mostly read when we
  * execute "avstream <service_id> ..." commands
  * each command is run in a child process, so the memory is lost when the
  * process ends
- * so we cache the tables in the file system
- * all cache items are MAX_TABLE_LEN bytes long
+ * so we cache the tables in a shared mapping created before any of them are forked
+ *
+ * each entry is a complete section, we keep its real length and version number
+ * we also keep an index of service_id -> PMT PID, built when the PAT is saved
+ * so read_pmt() does not need to search the PAT each time
+ *
+ * the PMTs and SDTs belong to the PAT they were read with
+ * if a new PAT has a different transport_stream_id or version number,
+ * all the entries read with the old one are no longer valid
+ * on retune we don't throw anything away, only the PAT has to be read again before it is used
+ * if it is the same PAT, we carry on using the PMTs and SDT we have,
+ * the downloader watches for new versions of them and saves them here when they arrive
+ * a section with a new version number replaces the old one, and the other sections of the old version
+ *
+ * any process may write to the cache, so writers take a lock
+ * readers don't lock, they use the sequence number to check nothing changed while they were copying
+ * the lock is a robust mutex, so if a writer is killed while it holds it, the next process to take it finds out
+ * we don't know what it was changing, so we throw everything away and read the tables again
+ * readers that wait too long for an update to finish take the lock, so they do the clean up if the writer is dead
  */
 
-#define CACHE_DIR	"cache"
+/* number of times a reader yields before it takes the lock to find out if the writer has died */
+#define READ_SPINS		1000
 
-bool
-cache_init(void)
+/* max number of sections we keep */
+#define CACHE_ENTRIES		128
+
+struct cache_entry
 {
-	if(mkdir(CACHE_DIR, 0755) < 0 && errno != EEXIST)
-		fatal("Unable to create cache directory '%s': %s", CACHE_DIR, strerror(errno));
+	bool used;
+	uint8_t tid;
+	uint16_t id;		/* service_id for PMTs, 0 for anything else */
+	uint8_t sn;		/* section number */
+	uint8_t version;
+	uint32_t generation;	/* PAT generation it was read with */
+	uint16_t length;	/* bytes in data[] */
+	unsigned char data[MAX_TABLE_LEN];
+};
 
-	cache_flush();
+struct service_pid
+{
+	uint16_t service_id;
+	uint16_t pmt_pid;
+};
 
-	return true;
+struct cache
+{
+	pthread_mutex_t lock;			/* held by writers */
+	uint32_t seq;				/* odd while an update is in progress */
+	bool pat_verified;			/* false => need to read the PAT again */
+	uint16_t transport_stream_id;		/* from the current PAT */
+	uint8_t pat_version;
+	uint32_t generation;			/* changes each time we get a different PAT */
+	unsigned int next_victim;		/* entry to reuse when they are all valid */
+	unsigned int nservices;
+	struct service_pid service[CACHE_MAX_SERVICES];
+	struct cache_entry entry[CACHE_ENTRIES];
+};
+
+static struct cache *_cache = NULL;
+
+static uint16_t
+section_length(unsigned char *data)
+{
+	return 3 + (((data[1] & 0x0f) << 8) + data[2]);
+}
+
+static uint8_t
+section_version(unsigned char *data)
+{
+	return (data[5] >> 1) & 0x1f;
+}
+
+static void
+start_update(void)
+{
+	unsigned int i;
+
+	if(pthread_mutex_lock(&_cache->lock) == EOWNERDEAD)
+	{
+		error("Process died while updating the table cache, emptying it");
+		/* make the sequence number even again */
+		if(_cache->seq & 1)
+			__atomic_store_n(&_cache->seq, _cache->seq + 1, __ATOMIC_RELAXED);
+		for(i=0; i<CACHE_ENTRIES; i++)
+			_cache->entry[i].used = false;
+		_cache->pat_verified = false;
+		_cache->generation ++;
+		pthread_mutex_consistent(&_cache->lock);
+	}
+
+	__atomic_store_n(&_cache->seq, _cache->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return;
+}
+
+static void
+end_update(void)
+{
+	__atomic_store_n(&_cache->seq, _cache->seq + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&_cache->lock);
+
+	return;
+}
+
+/*
+ * returns the sequence number to pass to read_ok()
+ */
+
+static uint32_t
+start_read(void)
+{
+	uint32_t seq;
+	unsigned int spins = 0;
+
+	/* wait for any update to finish */
+	while((seq = __atomic_load_n(&_cache->seq, __ATOMIC_ACQUIRE)) & 1)
+	{
+		/* waits for the writer, or cleans up if it has died */
+		if(++ spins == READ_SPINS)
+		{
+			start_update();
+			end_update();
+			spins = 0;
+		}
+		sched_yield();
+	}
+
+	return seq;
+}
+
+/*
+ * returns false if the cache was updated while we were reading it
+ */
+
+static bool
+read_ok(uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return (__atomic_load_n(&_cache->seq, __ATOMIC_RELAXED) == seq);
+}
+
+static struct cache_entry *
+find_entry(uint8_t tid, uint16_t id, uint8_t sn)
+{
+	unsigned int i;
+	struct cache_entry *ent;
+
+	for(i=0; i<CACHE_ENTRIES; i++)
+	{
+		ent = &_cache->entry[i];
+		if(ent->used && ent->tid == tid && ent->id == id && ent->sn == sn)
+			return ent;
+	}
+
+	return NULL;
+}
+
+/*
+ * called with the lock held
+ */
+
+static void
+index_pat(unsigned char *pat)
+{
+	uint16_t length = section_length(pat);
+	uint16_t offset;
+	uint16_t service_id;
+	struct service_pid *svc;
+
+	_cache->nservices = 0;
+
+	/* -4 for the CRC at the end */
+	for(offset=8; offset + 4 <= length - 4 && _cache->nservices < CACHE_MAX_SERVICES; offset+=4)
+	{
+		service_id = (pat[offset] << 8) + pat[offset+1];
+		/* service_id 0 is the NIT PID */
+		if(service_id == 0)
+			continue;
+		svc = &_cache->service[_cache->nservices++];
+		svc->service_id = service_id;
+		svc->pmt_pid = ((pat[offset+2] & 0x1f) << 8) + pat[offset+3];
+	}
+
+	return;
 }
 
 /*
- * returns false if the item is not in the cache
+ * must be called before we fork any other processes
  */
 
 bool
-cache_load(char *item, unsigned char *out)
+cache_init(void)
 {
-	char filename[PATH_MAX];
-	FILE *f;
-	size_t nread;
+	void *map;
+	pthread_mutexattr_t attr;
+
+	map = mmap(NULL, sizeof(struct cache), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED)
+	{
+		error("Unable to create table cache: %s", strerror(errno));
+		return false;
+	}
 
-	snprintf(filename, sizeof(filename), "%s/%s", CACHE_DIR, item);
+	/* mmap gives us zeroed pages, so everything is empty */
+	_cache = map;
 
-	if((f = fopen(filename, "r")) == NULL)
+	/* the lock is shared by all the processes, and must not stay locked if one dies holding it */
+	if(pthread_mutexattr_init(&attr) != 0
+	|| pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0
+	|| pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0
+	|| pthread_mutex_init(&_cache->lock, &attr) != 0)
+	{
+		error("Unable to create table cache lock");
+		munmap(map, sizeof(struct cache));
+		_cache = NULL;
 		return false;
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	return true;
+}
+
+/*
+ * copies the section into out, which must be at least MAX_TABLE_LEN bytes
+ * returns false if the section is not in the cache
+ */
 
-	nread = fread(out, 1, MAX_TABLE_LEN, f);
+bool
+cache_load(uint8_t tid, uint16_t id, uint8_t sn, unsigned char *out)
+{
+	struct cache_entry *ent;
+	uint32_t seq;
+	bool found;
 
-	fclose(f);
+	do
+	{
+		seq = start_read();
+		found = false;
+		/* after a retune, we need to read the PAT again to see if we still have the same one */
+		if((ent = find_entry(tid, id, sn)) == NULL
+		|| (tid == TID_PAT && !_cache->pat_verified)
+		|| ent->generation != _cache->generation
+		|| ent->length > MAX_TABLE_LEN)
+			continue;
+		memcpy(out, ent->data, ent->length);
+		found = true;
+	}
+	while(!read_ok(seq));
 
-	return (nread == MAX_TABLE_LEN);
+	return found;
 }
 
+/*
+ * data is a complete section
+ * if it is a PAT that is different to the one we had, all the other entries are thrown away
+ */
+
 void
-cache_save(char *item, unsigned char *data)
+cache_save(uint8_t tid, uint16_t id, uint8_t sn, unsigned char *data)
 {
-	char filename[PATH_MAX];
-	FILE *f;
+	struct cache_entry *ent;
+	uint16_t length = section_length(data);
+	uint16_t tsid;
+	uint8_t version;
+	unsigned int i;
 
-	snprintf(filename, sizeof(filename), "%s/%s", CACHE_DIR, item);
-
-	if((f = fopen(filename, "w")) == NULL)
+	if(length > MAX_TABLE_LEN)
 		return;
 
-	/* if we don't write it all, we'll find out when we try to load it */
-	fwrite(data, 1, MAX_TABLE_LEN, f);
+	version = section_version(data);
+
+	start_update();
 
-	fclose(f);
+	if(tid == TID_PAT)
+	{
+		tsid = (data[3] << 8) + data[4];
+		/* is it still the same PAT */
+		if(_cache->generation == 0
+		|| tsid != _cache->transport_stream_id
+		|| version != _cache->pat_version)
+		{
+			vverbose("New PAT: transport_stream_id=%u version=%u", tsid, version);
+			_cache->generation ++;
+			_cache->transport_stream_id = tsid;
+			_cache->pat_version = version;
+			index_pat(data);
+		}
+		_cache->pat_verified = true;
+	}
+
+	/* find an entry to put it in */
+	if((ent = find_entry(tid, id, sn)) == NULL)
+	{
+		for(i=0; i<CACHE_ENTRIES && ent == NULL; i++)
+		{
+			if(!_cache->entry[i].used
+			|| _cache->entry[i].generation != _cache->generation)
+				ent = &_cache->entry[i];
+		}
+		/* full of valid entries, just reuse the next one */
+		if(ent == NULL)
+		{
+			ent = &_cache->entry[_cache->next_victim];
+			_cache->next_victim = (_cache->next_victim + 1) % CACHE_ENTRIES;
+		}
+	}
+	else if(ent->version != version)
+	{
+		vverbose("Table 0x%x id %u section %u: version %u -> %u", tid, id, sn, ent->version, version);
+	}
+
+	/* the other sections of the table need to be read again if they have a different version */
+	for(i=0; i<CACHE_ENTRIES; i++)
+	{
+		if(_cache->entry[i].used
+		&& &_cache->entry[i] != ent
+		&& _cache->entry[i].tid == tid
+		&& _cache->entry[i].id == id
+		&& _cache->entry[i].version != version)
+			_cache->entry[i].used = false;
+	}
+
+	ent->used = true;
+	ent->tid = tid;
+	ent->id = id;
+	ent->sn = sn;
+	ent->version = version;
+	ent->generation = _cache->generation;
+	ent->length = length;
+	memcpy(ent->data, data, length);
+
+	end_update();
 
 	return;
 }
 
-void
-cache_flush(void)
+/*
+ * returns the PMT PID for the given service from the current PAT
+ * returns 0 if we don't know it
+ */
+
+uint16_t
+cache_pmt_pid(uint16_t service_id)
 {
-	DIR *d;
-	struct dirent *item;
-	char filename[PATH_MAX];
+	uint16_t pid;
+	uint32_t seq;
+	unsigned int i;
 
-	if((d = opendir(CACHE_DIR)) == NULL)
-		return;
+	do
+	{
+		seq = start_read();
+		pid = 0;
+		if(!_cache->pat_verified)
+			continue;
+		for(i=0; i<_cache->nservices && i<CACHE_MAX_SERVICES && pid == 0; i++)
+		{
+			if(_cache->service[i].service_id == service_id)
+				pid = _cache->service[i].pmt_pid;
+		}
+	}
+	while(!read_ok(seq));
+
+	return pid;
+}
 
-	while((item = readdir(d)) != NULL)
+/*
+ * copies the service_ids in the current PAT into out
+ * returns the number of services, 0 if we don't have a PAT
+ */
+
+unsigned int
+cache_services(uint16_t *out, unsigned int max)
+{
+	uint32_t seq;
+	unsigned int n;
+
+	do
 	{
-		/* skip . and .. */
-		if(strcmp(item->d_name, ".") == 0
-		|| strcmp(item->d_name, "..") == 0)
+		seq = start_read();
+		n = 0;
+		if(!_cache->pat_verified)
 			continue;
-		snprintf(filename, sizeof(filename), "%s/%s", CACHE_DIR, item->d_name);
-		unlink(filename);
+		for(n=0; n<_cache->nservices && n<CACHE_MAX_SERVICES && n<max; n++)
+			out[n] = _cache->service[n].service_id;
 	}
+	while(!read_ok(seq));
 
-	closedir(d);
+	return n;
+}
+
+/*
+ * we may be on a different multiplex now
+ * we keep all the entries, but the PAT has to be read again to see if they are still valid
+ * the downloader catches any new versions of the PMTs and SDT
+ */
+
+void
+cache_retune(void)
+{
+	start_update();
+
+	_cache->pat_verified = false;
+
+	end_update();
 
 	return;
 }
 
-
@@ -24,13 +24,20 @@
 #define __CACHE_H__
 
 #include <stdbool.h>
+#include <stdint.h>
+
+/* max number of services in a PAT */
+#define CACHE_MAX_SERVICES	256
 
 bool cache_init(void);
 
-bool cache_load(char *, unsigned char *);
-void cache_save(char *, unsigned char *);
+bool cache_load(uint8_t, uint16_t, uint8_t, unsigned char *);
+void cache_save(uint8_t, uint16_t, uint8_t, unsigned char *);
+
+uint16_t cache_pmt_pid(uint16_t);
+unsigned int cache_services(uint16_t *, unsigned int);
 
-void cache_flush(void);
+void cache_retune(void);
 
 #endif	/* __CACHE_H__ */
 
@@ -21,6 +21,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <netinet/in.h>
@@ -29,37 +30,74 @@
 #include "table.h"
 #include "dsmcc.h"
 #include "biop.h"
+#include "tsfile.h"
+#include "wanted.h"
+#include "stats.h"
 #include "utils.h"
 
+/*
+ * downloads car and all the other carousels in its group
+ * the sections from each PID are given to every carousel that uses that PID
+ */
+
 void
 load_carousel(struct carousel *car)
 {
 	unsigned char table[MAX_TABLE_LEN];
+	struct carousel *member;
+	uint32_t download_id;
+	uint16_t module_id;
 	bool done;
 
 	/* no modules yet */
-	car->nmodules = 0;
-	car->modules = NULL;
+	stats_start();
+	for(member=car; member!=NULL; member=member->next)
+	{
+		member->nmodules = 0;
+		bzero(member->modules, sizeof(member->modules));
+		member->stats = stats_add_carousel(member->service_id, member->carousel_id);
+	}
+
+	/* reading the PSI tables may have taken us past the start of the carousel */
+	if(using_tsfile())
+		tsfile_rewind();
 
 	/* see what the next DSMCC table is */
 	done = false;
 	do
 	{
 		struct dsmccMessageHeader *dsmcc;
+		stats_periodic();
+		/* catch any changes to the PMTs and SDT we have cached */
+		check_psi_versions(car);
+		/* download any modules the browser is waiting for first */
+		while(wanted_next(&download_id, &module_id))
+		{
+			for(member=car; member!=NULL; member=member->next)
+				set_module_priority(member, download_id, module_id, PRIORITY_WANTED);
+		}
 		if(!read_dsmcc_tables(car, table))
+		{
+			/* we've read the whole Transport Stream file */
+			if(using_tsfile())
+			{
+				verbose("End of Transport Stream");
+				stats_final();
+				return;
+			}
 			fatal("Unable to read PID");
+		}
 		dsmcc = (struct dsmccMessageHeader *) &table[8];
 		if(dsmcc->protocolDiscriminator == DSMCC_PROTOCOL
 		&& dsmcc->dsmccType == DSMCC_TYPE_DOWNLOAD)
 		{
-			if(ntohs(dsmcc->messageId) == DSMCC_MSGID_DII)
-				process_dii(car, (struct DownloadInfoIndication *) dsmccMessage(dsmcc), ntohl(dsmcc->transactionId));
-			else if(ntohs(dsmcc->messageId) == DSMCC_MSGID_DSI)
-				process_dsi(car, (struct DownloadServerInitiate *) dsmccMessage(dsmcc));
-			else if(ntohs(dsmcc->messageId) == DSMCC_MSGID_DDB)
-				process_ddb(car, (struct DownloadDataBlock *) dsmccMessage(dsmcc), ntohl(dsmcc->transactionId), DDB_blockDataLength(dsmcc));
-			else
-				error("Unknown DSMCC messageId: 0x%x", ntohs(dsmcc->messageId));
+			for(member=car; member!=NULL; member=member->next)
+			{
+				if(!carousel_has_pid(member, car->current_pid))
+					continue;
+				member->current_pid = car->current_pid;
+				process_dsmcc(member, dsmcc);
+			}
 		}
 	}
 	while(!done);
@@ -67,9 +105,98 @@ load_carousel(struct carousel *car)
 	return;
 }
 
+/*
+ * returns the priority of a DDB we have read from pid, but not processed yet
+ * car is the first carousel in the group
+ */
+
+unsigned int
+ddb_priority(struct carousel *car, uint16_t pid, struct dsmccMessageHeader *dsmcc)
+{
+	struct DownloadDataBlock *ddb;
+	struct carousel *member;
+	struct module *mod;
+	unsigned int priority;
+
+	if(dsmcc->protocolDiscriminator != DSMCC_PROTOCOL
+	|| dsmcc->dsmccType != DSMCC_TYPE_DOWNLOAD
+	|| ntohs(dsmcc->messageId) != DSMCC_MSGID_DDB)
+		return PRIORITY_NORMAL;
+
+	ddb = (struct DownloadDataBlock *) dsmccMessage(dsmcc);
+
+	/* if several carousels use the PID, it gets the highest of their priorities */
+	priority = PRIORITY_NONE;
+	for(member=car; member!=NULL; member=member->next)
+	{
+		if(carousel_has_pid(member, pid)
+		&& (mod = find_module(member, ntohs(ddb->moduleId), ntohl(dsmcc->transactionId))) != NULL
+		&& mod->version == ddb->moduleVersion
+		&& mod->blocks_left != 0)
+			priority = MAX(priority, mod->priority);
+	}
+
+	return priority;
+}
+
+void
+process_dsmcc(struct carousel *car, struct dsmccMessageHeader *dsmcc)
+{
+	if(ntohs(dsmcc->messageId) == DSMCC_MSGID_DII)
+		process_dii(car, (struct DownloadInfoIndication *) dsmccMessage(dsmcc), ntohl(dsmcc->transactionId));
+	else if(ntohs(dsmcc->messageId) == DSMCC_MSGID_DSI)
+		process_dsi(car, (struct DownloadServerInitiate *) dsmccMessage(dsmcc), ntohl(dsmcc->transactionId));
+	else if(ntohs(dsmcc->messageId) == DSMCC_MSGID_DDB)
+		process_ddb(car, (struct DownloadDataBlock *) dsmccMessage(dsmcc), ntohl(dsmcc->transactionId), DDB_blockDataLength(dsmcc));
+	else
+		error("Unknown DSMCC messageId: 0x%x", ntohs(dsmcc->messageId));
+
+	return;
+}
+
+/*
+ * the transactionId of a DII is a version number, it changes if any of the modules it lists change
+ * a two layer carousel has several DIIs for each downloadId, the identification bits say which one this is
+ * returns NULL if we have already processed this version of the DII
+ * otherwise remembers the new transactionId and returns the entry for this DII
+ */
+
+static struct dii_version *
+dii_changed(struct carousel *car, uint32_t download_id, uint32_t transaction_id)
+{
+	struct dii_version *ver;
+	unsigned int i;
+
+	for(i=0; i<car->ndiis; i++)
+	{
+		ver = &car->diis[i];
+		if(ver->download_id == download_id
+		&& ver->identification == DII_IDENTIFICATION(transaction_id))
+		{
+			if(ver->transaction_id == transaction_id)
+				return NULL;
+			verbose("DII updated: downloadId %u transactionId %u -> %u", download_id, ver->transaction_id, transaction_id);
+			ver->transaction_id = transaction_id;
+			return ver;
+		}
+	}
+
+	car->diis = safe_realloc(car->diis, (car->ndiis + 1) * sizeof(struct dii_version));
+	ver = &car->diis[car->ndiis ++];
+	ver->download_id = download_id;
+	ver->identification = DII_IDENTIFICATION(transaction_id);
+	ver->transaction_id = transaction_id;
+	ver->nmodules = 0;
+	ver->module_ids = NULL;
+
+	return ver;
+}
+
 void
 process_dii(struct carousel *car, struct DownloadInfoIndication *dii, uint32_t transactionId)
 {
+	struct dii_version *ver;
+	struct module *existing;
 	unsigned int nmodules;
 	unsigned int i;
 
@@ -77,9 +204,20 @@ process_dii(struct carousel *car, struct DownloadInfoIndication *dii, uint32_t t
 	vverbose("transactionId: %u", transactionId);
 	vverbose("downloadId: %u", ntohl(dii->downloadId));
 
+	/* nothing has changed since the last time we saw it */
+	if((ver = dii_changed(car, ntohl(dii->downloadId), transactionId)) == NULL)
+		return;
+
 	nmodules = DII_numberOfModules(dii);
 	vverbose("numberOfModules: %u", nmodules);
 
+	/* remember what it lists, so we know which modules are still in the carousel */
+	safe_free(ver->module_ids);
+	ver->module_ids = safe_malloc(nmodules * sizeof(uint16_t));
+	ver->nmodules = nmodules;
+	for(i=0; i<nmodules; i++)
+		ver->module_ids[i] = ntohs(DII_module(dii, i)->moduleId);
+
 	for(i=0; i<nmodules; i++)
 	{
 		struct DIIModule *mod;
@@ -88,29 +226,50 @@ process_dii(struct carousel *car, struct DownloadInfoIndication *dii, uint32_t t
 		vverbose(" moduleId: %u", ntohs(mod->moduleId));
 		vverbose(" moduleVersion: %u", mod->moduleVersion);
 		vverbose(" moduleSize: %u", ntohl(mod->moduleSize));
-		if(find_module(car, ntohs(mod->moduleId), mod->moduleVersion, ntohl(dii->downloadId)) == NULL)
-			add_module(car, dii, mod);
+		/* only download the modules that have changed */
+		existing = find_module(car, ntohs(mod->moduleId), ntohl(dii->downloadId));
+		if(existing != NULL && existing->version == mod->moduleVersion)
+			continue;
+		if(existing != NULL)
+		{
+			verbose("Module %u updated: version %u -> %u", existing->module_id, existing->version, mod->moduleVersion);
+			delete_module(car, existing);
+		}
+		add_module(car, dii, mod);
 	}
 
+	/* stop downloading modules that are no longer in the carousel */
+	delete_old_modules(car, ntohl(dii->downloadId));
+
 	return;
 }
 
 void
-process_dsi(struct carousel *car, struct DownloadServerInitiate *dsi)
+process_dsi(struct carousel *car, struct DownloadServerInitiate *dsi, uint32_t transactionId)
 {
 	uint16_t elementary_pid;
+	unsigned int i;
 
 	verbose("DownloadServerInitiate");
 
 	/* only download the DSI from the boot PID */
-	if(car->current_pid != car->boot_pid
-	|| car->got_dsi)
+	if(car->current_pid != car->boot_pid)
 		return;
 
-	/* TODO: check for updated version */
+	/* has it changed since we last processed it */
+	if(car->got_dsi && car->dsi_transaction_id == transactionId)
+		return;
+	if(car->got_dsi)
+		verbose("DSI updated: transactionId %u -> %u", car->dsi_transaction_id, transactionId);
+
 	car->got_dsi = true;
+	car->dsi_transaction_id = transactionId;
+
+	elementary_pid = process_biop_service_gateway_info(car, car->service_id, DSI_privateDataByte(dsi), ntohs(dsi->privateDataLength));
 
-	elementary_pid = process_biop_service_gateway_info(car->service_id, &car->assoc, DSI_privateDataByte(dsi), ntohs(dsi->privateDataLength));
+	/* any other services using the same carousel have the same root */
+	for(i=0; i<car->nservices; i++)
+		process_biop_service_gateway_info(car, car->services[i], DSI_privateDataByte(dsi), ntohs(dsi->privateDataLength));
 
 	/* make sure we are downloading data from the PID the DSI refers to */
 	add_dsmcc_pid(car, elementary_pid);
@@ -135,7 +294,8 @@ process_ddb(struct carousel *car, struct DownloadDataBlock *ddb, uint32_t downlo
 	block = DDB_blockDataByte(ddb);
 	vhexdump(block, blockLength);
 
-	if((mod = find_module(car, ntohs(ddb->moduleId), ddb->moduleVersion, downloadId)) != NULL)
+	if((mod = find_module(car, ntohs(ddb->moduleId), downloadId)) != NULL
+	&& mod->version == ddb->moduleVersion)
 		download_block(car, mod, ntohs(ddb->blockNumber), block, blockLength);
 
 	return;
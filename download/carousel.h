@@ -31,8 +31,11 @@
 /* functions */
 void load_carousel(struct carousel *);
 
+unsigned int ddb_priority(struct carousel *, uint16_t, struct dsmccMessageHeader *);
+
+void process_dsmcc(struct carousel *, struct dsmccMessageHeader *);
 void process_dii(struct carousel *, struct DownloadInfoIndication *, uint32_t);
-void process_dsi(struct carousel *, struct DownloadServerInitiate *);
+void process_dsi(struct carousel *, struct DownloadServerInitiate *, uint32_t);
 void process_ddb(struct carousel *, struct DownloadDataBlock *, uint32_t, uint32_t);
 
 #endif	/* __CAROUSEL_H__ */
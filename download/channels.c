@@ -31,8 +31,11 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <linux/dvb/frontend.h>
 
+#include "cache.h"
+#include "scan.h"
 #include "utils.h"
 
 /* magic DVB-S values from dvbtune */
@@ -41,13 +44,49 @@
 #define LOF2 (10600*1000UL)
 #define ONE_kHz 1000UL
 
+/* number of hash buckets in each channels.conf index, must be a power of 2 */
+#define CHANNELS_HASH_SIZE	1024
+
+/* fe_type_t values are 0 to FE_ATSC */
+#define NUM_FE_TYPES		(FE_ATSC + 1)
+
+/*
+ * channels.conf is read once and the lines are kept in memory
+ * the first time we tune a frontend of a given type, the lines in that type's format are parsed into a hash table
+ * all the frontends of the same type then share it
+ * if the file changes (or we get a SIGHUP), it is read again
+ */
+
+struct channel
+{
+	uint32_t next;		/* index + 1 of the next channel in this hash bucket, 0 => end of list */
+	uint16_t service_id;
+	char *line;		/* the line it came from */
+	struct dvb_frontend_parameters params;
+	char pol;		/* DVB-S only */
+	unsigned int sat_no;	/* DVB-S only */
+};
+
+struct channel_index
+{
+	bool parsed;		/* false until the first time we need it */
+	unsigned int nchannels;
+	struct channel *channels;
+	uint32_t hash[CHANNELS_HASH_SIZE];	/* index + 1 of the first channel in each bucket, 0 => empty */
+};
+
 /* internal functions */
 static bool get_tune_params(fe_type_t, uint16_t, struct dvb_frontend_parameters *, char *, unsigned int *);
 
-static bool get_dvbt_tune_params(uint16_t, struct dvb_frontend_parameters *);
-static bool get_dvbs_tune_params(uint16_t, struct dvb_frontend_parameters *, char *, unsigned int *);
-static bool get_dvbc_tune_params(uint16_t, struct dvb_frontend_parameters *);
-static bool get_atsc_tune_params(uint16_t, struct dvb_frontend_parameters *);
+static void check_channels_conf(void);
+static void load_channels_conf(void);
+static void free_channels_conf(void);
+static void parse_channels(fe_type_t, struct channel_index *);
+
+static bool parse_dvbt_line(char *, struct channel *);
+static bool parse_dvbs_line(char *, struct channel *);
+static bool parse_dvbc_line(char *, struct channel *);
+static bool parse_atsc_line(char *, struct channel *);
 
 /* DISEQC code from dvbtune, written by Dave Chapman */
 struct diseqc_cmd
@@ -59,6 +98,21 @@ struct diseqc_cmd
 static int do_diseqc(int, int, char, bool);
 static int diseqc_send_msg(int, fe_sec_voltage_t, struct diseqc_cmd *, fe_sec_tone_mode_t, fe_sec_mini_cmd_t);
 
+/* frontends we have opened, we need to keep them open to stop them untuning themselves */
+struct frontend
+{
+	unsigned int adapter;
+	unsigned int frontend;
+	int fd;
+	bool first_time;	/* true if we have not tuned it yet */
+};
+
+static struct frontend *_frontends = NULL;
+static unsigned int _nfrontends = 0;
+
+static struct frontend *open_frontend(unsigned int, unsigned int);
+static void get_frontend_info(int, struct dvb_frontend_info *);
+
 /*
  * returns "tzap" if the given DVB adapter is DVB-T,
  * "szap" if it is DVB-S
@@ -121,7 +175,13 @@ zap_name(unsigned int adapter, unsigned int frontend)
 	}
 }
 
-static FILE *_channels = NULL;
+static char _channels_path[PATH_MAX];
+static bool _have_channels = false;
+static struct stat _channels_stat;		/* the file as it was when we read it */
+static unsigned int _nlines = 0;
+static char **_lines = NULL;
+static uint8_t _listed[65536 / 8];		/* bit map of the service_ids in the file, whatever its format */
+static struct channel_index _index[NUM_FE_TYPES];
 
 /*
  * if filename is NULL, it searches for:
@@ -136,7 +196,7 @@ init_channels_conf(char *zap_name, char *filename)
 	char *home;
 	char pathname[PATH_MAX];
 
-	if(_channels != NULL)
+	if(_have_channels)
 		fatal("init_channels_conf: already initialised");
 
 	if(filename == NULL)
@@ -145,21 +205,191 @@ init_channels_conf(char *zap_name, char *filename)
 		{
 			snprintf(pathname, sizeof(pathname), "%s/.%s/channels.conf", home, zap_name);
 			verbose("Trying to open %s", pathname);
-			_channels = fopen(pathname, "r");
+			_have_channels = (access(pathname, R_OK) == 0);
 		}
-		if(_channels == NULL)
+		if(!_have_channels)
 		{
-			verbose("Trying to open /etc/channels.conf");
-			_channels = fopen("/etc/channels.conf", "r");
+			snprintf(pathname, sizeof(pathname), "/etc/channels.conf");
+			verbose("Trying to open %s", pathname);
+			_have_channels = (access(pathname, R_OK) == 0);
 		}
 	}
 	else
 	{
-		verbose("Trying to open %s", filename);
-		_channels = fopen(filename, "r");
+		snprintf(pathname, sizeof(pathname), "%s", filename);
+		verbose("Trying to open %s", pathname);
+		_have_channels = (access(pathname, R_OK) == 0);
+	}
+
+	/* we may chdir before we read it again */
+	if(_have_channels
+	&& realpath(pathname, _channels_path) == NULL)
+		_have_channels = false;
+
+	if(_have_channels)
+		load_channels_conf();
+
+	return _have_channels;
+}
+
+/*
+ * call this when we get a SIGHUP, so the user can make us see a new channels.conf file
+ */
+
+void
+reload_channels_conf(void)
+{
+	if(!_have_channels)
+		return;
+
+	verbose("Reloading %s", _channels_path);
+
+	load_channels_conf();
+
+	return;
+}
+
+/*
+ * read it again if it has changed since we last read it
+ */
+
+static void
+check_channels_conf(void)
+{
+	struct stat now;
+
+	if(!_have_channels
+	|| stat(_channels_path, &now) < 0)
+		return;
+
+	if(now.st_ino != _channels_stat.st_ino
+	|| now.st_size != _channels_stat.st_size
+	|| now.st_mtime != _channels_stat.st_mtime)
+	{
+		verbose("%s has changed", _channels_path);
+		load_channels_conf();
 	}
 
-	return (_channels != NULL);
+	return;
+}
+
+/*
+ * read the lines of the file into memory, the per frontend type indexes are built when we need them
+ */
+
+static void
+load_channels_conf(void)
+{
+	FILE *file;
+	char line[1024];
+	char *p;
+	unsigned long id;
+	size_t len;
+
+	free_channels_conf();
+
+	if((file = fopen(_channels_path, "r")) == NULL)
+	{
+		error("Unable to open %s: %s", _channels_path, strerror(errno));
+		return;
+	}
+
+	if(fstat(fileno(file), &_channels_stat) < 0)
+		bzero(&_channels_stat, sizeof(_channels_stat));
+
+	while(fgets(line, sizeof(line), file) != NULL)
+	{
+		/* chop off trailing \n */
+		len = strlen(line);
+		while(len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		/* service_id is the last field for all channels.conf file formats */
+		if((p = rindex(line, ':')) == NULL)
+			continue;
+		id = strtoul(p + 1, NULL, 0);
+		if(id <= 0xffff)
+			_listed[id / 8] |= 1 << (id % 8);
+		_lines = safe_realloc(_lines, (_nlines + 1) * sizeof(char *));
+		_lines[_nlines] = safe_malloc(len + 1);
+		memcpy(_lines[_nlines], line, len + 1);
+		_nlines ++;
+	}
+
+	fclose(file);
+
+	vverbose("Read %u lines from %s", _nlines, _channels_path);
+
+	return;
+}
+
+static void
+free_channels_conf(void)
+{
+	unsigned int i;
+
+	for(i=0; i<_nlines; i++)
+		safe_free(_lines[i]);
+	safe_free(_lines);
+	_lines = NULL;
+	_nlines = 0;
+
+	bzero(_listed, sizeof(_listed));
+
+	for(i=0; i<NUM_FE_TYPES; i++)
+	{
+		safe_free(_index[i].channels);
+		bzero(&_index[i], sizeof(struct channel_index));
+	}
+
+	return;
+}
+
+/*
+ * put the lines that are in the format for fe_type in its hash table
+ * if a service_id is in the file more than once, the first one wins
+ */
+
+static void
+parse_channels(fe_type_t fe_type, struct channel_index *index)
+{
+	struct channel ch;
+	unsigned int bucket;
+	uint32_t i;
+	unsigned int n;
+	bool ok;
+
+	index->parsed = true;
+
+	for(n=0; n<_nlines; n++)
+	{
+		bzero(&ch, sizeof(ch));
+		if(fe_type == FE_OFDM)
+			ok = parse_dvbt_line(_lines[n], &ch);
+		else if(fe_type == FE_QPSK)
+			ok = parse_dvbs_line(_lines[n], &ch);
+		else if(fe_type == FE_QAM)
+			ok = parse_dvbc_line(_lines[n], &ch);
+		else if(fe_type == FE_ATSC)
+			ok = parse_atsc_line(_lines[n], &ch);
+		else
+			ok = false;
+		if(!ok)
+			continue;
+		bucket = ch.service_id & (CHANNELS_HASH_SIZE - 1);
+		for(i=index->hash[bucket]; i!=0 && index->channels[i - 1].service_id!=ch.service_id; i=index->channels[i - 1].next)
+			;
+		if(i != 0)
+			continue;
+		ch.line = _lines[n];
+		ch.next = index->hash[bucket];
+		index->channels = safe_realloc(index->channels, (index->nchannels + 1) * sizeof(struct channel));
+		index->channels[index->nchannels ++] = ch;
+		index->hash[bucket] = index->nchannels;
+	}
+
+	vverbose("%u channels in %s for frontend type %d", index->nchannels, _channels_path, fe_type);
+
+	return;
 }
 
 /*
@@ -237,57 +467,84 @@ static const struct param transmissionmode_list[] =
 
 #define LIST_SIZE(x)	(sizeof(x) / sizeof(struct param))
 
+/*
+ * returns -1 if str is not in map
+ */
+
 static int
 str2enum(char *str, const struct param *map, int map_size)
 {
-	while(map_size >= 0)
+	while(map_size > 0)
 	{
 		map_size --;
 		if(strcmp(str, map[map_size].name) == 0)
 			return map[map_size].value;
 	}
 
-	fatal("Invalid parameter '%s' in channels.conf file", str);
-
-	/* not reached */
 	return -1;
 }
 
 /*
  * return the params needed to tune to the given service_id
- * the data is read from the channels.conf file
+ * the data comes from the channels.conf file
  * returns false if the service_id is not found
  */
 
 static bool
 get_tune_params(fe_type_t fe_type, uint16_t service_id, struct dvb_frontend_parameters *out, char *pol, unsigned int *sat_no)
 {
-	if(_channels == NULL)
+	struct channel_index *index;
+	struct channel *ch;
+	uint32_t i;
+
+	check_channels_conf();
+
+	if(!_have_channels)
 	{
 		verbose("No channels.conf file available");
 		return false;
 	}
 
-	bzero(out, sizeof(struct dvb_frontend_parameters));
+	if((unsigned int) fe_type >= NUM_FE_TYPES)
+	{
+		error("Unknown DVB device type (%d)", fe_type);
+		return false;
+	}
 
 	verbose("Searching channels.conf for service_id %u", service_id);
 
-	rewind(_channels);
+	index = &_index[fe_type];
+	if(!index->parsed)
+		parse_channels(fe_type, index);
 
-	if(fe_type == FE_OFDM)
-		return get_dvbt_tune_params(service_id, out);
-	else if(fe_type == FE_QPSK)
-		return get_dvbs_tune_params(service_id, out, pol, sat_no);
-	else if(fe_type == FE_QAM)
-		return get_dvbc_tune_params(service_id, out);
-	else if(fe_type == FE_ATSC)
-		return get_atsc_tune_params(service_id, out);
-	else
-		error("Unknown DVB device type (%d)", fe_type);
+	for(i=index->hash[service_id & (CHANNELS_HASH_SIZE - 1)]; i!=0; i=ch->next)
+	{
+		ch = &index->channels[i - 1];
+		if(ch->service_id == service_id)
+		{
+			verbose("%s", ch->line);
+			*out = ch->params;
+			*pol = ch->pol;
+			*sat_no = ch->sat_no;
+			return true;
+		}
+	}
 
 	return false;
 }
 
+/*
+ * the parse_xxx_line() functions return false if the line is not in the right format for that frontend type
+ * they give an error if it is in the right format but has a value we don't understand
+ */
+
+#define PARSE_ENUM(field, str, list)							\
+	if((field = str2enum(str, list, LIST_SIZE(list))) == -1)			\
+	{										\
+		error("Invalid parameter '%s' in channels.conf file", str);		\
+		return false;								\
+	}
+
 /*
  * DVB-T channels.conf format is:
  * name:freq:inversion:bandwidth:code_rate_HP:code_rate_LP:constellation:transmission_mode:guard_interval:hierarchy:vpid:apid:service_id
@@ -296,9 +553,8 @@ get_tune_params(fe_type_t fe_type, uint16_t service_id, struct dvb_frontend_para
  */
 
 static bool
-get_dvbt_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out)
+parse_dvbt_line(char *line, struct channel *ch)
 {
-	char line[1024];
 	unsigned int freq;
 	char inv[32];
 	char bw[32];
@@ -309,32 +565,23 @@ get_dvbt_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out)
 	char gi[32];
 	char hier[32];
 	unsigned int id;
-	int len;
+	struct dvb_frontend_parameters *out = &ch->params;
 
-	while(!feof(_channels))
-	{
-		if(fgets(line, sizeof(line), _channels) == NULL
-		|| sscanf(line, "%*[^:]:%u:%32[^:]:%32[^:]:%32[^:]:%32[^:]:%32[^:]:%32[^:]:%32[^:]:%32[^:]:%*[^:]:%*[^:]:%u", &freq, inv, bw, hp, lp, qam, trans, gi, hier, &id) != 10
-		|| id != service_id)
-			continue;
-		/* chop off trailing \n */
-		len = strlen(line) - 1;
-		while(len >= 0 && line[len] == '\n')
-			line[len--] = '\0';
-		verbose("%s", line);
-		out->frequency = freq;
-		out->inversion = str2enum(inv, inversion_list, LIST_SIZE(inversion_list));
-		out->u.ofdm.bandwidth = str2enum(bw, bw_list, LIST_SIZE(bw_list));
-		out->u.ofdm.code_rate_HP = str2enum(hp, fec_list, LIST_SIZE(fec_list));
-		out->u.ofdm.code_rate_LP = str2enum(lp, fec_list, LIST_SIZE(fec_list));
-		out->u.ofdm.constellation = str2enum(qam, qam_list, LIST_SIZE(qam_list));
-		out->u.ofdm.transmission_mode = str2enum(trans, transmissionmode_list, LIST_SIZE(transmissionmode_list));
-		out->u.ofdm.guard_interval = str2enum(gi, guard_list, LIST_SIZE(guard_list));
-		out->u.ofdm.hierarchy_information = str2enum(hier, hierarchy_list, LIST_SIZE(hierarchy_list));
-		return true;
-	}
+	if(sscanf(line, "%*[^:]:%u:%31[^:]:%31[^:]:%31[^:]:%31[^:]:%31[^:]:%31[^:]:%31[^:]:%31[^:]:%*[^:]:%*[^:]:%u", &freq, inv, bw, hp, lp, qam, trans, gi, hier, &id) != 10)
+		return false;
 
-	return false;
+	ch->service_id = id;
+	out->frequency = freq;
+	PARSE_ENUM(out->inversion, inv, inversion_list);
+	PARSE_ENUM(out->u.ofdm.bandwidth, bw, bw_list);
+	PARSE_ENUM(out->u.ofdm.code_rate_HP, hp, fec_list);
+	PARSE_ENUM(out->u.ofdm.code_rate_LP, lp, fec_list);
+	PARSE_ENUM(out->u.ofdm.constellation, qam, qam_list);
+	PARSE_ENUM(out->u.ofdm.transmission_mode, trans, transmissionmode_list);
+	PARSE_ENUM(out->u.ofdm.guard_interval, gi, guard_list);
+	PARSE_ENUM(out->u.ofdm.hierarchy_information, hier, hierarchy_list);
+
+	return true;
 }
 
 /*
@@ -345,33 +592,23 @@ get_dvbt_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out)
  */
 
 static bool
-get_dvbs_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out, char *pol, unsigned int *sat_no)
+parse_dvbs_line(char *line, struct channel *ch)
 {
-	char line[1024];
 	unsigned int freq;
 	unsigned int sr;
 	unsigned int id;
-	int len;
+	struct dvb_frontend_parameters *out = &ch->params;
 
-	while(!feof(_channels))
-	{
-		if(fgets(line, sizeof(line), _channels) == NULL
-		|| sscanf(line, "%*[^:]:%u:%c:%u:%u:%*[^:]:%*[^:]:%u", &freq, pol, sat_no, &sr, &id) != 5
-		|| id != service_id)
-			continue;
-		/* chop off trailing \n */
-		len = strlen(line) - 1;
-		while(len >= 0 && line[len] == '\n')
-			line[len--] = '\0';
-		verbose("%s", line);
-		out->frequency = freq * 1000;
-		out->inversion = INVERSION_AUTO;
-		out->u.qpsk.symbol_rate = sr * 1000;
-		out->u.qpsk.fec_inner = FEC_AUTO;
-		return true;
-	}
+	if(sscanf(line, "%*[^:]:%u:%c:%u:%u:%*[^:]:%*[^:]:%u", &freq, &ch->pol, &ch->sat_no, &sr, &id) != 5)
+		return false;
 
-	return false;
+	ch->service_id = id;
+	out->frequency = freq * 1000;
+	out->inversion = INVERSION_AUTO;
+	out->u.qpsk.symbol_rate = sr * 1000;
+	out->u.qpsk.fec_inner = FEC_AUTO;
+
+	return true;
 }
 
 /*
@@ -382,37 +619,27 @@ get_dvbs_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out, c
  */
 
 static bool
-get_dvbc_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out)
+parse_dvbc_line(char *line, struct channel *ch)
 {
-	char line[1024];
 	unsigned int freq;
 	char inv[32];
 	unsigned int sr;
 	char fec[32];
 	char mod[32];
 	unsigned int id;
-	int len;
+	struct dvb_frontend_parameters *out = &ch->params;
 
-	while(!feof(_channels))
-	{
-		if(fgets(line, sizeof(line), _channels) == NULL
-		|| sscanf(line, "%*[^:]:%u:%32[^:]:%u:%32[^:]:%32[^:]:%*[^:]:%*[^:]:%u", &freq, inv, &sr, fec, mod, &id) != 6
-		|| id != service_id)
-			continue;
-		/* chop off trailing \n */
-		len = strlen(line) - 1;
-		while(len >= 0 && line[len] == '\n')
-			line[len--] = '\0';
-		verbose("%s", line);
-		out->frequency = freq;
-		out->inversion = str2enum(inv, inversion_list, LIST_SIZE(inversion_list));
-		out->u.qam.symbol_rate = sr;
-		out->u.qam.fec_inner = str2enum(fec, fec_list, LIST_SIZE(fec_list));
-		out->u.qam.modulation = str2enum(mod, qam_list, LIST_SIZE(qam_list));
-		return true;
-	}
+	if(sscanf(line, "%*[^:]:%u:%31[^:]:%u:%31[^:]:%31[^:]:%*[^:]:%*[^:]:%u", &freq, inv, &sr, fec, mod, &id) != 6)
+		return false;
 
-	return false;
+	ch->service_id = id;
+	out->frequency = freq;
+	PARSE_ENUM(out->inversion, inv, inversion_list);
+	out->u.qam.symbol_rate = sr;
+	PARSE_ENUM(out->u.qam.fec_inner, fec, fec_list);
+	PARSE_ENUM(out->u.qam.modulation, mod, qam_list);
+
+	return true;
 }
 
 /*
@@ -423,32 +650,22 @@ get_dvbc_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out)
  */
 
 static bool
-get_atsc_tune_params(uint16_t service_id, struct dvb_frontend_parameters *out)
+parse_atsc_line(char *line, struct channel *ch)
 {
-	char line[1024];
 	unsigned int freq;
 	char mod[32];
 	unsigned int id;
-	int len;
+	struct dvb_frontend_parameters *out = &ch->params;
 
-	while(!feof(_channels))
-	{
-		if(fgets(line, sizeof(line), _channels) == NULL
-		|| sscanf(line, "%*[^:]:%u:%32[^:]:%*[^:]:%*[^:]:%u", &freq, mod, &id) != 3
-		|| id != service_id)
-			continue;
-		/* chop off trailing \n */
-		len = strlen(line) - 1;
-		while(len >= 0 && line[len] == '\n')
-			line[len--] = '\0';
-		verbose("%s", line);
-		out->frequency = freq;
-		/* out->inversion is not set by azap */
-		out->u.vsb.modulation = str2enum(mod, qam_list, LIST_SIZE(qam_list));
-		return true;
-	}
+	if(sscanf(line, "%*[^:]:%u:%31[^:]:%*[^:]:%*[^:]:%u", &freq, mod, &id) != 3)
+		return false;
 
-	return false;
+	ch->service_id = id;
+	out->frequency = freq;
+	/* out->inversion is not set by azap */
+	PARSE_ENUM(out->u.vsb.modulation, mod, qam_list);
+
+	return true;
 }
 
 /* DISEQC code from dvbtune, written by Dave Chapman */
@@ -499,58 +716,92 @@ diseqc_send_msg(int fd, fe_sec_voltage_t v, struct diseqc_cmd *cmd, fe_sec_tone_
 }
 
 /*
- * retune to the frequency the given service_id is on
+ * returns the given frontend, opening it the first time
  */
 
-bool
-tune_service_id(unsigned int adapter, unsigned int frontend, unsigned int timeout, uint16_t service_id)
+static struct frontend *
+open_frontend(unsigned int adapter, unsigned int frontend)
 {
 	char fe_dev[PATH_MAX];
-	bool got_info;
-	struct dvb_frontend_info fe_info;
-	struct dvb_frontend_parameters current_params;
-	struct dvb_frontend_parameters needed_params;
-	char polarity;
-	unsigned int sat_no;
-	bool hi_lo;
-	struct dvb_frontend_event event;
-//	fe_status_t status;
-	bool lock;
-	/* need to keep the frontend device open to stop it untuning itself */
-	static int fe_fd = -1;
-	static bool first_time = true;
+	struct frontend *fe;
+	unsigned int i;
 
-	if(fe_fd < 0)
+	for(i=0; i<_nfrontends; i++)
 	{
-		snprintf(fe_dev, sizeof(fe_dev), FE_DEVICE, adapter, frontend);
-		/*
-		 * need O_RDWR if you want to tune, O_RDONLY is okay for getting info
-		 * if someone else is using the frontend, we can only open O_RDONLY
-		 * => we can still download data, but just not retune
-		 */
-		if((fe_fd = open(fe_dev, O_RDWR | O_NONBLOCK)) < 0)
-		{
-			error("Unable to open '%s' read/write; you will not be able to retune", fe_dev);
-			if((fe_fd = open(fe_dev, O_RDONLY | O_NONBLOCK)) < 0)
-				fatal("open '%s': %s", fe_dev, strerror(errno));
-			/* don't try to tune in */
-			first_time = false;
-		}
+		if(_frontends[i].adapter == adapter && _frontends[i].frontend == frontend)
+			return &_frontends[i];
+	}
+
+	_frontends = safe_realloc(_frontends, (_nfrontends + 1) * sizeof(struct frontend));
+	fe = &_frontends[_nfrontends];
+
+	fe->adapter = adapter;
+	fe->frontend = frontend;
+	fe->first_time = true;
+
+	snprintf(fe_dev, sizeof(fe_dev), FE_DEVICE, adapter, frontend);
+	/*
+	 * need O_RDWR if you want to tune, O_RDONLY is okay for getting info
+	 * if someone else is using the frontend, we can only open O_RDONLY
+	 * => we can still download data, but just not retune
+	 */
+	if((fe->fd = open(fe_dev, O_RDWR | O_NONBLOCK)) < 0)
+	{
+		error("Unable to open '%s' read/write; you will not be able to retune", fe_dev);
+		if((fe->fd = open(fe_dev, O_RDONLY | O_NONBLOCK)) < 0)
+			fatal("open '%s': %s", fe_dev, strerror(errno));
+		/* don't try to tune in */
+		fe->first_time = false;
 	}
 
+	_nfrontends ++;
+
+	return fe;
+}
+
+static void
+get_frontend_info(int fe_fd, struct dvb_frontend_info *fe_info)
+{
+	bool got_info;
+
 	vverbose("Getting frontend info");
 
 	do
 	{
 		/* maybe interrupted by a signal */
-		got_info = (ioctl(fe_fd, FE_GET_INFO, &fe_info) >= 0);
+		got_info = (ioctl(fe_fd, FE_GET_INFO, fe_info) >= 0);
 		if(!got_info && errno != EINTR)
 			fatal("ioctl FE_GET_INFO: %s", strerror(errno));
 	}
 	while(!got_info);
 
+	return;
+}
+
+/*
+ * retune to the frequency the given service_id is on
+ */
+
+bool
+tune_service_id(unsigned int adapter, unsigned int frontend, unsigned int timeout, uint16_t service_id)
+{
+	struct frontend *fe;
+	struct dvb_frontend_info fe_info;
+	struct dvb_frontend_parameters current_params;
+	struct dvb_frontend_parameters needed_params;
+	char polarity;
+	unsigned int sat_no;
+	bool hi_lo;
+	struct dvb_frontend_event event;
+//	fe_status_t status;
+	bool lock;
+
+	fe = open_frontend(adapter, frontend);
+
+	get_frontend_info(fe->fd, &fe_info);
+
 	/* see what we are currently tuned to */
-	if(ioctl(fe_fd, FE_GET_FRONTEND, &current_params) < 0)
+	if(ioctl(fe->fd, FE_GET_FRONTEND, &current_params) < 0)
 		fatal("ioctl FE_GET_FRONTEND: %s", strerror(errno));
 
 	/* find the tuning params for the service */
@@ -568,23 +819,23 @@ tune_service_id(unsigned int adapter, unsigned int frontend, unsigned int timeou
 	 * so, always retune the first time we are called
 	 */
 #if 0
-	if(ioctl(fe_fd, FE_READ_STATUS, &status) < 0)
+	if(ioctl(fe->fd, FE_READ_STATUS, &status) < 0)
 		lock = false;
 	else
 		lock = status & FE_HAS_LOCK;
 #endif
 
 	/* are we already tuned to the right frequency */
-	vverbose("Current frequency %u; needed %u; first_time=%d", current_params.frequency, needed_params.frequency, first_time);
+	vverbose("Current frequency %u; needed %u; first_time=%d", current_params.frequency, needed_params.frequency, fe->first_time);
 
 	/* frequency resolution is up to 1 kHz */
-	if(first_time
+	if(fe->first_time
 	|| abs(current_params.frequency - needed_params.frequency) >= ONE_kHz)
 	{
-		first_time = false;
-		verbose("Retuning to frequency %u", needed_params.frequency);
+		fe->first_time = false;
+		verbose("Retuning adapter %u to frequency %u", adapter, needed_params.frequency);
 		/* empty event queue */
-		while(ioctl(fe_fd, FE_GET_EVENT, &event) >= 0)
+		while(ioctl(fe->fd, FE_GET_EVENT, &event) >= 0)
 			; /* do nothing */
 		/* do DISEQC (whatever that is) for DVB-S */
 		if(fe_info.type == FE_QPSK)
@@ -599,11 +850,11 @@ tune_service_id(unsigned int adapter, unsigned int frontend, unsigned int timeou
 				needed_params.frequency -= LOF2;
 				hi_lo = true;
 			}
-			if(do_diseqc(fe_fd, sat_no, polarity, hi_lo) < 0)
+			if(do_diseqc(fe->fd, sat_no, polarity, hi_lo) < 0)
 				error("DISEQC command failed for service_id %u", service_id);
 		}
 		/* tune in */
-		if(ioctl(fe_fd, FE_SET_FRONTEND, &needed_params) < 0)
+		if(ioctl(fe->fd, FE_SET_FRONTEND, &needed_params) < 0)
 			fatal("Unable to retune: ioctl FE_SET_FRONTEND: %s", strerror(errno));
 		/* wait for lock */
 		vverbose("Waiting for tuner to lock on");
@@ -611,7 +862,7 @@ tune_service_id(unsigned int adapter, unsigned int frontend, unsigned int timeou
 		lock = false;
 		while(!lock)
 		{
-			if(ioctl(fe_fd, FE_GET_EVENT, &event) >= 0)
+			if(ioctl(fe->fd, FE_GET_EVENT, &event) >= 0)
 				lock = event.status & FE_HAS_LOCK;
 		}
 		vverbose("Retuned");
@@ -621,29 +872,56 @@ tune_service_id(unsigned int adapter, unsigned int frontend, unsigned int timeou
 }
 
 /*
- * returns true if service_id is listed in the channels file
+ * returns true if the frontend is tuned to the frequency the given service_id is on
+ * only reliable if we have tuned it ourselves, see tune_service_id()
+ */
+
+bool
+service_tuned(unsigned int adapter, unsigned int frontend, uint16_t service_id)
+{
+	struct frontend *fe;
+	struct dvb_frontend_info fe_info;
+	struct dvb_frontend_parameters current_params;
+	struct dvb_frontend_parameters needed_params;
+	char polarity;
+	unsigned int sat_no;
+
+	fe = open_frontend(adapter, frontend);
+
+	get_frontend_info(fe->fd, &fe_info);
+
+	if(ioctl(fe->fd, FE_GET_FRONTEND, &current_params) < 0
+	|| !get_tune_params(fe_info.type, service_id, &needed_params, &polarity, &sat_no))
+		return false;
+
+	/* tune_service_id() gives DVB-S frontends the intermediate frequency */
+	if(fe_info.type == FE_QPSK)
+		needed_params.frequency -= (needed_params.frequency < SLOF) ? LOF1 : LOF2;
+
+	/* same test as tune_service_id() */
+	return abs(current_params.frequency - needed_params.frequency) < ONE_kHz;
+}
+
+/*
+ * returns true if we can retune to service_id
+ * ie the service index says it is on the network,
+ * and it is listed in the channels file or it is on the multiplex we are tuned to
+ * if we have not scanned yet, all we can go on is whether we can tune to it
  */
 
 bool
 service_available(uint16_t service_id)
 {
-	char line[1024];
-	char *p;
-	unsigned long id;
+	check_channels_conf();
+	scan_reload();
 
-	rewind(_channels);
+	if(scan_nservices() != 0
+	&& scan_find(service_id) == NULL)
+		return false;
 
-	while(!feof(_channels))
-	{
-		/* service_id is the last field for all channels.conf file formats */
-		if(fgets(line, sizeof(line), _channels) == NULL
-		|| (p = rindex(line, ':')) == NULL)
-			continue;
-		id = strtoul(p + 1, NULL, 0);
-		if(id == service_id)
-			return true;
-	}
+	if((_listed[service_id / 8] & (1 << (service_id % 8))) != 0)
+		return true;
 
-	return false;
+	return (cache_pmt_pid(service_id) != 0);
 }
 
@@ -29,8 +29,10 @@
 char *zap_name(unsigned int, unsigned int);
 
 bool init_channels_conf(char *, char *);
+void reload_channels_conf(void);
 
 bool tune_service_id(unsigned int, unsigned int, unsigned int, uint16_t);
+bool service_tuned(unsigned int, unsigned int, uint16_t);
 
 bool service_available(uint16_t);
 
@@ -9,20 +9,28 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <poll.h>
 
 #include "command.h"
 #include "findmheg.h"
 #include "assoc.h"
 #include "fs.h"
+#include "objstore.h"
+#include "wanted.h"
+#include "stats.h"
 #include "stream.h"
+#include "tuner.h"
 #include "channels.h"
 #include "utils.h"
 
 /* max number of args that can be passed to a command (arbitrary) */
-#define ARGV_MAX	10
+#define ARGV_MAX	64
 
 /* the commands */
 bool cmd_assoc(struct listen_data *, FILE *, int, char **);
@@ -34,42 +42,62 @@ bool cmd_avstream(struct listen_data *, FILE *, int, char **);
 bool cmd_check(struct listen_data *, FILE *, int, char **);
 bool cmd_file(struct listen_data *, FILE *, int, char **);
 bool cmd_help(struct listen_data *, FILE *, int, char **);
+bool cmd_mfile(struct listen_data *, FILE *, int, char **);
 bool cmd_quit(struct listen_data *, FILE *, int, char **);
 bool cmd_retune(struct listen_data *, FILE *, int, char **);
 bool cmd_service(struct listen_data *, FILE *, int, char **);
+bool cmd_stats(struct listen_data *, FILE *, int, char **);
 bool cmd_vdemux(struct listen_data *, FILE *, int, char **);
 bool cmd_vstream(struct listen_data *, FILE *, int, char **);
+bool cmd_watch(struct listen_data *, FILE *, int, char **);
 
 static struct
 {
 	char *name;
 	char *args;
 	bool (*proc)(struct listen_data *, FILE *, int, char **);
+	bool stream;		/* true if it keeps the connection until the client closes it */
 	char *help;
 } command[] =
 {
-	{ "assoc", "",						cmd_assoc,	"List component tag to PID mappings" },
-	{ "ademux", "[<ServiceID>] <ComponentTag>",		cmd_ademux,	"Demux the given audio component tag" },
-	{ "astream", "[<ServiceID>] <ComponentTag>",		cmd_astream,	"Stream the given audio component tag" },
-	{ "available", "<ServiceID>",				cmd_available,	"Return OK if the ServiceID is available" },
-	{ "avdemux", "[<ServiceID>] <AudioTag> <VideoTag>",	cmd_avdemux,	"Demux the given audio and video component tags" },
-	{ "avstream", "[<ServiceID>] <AudioTag> <VideoTag>",	cmd_avstream,	"Stream the given audio and video component tags" },
-	{ "check", "<ContentReference>",			cmd_check,	"Check if the given file exists on the carousel" },
-	{ "exit", "",						cmd_quit,	"Close the connection" },
-	{ "file", "<ContentReference>",				cmd_file,	"Retrieve the given file from the carousel" },
-	{ "help", "",						cmd_help,	"List available commands" },
-	{ "quit", "",						cmd_quit,	"Close the connection" },
-	{ "retune", "<ServiceID>",				cmd_retune,	"Start downloading the carousel from ServiceID" },
-	{ "service", "",					cmd_service,	"Show the current service ID" },
-	{ "vdemux", "[<ServiceID>] <ComponentTag>",		cmd_vdemux,	"Demux the given video component tag" },
-	{ "vstream", "[<ServiceID>] <ComponentTag>",		cmd_vstream,	"Stream the given video component tag" },
-	{ NULL, NULL, NULL, NULL }
+	{ "assoc", "",						cmd_assoc,	false,	"List component tag to PID mappings" },
+	{ "ademux", "[<ServiceID>] <ComponentTag>",		cmd_ademux,	true,	"Demux the given audio component tag" },
+	{ "astream", "[<ServiceID>] <ComponentTag>",		cmd_astream,	true,	"Stream the given audio component tag" },
+	{ "available", "<ServiceID>",				cmd_available,	false,	"Return OK if the ServiceID is available" },
+	{ "avdemux", "[<ServiceID>] <AudioTag> <VideoTag>",	cmd_avdemux,	true,	"Demux the given audio and video component tags" },
+	{ "avstream", "[<ServiceID>] <AudioTag> <VideoTag>",	cmd_avstream,	true,	"Stream the given audio and video component tags" },
+	{ "check", "<ContentReference>",			cmd_check,	false,	"Check if the given file exists on the carousel" },
+	{ "exit", "",						cmd_quit,	false,	"Close the connection" },
+	{ "file", "<ContentReference>",				cmd_file,	false,	"Retrieve the given file from the carousel" },
+	{ "help", "",						cmd_help,	false,	"List available commands" },
+	{ "mfile", "<ContentReference>...",			cmd_mfile,	false,	"Retrieve each of the given files from the carousel" },
+	{ "quit", "",						cmd_quit,	false,	"Close the connection" },
+	{ "retune", "<ServiceID>",				cmd_retune,	false,	"Start downloading the carousel from ServiceID" },
+	{ "service", "",					cmd_service,	false,	"Show the current service ID" },
+	{ "stats", "",						cmd_stats,	false,	"Show carousel download statistics" },
+	{ "vdemux", "[<ServiceID>] <ComponentTag>",		cmd_vdemux,	true,	"Demux the given video component tag" },
+	{ "vstream", "[<ServiceID>] <ComponentTag>",		cmd_vstream,	true,	"Stream the given video component tag" },
+	{ "watch", "<ContentReference>...",			cmd_watch,	true,	"Wait for the given files to arrive on the carousel" },
+	{ NULL, NULL, NULL, false, NULL }
 };
 
 /* send an OK/error code etc response down client_sock */
 #define SEND_RESPONSE(RC, MESSAGE)	fputs(#RC " " MESSAGE "\n", client)
 
+/* a file on the carousel, either in the object store or the file system */
+struct carousel_file
+{
+	unsigned char *data;		/* copy of it from the object store, NULL if it is not in the object store */
+	FILE *file;			/* if it is not in the object store */
+	uint32_t size;
+};
+
 /* internal routines */
+int check_carousel_file(struct listen_data *, char *);
+int open_carousel_file(struct listen_data *, char *, struct carousel_file *);
+void send_carousel_file(FILE *, struct carousel_file *);
+bool client_closed(FILE *);
+
 char *external_filename(struct listen_data *, char *);
 char *canonical_filename(char *);
 
@@ -130,6 +158,29 @@ process_command(struct listen_data *listen_data, FILE *client, char *cmd)
 	return false;
 }
 
+/*
+ * return true if the given command line will keep the connection until the client closes it
+ * ie it needs a process to itself
+ */
+
+bool
+is_stream_command(char *cmd)
+{
+	unsigned int cmd_len;
+	int i;
+
+	/* length of the command name, it may be abbreviated */
+	cmd_len = strcspn(cmd, " ");
+
+	for(i=0; command[i].name != NULL; i++)
+	{
+		if(strncmp(cmd, command[i].name, cmd_len) == 0)
+			return command[i].stream;
+	}
+
+	return false;
+}
+
 /*
  * the commands
  * listen_data is global data needed by listener commands
@@ -202,6 +253,7 @@ cmd_ademux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 	struct carousel *car = listen_data->carousel;
 	int service;
 	int tag;
+	struct tuner *tuner;
 	struct avstreams *streams;
 	int audio_fd;
 	char hdr[64];
@@ -219,19 +271,28 @@ cmd_ademux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 		tag = strtol(argv[2], NULL, 0);
 	}
 
-	streams = find_avstreams(car, service, tag, -1);
+	/* find a tuner that is receiving the service */
+	if((tuner = tuner_acquire(car, service)) == NULL)
+	{
+		SEND_RESPONSE(500, "No tuner available");
+		return false;
+	}
+
+	streams = find_avstreams(car, tuner, service, tag, -1);
 
 	/* check we have a default stream */
 	if(streams->audio_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve audio PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* add the PID to the demux device */
-	if((audio_fd = add_demux_filter(car->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
+	if((audio_fd = add_demux_filter(tuner->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open audio PID");
+		tuner_release(tuner);
 		return false;
 	}
 
@@ -243,7 +304,7 @@ cmd_ademux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 	fputs(hdr, client);
 
 	/* tell the client where the dvr device is */
-	snprintf(hdr, sizeof(hdr), "Device %s\n", car->dvr_device);
+	snprintf(hdr, sizeof(hdr), "Device %s\n", tuner->dvr_device);
 	fputs(hdr, client);
 
 	fflush(client);
@@ -255,6 +316,7 @@ cmd_ademux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 	/* clean up */
 	ioctl(audio_fd, DMX_STOP);
 	close(audio_fd);
+	tuner_release(tuner);
 
 	/* close the connection */
 	return true;
@@ -275,6 +337,7 @@ cmd_astream(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	struct carousel *car = listen_data->carousel;
 	int service;
 	int tag;
+	struct tuner *tuner;
 	struct avstreams *streams;
 	int audio_fd;
 	int ts_fd;
@@ -293,27 +356,37 @@ cmd_astream(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 		tag = strtol(argv[2], NULL, 0);
 	}
 
-	streams = find_avstreams(car, service, tag, -1);
+	/* find a tuner that is receiving the service */
+	if((tuner = tuner_acquire(car, service)) == NULL)
+	{
+		SEND_RESPONSE(500, "No tuner available");
+		return false;
+	}
+
+	streams = find_avstreams(car, tuner, service, tag, -1);
 
 	/* check we have a default stream */
 	if(streams->audio_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve audio PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* add the PID to the demux device */
-	if((audio_fd = add_demux_filter(car->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
+	if((audio_fd = add_demux_filter(tuner->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open audio PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* we can now read a transport stream from the dvr device */
-	if((ts_fd = open(car->dvr_device, O_RDONLY)) < 0)
+	if((ts_fd = open(tuner->dvr_device, O_RDONLY)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open DVB device");
 		close(audio_fd);
+		tuner_release(tuner);
 		return false;
 	}
 
@@ -331,6 +404,7 @@ cmd_astream(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	ioctl(audio_fd, DMX_STOP);
 	close(audio_fd);
 	close(ts_fd);
+	tuner_release(tuner);
 
 	/* close the connection */
 	return true;
@@ -352,6 +426,7 @@ cmd_vdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 	struct carousel *car = listen_data->carousel;
 	int service;
 	int tag;
+	struct tuner *tuner;
 	struct avstreams *streams;
 	int video_fd;
 	char hdr[64];
@@ -369,19 +444,28 @@ cmd_vdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 		tag = strtol(argv[2], NULL, 0);
 	}
 
-	streams = find_avstreams(car, service, -1, tag);
+	/* find a tuner that is receiving the service */
+	if((tuner = tuner_acquire(car, service)) == NULL)
+	{
+		SEND_RESPONSE(500, "No tuner available");
+		return false;
+	}
+
+	streams = find_avstreams(car, tuner, service, -1, tag);
 
 	/* check we have a default stream */
 	if(streams->video_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve video PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* add the PID to the demux device */
-	if((video_fd = add_demux_filter(car->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
+	if((video_fd = add_demux_filter(tuner->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open video PID");
+		tuner_release(tuner);
 		return false;
 	}
 
@@ -393,7 +477,7 @@ cmd_vdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 	fputs(hdr, client);
 
 	/* tell the client where the dvr device is */
-	snprintf(hdr, sizeof(hdr), "Device %s\n", car->dvr_device);
+	snprintf(hdr, sizeof(hdr), "Device %s\n", tuner->dvr_device);
 	fputs(hdr, client);
 
 	fflush(client);
@@ -405,6 +489,7 @@ cmd_vdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 	/* clean up */
 	ioctl(video_fd, DMX_STOP);
 	close(video_fd);
+	tuner_release(tuner);
 
 	/* close the connection */
 	return true;
@@ -425,6 +510,7 @@ cmd_vstream(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	struct carousel *car = listen_data->carousel;
 	int service;
 	int tag;
+	struct tuner *tuner;
 	struct avstreams *streams;
 	int video_fd;
 	int ts_fd;
@@ -443,27 +529,37 @@ cmd_vstream(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 		tag = strtol(argv[2], NULL, 0);
 	}
 
-	streams = find_avstreams(car, service, -1, tag);
+	/* find a tuner that is receiving the service */
+	if((tuner = tuner_acquire(car, service)) == NULL)
+	{
+		SEND_RESPONSE(500, "No tuner available");
+		return false;
+	}
+
+	streams = find_avstreams(car, tuner, service, -1, tag);
 
 	/* check we have a default stream */
 	if(streams->video_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve video PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* add the PID to the demux device */
-	if((video_fd = add_demux_filter(car->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
+	if((video_fd = add_demux_filter(tuner->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open video PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* we can now read a transport stream from the dvr device */
-	if((ts_fd = open(car->dvr_device, O_RDONLY)) < 0)
+	if((ts_fd = open(tuner->dvr_device, O_RDONLY)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open DVB device");
 		close(video_fd);
+		tuner_release(tuner);
 		return false;
 	}
 
@@ -481,6 +577,7 @@ cmd_vstream(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	ioctl(video_fd, DMX_STOP);
 	close(video_fd);
 	close(ts_fd);
+	tuner_release(tuner);
 
 	/* close the connection */
 	return true;
@@ -502,6 +599,7 @@ cmd_avdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	int service;
 	int audio_tag;
 	int video_tag;
+	struct tuner *tuner;
 	struct avstreams *streams;
 	int audio_fd;
 	int video_fd;
@@ -522,30 +620,41 @@ cmd_avdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 		video_tag = strtol(argv[3], NULL, 0);
 	}
 
-	streams = find_avstreams(car, service, audio_tag, video_tag);
+	/* find a tuner that is receiving the service */
+	if((tuner = tuner_acquire(car, service)) == NULL)
+	{
+		SEND_RESPONSE(500, "No tuner available");
+		return false;
+	}
+
+	streams = find_avstreams(car, tuner, service, audio_tag, video_tag);
 
 	/* check we have a default stream */
 	if(streams->audio_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve audio PID");
+		tuner_release(tuner);
 		return false;
 	}
 	if(streams->video_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve video PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* add the PIDs to the demux device */
-	if((audio_fd = add_demux_filter(car->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
+	if((audio_fd = add_demux_filter(tuner->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open audio PID");
+		tuner_release(tuner);
 		return false;
 	}
-	if((video_fd = add_demux_filter(car->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
+	if((video_fd = add_demux_filter(tuner->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open video PID");
 		close(audio_fd);
+		tuner_release(tuner);
 		return false;
 	}
 
@@ -558,7 +667,7 @@ cmd_avdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	fputs(hdr, client);
 
 	/* tell the client where the dvr device is */
-	snprintf(hdr, sizeof(hdr), "Device %s\n", car->dvr_device);
+	snprintf(hdr, sizeof(hdr), "Device %s\n", tuner->dvr_device);
 	fputs(hdr, client);
 
 	fflush(client);
@@ -572,6 +681,7 @@ cmd_avdemux(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	ioctl(video_fd, DMX_STOP);
 	close(audio_fd);
 	close(video_fd);
+	tuner_release(tuner);
 
 	/* close the connection */
 	return true;
@@ -593,6 +703,7 @@ cmd_avstream(struct listen_data *listen_data, FILE *client, int argc, char *argv
 	int service;
 	int audio_tag;
 	int video_tag;
+	struct tuner *tuner;
 	struct avstreams *streams;
 	int audio_fd;
 	int video_fd;
@@ -614,39 +725,51 @@ cmd_avstream(struct listen_data *listen_data, FILE *client, int argc, char *argv
 		video_tag = strtol(argv[3], NULL, 0);
 	}
 
-	streams = find_avstreams(car, service, audio_tag, video_tag);
+	/* find a tuner that is receiving the service */
+	if((tuner = tuner_acquire(car, service)) == NULL)
+	{
+		SEND_RESPONSE(500, "No tuner available");
+		return false;
+	}
+
+	streams = find_avstreams(car, tuner, service, audio_tag, video_tag);
 
 	/* check we have a default stream */
 	if(streams->audio_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve audio PID");
+		tuner_release(tuner);
 		return false;
 	}
 	if(streams->video_pid == 0)
 	{
 		SEND_RESPONSE(500, "Unable to resolve video PID");
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* add the PIDs to the demux device */
-	if((audio_fd = add_demux_filter(car->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
+	if((audio_fd = add_demux_filter(tuner->demux_device, streams->audio_pid, DMX_PES_AUDIO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open audio PID");
+		tuner_release(tuner);
 		return false;
 	}
-	if((video_fd = add_demux_filter(car->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
+	if((video_fd = add_demux_filter(tuner->demux_device, streams->video_pid, DMX_PES_VIDEO)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open video PID");
 		close(audio_fd);
+		tuner_release(tuner);
 		return false;
 	}
 
 	/* we can now read a transport stream from the dvr device */
-	if((ts_fd = open(car->dvr_device, O_RDONLY)) < 0)
+	if((ts_fd = open(tuner->dvr_device, O_RDONLY)) < 0)
 	{
 		SEND_RESPONSE(500, "Unable to open DVB device");
 		close(audio_fd);
 		close(video_fd);
+		tuner_release(tuner);
 		return false;
 	}
 
@@ -667,6 +790,7 @@ cmd_avstream(struct listen_data *listen_data, FILE *client, int argc, char *argv
 	close(audio_fd);
 	close(video_fd);
 	close(ts_fd);
+	tuner_release(tuner);
 
 	/* close the connection */
 	return true;
@@ -674,7 +798,8 @@ cmd_avstream(struct listen_data *listen_data, FILE *client, int argc, char *argv
 
 /*
  * available <ServiceID>
- * returns 200 OK if ServiceID is listed in the channels.conf file
+ * returns 200 OK if ServiceID is in the service index,
+ * and is listed in the channels.conf file or is on the multiplex we are tuned to
  */
 
 bool
@@ -703,25 +828,21 @@ cmd_available(struct listen_data *listen_data, FILE *client, int argc, char *arg
 bool
 cmd_check(struct listen_data *listen_data, FILE *client, int argc, char *argv[])
 {
-	char *filename;
-	FILE *file;
-
 	CHECK_USAGE(2, "check <ContentReference>");
 
-	if((filename = external_filename(listen_data, argv[1])) == NULL)
-	{
-		SEND_RESPONSE(500, "Invalid ContentReference");
-		return false;
-	}
-
-	if((file = fopen(filename, "r")) != NULL)
+	switch(check_carousel_file(listen_data, argv[1]))
 	{
-		fclose(file);
+	case 200:
 		SEND_RESPONSE(200, "OK");
-	}
-	else
-	{
+		break;
+
+	case 404:
 		SEND_RESPONSE(404, "Not found");
+		break;
+
+	default:
+		SEND_RESPONSE(500, "Invalid ContentReference");
+		break;
 	}
 
 	return false;
@@ -736,64 +857,139 @@ cmd_check(struct listen_data *listen_data, FILE *client, int argc, char *argv[])
 bool
 cmd_file(struct listen_data *listen_data, FILE *client, int argc, char *argv[])
 {
-	char *filename;
-	struct stat info;
-	FILE *file;
-	long size;
+	struct carousel_file file;
 	char hdr[64];
-	long left;
-	size_t nread;
-	char buff[1024 * 8];
 
 	CHECK_USAGE(2, "file <ContentReference>");
 
-	if((filename = external_filename(listen_data, argv[1])) == NULL)
+	switch(open_carousel_file(listen_data, argv[1], &file))
 	{
-		SEND_RESPONSE(500, "Invalid ContentReference");
-		return false;
+	case 200:
+		SEND_RESPONSE(200, "OK");
+		/* send the file length */
+		snprintf(hdr, sizeof(hdr), "Length %u\n", file.size);
+		fputs(hdr, client);
+		/* send the file contents */
+		send_carousel_file(client, &file);
+		break;
+
+	case 404:
+		SEND_RESPONSE(404, "Not found");
+		break;
+
+	default:
+		SEND_RESPONSE(500, "Invalid file");
+		break;
 	}
 
-	/* check it is a regular file */
-	if(stat(filename, &info) < 0
-	|| !S_ISREG(info.st_mode))
+	return false;
+}
+
+/*
+ * mfile <ContentReference> [<ContentReference> ...]
+ * send several files in one go
+ * after the OK code, each ContentReference is either sent as "<n> 200 Length <length>\n<file contents>",
+ * or there is just a "<n> <code>" line if it could not be sent
+ * where n is its position on the command line (starting at 0) and code is 404 or 500
+ * a line containing just "." ends the list
+ */
+
+bool
+cmd_mfile(struct listen_data *listen_data, FILE *client, int argc, char *argv[])
+{
+	struct carousel_file file;
+	int rc;
+	int i;
+
+	if(argc < 2)
 	{
-		SEND_RESPONSE(500, "Invalid file");
+		SEND_RESPONSE(500, "Syntax: mfile <ContentReference> [<ContentReference> ...]");
 		return false;
 	}
 
-	if((file = fopen(filename, "r")) == NULL)
+	SEND_RESPONSE(200, "OK");
+
+	for(i=1; i<argc; i++)
 	{
-		SEND_RESPONSE(404, "Not found");
-		return false;
+		if((rc = open_carousel_file(listen_data, argv[i], &file)) == 200)
+		{
+			fprintf(client, "%d 200 Length %u\n", i - 1, file.size);
+			send_carousel_file(client, &file);
+		}
+		else
+		{
+			fprintf(client, "%d %d\n", i - 1, rc);
+		}
 	}
 
-	/* find the file length */
-	if(fseek(file, 0, SEEK_END) < 0
-	|| (size = ftell(file)) < 0)
+	/* terminator */
+	fprintf(client, ".\n");
+
+	return false;
+}
+
+/*
+ * watch <ContentReference> [<ContentReference> ...]
+ * wait for files that are not on the carousel yet
+ * after the OK code, a "<n> <code>" line is sent as soon as each ContentReference is available,
+ * where n is its position on the command line (starting at 0) and code is 200, or 500 if it is invalid
+ * a line containing just "." is sent when they have all arrived, and the connection is closed
+ * the client can close the connection at any time if it is no longer interested
+ * the downloader wakes us up each time it saves something, so the client doesn't need to poll
+ */
+
+/* how often we check if the client has gone away (ms) */
+#define WATCH_TIMEOUT	1000
+
+bool
+cmd_watch(struct listen_data *listen_data, FILE *client, int argc, char *argv[])
+{
+	bool *done;
+	int left;
+	uint32_t seen;
+	int rc;
+	int i;
+
+	if(argc < 2)
 	{
-		SEND_RESPONSE(500, "Error reading file");
+		SEND_RESPONSE(500, "Syntax: watch <ContentReference> [<ContentReference> ...]");
 		return false;
 	}
-	rewind(file);
 
 	SEND_RESPONSE(200, "OK");
 
-	/* send the file length */
-	snprintf(hdr, sizeof(hdr), "Length %ld\n", size);
-	fputs(hdr, client);
+	done = safe_malloc((argc - 1) * sizeof(bool));
+	for(i=0; i<argc-1; i++)
+		done[i] = false;
+	left = argc - 1;
 
-	/* send the file contents */
-	left = size;
 	while(left > 0)
 	{
-		nread = fread(buff, 1, sizeof(buff), file);
-		fwrite(buff, 1, nread, client);
-		left -= nread;
+		/* read the counter before we look, so we don't miss anything that arrives while we are looking */
+		seen = objstore_changes();
+		for(i=1; i<argc; i++)
+		{
+			if(!done[i - 1]
+			&& (rc = check_carousel_file(listen_data, argv[i])) != 404)
+			{
+				fprintf(client, "%d %d\n", i - 1, rc);
+				done[i - 1] = true;
+				left --;
+			}
+		}
+		fflush(client);
+		if(left == 0 || client_closed(client))
+			break;
+		objstore_wait(seen, WATCH_TIMEOUT);
 	}
 
-	fclose(file);
+	/* terminator */
+	if(left == 0)
+		fprintf(client, ".\n");
 
-	return false;
+	safe_free(done);
+
+	return true;
 }
 
 /*
@@ -819,6 +1015,8 @@ cmd_retune(struct listen_data *listen_data, FILE *client, int argc, char *argv[]
 		/* send a SIGHUP to the main listener process */
 		value.sival_int = service_id;
 		sigqueue(getppid(), SIGHUP, value);
+		/* make sure new connections get the new carousel before we say OK */
+		wait_for_retune();
 	}
 
 	SEND_RESPONSE(200, "OK");
@@ -845,6 +1043,24 @@ cmd_service(struct listen_data *listen_data, FILE *client, int argc, char *argv[
 	return false;
 }
 
+/*
+ * stats
+ * show the section rates, module progress etc of the current download
+ */
+
+bool
+cmd_stats(struct listen_data *listen_data, FILE *client, int argc, char *argv[])
+{
+	SEND_RESPONSE(200, "OK");
+
+	stats_dump(client);
+
+	/* terminator */
+	fprintf(client, ".\n");
+
+	return false;
+}
+
 /*
  * help
  */
@@ -878,6 +1094,185 @@ cmd_quit(struct listen_data *listen_data, FILE *client, int argc, char *argv[])
 	return true;
 }
 
+/*
+ * the browser is waiting for a file we haven't got yet
+ * if we know which module it is in, ask the downloader to get that module next
+ */
+
+static void
+want_carousel_file(char *filename)
+{
+	uint32_t download_id;
+	uint16_t module_id;
+
+	if(fs_missing_module(filename, &download_id, &module_id))
+	{
+		vverbose("Want module %u for '%s'", module_id, filename);
+		wanted_add(download_id, module_id);
+	}
+
+	return;
+}
+
+/*
+ * returns 200 if the ContentReference is on the carousel, 404 if not, 500 if it is invalid
+ */
+
+int
+check_carousel_file(struct listen_data *listen_data, char *cref)
+{
+	char *filename;
+	FILE *file;
+	uint32_t epoch;
+
+	if((filename = external_filename(listen_data, cref)) == NULL)
+		return 500;
+
+	/* try the object store first, it saves going to the file system */
+	epoch = objstore_epoch();
+	if(objstore_find(filename, epoch) != NULL
+	&& objstore_valid(epoch))
+		return 200;
+
+	if((file = fopen(filename, "r")) != NULL)
+	{
+		fclose(file);
+		return 200;
+	}
+
+	want_carousel_file(filename);
+
+	return 404;
+}
+
+/*
+ * returns 200 if the ContentReference is a file on the carousel and fills in file
+ * returns 404 if it does not exist, 500 if it is invalid or not a regular file
+ * if it returns 200, you must call send_carousel_file
+ */
+
+int
+open_carousel_file(struct listen_data *listen_data, char *cref, struct carousel_file *file)
+{
+	char *filename;
+	struct stat info;
+	struct objstore_entry *obj;
+	uint32_t epoch;
+
+	if((filename = external_filename(listen_data, cref)) == NULL)
+		return 500;
+
+	/*
+	 * if the object store has it, we can send it from memory
+	 * take a copy, the store may be reset before we have sent it all
+	 */
+	file->data = NULL;
+	epoch = objstore_epoch();
+	if((obj = objstore_find(filename, epoch)) != NULL)
+	{
+		if(obj->type != OBJSTORE_FILE && objstore_valid(epoch))
+			return 500;
+		if(obj->type == OBJSTORE_FILE
+		&& (file->data = objstore_copy(obj, epoch, &file->size)) != NULL)
+		{
+			file->file = NULL;
+			return 200;
+		}
+		/* it changed under us, use the file system */
+	}
+
+	/* check it is a regular file */
+	if(stat(filename, &info) < 0)
+	{
+		want_carousel_file(filename);
+		return 500;
+	}
+	if(!S_ISREG(info.st_mode))
+		return 500;
+
+	if((file->file = fopen(filename, "r")) == NULL)
+		return 404;
+
+	file->size = info.st_size;
+
+	return 200;
+}
+
+/*
+ * send the file contents and close it
+ * if we can't read it all, pad it with 0's so the client still gets the length we told it
+ */
+
+void
+send_carousel_file(FILE *client, struct carousel_file *file)
+{
+	uint32_t left;
+	size_t nread;
+	ssize_t nsent;
+	off_t offset;
+	char buff[1024 * 8];
+
+	if(file->data != NULL)
+	{
+		fwrite(file->data, 1, file->size, client);
+		safe_free(file->data);
+		return;
+	}
+
+	/* let the kernel copy the file straight into the socket */
+	fflush(client);
+	offset = 0;
+	left = file->size;
+	while(left > 0)
+	{
+		nsent = sendfile(fileno(client), fileno(file->file), &offset, left);
+		if(nsent < 0 && errno == EINTR)
+			continue;
+		if(nsent <= 0)
+			break;
+		left -= nsent;
+	}
+
+	/* if sendfile() failed or the file got shorter, send the rest the slow way */
+	if(left > 0)
+		fseeko(file->file, offset, SEEK_SET);
+	while(left > 0)
+	{
+		if((nread = fread(buff, 1, MIN(left, sizeof(buff)), file->file)) == 0)
+		{
+			nread = MIN(left, sizeof(buff));
+			bzero(buff, nread);
+		}
+		fwrite(buff, 1, nread, client);
+		left -= nread;
+	}
+
+	fclose(file->file);
+
+	return;
+}
+
+/*
+ * returns true if the client has closed the connection
+ * any data it has sent is ignored
+ */
+
+bool
+client_closed(FILE *client)
+{
+	struct pollfd pfd;
+	char c;
+
+	pfd.fd = fileno(client);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	if(poll(&pfd, 1, 0) <= 0)
+		return false;
+
+	return (recv(pfd.fd, &c, 1, MSG_DONTWAIT) <= 0);
+}
+
 /*
  * return a filename that can be used to load the given ContentReference from the filesystem
  * returns a static string that will be overwritten by the next call to this routine
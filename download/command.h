@@ -7,6 +7,10 @@
 
 #include "listen.h"
 
+/* max length of a command line, mfile and watch can have a lot of arguments */
+#define MAX_COMMAND_LEN	(8 * 1024)
+
 bool process_command(struct listen_data *, FILE *, char *);
+bool is_stream_command(char *);
 
 #endif
@@ -93,6 +93,61 @@ DII_module(struct DownloadInfoIndication *dii, uint16_t n)
 	return (struct DIIModule *) &byte[offset];
 }
 
+/*
+ * returns the original_size from the compressed_module_descriptor in the module's BIOP::ModuleInfo
+ * returns 0 if the module does not have one (ie it is not compressed)
+ */
+
+uint32_t
+DIIModule_originalSize(struct DIIModule *mod)
+{
+	unsigned char *byte = ((unsigned char *) mod) + sizeof(struct DIIModule);
+	unsigned int offset;
+	unsigned int taps_count;
+	unsigned int user_end;
+	uint8_t tag;
+	uint8_t len;
+
+	/* skip moduleTimeOut, blockTimeOut, minBlockTime */
+	offset = 12;
+	if(offset >= mod->moduleInfoLength)
+		return 0;
+
+	/* skip the taps */
+	taps_count = byte[offset ++];
+	while(taps_count != 0)
+	{
+		taps_count --;
+		/* id, use, association_tag */
+		offset += 6;
+		if(offset >= mod->moduleInfoLength)
+			return 0;
+		/* selector */
+		offset += 1 + byte[offset];
+	}
+	if(offset >= mod->moduleInfoLength)
+		return 0;
+
+	/* userInfo is a descriptor loop */
+	user_end = offset + 1 + byte[offset];
+	offset ++;
+	if(user_end > mod->moduleInfoLength)
+		user_end = mod->moduleInfoLength;
+
+	while(offset + 2 <= user_end)
+	{
+		tag = byte[offset];
+		len = byte[offset + 1];
+		offset += 2;
+		/* compression_method, original_size */
+		if(tag == DESC_COMPRESSED_MODULE && len >= 5 && offset + 5 <= user_end)
+			return (byte[offset + 1] << 24) | (byte[offset + 2] << 16) | (byte[offset + 3] << 8) | byte[offset + 4];
+		offset += len;
+	}
+
+	return 0;
+}
+
 /*
  * returns the number of bytes of data in the DDB block
  */
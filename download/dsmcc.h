@@ -104,9 +104,13 @@ struct DIIModule
 	/* uint8_t moduleInfoByte[moduleInfoLength] */
 } __attribute__((__packed__));
 
+/* descriptor in the moduleInfo userInfo saying the module is compressed */
+#define DESC_COMPRESSED_MODULE	0x09
+
 /* helper functions */
 uint16_t DII_numberOfModules(struct DownloadInfoIndication *);
 struct DIIModule *DII_module(struct DownloadInfoIndication *, uint16_t);
+uint32_t DIIModule_originalSize(struct DIIModule *);
 
 /*
  * DownloadDataBlock message
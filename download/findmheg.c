@@ -30,6 +30,7 @@
 #include "findmheg.h"
 #include "table.h"
 #include "assoc.h"
+#include "cache.h"
 #include "utils.h"
 
 /* stream_types we are interested in */
@@ -74,8 +75,12 @@ struct data_broadcast_id_descriptor
 #define UK_APPLICATION_TYPE_CODE	0x0101
 #define NZ_APPLICATION_TYPE_CODE	0x0505
 
+static void init_carousel(struct carousel *, unsigned int, uint16_t);
+static void read_carousel_pmt(struct carousel *, unsigned char *, int);
+static void free_carousel(struct carousel *);
+
 static struct avstreams *find_current_avstreams(struct carousel *, int, int);
-static struct avstreams *find_service_avstreams(struct carousel *, int, int, int);
+static struct avstreams *find_service_avstreams(struct carousel *, struct tuner *, int, int, int);
 
 bool
 is_audio_stream(uint8_t stream_type)
@@ -104,41 +109,14 @@ find_mheg(unsigned int adapter, unsigned int demux, unsigned int dvr, unsigned i
 {
 	unsigned char pmt[MAX_TABLE_LEN];
 	unsigned char *sdt = pmt;
-	uint16_t section_length;
-	uint16_t offset;
-	uint8_t stream_type;
-	uint16_t elementary_pid;
-	uint16_t info_length;
-	uint8_t desc_tag;
-	uint8_t desc_length;
-	uint16_t component_tag;
-	int desc_boot_pid;
-	int desc_carousel_id;
 
 	/* carousel data we know so far */
 	snprintf(_car.demux_device, sizeof(_car.demux_device), DEMUX_DEVICE, adapter, demux);
 	snprintf(_car.dvr_device, sizeof(_car.dvr_device), DVR_DEVICE, adapter, dvr);
-	_car.timeout = timeout;
-	_car.service_id = service_id;
+	init_carousel(&_car, timeout, service_id);
 
-	/* unknown */
-	_car.network_id = 0;
-	_car.carousel_id = 0;
-	_car.boot_pid = 0;
-	_car.audio_pid = 0;
-	_car.audio_type = 0;
-	_car.video_pid = 0;
-	_car.video_type = 0;
-	_car.current_pid = 0;
-	/* map between stream_id_descriptors and elementary_PIDs */
-	init_assoc(&_car.assoc);
-	/* no PIDs yet */
-	_car.npids = 0;
-	_car.pids = NULL;
-	/* no modules loaded yet */
-	_car.got_dsi = false;
-	_car.nmodules = 0;
-	_car.modules = NULL;
+	/* read the SDT, PAT and PMT at the same time, the reads below then find them in the cache */
+	read_psi(_car.demux_device, timeout, service_id, false);
 
 	/* find the original_network_id from the SDT */
 	if(!read_sdt(_car.demux_device, timeout, sdt, 0))
@@ -150,6 +128,199 @@ find_mheg(unsigned int adapter, unsigned int demux, unsigned int dvr, unsigned i
 	if(!read_pmt(_car.demux_device, service_id, timeout, pmt))
 		fatal("Unable to read PMT");
 
+	read_carousel_pmt(&_car, pmt, carousel_id);
+
+	/* did we find a DSM-CC stream */
+	if(_car.npids == 0)
+		fatal("Unable to find Carousel Descriptor in PMT");
+
+	return &_car;
+}
+
+/*
+ * add the carousels of all the other MHEG services on car's multiplex to car's group
+ * the downloader reads the PIDs for all of them at once
+ * if a service uses a carousel we already have, it is just added to that carousel's services
+ */
+
+void
+find_mux_mheg(struct carousel *car)
+{
+	uint16_t services[CACHE_MAX_SERVICES];
+	unsigned int nservices;
+	unsigned char pmt[MAX_TABLE_LEN];
+	struct carousel *new_car;
+	struct carousel *member;
+	struct carousel *last;
+	unsigned int i;
+
+	/* read all the PMTs at the same time, so read_pmt() below finds them in the cache */
+	read_psi(car->demux_device, car->timeout, car->service_id, true);
+
+	/* read_pmt() has already put the PAT in the cache for us */
+	nservices = cache_services(services, CACHE_MAX_SERVICES);
+
+	/* add new carousels to the end of the group */
+	for(last=car; last->next!=NULL; last=last->next)
+		;
+
+	for(i=0; i<nservices; i++)
+	{
+		if(services[i] == car->service_id)
+			continue;
+		/* not fatal, it may just not be running at the moment */
+		if(!read_pmt(car->demux_device, services[i], car->timeout, pmt))
+			continue;
+		new_car = safe_malloc(sizeof(struct carousel));
+		memcpy(new_car->demux_device, car->demux_device, sizeof(new_car->demux_device));
+		memcpy(new_car->dvr_device, car->dvr_device, sizeof(new_car->dvr_device));
+		init_carousel(new_car, car->timeout, services[i]);
+		new_car->network_id = car->network_id;
+		/* so add_dsmcc_pid() knows if someone else is already reading a PID */
+		new_car->group = car;
+		new_car->group_index = last->group_index + 1;
+		read_carousel_pmt(new_car, pmt, -1);
+		/* is it an MHEG service */
+		if(new_car->npids == 0)
+		{
+			free_carousel(new_car);
+			continue;
+		}
+		/* is it a carousel we are already downloading */
+		for(member=car; member!=NULL; member=member->next)
+		{
+			if(member->boot_pid == new_car->boot_pid
+			&& member->carousel_id == new_car->carousel_id)
+				break;
+		}
+		if(member != NULL)
+		{
+			vverbose("service_id %u uses the same carousel as service_id %u", services[i], member->service_id);
+			member->services = safe_realloc(member->services, (member->nservices + 1) * sizeof(uint16_t));
+			member->services[member->nservices ++] = services[i];
+			free_carousel(new_car);
+			continue;
+		}
+		verbose("Also downloading carousel %u on PID %u for service_id %u", new_car->carousel_id, new_car->boot_pid, services[i]);
+		last->next = new_car;
+		last = new_car;
+	}
+
+	return;
+}
+
+/*
+ * the listener process doesn't read the carousels, the downloader does
+ * so once the downloader has been forked, the listener can close the section filters
+ * and forget about the rest of the group
+ */
+
+void
+release_mux_mheg(struct carousel *car)
+{
+	struct carousel *member;
+	struct carousel *next;
+
+	for(member=car->next; member!=NULL; member=next)
+	{
+		next = member->next;
+		free_carousel(member);
+	}
+	car->next = NULL;
+
+	close_dsmcc_pids(car);
+
+	safe_free(car->services);
+	car->services = NULL;
+	car->nservices = 0;
+
+	return;
+}
+
+/*
+ * init the fields we don't know yet
+ * the demux and dvr devices must already be set
+ */
+
+static void
+init_carousel(struct carousel *car, unsigned int timeout, uint16_t service_id)
+{
+	car->timeout = timeout;
+	car->service_id = service_id;
+
+	/* unknown */
+	car->downloader = 0;
+	car->network_id = 0;
+	car->carousel_id = 0;
+	car->boot_pid = 0;
+	car->audio_pid = 0;
+	car->audio_type = 0;
+	car->video_pid = 0;
+	car->video_type = 0;
+	car->current_pid = 0;
+	/* map between stream_id_descriptors and elementary_PIDs */
+	init_assoc(&car->assoc);
+	/* no PIDs yet */
+	car->npids = 0;
+	car->pids = NULL;
+	/* created by the downloader process when it starts reading */
+	car->epoll_fd = -1;
+	car->sections = NULL;
+	/* on our own until find_mux_mheg() adds other carousels */
+	car->group = car;
+	car->next = NULL;
+	car->group_index = 0;
+	car->nservices = 0;
+	car->services = NULL;
+	/* no modules loaded yet */
+	car->got_dsi = false;
+	car->dsi_transaction_id = 0;
+	car->ndiis = 0;
+	car->diis = NULL;
+	car->npriorities = 0;
+	car->priorities = NULL;
+	car->nmodules = 0;
+	bzero(car->modules, sizeof(car->modules));
+	car->stats = NULL;
+
+	return;
+}
+
+static void
+free_carousel(struct carousel *car)
+{
+	unsigned int i;
+
+	close_dsmcc_pids(car);
+	safe_free(car->services);
+	for(i=0; i<car->ndiis; i++)
+		safe_free(car->diis[i].module_ids);
+	safe_free(car->diis);
+	safe_free(car->priorities);
+	safe_free(car);
+
+	return;
+}
+
+/*
+ * fill in the PIDs etc from the service's PMT
+ * car->npids will still be 0 if it does not have a DSM-CC stream
+ */
+
+static void
+read_carousel_pmt(struct carousel *car, unsigned char *pmt, int carousel_id)
+{
+	uint16_t section_length;
+	uint16_t offset;
+	uint8_t stream_type;
+	uint16_t elementary_pid;
+	uint16_t info_length;
+	uint8_t desc_tag;
+	uint8_t desc_length;
+	uint16_t component_tag;
+	int desc_boot_pid;
+	int desc_carousel_id;
+
 	section_length = 3 + (((pmt[1] & 0x0f) << 8) + pmt[2]);
 
 	/* skip the program_info descriptors */
@@ -169,8 +340,8 @@ find_mheg(unsigned int adapter, unsigned int demux, unsigned int dvr, unsigned i
 		/* is it the default video stream for this service */
 		if(stream_type == STREAM_TYPE_VIDEO_MPEG2)
 		{
-			_car.video_pid = elementary_pid;
-			_car.video_type = stream_type;
+			car->video_pid = elementary_pid;
+			car->video_type = stream_type;
 			vverbose("PID=%u video stream_type=0x%x", elementary_pid, stream_type);
 		}
 		/* it's not the boot PID yet */
@@ -227,7 +398,7 @@ find_mheg(unsigned int adapter, unsigned int demux, unsigned int dvr, unsigned i
 				desc = (struct stream_id_descriptor *) &pmt[offset];
 				component_tag = desc->component_tag;
 				vverbose("PID=%u component_tag=%u", elementary_pid, component_tag);
-				add_assoc(&_car.assoc, elementary_pid, desc->component_tag, stream_type);
+				add_assoc(&car->assoc, elementary_pid, desc->component_tag, stream_type);
 			}
 			else if(desc_tag == TAG_LANGUAGE_DESCRIPTOR && is_audio_stream(stream_type))
 			{
@@ -236,8 +407,8 @@ find_mheg(unsigned int adapter, unsigned int demux, unsigned int dvr, unsigned i
 				/* only remember the normal audio stream (not visually impaired stream) */
 				if(desc->audio_type == 0)
 				{
-					_car.audio_pid = elementary_pid;
-					_car.audio_type = stream_type;
+					car->audio_pid = elementary_pid;
+					car->audio_type = stream_type;
 					vverbose("PID=%u audio stream_type=0x%x", elementary_pid, stream_type);
 				}
 			}
@@ -253,28 +424,76 @@ find_mheg(unsigned int adapter, unsigned int demux, unsigned int dvr, unsigned i
 		if(desc_boot_pid != -1)
 		{
 			vverbose("Set boot_pid=%u carousel_id=%u", desc_boot_pid, desc_carousel_id);
-			_car.carousel_id = desc_carousel_id;
-			_car.boot_pid = desc_boot_pid;
-			add_dsmcc_pid(&_car, desc_boot_pid);
+			car->carousel_id = desc_carousel_id;
+			car->boot_pid = desc_boot_pid;
+			add_dsmcc_pid(car, desc_boot_pid);
 		}
 	}
 
-	/* did we find a DSM-CC stream */
-	if(_car.npids == 0)
-		fatal("Unable to find Carousel Descriptor in PMT");
+	return;
+}
 
-	return &_car;
+/*
+ * returns true if the PMT has a DSM-CC stream with an MHEG boot PID
+ * ie the same test read_carousel_pmt() uses, without adding any PIDs
+ */
+
+bool
+pmt_has_mheg(unsigned char *pmt)
+{
+	uint16_t section_length;
+	uint16_t offset;
+	uint16_t info_length;
+	uint8_t desc_tag;
+	uint8_t desc_length;
+	struct data_broadcast_id_descriptor *desc;
+
+	section_length = 3 + (((pmt[1] & 0x0f) << 8) + pmt[2]);
+
+	/* skip the program_info descriptors */
+	offset = 10;
+	info_length = ((pmt[offset] & 0x0f) << 8) + pmt[offset+1];
+	offset += 2 + info_length;
+
+	while(offset + 5 <= section_length - 4)
+	{
+		/* skip the stream_type and elementary_PID */
+		offset += 3;
+		info_length = ((pmt[offset] & 0x0f) << 8) + pmt[offset+1];
+		offset += 2;
+		while(info_length >= 2 && offset + 2 <= section_length - 4)
+		{
+			desc_tag = pmt[offset];
+			desc_length = pmt[offset+1];
+			offset += 2;
+			info_length -= 2;
+			desc = (struct data_broadcast_id_descriptor *) &pmt[offset];
+			if(desc_tag == TAG_DATA_BROADCAST_ID_DESCRIPTOR
+			&& desc_length >= sizeof(desc->data_broadcast_id)
+			&& ntohs(desc->data_broadcast_id) == DATA_BROADCAST_ID)
+				return true;
+			offset += desc_length;
+			info_length -= MIN(info_length, desc_length);
+		}
+		offset += info_length;
+	}
+
+	return false;
 }
 
 static struct avstreams _streams;
 
+/*
+ * tuner is the one we will stream service_id from
+ */
+
 struct avstreams *
-find_avstreams(struct carousel *car, int service_id, int audio_tag, int video_tag)
+find_avstreams(struct carousel *car, struct tuner *tuner, int service_id, int audio_tag, int video_tag)
 {
 	if(service_id == -1)
 		return find_current_avstreams(car, audio_tag, video_tag);
 	else
-		return find_service_avstreams(car, service_id, audio_tag, video_tag);
+		return find_service_avstreams(car, tuner, service_id, audio_tag, video_tag);
 }
 
 static struct avstreams *
@@ -309,7 +528,7 @@ find_current_avstreams(struct carousel *car, int audio_tag, int video_tag)
 }
 
 static struct avstreams *
-find_service_avstreams(struct carousel *car, int service_id, int audio_tag, int video_tag)
+find_service_avstreams(struct carousel *car, struct tuner *tuner, int service_id, int audio_tag, int video_tag)
 {
 	unsigned char pmt[MAX_TABLE_LEN];
 	uint16_t section_length;
@@ -320,14 +539,19 @@ find_service_avstreams(struct carousel *car, int service_id, int audio_tag, int
 	uint8_t desc_tag;
 	uint8_t desc_length;
 	uint16_t component_tag;
+	bool rc;
 
 	verbose("find_service_avstreams: %d %d %d", service_id, audio_tag, video_tag);
 
 	/* in case we don't find them */
 	bzero(&_streams, sizeof(_streams));
 
-	/* get the PMT */
-	if(!read_pmt(car->demux_device, service_id, car->timeout, pmt))
+	/* get the PMT, only the main tuner is on the multiplex the cache has the tables for */
+	if(tuner->main)
+		rc = read_pmt(car->demux_device, service_id, car->timeout, pmt);
+	else
+		rc = read_uncached_pmt(tuner->demux_device, service_id, car->timeout, pmt);
+	if(!rc)
 		fatal("Unable to read PMT");
 
 	section_length = 3 + (((pmt[1] & 0x0f) << 8) + pmt[2]);
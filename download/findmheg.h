@@ -24,6 +24,9 @@
 #define __FINDMHEG_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "tuner.h"
 
 struct avstreams
 {
@@ -34,8 +37,12 @@ struct avstreams
 };
 
 struct carousel *find_mheg(unsigned int, unsigned int, unsigned int, unsigned int, uint16_t, int);
+void find_mux_mheg(struct carousel *);
+void release_mux_mheg(struct carousel *);
+
+bool pmt_has_mheg(unsigned char *);
 
-struct avstreams *find_avstreams(struct carousel *, int, int, int);
+struct avstreams *find_avstreams(struct carousel *, struct tuner *, int, int, int);
 
 #endif	/* __FINDMHEG_H__ */
 
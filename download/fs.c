@@ -9,6 +9,10 @@
  * (the sym links maybe dangling if we have not downloaded all the files yet)
  *
  * we also create a symlink that points to the Service Gateway dir
+ *
+ * when a module is updated, any of its files that are not in the new version are removed,
+ * as are any links in its directories that the new version does not list
+ * when a module is removed from the carousel, all its files are removed
  */
 
 /*
@@ -33,17 +37,340 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdbool.h>
 #include <errno.h>
 #include <limits.h>
+#include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include "fs.h"
+#include "objstore.h"
+#include "stats.h"
 #include "biop.h"
 #include "utils.h"
 
 static char _carousel_root[PATH_MAX];
 
+/*
+ * files and links are created with NEW_SUFFIX on the end of their name, then renamed
+ * so anyone reading them never sees half a file, or a missing link
+ * while a module is being processed, the renames are saved up until fs_commit_update()
+ * so a module that fails to process doesn't replace anything,
+ * and the object store sees all the objects in the module change at once
+ */
+
+#define NEW_SUFFIX	".new"
+
+struct pending_object
+{
+	char *name;	/* final name, the file is currently called name NEW_SUFFIX */
+	bool link;	/* links are renamed after files, so they don't point to something that isn't there yet */
+	bool dir;	/* directories are not renamed, but we remove anything in them that was not in the update */
+};
+
+static bool _in_update = false;
+static uint16_t _update_pid;		/* the module we are updating */
+static uint32_t _update_cid;
+static uint16_t _update_module;
+static struct pending_object *_pending = NULL;
+static unsigned int _npending = 0;
+
+static void add_pending(char *, bool, bool);
+static bool is_pending(char *);
+static void publish_object(char *, bool);
+static void rename_object(char *);
+static char *new_name(char *);
+static void remove_stale_objects(void);
+static void remove_object(char *);
+static char *relative_target(char *, char *);
+
+/*
+ * the objects in the given module are about to be saved
+ */
+
+void
+fs_begin_update(uint16_t elementary_pid, uint32_t carousel_id, uint16_t module_id)
+{
+	_in_update = true;
+	_update_pid = elementary_pid;
+	_update_cid = carousel_id;
+	_update_module = module_id;
+	_npending = 0;
+
+	objstore_begin();
+
+	return;
+}
+
+void
+fs_commit_update(void)
+{
+	unsigned int i;
+
+	_in_update = false;
+
+	/* files and directories first, then the links that point to them */
+	for(i=0; i<_npending; i++)
+	{
+		if(!_pending[i].link && !_pending[i].dir)
+			rename_object(_pending[i].name);
+	}
+	for(i=0; i<_npending; i++)
+	{
+		if(_pending[i].link)
+			rename_object(_pending[i].name);
+	}
+
+	/* get rid of anything the old version of the module had that the new one does not */
+	remove_stale_objects();
+
+	for(i=0; i<_npending; i++)
+		safe_free(_pending[i].name);
+	_npending = 0;
+
+	objstore_commit();
+
+	return;
+}
+
+void
+fs_abort_update(void)
+{
+	unsigned int i;
+
+	_in_update = false;
+
+	for(i=0; i<_npending; i++)
+	{
+		if(!_pending[i].dir)
+			unlink(new_name(_pending[i].name));
+		safe_free(_pending[i].name);
+	}
+	_npending = 0;
+
+	objstore_abort();
+
+	return;
+}
+
+static void
+add_pending(char *name, bool link, bool dir)
+{
+	_pending = safe_realloc(_pending, (_npending + 1) * sizeof(struct pending_object));
+	_pending[_npending].name = safe_malloc(strlen(name) + 1);
+	strcpy(_pending[_npending].name, name);
+	_pending[_npending].link = link;
+	_pending[_npending].dir = dir;
+	_npending ++;
+
+	return;
+}
+
+/*
+ * returns true if name has been saved in the current update
+ */
+
+static bool
+is_pending(char *name)
+{
+	unsigned int i;
+
+	for(i=0; i<_npending; i++)
+	{
+		if(strcmp(_pending[i].name, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * name has been created as name NEW_SUFFIX
+ * rename it now, or when the update is committed
+ */
+
+static void
+publish_object(char *name, bool link)
+{
+	if(!_in_update)
+		rename_object(name);
+	else
+		add_pending(name, link, false);
+
+	return;
+}
+
+static void
+rename_object(char *name)
+{
+	char *tmpname;
+
+	tmpname = new_name(name);
+
+	/* this replaces any old version in one go */
+	if(rename(tmpname, name) < 0)
+		error("Unable to rename '%s' to '%s': %s", tmpname, name, strerror(errno));
+
+	return;
+}
+
+/*
+ * returns name NEW_SUFFIX
+ * returns a static string that will be overwritten by the next call to this function
+ */
+
+static char _new_name[PATH_MAX];
+
+static char *
+new_name(char *name)
+{
+	if(snprintf(_new_name, sizeof(_new_name), "%s%s", name, NEW_SUFFIX) >= (int) sizeof(_new_name))
+		fatal("File name too long: '%s'", name);
+
+	return _new_name;
+}
+
+/*
+ * called when an update is committed
+ * removes the files in the module we are updating that were not saved in this update,
+ * and the links in its directories that were not saved in this update
+ */
+
+static void
+remove_stale_objects(void)
+{
+	char root[PATH_MAX];
+	char name[PATH_MAX];
+	DIR *dir;
+	struct dirent *ent;
+	unsigned int module_id;
+	unsigned int i;
+
+	/* files are called <kind>-<module>-<key> */
+	snprintf(root, sizeof(root), "%s/%u/%u", CAROUSELS_DIR, _update_pid, _update_cid);
+	if((dir = opendir(root)) != NULL)
+	{
+		while((ent = readdir(dir)) != NULL)
+		{
+			if(sscanf(ent->d_name, "%*[^-]-%u-", &module_id) != 1
+			|| module_id != _update_module
+			|| snprintf(name, sizeof(name), "%s/%s", root, ent->d_name) >= (int) sizeof(name))
+				continue;
+			if(!is_pending(name))
+				remove_object(name);
+		}
+		closedir(dir);
+	}
+
+	/* links in the directories the new version of the module has */
+	for(i=0; i<_npending; i++)
+	{
+		if(!_pending[i].dir
+		|| (dir = opendir(_pending[i].name)) == NULL)
+			continue;
+		while((ent = readdir(dir)) != NULL)
+		{
+			if(strcmp(ent->d_name, ".") == 0
+			|| strcmp(ent->d_name, "..") == 0
+			|| snprintf(name, sizeof(name), "%s/%s", _pending[i].name, ent->d_name) >= (int) sizeof(name))
+				continue;
+			if(!is_pending(name))
+			{
+				unlink(name);
+				objstore_remove(name);
+				verbose("Removed directory entry '%s'", name);
+			}
+		}
+		closedir(dir);
+	}
+
+	return;
+}
+
+/*
+ * remove a file, or a directory and the links in it
+ * and stop the object store returning any copy it has of them
+ */
+
+static void
+remove_object(char *path)
+{
+	char name[PATH_MAX];
+	struct stat info;
+	DIR *dir;
+	struct dirent *ent;
+
+	if(lstat(path, &info) == 0
+	&& S_ISDIR(info.st_mode)
+	&& (dir = opendir(path)) != NULL)
+	{
+		while((ent = readdir(dir)) != NULL)
+		{
+			if(strcmp(ent->d_name, ".") == 0
+			|| strcmp(ent->d_name, "..") == 0
+			|| snprintf(name, sizeof(name), "%s/%s", path, ent->d_name) >= (int) sizeof(name))
+				continue;
+			unlink(name);
+			objstore_remove(name);
+		}
+		closedir(dir);
+		if(rmdir(path) < 0)
+			error("Unable to remove directory '%s': %s", path, strerror(errno));
+	}
+	else if(unlink(path) < 0 && errno != ENOENT)
+	{
+		error("Unable to remove '%s': %s", path, strerror(errno));
+	}
+
+	objstore_remove(path);
+
+	verbose("Removed '%s'", path);
+
+	return;
+}
+
+/*
+ * the module is no longer in the carousel, remove all its files
+ * we don't know which PID it came from, so look in all of them
+ */
+
+void
+fs_delete_module(uint32_t carousel_id, uint16_t module_id)
+{
+	char root[PATH_MAX];
+	char name[PATH_MAX];
+	DIR *pids;
+	DIR *dir;
+	struct dirent *pid;
+	struct dirent *ent;
+	unsigned int mid;
+
+	if((pids = opendir(CAROUSELS_DIR)) == NULL)
+		return;
+
+	while((pid = readdir(pids)) != NULL)
+	{
+		if(pid->d_name[0] == '.'
+		|| snprintf(root, sizeof(root), "%s/%s/%u", CAROUSELS_DIR, pid->d_name, carousel_id) >= (int) sizeof(root)
+		|| (dir = opendir(root)) == NULL)
+			continue;
+		while((ent = readdir(dir)) != NULL)
+		{
+			if(sscanf(ent->d_name, "%*[^-]-%u-", &mid) != 1
+			|| mid != module_id
+			|| snprintf(name, sizeof(name), "%s/%s", root, ent->d_name) >= (int) sizeof(name))
+				continue;
+			remove_object(name);
+		}
+		closedir(dir);
+	}
+
+	closedir(pids);
+
+	return;
+}
+
 char *
 make_carousel_root(uint16_t elementary_pid, uint32_t carousel_id)
 {
@@ -70,6 +397,7 @@ save_file(char *kind, uint16_t elementary_pid, uint32_t carousel_id, uint16_t mo
 	char *root;
 	char *ascii_key;
 	char filename[PATH_MAX];
+	char *tmpname;
 	FILE *f;
 
 	/* make sure the carousel directory exists */
@@ -80,14 +408,22 @@ save_file(char *kind, uint16_t elementary_pid, uint32_t carousel_id, uint16_t mo
 
 	/* construct the file name */
 	snprintf(filename, sizeof(filename), "%s/%s-%u-%s", root, kind, module_id, ascii_key);
+	tmpname = new_name(filename);
 
-	if((f = fopen(filename, "wb")) == NULL)
-		fatal("Unable to create file '%s': %s", filename, strerror(errno));
+	if((f = fopen(tmpname, "wb")) == NULL)
+		fatal("Unable to create file '%s': %s", tmpname, strerror(errno));
 	if(fwrite(file, 1, file_size, f) != file_size)
-		fatal("Unable to write to file '%s'", filename);
+		fatal("Unable to write to file '%s'", tmpname);
 
 	fclose(f);
 
+	stats_written(file_size);
+
+	publish_object(filename, false);
+
+	/* give the command processes a copy they can use without going to the file system */
+	objstore_add(OBJSTORE_FILE, filename, file, file_size);
+
 	verbose("Created file '%s'", filename);
 
 	return;
@@ -103,8 +439,10 @@ make_service_root(uint16_t service_id, char *kind, uint16_t elementary_pid, uint
 {
 	char dirname[PATH_MAX];
 	char *ascii_key;
-	char realfile[PATH_MAX];
+	char target[PATH_MAX];
+	char *realfile;
 	char linkfile[PATH_MAX];
+	char *tmpname;
 
 	/* make sure the services directory exists */
 	snprintf(dirname, sizeof(dirname), "%s", SERVICES_DIR);
@@ -115,17 +453,23 @@ make_service_root(uint16_t service_id, char *kind, uint16_t elementary_pid, uint
 	ascii_key = convert_key(key, key_size);
 
 	/* create a symlink to the Service Gateway dir */
-	snprintf(realfile, sizeof(realfile), "../%s/%u/%u/%s-%u-%s", CAROUSELS_DIR, elementary_pid, carousel_id, kind, module_id, ascii_key);
+	snprintf(target, sizeof(target), "%s/%u/%u/%s-%u-%s", CAROUSELS_DIR, elementary_pid, carousel_id, kind, module_id, ascii_key);
 	snprintf(linkfile, sizeof(linkfile), "%s/%u", dirname, service_id);
+	realfile = relative_target(linkfile, target);
+	tmpname = new_name(linkfile);
 
 	/*
-	 * linkfile may already exist if we get an update to an existing module
-	 * if linkfile already exists, symlink will not update it
-	 * so delete it first to make sure the link gets updated
+	 * linkfile may already exist if we get an update to the DSI
+	 * symlink will not replace an existing file, so make a new link and rename it
 	 */
-	unlink(linkfile);
-	if(symlink(realfile, linkfile) < 0 && errno != EEXIST)
-		fatal("Unable to create link '%s' to '%s': %s", linkfile, realfile, strerror(errno));
+	unlink(tmpname);
+	if(symlink(realfile, tmpname) < 0)
+		fatal("Unable to create link '%s' to '%s': %s", tmpname, realfile, strerror(errno));
+
+	publish_object(linkfile, true);
+
+	/* the object store names things relative to the base directory */
+	objstore_add(OBJSTORE_LINK, linkfile, (unsigned char *) target, strlen(target));
 
 	verbose("Added service root '%s' -> '%s'", linkfile, realfile);
 
@@ -157,6 +501,12 @@ make_dir(char *kind, uint16_t elementary_pid, uint32_t carousel_id, uint16_t mod
 	if(mkdir(_dirname, 0755) < 0 && errno != EEXIST)
 		fatal("Unable to create directory '%s': %s", _dirname, strerror(errno));
 
+	/* when the update is committed, we remove anything in it that the new version does not list */
+	if(_in_update)
+		add_pending(_dirname, false, true);
+
+	objstore_add(OBJSTORE_DIR, _dirname, NULL, 0);
+
 	verbose("Created directory '%s'", _dirname);
 
 	return _dirname;
@@ -171,29 +521,62 @@ void
 add_dir_entry(char *dir, char *entry, uint32_t entry_size, char *kind, uint16_t elementary_pid, uint32_t carousel_id, uint16_t module_id, char *key, uint32_t key_size)
 {
 	char *ascii_key;
-	char realfile[PATH_MAX];
+	char target[PATH_MAX];
+	char *realfile;
 	char linkfile[PATH_MAX];
+	char *tmpname;
 
 	/* BBC use numbers as object keys, so convert to a text value we can use as a file name */
 	ascii_key = convert_key(key, key_size);
 
-	snprintf(realfile, sizeof(realfile), "../../../../%s/%u/%u/%s-%u-%s", CAROUSELS_DIR, elementary_pid, carousel_id, kind, module_id, ascii_key);
+	snprintf(target, sizeof(target), "%s/%u/%u/%s-%u-%s", CAROUSELS_DIR, elementary_pid, carousel_id, kind, module_id, ascii_key);
 	snprintf(linkfile, sizeof(linkfile), "%s/%.*s", dir, entry_size, entry);
+	realfile = relative_target(linkfile, target);
+	tmpname = new_name(linkfile);
 
 	/*
 	 * linkfile may already exist if we get an update to an existing module
-	 * if linkfile already exists, symlink will not update it
-	 * so delete it first to make sure the link gets updated
+	 * symlink will not replace an existing file, so make a new link and rename it
 	 */
-	unlink(linkfile);
-	if(symlink(realfile, linkfile) < 0)
-		fatal("Unable to create link '%s' to '%s': %s", linkfile, realfile, strerror(errno));
+	unlink(tmpname);
+	if(symlink(realfile, tmpname) < 0)
+		fatal("Unable to create link '%s' to '%s': %s", tmpname, realfile, strerror(errno));
+
+	publish_object(linkfile, true);
+
+	objstore_add(OBJSTORE_LINK, linkfile, (unsigned char *) target, strlen(target));
 
 	verbose("Added directory entry '%s' -> '%s'", linkfile, realfile);
 
 	return;
 }
 
+/*
+ * link and target are both relative to the base directory
+ * returns what the symlink link should contain to point to target
+ * ie a ../ for each directory link is in, then target
+ * returns a static string that will be overwritten by the next call to this function
+ */
+
+static char _relative_target[PATH_MAX];
+
+static char *
+relative_target(char *link, char *target)
+{
+	size_t len;
+
+	len = 0;
+	while((link = strchr(link, '/')) != NULL && len + 3 < sizeof(_relative_target))
+	{
+		memcpy(&_relative_target[len], "../", 3);
+		len += 3;
+		link ++;
+	}
+	snprintf(&_relative_target[len], sizeof(_relative_target) - len, "%s", target);
+
+	return _relative_target;
+}
+
 /*
  * BBC use numbers as object keys, ITV/C4 use ascii strings
  * we want an ascii string we can use as a filename
@@ -202,6 +585,59 @@ add_dir_entry(char *dir, char *entry, uint32_t entry_size, char *kind, uint16_t
 
 static char _ascii_key[PATH_MAX];
 
+/*
+ * if path does not exist because we have not downloaded the module it is in yet,
+ * fill in the download_id and module_id of that module and return true
+ * files are links to carousels/<PID>/<CID>/<kind>-<module>-<key>, so if the link is there but the file isn't,
+ * we can tell what module it is in from the link's target
+ * if the directory it is in is missing too, we look at the directory's link instead
+ * returns false if the module is already here (so the file really does not exist), or we can't tell
+ */
+
+bool
+fs_missing_module(char *path, uint32_t *download_id, uint16_t *module_id)
+{
+	char name[PATH_MAX];
+	char target[PATH_MAX];
+	ssize_t len;
+	struct stat info;
+	char *slash;
+	unsigned int cid;
+	unsigned int mid;
+
+	snprintf(name, sizeof(name), "%s", path);
+
+	while(true)
+	{
+		if((len = readlink(name, target, sizeof(target) - 1)) >= 0)
+		{
+			/* a link to something we already have */
+			if(stat(name, &info) == 0)
+				return false;
+			target[len] = '\0';
+			/* find the <CID>/<kind>-<module>-<key> part */
+			if((slash = strrchr(target, '/')) == NULL)
+				return false;
+			do
+				slash --;
+			while(slash > target && *slash != '/');
+			if(*slash == '/')
+				slash ++;
+			if(sscanf(slash, "%u/%*[^-]-%u-", &cid, &mid) != 2)
+				return false;
+			*download_id = cid;
+			*module_id = mid;
+			return true;
+		}
+		/* if it is not a link, or we get to the top, we can't tell */
+		if(errno != ENOENT
+		|| (slash = strrchr(name, '/')) == NULL)
+			return false;
+		/* try the directory it is in */
+		*slash = '\0';
+	}
+}
+
 char *
 convert_key(char *key, uint32_t size)
 {
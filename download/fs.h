@@ -29,6 +29,12 @@
 #define SERVICES_DIR	"services"
 #define CAROUSELS_DIR	"carousels"
 
+void fs_begin_update(uint16_t, uint32_t, uint16_t);
+void fs_commit_update(void);
+void fs_abort_update(void);
+
+void fs_delete_module(uint32_t, uint16_t);
+
 char *make_carousel_root(uint16_t, uint32_t);
 
 void save_file(char *, uint16_t, uint32_t, uint16_t, char *, uint32_t, unsigned char *, uint32_t);
@@ -38,6 +44,8 @@ void make_service_root(uint16_t, char *, uint16_t, uint32_t, uint16_t, char *, u
 char *make_dir(char *, uint16_t, uint32_t, uint16_t, char *, uint32_t);
 void add_dir_entry(char *, char *, uint32_t, char *, uint16_t, uint32_t, uint16_t, char *, uint32_t);
 
+bool fs_missing_module(char *, uint32_t *, uint16_t *);
+
 char *convert_key(char *, uint32_t);
 
 #endif	/* __FS_H__ */
@@ -21,85 +21,56 @@
  */
 
 #include <stdio.h>
+#include <stdbool.h>
 #include <limits.h>
 
+#include "list.h"
+#include "scan.h"
 #include "table.h"
 #include "utils.h"
 
-/* service_descriptor tag */
-#define TAG_SERVICE_DESCRIPTOR	0x48
+static void list_services(bool);
+
+/*
+ * scan the SDTs and NIT, then print the services on our multiplex followed by the rest of the network
+ * the scan also updates the service index the listener uses
+ */
 
 void
 list_channels(unsigned int adapter, unsigned int demux, unsigned int timeout)
 {
 	char demux_dev[PATH_MAX];
-	unsigned char sdt[MAX_TABLE_LEN];
-	uint16_t size;
-	uint16_t offset;
-	uint16_t service_id;
-	uint16_t desc_loop_length;
-	uint8_t desc_tag;
-	uint8_t desc_length;
-	uint8_t name_len;
-	uint8_t sn, lsn;
 
 	snprintf(demux_dev, sizeof(demux_dev), DEMUX_DEVICE, adapter, demux);
 
+	if(!scan_services(demux_dev, timeout))
+		fatal("Unable to read SDT");
+
 	printf("Channels on this mutiplex:\n\n");
-	printf("ID\tChannel\n");
-	printf("==\t=======\n");
+	list_services(true);
+
+	printf("\nChannels on other multiplexes:\n\n");
+	list_services(false);
+
+	return;
+}
+
+static void
+list_services(bool actual)
+{
+	struct scan_service *svc;
+	char *mheg[] = { "?", "No", "Yes" };
+	unsigned int i;
+
+	printf("ID\tMHEG\tChannel\n");
+	printf("==\t====\t=======\n");
 
-	/* grab the Service Description Table */
-	for(sn=0, lsn=0; sn<=lsn; sn++)
+	for(i=0; i<scan_nservices(); i++)
 	{
-		if(!read_sdt(demux_dev, timeout, sdt, sn))
-			fatal("Unable to read SDT");
-		/* 12 bit section_length field */
-		size = 3 + (((sdt[1] & 0x0f) << 8) + sdt[2]);
-		/* last_section_number */
-		lsn = sdt[7];
-		/* loop through the services */
-		offset = 11;
-		/* -4 for the CRC at the end */
-		while(offset < (size - 4))
-		{
-			service_id = (sdt[offset] << 8) + sdt[offset+1];
-			printf("%u\t", service_id);
-			/* move on to the descriptors */
-			offset += 3;
-			desc_loop_length = ((sdt[offset] & 0x0f) << 8) + sdt[offset+1];
-			offset += 2;
-			/* find the service_descriptor tag */
-			while(desc_loop_length != 0)
-			{
-				desc_tag = sdt[offset];
-				desc_length = sdt[offset+1];
-				offset += 2;
-				desc_loop_length -= 2;
-				if(desc_tag == TAG_SERVICE_DESCRIPTOR)
-				{
-					/* service_type = sds[offset]; */
-					offset += 1;
-					/* service_provider_name */
-					name_len = sdt[offset];
-					offset += 1 + name_len;
-					/* service_name */
-					name_len = sdt[offset];
-					offset += 1;
-					printf("%.*s\n", name_len, &sdt[offset]);
-					offset += name_len;
-				}
-				else
-				{
-					vverbose("desc_tag: %u", desc_tag);
-					vhexdump(&sdt[offset], desc_length);
-					offset += desc_length;
-				}
-				desc_loop_length -= desc_length;
-			}
-		}
+		svc = scan_service(i);
+		if(svc->actual == actual)
+			printf("%u\t%s\t%s\n", svc->service_id, mheg[svc->mheg], svc->name);
 	}
 
 	return;
 }
-
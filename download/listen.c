@@ -10,10 +10,13 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 
 #include "command.h"
@@ -21,18 +24,61 @@
 #include "carousel.h"
 #include "channels.h"
 #include "cache.h"
+#include "objstore.h"
+#include "scan.h"
+#include "tsfile.h"
 #include "utils.h"
 
 /* listen() backlog, 5 is max for BSD apparently */
 #define BACKLOG		5
 
+/* max number of worker processes (arbitrary) */
+#define MAX_WORKERS	64
+
+/* max number of connections each worker process handles at once (arbitrary) */
+#define MAX_CLIENTS	32
+
+/*
+ * a worker stops running a client's commands while it has at least this many bytes of responses waiting to be sent
+ * it carries on when the client has read them
+ */
+#define MAX_CLIENT_OUTPUT	(64 * 1024)
+
+/*
+ * a connection to a worker process
+ * the socket is non-blocking, so a client that is slow to read its responses does not hold up the others
+ */
+struct client
+{
+	int sock;			/* the connection */
+	struct sockaddr_in addr;	/* where it came from */
+	size_t cmd_len;			/* bytes in cmd so far */
+	char cmd[MAX_COMMAND_LEN];	/* command we are reading */
+	char *out;			/* responses waiting to be sent */
+	size_t out_len;			/* bytes in out */
+	size_t out_sent;		/* bytes of out we have sent */
+	bool closing;			/* close the connection when out has been sent */
+};
+
 /* internal functions */
 static int get_host_addr(char *, struct in_addr *);
 
 static void handle_connection(struct listen_data *, int, struct sockaddr_in *);
+static void stop_connections(void);
+
+static void start_workers(struct listen_data *, int);
+static void stop_workers(void);
+static bool workers_missing(void);
+static void run_worker(struct listen_data *, int);
+static bool client_input(struct listen_data *, struct client *);
+static bool client_commands(struct listen_data *, struct client *);
+static bool client_output(struct client *);
+static void close_client(struct client *);
+static void stream_client(struct listen_data *, struct client *, char *);
 
 static void dead_child(int);
 static void hup_handler(int, siginfo_t *, void *);
+static void term_handler(int);
 
 /*
  * we have a main process that listens for commands on the network
@@ -41,8 +87,55 @@ static void hup_handler(int, siginfo_t *, void *);
  * to retune, the command processing process sends a SIGHUP to the main process
  * the siginfo contains the new service_id
  * this variable is set by the SIGHUP handler from the siginfo, -1 => no retune needed
+ * a SIGHUP from anyone else (eg kill -HUP) tells us to read the channels.conf file again
  */
 static volatile int retune_id = -1;
+static volatile sig_atomic_t _reload_channels = false;
+
+/*
+ * with the -w option, a fixed pool of worker processes accept connections
+ * each worker keeps its connections open and handles all their commands
+ * only the commands that send a stream get a process to themselves
+ * on retune, the main process tells the old workers to finish what they are doing and exit
+ * it then starts new workers that have the new carousel
+ */
+static unsigned int _nworkers = 0;
+static volatile pid_t _workers[MAX_WORKERS];
+
+/*
+ * without the -w option, each connection has its own process
+ * on retune, the main process tells them to finish the command they are processing and exit
+ * the clients will reconnect and get a process with the new carousel
+ */
+static volatile pid_t *_connections = NULL;
+static unsigned int _nconnections = 0;
+
+/* these are only used in the worker and connection processes */
+static volatile sig_atomic_t _stale = false;		/* set when the main process has retuned */
+
+/* these are only used in the worker processes */
+static int _listen_sock = -1;
+static struct client _clients[MAX_CLIENTS];
+static unsigned int _nclients = 0;
+
+/*
+ * with the -m option, the downloader gets the carousels of all the MHEG services on the multiplex
+ * retuning to any of these services doesn't need a new downloader, the carousel is already on disk
+ */
+static bool _all_services = false;
+static uint16_t _mux_services[CACHE_MAX_SERVICES];
+static unsigned int _nmux_services = 0;
+
+static bool downloading_service(uint16_t);
+
+/*
+ * reading the SDTs and NIT can take as long as the timeout, so it is done by a separate process
+ * commands carry on using the old index until the new one is saved
+ */
+static volatile pid_t _scanner = 0;
+
+static void rescan_services(struct listen_data *, unsigned int);
+static void stop_rescan(void);
 
 /*
  * extract the IP addr and port number from a string in one of these forms:
@@ -123,17 +216,22 @@ get_host_addr(char *host, struct in_addr *output)
  */
 
 void
-start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned int frontend, unsigned int demux, unsigned int dvr, unsigned int timeout, uint16_t service_id, int carousel_id)
+start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned int frontend, unsigned int demux, unsigned int dvr, unsigned int timeout, uint16_t service_id, int carousel_id, unsigned int nworkers, bool all_services)
 {
 	struct listen_data listen_data;
 	struct sigaction action;
+	sigset_t pool_signals;
+	sigset_t old_mask;
 	int sockopt;
 	int listen_sock;
 	int accept_sock;
 	fd_set read_fds;
 	socklen_t addr_len;
 	struct sockaddr_in client_addr;
+	sigset_t fork_signals;
 	pid_t child;
+	pid_t downloader;
+	unsigned int i;
 
 	/* don't let our children become zombies */
 	action.sa_handler = dead_child;
@@ -143,8 +241,12 @@ start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned i
 		fatal("signal: SIGCHLD: %s", strerror(errno));
 
 	/* fork off a child to download the carousel */
+	_all_services = all_services;
 	listen_data.carousel = start_downloader(adapter, frontend, demux, dvr, timeout, service_id, carousel_id);
 
+	/* update the service index now we are tuned, use the saved one until it is done */
+	rescan_services(&listen_data, timeout);
+
 	/* catch SIGHUP - tells us to retune */
 	action.sa_sigaction = hup_handler;
 	sigemptyset(&action.sa_mask);
@@ -169,19 +271,84 @@ start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned i
 	if(listen(listen_sock, BACKLOG) < 0)
 		fatal("listen: %s", strerror(errno));
 
+	/* start the worker processes, they accept the connections */
+	if(nworkers > 0)
+	{
+		_nworkers = MIN(nworkers, MAX_WORKERS);
+		verbose("Starting %u worker processes", _nworkers);
+		/* only one worker will get each connection, the others must not block in accept */
+		if(fcntl(listen_sock, F_SETFL, O_NONBLOCK) < 0)
+			fatal("fcntl: O_NONBLOCK: %s", strerror(errno));
+		start_workers(&listen_data, listen_sock);
+	}
+
+	/* the signals the main process waits for if we have workers */
+	sigemptyset(&pool_signals);
+	sigaddset(&pool_signals, SIGHUP);
+	sigaddset(&pool_signals, SIGCHLD);
+
+	/*
+	 * the signals we block while forking a connection process
+	 * dead_child must not see it before we remember its PID,
+	 * and it must not get a SIGTERM before it can catch it
+	 */
+	sigemptyset(&fork_signals);
+	sigaddset(&fork_signals, SIGCHLD);
+	sigaddset(&fork_signals, SIGTERM);
+
 	/* listen for connections */
 	while(true)
 	{
+		/* new connections and workers get the new channels.conf when we fork them */
+		if(_reload_channels)
+		{
+			_reload_channels = false;
+			reload_channels_conf();
+		}
 		/* do we need to retune */
 		if(retune_id != -1)
 		{
 			verbose("Retune to service_id %d", retune_id);
-			/* kill the current downloader process and start a new one */
-			kill(listen_data.carousel->downloader, SIGKILL);
-			cache_flush();
-			listen_data.carousel = start_downloader(adapter, frontend, demux, dvr, timeout, retune_id, -1);
+			/* new connections wait in the listen queue until the new workers are started */
+			stop_workers();
+			stop_connections();
+			/* the scan would see the multiplex change under it */
+			stop_rescan();
+			if(downloading_service(retune_id))
+			{
+				/* the downloader already has this carousel, we just need the new service's PIDs */
+				downloader = listen_data.carousel->downloader;
+				listen_data.carousel = find_mheg(adapter, demux, dvr, timeout, retune_id, -1);
+				release_mux_mheg(listen_data.carousel);
+				listen_data.carousel->downloader = downloader;
+			}
+			else
+			{
+				/* kill the current downloader process and start a new one */
+				kill(listen_data.carousel->downloader, SIGKILL);
+				/* make sure it has gone before we empty the object store, dead_child may reap it first */
+				while(waitpid(listen_data.carousel->downloader, NULL, 0) < 0 && errno == EINTR)
+					;
+				objstore_reset();
+				cache_retune();
+				listen_data.carousel = start_downloader(adapter, frontend, demux, dvr, timeout, retune_id, -1);
+			}
+			/* the index covers the whole network, so only scan again if it is old */
+			if(scan_stale())
+				rescan_services(&listen_data, timeout);
 			retune_id = -1;
 		}
+		/* if we have workers, all we need to do is keep them running */
+		if(_nworkers > 0)
+		{
+			start_workers(&listen_data, listen_sock);
+			/* wait for a retune or a worker to die */
+			sigprocmask(SIG_BLOCK, &pool_signals, &old_mask);
+			if(retune_id == -1 && !_reload_channels && !workers_missing())
+				sigsuspend(&old_mask);
+			sigprocmask(SIG_SETMASK, &old_mask, NULL);
+			continue;
+		}
 		/* listen for a connection */
 		FD_ZERO(&read_fds);
 		FD_SET(listen_sock, &read_fds);
@@ -203,6 +370,7 @@ start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned i
 			continue;
 		}
 		/* fork off a child to handle it */
+		sigprocmask(SIG_BLOCK, &fork_signals, &old_mask);
 		if((child = fork()) < 0)
 		{
 			/* if we can't fork it's probably best to kill ourselves*/
@@ -212,6 +380,15 @@ start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned i
 		{
 			/* child */
 			close(listen_sock);
+			/* the connection PIDs are only any use to the main process */
+			_nconnections = 0;
+			/* the main process sends us a SIGTERM when our carousel is stale */
+			action.sa_handler = term_handler;
+			sigemptyset(&action.sa_mask);
+			action.sa_flags = 0;
+			if(sigaction(SIGTERM, &action, NULL) < 0)
+				fatal("signal: SIGTERM: %s", strerror(errno));
+			sigprocmask(SIG_SETMASK, &old_mask, NULL);
 			handle_connection(&listen_data, accept_sock, &client_addr);
 			close(accept_sock);
 			/* use _exit in child so stdio etc don't clean up twice */
@@ -221,6 +398,16 @@ start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned i
 		{
 			/* parent */
 			close(accept_sock);
+			/* remember its PID so we can stop it on retune, reuse a slot dead_child has cleared */
+			for(i=0; i<_nconnections && _connections[i]!=0; i++)
+				;
+			if(i == _nconnections)
+			{
+				_connections = safe_realloc((void *) _connections, (_nconnections + 1) * sizeof(pid_t));
+				_nconnections ++;
+			}
+			_connections[i] = child;
+			sigprocmask(SIG_SETMASK, &old_mask, NULL);
 		}
 	}
 
@@ -237,21 +424,40 @@ start_listener(struct sockaddr_in *listen_addr, unsigned int adapter, unsigned i
 static void
 handle_connection(struct listen_data *listen_data, int client_sock, struct sockaddr_in *client_addr)
 {
+	FILE *in;
 	FILE *client;
-	char cmd[1024];
+	int out_sock;
+	char cmd[MAX_COMMAND_LEN];
 	size_t len;
 	bool quit;
 
 	verbose("Connection from %s:%d", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
 
-	if((client = fdopen(client_sock, "r+")) == NULL)
+	/*
+	 * clients may send several commands before reading any responses
+	 * so use separate FILEs for reading and writing,
+	 * otherwise the first response would throw away the commands we have buffered
+	 */
+	if((in = fdopen(client_sock, "r")) == NULL)
 		return;
+	if((out_sock = dup(client_sock)) < 0
+	|| (client = fdopen(out_sock, "w")) == NULL)
+	{
+		if(out_sock >= 0)
+			close(out_sock);
+		fclose(in);
+		return;
+	}
 
-	/* read commands from the client */
+	/*
+	 * read commands from the client
+	 * stop if the main process retunes, our carousel is stale
+	 * the SIGTERM interrupts fgets, so we don't wait for another command first
+	 */
 	quit = false;
-	while(!feof(client) && !quit)
+	while(!feof(in) && !quit && !_stale)
 	{
-		if(fgets(cmd, sizeof(cmd), client) == NULL)
+		if(fgets(cmd, sizeof(cmd), in) == NULL)
 		{
 			quit = true;
 		}
@@ -264,29 +470,440 @@ handle_connection(struct listen_data *listen_data, int client_sock, struct socka
 				cmd[len--] = '\0';
 			/* process the command */
 			quit = process_command(listen_data, client, cmd);
+			fflush(client);
 		}
 	}
 
 	fclose(client);
+	fclose(in);
 
 	verbose("Connection from %s:%d closed", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
 
 	return;
 }
 
+/*
+ * start worker processes to replace any that have died or been stopped
+ */
+
+static void
+start_workers(struct listen_data *listen_data, int listen_sock)
+{
+	sigset_t chld;
+	sigset_t old_mask;
+	unsigned int i;
+	pid_t child;
+
+	/* don't let dead_child see a worker before we have remembered its PID */
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &old_mask);
+
+	for(i=0; i<_nworkers; i++)
+	{
+		if(_workers[i] != 0)
+			continue;
+		if((child = fork()) < 0)
+		{
+			/* if we can't fork it's probably best to kill ourselves*/
+			fatal("fork: %s", strerror(errno));
+		}
+		else if(child == 0)
+		{
+			sigprocmask(SIG_SETMASK, &old_mask, NULL);
+			run_worker(listen_data, listen_sock);
+			/* use _exit in child so stdio etc don't clean up twice */
+			_exit(EXIT_SUCCESS);
+		}
+		_workers[i] = child;
+	}
+
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+	return;
+}
+
+/*
+ * tell the connection processes to finish the commands they are processing and exit
+ */
+
+static void
+stop_connections(void)
+{
+	unsigned int i;
+
+	for(i=0; i<_nconnections; i++)
+	{
+		if(_connections[i] != 0)
+			kill(_connections[i], SIGTERM);
+		/* dead_child will reap it */
+		_connections[i] = 0;
+	}
+
+	return;
+}
+
+/*
+ * tell the workers to finish the commands they are processing and exit
+ */
+
+static void
+stop_workers(void)
+{
+	unsigned int i;
+
+	for(i=0; i<_nworkers; i++)
+	{
+		if(_workers[i] != 0)
+			kill(_workers[i], SIGTERM);
+		/* dead_child will reap it */
+		_workers[i] = 0;
+	}
+
+	return;
+}
+
+static bool
+workers_missing(void)
+{
+	unsigned int i;
+
+	for(i=0; i<_nworkers; i++)
+	{
+		if(_workers[i] == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * called in a worker or connection process after it has sent a retune request to the main process
+ * waits until the main process has told us our carousel is stale
+ * this means any new connections will get a process with the new carousel
+ */
+
+void
+wait_for_retune(void)
+{
+	sigset_t term;
+	sigset_t old_mask;
+
+	sigemptyset(&term);
+	sigaddset(&term, SIGTERM);
+	sigprocmask(SIG_BLOCK, &term, &old_mask);
+	while(!_stale)
+		sigsuspend(&old_mask);
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+	return;
+}
+
+/*
+ * worker process
+ * accepts connections and reads commands from all of them until the main process retunes
+ */
+
+static void
+run_worker(struct listen_data *listen_data, int listen_sock)
+{
+	struct sigaction action;
+	struct pollfd fds[MAX_CLIENTS + 1];
+	struct client *client;
+	socklen_t addr_len;
+	int sock;
+	bool ok;
+	unsigned int i;
+
+	_listen_sock = listen_sock;
+	/* the worker PIDs are only any use to the main process */
+	_nworkers = 0;
+
+	/* the main process sends us a SIGTERM when our carousel is stale */
+	action.sa_handler = term_handler;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = 0;
+	if(sigaction(SIGTERM, &action, NULL) < 0)
+		fatal("signal: SIGTERM: %s", strerror(errno));
+
+	while(!_stale)
+	{
+		fds[0].fd = listen_sock;
+		fds[0].events = (_nclients < MAX_CLIENTS) ? POLLIN : 0;
+		/* don't read any more commands until the client has read the responses we have for it */
+		for(i=0; i<_nclients; i++)
+		{
+			fds[i + 1].fd = _clients[i].sock;
+			fds[i + 1].events = (_clients[i].out_sent < _clients[i].out_len) ? POLLOUT : POLLIN;
+		}
+		if(poll(fds, _nclients + 1, -1) < 0)
+		{
+			/* could have been interupted by SIGCHLD or SIGTERM */
+			if(errno != EINTR)
+				error("poll: %s", strerror(errno));
+			continue;
+		}
+		/* go backwards so removing a client does not move the ones we have not looked at yet */
+		for(i=_nclients; i>0 && !_stale; i--)
+		{
+			if(fds[i].revents == 0)
+				continue;
+			client = &_clients[i - 1];
+			/* send more of its responses, or read more commands */
+			if(fds[i].events & POLLOUT)
+				ok = client_output(client) && client_commands(listen_data, client);
+			else
+				ok = client_input(listen_data, client);
+			if(!ok)
+			{
+				close_client(client);
+				_clients[i - 1] = _clients[_nclients - 1];
+				_nclients --;
+			}
+		}
+		/* any new connections */
+		if((fds[0].revents & POLLIN) && !_stale)
+		{
+			client = &_clients[_nclients];
+			addr_len = sizeof(client->addr);
+			/* another worker may have got it first */
+			if((sock = accept(listen_sock, (struct sockaddr *) &client->addr, &addr_len)) < 0)
+			{
+				if(errno != EAGAIN && errno != EWOULDBLOCK)
+					error("accept: %s", strerror(errno));
+				continue;
+			}
+			if(fcntl(sock, F_SETFL, O_NONBLOCK) < 0)
+			{
+				error("fcntl: O_NONBLOCK: %s", strerror(errno));
+				close(sock);
+				continue;
+			}
+			client->sock = sock;
+			client->cmd_len = 0;
+			client->out = NULL;
+			client->out_len = 0;
+			client->out_sent = 0;
+			client->closing = false;
+			_nclients ++;
+			verbose("Connection from %s:%d", inet_ntoa(client->addr.sin_addr), ntohs(client->addr.sin_port));
+		}
+	}
+
+	/* our carousel is stale, the clients will need to reconnect to a new worker */
+	close(listen_sock);
+	for(i=0; i<_nclients; i++)
+	{
+		/* send what we can without waiting */
+		client_output(&_clients[i]);
+		close_client(&_clients[i]);
+	}
+
+	return;
+}
+
+/*
+ * read data from the client and process any complete commands
+ * returns false if we should close the connection
+ */
+
+static bool
+client_input(struct listen_data *listen_data, struct client *client)
+{
+	ssize_t nread;
+
+	if((nread = read(client->sock, &client->cmd[client->cmd_len], sizeof(client->cmd) - client->cmd_len - 1)) < 0
+	&& (errno == EINTR || errno == EAGAIN))
+		return true;
+	if(nread <= 0)
+		return false;
+	client->cmd_len += nread;
+
+	return client_commands(listen_data, client);
+}
+
+/*
+ * process the complete commands we have read from the client
+ * the responses are kept in memory and sent as the client reads them
+ * stops if the client has too much output waiting, run_worker calls us again when it has been sent
+ * returns false if we should close the connection
+ */
+
+static bool
+client_commands(struct listen_data *listen_data, struct client *client)
+{
+	char cmd[sizeof(client->cmd)];
+	char *nl;
+	size_t len;
+	FILE *out;
+	char *resp;
+	size_t resp_len;
+	bool quit;
+
+	while(!client->closing)
+	{
+		/* see if the client will take what we have so far before we add any more */
+		if((client->out_len - client->out_sent) >= MAX_CLIENT_OUTPUT)
+		{
+			if(!client_output(client))
+				return false;
+			if((client->out_len - client->out_sent) >= MAX_CLIENT_OUTPUT)
+				break;
+		}
+		/* find the end of the next command, if the buffer is full treat it all as a command */
+		if((nl = memchr(client->cmd, '\n', client->cmd_len)) != NULL)
+			len = nl - client->cmd;
+		else if(client->cmd_len == sizeof(client->cmd) - 1)
+			len = client->cmd_len;
+		else
+			break;
+		/* take it out of the buffer */
+		memcpy(cmd, client->cmd, len);
+		cmd[len] = '\0';
+		if(nl != NULL)
+			len ++;
+		client->cmd_len -= len;
+		memmove(client->cmd, &client->cmd[len], client->cmd_len);
+		/* strip off any trailing \r */
+		len = strlen(cmd);
+		while(len > 0 && cmd[len - 1] == '\r')
+			cmd[--len] = '\0';
+		if(len == 0)
+			continue;
+		/* streams need a process to themselves */
+		if(is_stream_command(cmd))
+		{
+			stream_client(listen_data, client, cmd);
+			return false;
+		}
+		/* add the response to what we have not sent yet */
+		resp = NULL;
+		resp_len = 0;
+		if((out = open_memstream(&resp, &resp_len)) == NULL)
+			fatal("open_memstream: %s", strerror(errno));
+		quit = process_command(listen_data, out, cmd);
+		fclose(out);
+		if(client->out_sent == client->out_len)
+		{
+			client->out_len = 0;
+			client->out_sent = 0;
+		}
+		client->out = safe_realloc(client->out, client->out_len + resp_len + 1);
+		memcpy(&client->out[client->out_len], resp, resp_len);
+		client->out_len += resp_len;
+		safe_free(resp);
+		client->closing = quit;
+	}
+
+	if(!client_output(client))
+		return false;
+
+	/* close it once we have sent everything */
+	return !client->closing || client->out_sent < client->out_len;
+}
+
+/*
+ * send as much of the client's waiting output as we can without blocking
+ * returns false if the connection has gone
+ */
+
+static bool
+client_output(struct client *client)
+{
+	ssize_t nsent;
+
+	while(client->out_sent < client->out_len)
+	{
+		nsent = send(client->sock, &client->out[client->out_sent], client->out_len - client->out_sent, MSG_NOSIGNAL);
+		if(nsent < 0 && errno == EINTR)
+			continue;
+		if(nsent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if(nsent <= 0)
+			return false;
+		client->out_sent += nsent;
+	}
+
+	return true;
+}
+
+static void
+close_client(struct client *client)
+{
+	close(client->sock);
+	safe_free(client->out);
+
+	verbose("Connection from %s:%d closed", inet_ntoa(client->addr.sin_addr), ntohs(client->addr.sin_port));
+
+	return;
+}
+
+/*
+ * fork off a process to run a command that sends a stream down the connection
+ * the worker closes its copy of the connection
+ */
+
+static void
+stream_client(struct listen_data *listen_data, struct client *client, char *cmd)
+{
+	FILE *stream;
+	ssize_t nsent;
+	unsigned int i;
+	pid_t child;
+
+	if((child = fork()) < 0)
+	{
+		error("fork: %s", strerror(errno));
+	}
+	else if(child == 0)
+	{
+		/* don't keep the other connections open */
+		close(_listen_sock);
+		for(i=0; i<_nclients; i++)
+		{
+			if(&_clients[i] != client)
+				close(_clients[i].sock);
+		}
+		/* we have the connection to ourselves now, so we can wait for the client */
+		fcntl(client->sock, F_SETFL, 0);
+		/* send the responses to the commands before this one first */
+		while(client->out_sent < client->out_len
+		   && (nsent = write(client->sock, &client->out[client->out_sent], client->out_len - client->out_sent)) > 0)
+			client->out_sent += nsent;
+		/* stream commands need to read from the connection too, so they can see when it is closed */
+		if(client->out_sent == client->out_len
+		&& (stream = fdopen(client->sock, "r+")) != NULL)
+		{
+			process_command(listen_data, stream, cmd);
+			fclose(stream);
+		}
+		/* use _exit in child so stdio etc don't clean up twice */
+		_exit(EXIT_SUCCESS);
+	}
+
+	return;
+}
+
 struct carousel *
 start_downloader(unsigned int adapter, unsigned int frontend, unsigned int demux, unsigned int dvr, unsigned int timeout, uint16_t service_id, int carousel_id)
 {
 	struct carousel *car;
+	struct carousel *member;
+	unsigned int i;
 	pid_t child;
 
-	/* retune if needed */
-	if(!tune_service_id(adapter, frontend, timeout, service_id))
+	/* retune if needed, nothing to tune if we are reading from a file */
+	if(!using_tsfile()
+	&& !tune_service_id(adapter, frontend, timeout, service_id))
 		error("Unable to retune; let's hope you're already tuned to the right frequency...");
 	
 	/* find the MHEG PIDs */
 	car = find_mheg(adapter, demux, dvr, timeout, service_id, carousel_id);
 
+	/* and maybe the MHEG PIDs for the rest of the multiplex */
+	if(_all_services)
+		find_mux_mheg(car);
+
 	verbose("Carousel ID=%u", car->carousel_id);
 	verbose("Boot PID=%u", car->boot_pid);
 	verbose("Video PID=%u", car->video_pid);
@@ -303,20 +920,144 @@ start_downloader(unsigned int adapter, unsigned int frontend, unsigned int demux
 		fatal("fork: %s", strerror(errno));
 	/* child downloads the carousel until killed by parent */
 	else if(child == 0)
-		load_carousel(car);                                            
+	{
+		load_carousel(car);
+		/* only returns if we get to the end of a Transport Stream file */
+		fflush(stdout);
+		_exit(EXIT_SUCCESS);
+	}
 	/* parent continues */
 
 	/* remember the PID of the downloader process so we can kill it on retune */
 	car->downloader = child;
 
+	/* remember which services it is downloading */
+	_nmux_services = 0;
+	for(member=car; member!=NULL && _nmux_services<CACHE_MAX_SERVICES; member=member->next)
+	{
+		_mux_services[_nmux_services ++] = member->service_id;
+		for(i=0; i<member->nservices && _nmux_services<CACHE_MAX_SERVICES; i++)
+			_mux_services[_nmux_services ++] = member->services[i];
+	}
+
+	/* only the downloader needs the section filters and the other carousels */
+	release_mux_mheg(car);
+
 	return car;
 }
 
+/*
+ * fork a process to read the SDTs and NIT again, in case the services have changed since the index was saved
+ * a Transport Stream file is only read by the downloader, we don't want to steal its packets
+ */
+
+static void
+rescan_services(struct listen_data *listen_data, unsigned int timeout)
+{
+	sigset_t chld;
+	sigset_t old_mask;
+	pid_t child;
+
+	if(using_tsfile() || _scanner != 0)
+		return;
+
+	/* dead_child must not see it before we remember its PID */
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &old_mask);
+
+	if((child = fork()) < 0)
+	{
+		/* not fatal, we still have the saved index */
+		error("fork: %s", strerror(errno));
+	}
+	else if(child == 0)
+	{
+		sigprocmask(SIG_SETMASK, &old_mask, NULL);
+		if(!scan_services(listen_data->carousel->demux_device, timeout))
+			error("Unable to scan for services");
+		/* use _exit in child so stdio etc don't clean up twice */
+		_exit(EXIT_SUCCESS);
+	}
+	else
+	{
+		_scanner = child;
+	}
+
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+	return;
+}
+
+/*
+ * kill the scanning process if it is still running
+ * the index is saved to a new file and renamed, so we never leave a half written one
+ */
+
+static void
+stop_rescan(void)
+{
+	pid_t scanner = _scanner;
+
+	if(scanner == 0)
+		return;
+
+	kill(scanner, SIGKILL);
+	/* dead_child may reap it first */
+	while(waitpid(scanner, NULL, 0) < 0 && errno == EINTR)
+		;
+	_scanner = 0;
+
+	return;
+}
+
+/*
+ * returns true if the downloader is getting the carousel for service_id
+ */
+
+static bool
+downloading_service(uint16_t service_id)
+{
+	unsigned int i;
+
+	for(i=0; i<_nmux_services; i++)
+	{
+		if(_mux_services[i] == service_id)
+			return true;
+	}
+
+	return false;
+}
+
 static void
 dead_child(int signo)
 {
-	if(signo == SIGCHLD)
-		wait(NULL);
+	pid_t child;
+	unsigned int i;
+	int saved_errno = errno;
+
+	if(signo != SIGCHLD)
+		return;
+
+	/* we may only get one signal for several children */
+	while((child = waitpid(-1, NULL, WNOHANG)) > 0)
+	{
+		/* if it was a worker, the main loop will start a new one */
+		for(i=0; i<_nworkers; i++)
+		{
+			if(_workers[i] == child)
+				_workers[i] = 0;
+		}
+		for(i=0; i<_nconnections; i++)
+		{
+			if(_connections[i] == child)
+				_connections[i] = 0;
+		}
+		if(_scanner == child)
+			_scanner = 0;
+	}
+
+	errno = saved_errno;
 
 	return;
 }
@@ -324,8 +1065,19 @@ dead_child(int signo)
 static void
 hup_handler(int signo, siginfo_t *info, void *ctx)
 {
-	if(signo == SIGHUP)
+	if(signo == SIGHUP && info->si_code == SI_QUEUE)
 		retune_id = info->si_value.sival_int;
+	else if(signo == SIGHUP)
+		_reload_channels = true;
+
+	return;
+}
+
+static void
+term_handler(int signo)
+{
+	if(signo == SIGTERM)
+		_stale = true;
 
 	return;
 }
@@ -5,6 +5,7 @@
 #ifndef __LISTEN_H__
 #define __LISTEN_H__
 
+#include <stdbool.h>
 #include <netinet/in.h>
 
 #include "module.h"
@@ -16,7 +17,8 @@ struct listen_data
 
 int parse_addr(char *, struct in_addr *, in_port_t *);
 
-void start_listener(struct sockaddr_in *, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, uint16_t, int);
+void start_listener(struct sockaddr_in *, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, uint16_t, int, unsigned int, bool);
+void wait_for_retune(void);
 struct carousel *start_downloader(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, uint16_t, int);
 
 #endif
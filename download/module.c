@@ -24,53 +24,322 @@
 #include <string.h>
 #include <stdbool.h>
 #include <zlib.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
 
 #include "dsmcc.h"
 #include "carousel.h"
 #include "biop.h"
+#include "fs.h"
 #include "utils.h"
 
+/*
+ * modules are stored in a hash table so we can find the module for each DDB quickly
+ * each hash bucket is a linked list, so a module's address never changes
+ */
+
+static unsigned int
+module_hash(uint32_t download_id, uint16_t module_id)
+{
+	return ((download_id * 31) ^ module_id) & (MODULE_HASH_SIZE - 1);
+}
+
+/*
+ * got_block is a bitmap, one bit per block
+ */
+
+#define BITMAP_SIZE(nblocks)	(((nblocks) + 7) / 8)
+
+static bool
+have_block(struct module *mod, uint16_t block)
+{
+	return (mod->got_block[block >> 3] & (1 << (block & 7))) != 0;
+}
+
+static void
+set_block(struct module *mod, uint16_t block)
+{
+	mod->got_block[block >> 3] |= (1 << (block & 7));
+
+	return;
+}
+
+/*
+ * the data buffer is not allocated until the first block arrives
+ * big modules are mmap'ed, the kernel only gives us a page when we write a block into it
+ * so memory use depends on how much we have received, not on the size given in the DII
+ */
+
+static bool
+alloc_module_data(struct module *mod)
+{
+	void *map;
+
+	if(mod->size >= MODULE_MMAP_SIZE)
+	{
+		map = mmap(NULL, mod->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(map == MAP_FAILED)
+		{
+			error("Unable to mmap %u bytes for module %u", mod->size, mod->module_id);
+			return false;
+		}
+		mod->data = map;
+		mod->mapped_size = mod->size;
+	}
+	else
+	{
+		mod->data = safe_malloc(mod->size);
+		mod->mapped_size = 0;
+	}
+
+	return true;
+}
+
+static void
+free_module_data(struct module *mod)
+{
+	if(mod->mapped_size != 0)
+		munmap(mod->data, mod->mapped_size);
+	else
+		safe_free(mod->data);
+
+	mod->data = NULL;
+	mod->mapped_size = 0;
+
+	return;
+}
+
+/*
+ * the smallest output buffer we start inflating into
+ */
+#define CHUNK_SIZE	(4 * 1024)
+
+/*
+ * originalSize in the DII is not to be trusted
+ * don't allocate more than this many times the compressed size up front, inflate_data grows it if needed
+ */
+#define MAX_INFLATE_GUESS	8
+
+static bool
+start_inflate(struct module *mod, uint32_t out_size)
+{
+	struct module_inflate *inf;
+
+	inf = safe_malloc(sizeof(struct module_inflate));
+
+	/* init zlib state */
+	inf->strm.zalloc = Z_NULL;
+	inf->strm.zfree = Z_NULL;
+	inf->strm.opaque = Z_NULL;
+	inf->strm.avail_in = 0;
+	inf->strm.next_in = Z_NULL;
+	if((inf->status = inflateInit(&inf->strm)) != Z_OK)
+	{
+		error("Unable to initialise zlib: %d", inf->status);
+		safe_free(inf);
+		return false;
+	}
+
+	inf->next_block = 0;
+	inf->out_size = MAX(out_size, CHUNK_SIZE);
+	inf->out = safe_malloc(inf->out_size);
+
+	mod->inflate = inf;
+
+	return true;
+}
+
+/*
+ * returns the zlib status, Z_STREAM_END when we have it all
+ */
+
+static int
+inflate_data(struct module *mod, unsigned char *data, uint32_t length)
+{
+	struct module_inflate *inf = mod->inflate;
+	uint64_t start;
+	uLong total_out;
+
+	/* ignore anything after the end of the stream or an error */
+	if(inf->status != Z_OK)
+		return inf->status;
+
+	start = stats_now();
+	total_out = inf->strm.total_out;
+
+	inf->strm.next_in = data;
+	inf->strm.avail_in = length;
+	do
+	{
+		/* only happens if the size in the DII was wrong */
+		if(inf->strm.total_out == inf->out_size)
+		{
+			inf->out_size *= 2;
+			inf->out = safe_realloc(inf->out, inf->out_size);
+		}
+		inf->strm.next_out = inf->out + inf->strm.total_out;
+		inf->strm.avail_out = inf->out_size - inf->strm.total_out;
+		inf->status = inflate(&inf->strm, Z_NO_FLUSH);
+		/* not an error, just means it needs more input */
+		if(inf->status == Z_BUF_ERROR)
+			inf->status = Z_OK;
+	}
+	while(inf->status == Z_OK && (inf->strm.avail_in != 0 || inf->strm.avail_out == 0));
+
+	stats_inflate(stats_now() - start, inf->strm.total_out - total_out);
+
+	return inf->status;
+}
+
+/*
+ * if keep is true, replace the compressed data with the uncompressed data
+ */
+
+static void
+end_inflate(struct module *mod, bool keep)
+{
+	struct module_inflate *inf = mod->inflate;
+
+	inflateEnd(&inf->strm);
+
+	if(keep)
+	{
+		free_module_data(mod);
+		mod->data = inf->out;
+		mod->size = inf->strm.total_out;
+	}
+	else
+	{
+		safe_free(inf->out);
+	}
+
+	safe_free(inf);
+	mod->inflate = NULL;
+
+	return;
+}
+
+/*
+ * give inflate any blocks that follow on from the ones it has already had
+ */
+
+static void
+inflate_blocks(struct module *mod)
+{
+	struct module_inflate *inf;
+	uint32_t offset;
+	uint32_t length;
+
+	if(mod->inflate == NULL
+	   && !start_inflate(mod, MIN(mod->original_size, (uint64_t) mod->size * MAX_INFLATE_GUESS)))
+		return;
+
+	inf = mod->inflate;
+	while(inf->next_block < mod->nblocks
+	   && have_block(mod, inf->next_block)
+	   && inf->status == Z_OK)
+	{
+		offset = inf->next_block * mod->block_size;
+		length = MIN(mod->block_size, mod->size - offset);
+		inflate_data(mod, mod->data + offset, length);
+		if(inf->status != Z_OK && inf->status != Z_STREAM_END)
+		{
+			verbose("Unable to inflate module %u: %d", mod->module_id, inf->status);
+			return;
+		}
+		/*
+		 * keep the compressed blocks, uncompress_module() needs them if inflating fails
+		 * they are freed by end_inflate() when we have inflated it all
+		 */
+		inf->next_block ++;
+	}
+
+	return;
+}
+
 /*
  * returns NULL if the module does not exist
- * if this is an update to a module we already have, the old one is deleted
+ * returns whatever version of the module we have, the caller checks if it is the one it wants
  */
 
 struct module *
-find_module(struct carousel *car, uint16_t module_id, uint8_t version, uint32_t download_id)
+find_module(struct carousel *car, uint16_t module_id, uint32_t download_id)
 {
+	struct module *mod;
+
+	for(mod=car->modules[module_hash(download_id, module_id)]; mod!=NULL; mod=mod->next)
+	{
+		if(mod->module_id == module_id
+		&& mod->download_id == download_id)
+			return mod;
+	}
+
+	return NULL;
+}
+
+/*
+ * returns true if any of the current DIIs for download_id list the module
+ */
+
+static bool
+module_listed(struct carousel *car, uint32_t download_id, uint16_t module_id)
+{
+	struct dii_version *ver;
 	unsigned int i;
+	unsigned int j;
 
-	for(i=0; i<car->nmodules; i++)
+	for(i=0; i<car->ndiis; i++)
 	{
-		if(car->modules[i].module_id == module_id
-		&& car->modules[i].download_id == download_id)
+		ver = &car->diis[i];
+		if(ver->download_id != download_id)
+			continue;
+		for(j=0; j<ver->nmodules; j++)
 		{
-			/* spot on */
-			if(car->modules[i].version == version)
-			{
-				return &car->modules[i];
-			}
-			/* is it an update to one we already have */
-			else if(car->modules[i].version < version)
-			{
-				delete_module(car, i);
-				return NULL;
-			}
+			if(ver->module_ids[j] == module_id)
+				return true;
 		}
 	}
 
-	return NULL;
+	return false;
+}
+
+/*
+ * delete any modules with this download_id that none of its DIIs list any more
+ * the files they contained are removed too
+ */
+
+void
+delete_old_modules(struct carousel *car, uint32_t download_id)
+{
+	struct module *mod;
+	struct module *next;
+	unsigned int hash;
+
+	for(hash=0; hash<MODULE_HASH_SIZE; hash++)
+	{
+		for(mod=car->modules[hash]; mod!=NULL; mod=next)
+		{
+			next = mod->next;
+			if(mod->download_id != download_id
+			|| module_listed(car, download_id, mod->module_id))
+				continue;
+			verbose("Module %u removed from carousel", mod->module_id);
+			fs_delete_module(mod->download_id, mod->module_id);
+			delete_module(car, mod);
+		}
+	}
+
+	return;
 }
 
 struct module *
 add_module(struct carousel *car, struct DownloadInfoIndication *dii, struct DIIModule *diimod)
 {
 	struct module *mod;
+	unsigned int hash;
+	unsigned int i;
 
-	car->nmodules ++;
-	car->modules = safe_realloc(car->modules, car->nmodules * sizeof(struct module));
-	mod = &car->modules[car->nmodules - 1];
+	mod = safe_malloc(sizeof(struct module));
 
 	mod->module_id = ntohs(diimod->moduleId);
 	mod->download_id = ntohl(dii->downloadId);
@@ -78,28 +347,95 @@ add_module(struct carousel *car, struct DownloadInfoIndication *dii, struct DIIM
 	mod->block_size = ntohs(dii->blockSize);
 	mod->nblocks = (ntohl(diimod->moduleSize) + mod->block_size - 1) / mod->block_size;
 	mod->blocks_left = mod->nblocks;
-	mod->got_block = safe_malloc(mod->nblocks * sizeof(bool));
-	bzero(mod->got_block, mod->nblocks * sizeof(bool));
+	mod->got_block = safe_malloc(BITMAP_SIZE(mod->nblocks));
+	bzero(mod->got_block, BITMAP_SIZE(mod->nblocks));
 	mod->size = ntohl(diimod->moduleSize);
-	mod->data = safe_malloc(mod->size);
+	mod->data = NULL;
+	mod->mapped_size = 0;
+	mod->original_size = DIIModule_originalSize(diimod);
+	mod->inflate = NULL;
+	mod->priority = PRIORITY_NORMAL;
+	for(i=0; i<car->npriorities; i++)
+	{
+		if(car->priorities[i].download_id == mod->download_id
+		&& car->priorities[i].module_id == mod->module_id)
+			mod->priority = car->priorities[i].priority;
+	}
+
+	mod->stats = stats_add_module(car->stats, mod->download_id, mod->module_id, mod->version, mod->nblocks);
 
-	verbose("add_module: nmodules=%u module=%u size=%u", car->nmodules, mod->module_id, mod->size);
+	/* add it to the start of its hash bucket */
+	hash = module_hash(mod->download_id, mod->module_id);
+	mod->next = car->modules[hash];
+	car->modules[hash] = mod;
+	car->nmodules ++;
+
+	verbose("add_module: nmodules=%u module=%u size=%u original_size=%u", car->nmodules, mod->module_id, mod->size, mod->original_size);
 
 	return mod;
 }
 
+/*
+ * download the blocks of this module before those of lower priority modules
+ * we remember it, so future versions of the module get the same priority
+ * a module's priority is never lowered
+ */
+
 void
-delete_module(struct carousel *car, uint32_t num)
+set_module_priority(struct carousel *car, uint32_t download_id, uint16_t module_id, unsigned int priority)
 {
-	uint32_t size;
+	struct module *mod;
+	unsigned int i;
+
+	for(i=0; i<car->npriorities; i++)
+	{
+		if(car->priorities[i].download_id == download_id
+		&& car->priorities[i].module_id == module_id)
+			break;
+	}
+
+	if(i == car->npriorities)
+	{
+		car->priorities = safe_realloc(car->priorities, (car->npriorities + 1) * sizeof(struct module_priority));
+		car->priorities[i].download_id = download_id;
+		car->priorities[i].module_id = module_id;
+		car->priorities[i].priority = PRIORITY_NORMAL;
+		car->npriorities ++;
+	}
+
+	if(car->priorities[i].priority >= priority)
+		return;
 
-	free_module(&car->modules[num]);
+	verbose("Module %u priority %u", module_id, priority);
+	car->priorities[i].priority = priority;
 
-	size = ((car->nmodules - 1) - num) * sizeof(struct module);
-	if(size > 0)
-		memmove(&car->modules[num], &car->modules[num + 1], size);
+	if((mod = find_module(car, module_id, download_id)) != NULL)
+		mod->priority = priority;
 
-	car->nmodules --;
+	return;
+}
+
+/*
+ * removes the module from the carousel and frees it
+ */
+
+void
+delete_module(struct carousel *car, struct module *mod)
+{
+	struct module **prev;
+
+	for(prev=&car->modules[module_hash(mod->download_id, mod->module_id)]; *prev!=NULL; prev=&(*prev)->next)
+	{
+		if(*prev == mod)
+		{
+			*prev = mod->next;
+			free_module(mod);
+			car->nmodules --;
+			return;
+		}
+	}
+
+	error("delete_module: module %u not found", mod->module_id);
 
 	return;
 }
@@ -107,15 +443,41 @@ delete_module(struct carousel *car, uint32_t num)
 void
 free_module(struct module *mod)
 {
-	safe_free(mod->data);
+	if(mod->inflate != NULL)
+		end_inflate(mod, false);
+	free_module_data(mod);
+	stats_del_module(mod->stats);
 	safe_free(mod->got_block);
+	safe_free(mod);
 
 	return;
 }
 
+/*
+ * returns true if we have all the modules the DIIs have told us about so far
+ */
+
+static bool
+carousel_complete(struct carousel *car)
+{
+	struct module *mod;
+	unsigned int i;
+
+	for(i=0; i<MODULE_HASH_SIZE; i++)
+	{
+		for(mod=car->modules[i]; mod!=NULL; mod=mod->next)
+			if(mod->blocks_left != 0)
+				return false;
+	}
+
+	return true;
+}
+
 void
 download_block(struct carousel *car, struct module *mod, uint16_t block, unsigned char *data, uint32_t length)
 {
+	uint32_t download_size;
+
 	/* assert */
 	if(block >= mod->nblocks)
 	{
@@ -124,20 +486,48 @@ download_block(struct carousel *car, struct module *mod, uint16_t block, unsigne
 	}
 
 	/* have we already got it */
-	if(mod->got_block[block])
+	if(have_block(mod, block))
+	{
+		if(car->stats != NULL)
+			car->stats->duplicates ++;
 		return;
+	}
 
-	mod->got_block[block] = true;
+	/* make sure it fits */
+	if((block * mod->block_size) + length > mod->size)
+	{
+		error("download_block: moduleId=%u block=%u length=%u size=%u", mod->module_id, block, length, mod->size);
+		return;
+	}
+
+	if(mod->data == NULL && !alloc_module_data(mod))
+		return;
+
+	set_block(mod, block);
 	memcpy(mod->data + (block * mod->block_size), data, length);
 
 	mod->blocks_left --;
+	if(mod->stats != NULL)
+		mod->stats->blocks_left = mod->blocks_left;
 
 	verbose("download_block: module=%u block=%u left=%u", mod->module_id, block, mod->blocks_left);
 
+	/* if the DII says it is compressed, inflate what we can now rather than waiting for all of it */
+	if(mod->original_size != 0)
+		inflate_blocks(mod);
+
 	/* have we got it all yet */
 	if(mod->blocks_left == 0)
 	{
 		verbose("got module %u (size=%u)", mod->module_id, mod->size);
+		/* inflating changes size, remember it in case we need to download it again */
+		download_size = mod->size;
+		if(mod->inflate != NULL)
+		{
+			/* if it went wrong, try uncompress_module below */
+			end_inflate(mod, mod->inflate->status == Z_STREAM_END);
+			verbose("inflated size=%u", mod->size);
+		}
 		/* if it doesn't start with 'BIOP' assume it is compressed */
 		if(strncmp((char *) mod->data, BIOP_MAGIC_STR, BIOP_MAGIC_LEN) != 0)
 		{
@@ -145,76 +535,50 @@ download_block(struct carousel *car, struct module *mod, uint16_t block, unsigne
 			uncompress_module(mod);
 			verbose("uncompressed size=%u", mod->size);
 		}
+		/* readers see all the objects in the module change at once, or none of them if it fails */
+		fs_begin_update(car->current_pid, mod->download_id, mod->module_id);
 		if(process_biop(car, mod, (struct BIOPMessageHeader *) mod->data, mod->size))
 		{
+			fs_commit_update();
 			/* we can free the data now, keep got_block so we don't download it again */
-			safe_free(mod->data);
-			/* delete_module may safe_free it again */
-			mod->data = NULL;
+			free_module_data(mod);
+			if(carousel_complete(car))
+				stats_complete(car->stats);
 		}
 		else
 		{
+			fs_abort_update();
 			/* failed to process it, try downloading it again */
+			free_module_data(mod);
+			mod->size = download_size;
 			mod->blocks_left = mod->nblocks;
-			/* assumes false == 0 */
-			bzero(mod->got_block, mod->nblocks * sizeof(bool));
+			bzero(mod->got_block, BITMAP_SIZE(mod->nblocks));
+			if(mod->stats != NULL)
+				mod->stats->blocks_left = mod->blocks_left;
 		}
 	}
 
 	return;
 }
 
-/*
- * uncompress in blocks of this size
- * this is also the minimum size of an uncompressed file
- */
-#define CHUNK_SIZE	(4 * 1024)
-
 int
 uncompress_module(struct module *mod)
 {
 	int ret;
-	z_stream strm;
-	unsigned char *out = NULL;
-	unsigned int out_size = 0;
 
-	/* init zlib state */
-	strm.zalloc = Z_NULL;
-	strm.zfree = Z_NULL;
-	strm.opaque = Z_NULL;
-	strm.avail_in = 0;
-	strm.next_in = Z_NULL;
-	ret = inflateInit(&strm);
-	if(ret != Z_OK)
-		return ret;
+	/* guess how big it will be, inflate_data will make it bigger if needed */
+	if(!start_inflate(mod, mod->size * 4))
+		return Z_MEM_ERROR;
 
-	strm.avail_in = mod->size;
-	strm.next_in = mod->data;
-	/* decompress until ouput buffer not full */
-	do
+	ret = inflate_data(mod, mod->data, mod->size);
+	if(ret != Z_OK && ret != Z_STREAM_END)
 	{
-		out = safe_realloc(out, out_size + CHUNK_SIZE);
-		strm.avail_out = CHUNK_SIZE;
-		strm.next_out = out + out_size;
-		ret = inflate(&strm, Z_NO_FLUSH);
-		if(ret != Z_OK && ret != Z_STREAM_END)
-		{
-			inflateEnd(&strm);
-			safe_free(out);
-			return ret;
-		}
-		out_size += CHUNK_SIZE - strm.avail_out;
+		end_inflate(mod, false);
+		return ret;
 	}
-	while(strm.avail_out == 0);
-
-	/* clean up */
-	inflateEnd(&strm);
 
 	/* swap compressed with uncompressed data */
-	safe_free(mod->data);
-	mod->data = out;
-	mod->size = out_size;
+	end_inflate(mod, true);
 
 	return Z_OK;
 }
-
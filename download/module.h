@@ -27,9 +27,11 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <sys/types.h>
+#include <zlib.h>
 
 #include "dsmcc.h"
 #include "assoc.h"
+#include "stats.h"
 
 /* PIDs we are reading */
 struct pid_fds
@@ -37,20 +39,81 @@ struct pid_fds
 	uint16_t pid;		/* DVB programme ID */
 	int fd_ctrl;		/* fd for reading DSMCC control table (0x3b) */
 	int fd_data;		/* fd for reading DSMCC data table (0x3c) */
+	unsigned int overflows;	/* number of times the demux buffer has overflowed */
+};
+
+/* sections we have read from the demux but not processed yet (defined in table.c) */
+struct section_queue;
+
+/* state for inflating a compressed module as its blocks arrive */
+struct module_inflate
+{
+	z_stream strm;
+	int status;			/* return value from the last call to inflate() */
+	uint16_t next_block;		/* next block to give to inflate() */
+	unsigned char *out;		/* the uncompressed data */
+	uint32_t out_size;		/* bytes allocated for out */
 };
 
 /* data about each module */
 struct module
 {
+	struct module *next;		/* next module in the same hash bucket */
 	uint16_t module_id;
 	uint32_t download_id;
 	uint8_t version;
 	uint16_t block_size;
 	uint16_t nblocks;
 	uint32_t blocks_left;		/* number of blocks left to download */
-	bool *got_block;		/* which blocks we have downloaded so far */
+	uint8_t *got_block;		/* bitmap of the blocks we have downloaded so far */
 	uint32_t size;			/* size of the file */
-	unsigned char *data;		/* the actual file data */
+	unsigned char *data;		/* the actual file data, NULL until we get the first block */
+	uint32_t mapped_size;		/* non-zero if data was mmap'ed rather than malloc'ed */
+	uint32_t original_size;		/* uncompressed size from the DII, 0 => not compressed */
+	struct module_inflate *inflate;	/* NULL until we start inflating it */
+	unsigned int priority;		/* PRIORITY_NORMAL etc */
+	struct module_stats *stats;	/* NULL if we are not keeping stats for it */
+};
+
+/*
+ * how urgently we want a section, higher values are processed first
+ * when we can't keep up, the lowest priority sections are thrown away
+ * (they will be broadcast again next time round the carousel)
+ */
+#define PRIORITY_NONE		0	/* a block we don't need */
+#define PRIORITY_NORMAL		1	/* a block of any other module */
+#define PRIORITY_WANTED		2	/* a block of a module the browser has asked for a file from */
+#define PRIORITY_BOOT		3	/* a block of the service gateway or boot application */
+#define PRIORITY_CONTROL	4	/* a DSI or DII */
+
+/* modules that should get a higher priority than normal */
+struct module_priority
+{
+	uint32_t download_id;
+	uint16_t module_id;
+	unsigned int priority;
+};
+
+/* modules bigger than this are mmap'ed so only the pages we write blocks into use memory */
+#define MODULE_MMAP_SIZE	(64 * 1024)
+
+/* number of hash buckets in struct carousel, must be a power of 2 */
+#define MODULE_HASH_SIZE	256
+
+/*
+ * the transactionId of a DII changes when any of its modules change
+ * a two layer carousel has several DIIs with the same downloadId,
+ * the identification bits of the transactionId tell us which one it is
+ */
+#define DII_IDENTIFICATION(TID)	(((TID) >> 1) & 0x7fff)
+
+struct dii_version
+{
+	uint32_t download_id;
+	uint16_t identification;	/* DII_IDENTIFICATION(transaction_id) */
+	uint32_t transaction_id;	/* version of the last DII we processed with this identification */
+	unsigned int nmodules;		/* modules it lists */
+	uint16_t *module_ids;		/* array, nmodules in length */
 };
 
 /* the whole carousel */
@@ -71,16 +134,31 @@ struct carousel
 	uint16_t current_pid;		/* PID we downloaded the last table from */
 	struct assoc assoc;		/* map stream_id's to elementary_pid's */
 	int32_t npids;			/* PIDs we are reading data from */
-	struct pid_fds *pids;		/* array, npids in length */
+	struct pid_fds *pids;		/* array, npids in length, fds are -1 if another carousel in the group reads the PID */
+	int epoll_fd;			/* waits for data on any of the pids, -1 => not created yet */
+	struct section_queue *sections;	/* read from the pids but not processed yet */
+	struct carousel *group;		/* first carousel on the multiplex, it reads the PIDs for the whole group */
+	struct carousel *next;		/* next carousel in the group */
+	uint32_t group_index;		/* our position in the group, the first carousel is 0 */
+	unsigned int nservices;		/* other services that use this carousel */
+	uint16_t *services;		/* array, nservices in length */
 	bool got_dsi;			/* true if we have downloaded the DSI */
+	uint32_t dsi_transaction_id;	/* version of the DSI we have */
+	unsigned int ndiis;		/* DIIs we have seen */
+	struct dii_version *diis;	/* array, ndiis in length */
+	unsigned int npriorities;	/* modules we want before the others */
+	struct module_priority *priorities;	/* array, npriorities in length */
 	uint32_t nmodules;		/* modules we have/are downloading */
-	struct module *modules;		/* array, nmodules in length */
+	struct module *modules[MODULE_HASH_SIZE];	/* hashed on download_id and module_id */
+	struct carousel_stats *stats;	/* NULL if we are not keeping stats for it */
 };
 
 /* functions */
-struct module *find_module(struct carousel *, uint16_t, uint8_t, uint32_t);
+struct module *find_module(struct carousel *, uint16_t, uint32_t);
 struct module *add_module(struct carousel *, struct DownloadInfoIndication *, struct DIIModule *);
-void delete_module(struct carousel *, uint32_t);
+void delete_module(struct carousel *, struct module *);
+void delete_old_modules(struct carousel *, uint32_t);
+void set_module_priority(struct carousel *, uint32_t, uint16_t, unsigned int);
 void free_module(struct module *);
 void download_block(struct carousel *, struct module *, uint16_t, unsigned char *, uint32_t);
 
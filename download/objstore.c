@@ -0,0 +1,543 @@
+/*
+ * objstore.c
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "objstore.h"
+#include "utils.h"
+
+/*
+ * the carousel is downloaded by one process and each command is run in another
+ * so the objects are kept in a shared mapping created before any of them are forked
+ * the downloader appends entries to it, the command processes only read it
+ * entries are never changed once they have been added,
+ * an updated object is added again at the start of its hash bucket so it hides the old one
+ * a deleted object is hidden in the same way, by adding an OBJSTORE_DELETED entry with its name
+ * this means readers never need to lock anything
+ *
+ * when a module is updated, all the objects in it should change at the same time
+ * so the downloader adds them between objstore_begin() and objstore_commit()
+ * the new entries are given the next generation number, readers skip entries newer than the published generation
+ * objstore_commit() publishes the new generation, so readers see all the changes at once
+ *
+ * each time new objects become visible, the changes counter is incremented and anyone in objstore_wait() is woken up
+ * it is a futex in the shared mapping, so it works across all the processes
+ *
+ * when the store fills up, or we retune to a different carousel, objstore_reset() empties it and starts again
+ * anything not added again since then is read from the file system
+ * the epoch is a sequence lock, it is odd while a reset is in progress and incremented again when it is done
+ * readers wait for an even epoch before they start and check it has not changed when they are done,
+ * so they never use an entry that has been overwritten
+ * an overwritten entry may contain anything, so its sizes are checked before they are used
+ */
+
+struct objstore
+{
+	uint32_t used;					/* bytes used, including this header */
+	uint32_t epoch;					/* odd while the store is being reset */
+	uint32_t published;				/* readers only see entries from this generation or earlier */
+	uint32_t changes;				/* incremented each time we add or publish something */
+	uint32_t bucket[OBJSTORE_HASH_SIZE];		/* offset of the first entry, 0 => empty */
+};
+
+static struct objstore *_store = NULL;
+
+/* only used in the downloader process, entries added since objstore_begin() */
+static bool _in_update = false;
+static uint32_t *_pending = NULL;
+static unsigned int _npending = 0;
+
+/* keep entries aligned */
+#define ENTRY_ALIGN(N)	(((N) + 7) & ~7)
+
+static uint32_t
+name_hash(char *name, size_t len)
+{
+	uint32_t hash = 0;
+
+	while(len != 0)
+	{
+		hash = (hash * 31) + *((unsigned char *) name);
+		name ++;
+		len --;
+	}
+
+	return hash;
+}
+
+static char *
+entry_name(struct objstore_entry *ent)
+{
+	return ((char *) ent) + sizeof(struct objstore_entry);
+}
+
+static unsigned char *
+entry_data(struct objstore_entry *ent, uint16_t name_len)
+{
+	return ((unsigned char *) ent) + sizeof(struct objstore_entry) + name_len;
+}
+
+/*
+ * returns true if an entry with this much name and data would fit in the store
+ * stops us reading past the end of the mapping if the entry has been overwritten
+ */
+
+static bool
+entry_fits(struct objstore_entry *ent, uint16_t name_len, uint32_t size)
+{
+	uint32_t offset = ((unsigned char *) ent) - ((unsigned char *) _store);
+
+	return ((uint64_t) offset + sizeof(struct objstore_entry) + name_len + size) <= OBJSTORE_SIZE;
+}
+
+/*
+ * must be called before we fork the downloader and any command processes
+ */
+
+bool
+objstore_init(void)
+{
+	void *map;
+
+	map = mmap(NULL, OBJSTORE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(map == MAP_FAILED)
+	{
+		error("Unable to create object store: %s", strerror(errno));
+		return false;
+	}
+
+	_store = map;
+	_store->used = ENTRY_ALIGN(sizeof(struct objstore));
+	_store->epoch = 0;
+	_store->published = 0;
+	_store->changes = 0;
+
+	return true;
+}
+
+/*
+ * wake up any processes waiting for new objects
+ */
+
+static void
+notify_change(void)
+{
+	__atomic_add_fetch(&_store->changes, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &_store->changes, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+	return;
+}
+
+/*
+ * throw away all the entries, the file system still has the objects
+ * called by the downloader when the store is full,
+ * and by the main process when it starts a new downloader on retune
+ */
+
+void
+objstore_reset(void)
+{
+	unsigned int i;
+
+	if(_store == NULL)
+		return;
+
+	/*
+	 * make the epoch odd while we empty it
+	 * it may already be odd if a downloader was killed in the middle of a reset
+	 */
+	__atomic_or_fetch(&_store->epoch, 1, __ATOMIC_SEQ_CST);
+
+	for(i=0; i<OBJSTORE_HASH_SIZE; i++)
+		__atomic_store_n(&_store->bucket[i], 0, __ATOMIC_RELEASE);
+	_store->used = ENTRY_ALIGN(sizeof(struct objstore));
+
+	/* readers that started before the reset see a different epoch and stop using what they have found */
+	__atomic_add_fetch(&_store->epoch, 1, __ATOMIC_SEQ_CST);
+
+	/* anything from an uncommitted update has gone too */
+	_npending = 0;
+
+	notify_change();
+
+	return;
+}
+
+/*
+ * only called by the downloader process
+ * name is the path of the object in the file system
+ * we take a copy of name and data
+ * if we are in an update, readers won't see it until objstore_commit() is called
+ */
+
+void
+objstore_add(uint8_t type, char *name, unsigned char *data, uint32_t size)
+{
+	struct objstore_entry *ent;
+	size_t name_len;
+	size_t ent_size;
+	uint32_t offset;
+	unsigned int bucket;
+
+	if(_store == NULL)
+		return;
+
+	name_len = strlen(name) + 1;
+	ent_size = ENTRY_ALIGN(sizeof(struct objstore_entry) + name_len + size);
+
+	/* start again, this also gets rid of any old version of this object */
+	if(ent_size > OBJSTORE_SIZE - _store->used)
+	{
+		verbose("Object store full, emptying it");
+		objstore_reset();
+	}
+
+	/* it is in the file system now, even if we can't keep a copy */
+	if(ent_size > OBJSTORE_SIZE - _store->used)
+	{
+		error("Object '%s' is too big for the object store", name);
+		if(!_in_update)
+			notify_change();
+		return;
+	}
+
+	offset = _store->used;
+	_store->used += ent_size;
+
+	ent = (struct objstore_entry *) (((unsigned char *) _store) + offset);
+	ent->hash = name_hash(name, name_len - 1);
+	ent->size = size;
+	ent->name_len = name_len;
+	ent->type = type;
+	memcpy(entry_name(ent), name, name_len);
+	if(size != 0)
+		memcpy(entry_data(ent, name_len), data, size);
+
+	/* link it in when the update is committed */
+	if(_in_update)
+	{
+		_pending = safe_realloc(_pending, (_npending + 1) * sizeof(uint32_t));
+		_pending[_npending ++] = offset;
+		return;
+	}
+
+	ent->generation = _store->published;
+
+	/* make sure it is all written before the readers can see it */
+	bucket = ent->hash & (OBJSTORE_HASH_SIZE - 1);
+	ent->next = _store->bucket[bucket];
+	__atomic_store_n(&_store->bucket[bucket], offset, __ATOMIC_RELEASE);
+
+	notify_change();
+
+	return;
+}
+
+/*
+ * only called by the downloader process
+ * name has been removed from the file system, stop readers seeing any old copy of it
+ */
+
+void
+objstore_remove(char *name)
+{
+	objstore_add(OBJSTORE_DELETED, name, NULL, 0);
+
+	return;
+}
+
+/*
+ * the following entries are not seen by readers until objstore_commit() is called
+ */
+
+void
+objstore_begin(void)
+{
+	_in_update = true;
+	_npending = 0;
+
+	return;
+}
+
+/*
+ * make all the entries added since objstore_begin() visible at the same time
+ */
+
+void
+objstore_commit(void)
+{
+	struct objstore_entry *ent;
+	uint32_t generation;
+	unsigned int bucket;
+	unsigned int i;
+
+	_in_update = false;
+
+	if(_store == NULL)
+		return;
+
+	/* the files have been renamed into place, even if we have nothing to publish here */
+	if(_npending == 0)
+	{
+		notify_change();
+		return;
+	}
+
+	/* readers skip these entries until we publish the new generation */
+	generation = _store->published + 1;
+	for(i=0; i<_npending; i++)
+	{
+		ent = (struct objstore_entry *) (((unsigned char *) _store) + _pending[i]);
+		ent->generation = generation;
+		bucket = ent->hash & (OBJSTORE_HASH_SIZE - 1);
+		ent->next = _store->bucket[bucket];
+		__atomic_store_n(&_store->bucket[bucket], _pending[i], __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&_store->published, generation, __ATOMIC_RELEASE);
+
+	_npending = 0;
+
+	notify_change();
+
+	return;
+}
+
+/*
+ * forget the entries added since objstore_begin()
+ * they were never linked in, so readers never saw them, we just waste the space
+ */
+
+void
+objstore_abort(void)
+{
+	_in_update = false;
+	_npending = 0;
+
+	return;
+}
+
+/*
+ * returns the entry with exactly this name, or NULL
+ * also returns NULL if it has been deleted, or the store is reset while we are looking
+ */
+
+static struct objstore_entry *
+find_entry(char *name, size_t len, uint32_t published, uint32_t epoch)
+{
+	struct objstore_entry *ent;
+	uint32_t hash;
+	uint32_t offset;
+
+	hash = name_hash(name, len);
+	offset = __atomic_load_n(&_store->bucket[hash & (OBJSTORE_HASH_SIZE - 1)], __ATOMIC_ACQUIRE);
+	while(offset != 0)
+	{
+		/* the entries may have been overwritten */
+		if(offset > OBJSTORE_SIZE - sizeof(struct objstore_entry)
+		|| !objstore_valid(epoch))
+			return NULL;
+		ent = (struct objstore_entry *) (((unsigned char *) _store) + offset);
+		/* skip entries from an update that has not been committed yet */
+		if(ent->generation <= published
+		&& ent->hash == hash
+		&& ent->name_len == len + 1
+		&& entry_fits(ent, len + 1, 0)
+		&& memcmp(entry_name(ent), name, len) == 0)
+			return (ent->type != OBJSTORE_DELETED) ? ent : NULL;
+		offset = ent->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * resolve a path such as "services/<ServiceID>/a/b" to a file or directory
+ * follows links in the same way the file system would, but in one pass with no system calls
+ * path components that are not in the store are assumed to be real directories (eg "services")
+ * returns NULL if it is not in the store, the file system may still have it
+ * epoch should come from objstore_epoch(), check objstore_valid() after using the entry
+ */
+
+struct objstore_entry *
+objstore_find(char *path, uint32_t epoch)
+{
+	char name[PATH_MAX];
+	size_t len;
+	size_t comp_len;
+	struct objstore_entry *ent;
+	uint32_t published;
+	uint32_t size;
+
+	if(_store == NULL)
+		return NULL;
+
+	/* use the same generation for the whole path, so we don't see half an update */
+	published = __atomic_load_n(&_store->published, __ATOMIC_ACQUIRE);
+
+	len = 0;
+	ent = NULL;
+	while(*path != '\0')
+	{
+		/* find the next component */
+		comp_len = strcspn(path, "/");
+		if(len + 1 + comp_len >= sizeof(name))
+			return NULL;
+		if(len != 0)
+			name[len++] = '/';
+		memcpy(&name[len], path, comp_len);
+		len += comp_len;
+		path += comp_len;
+		if(*path == '/')
+			path ++;
+		/* if it is a link, carry on from whatever it points to */
+		if((ent = find_entry(name, len, published, epoch)) != NULL
+		&& ent->type == OBJSTORE_LINK)
+		{
+			size = ent->size;
+			if(size >= sizeof(name) || !entry_fits(ent, len + 1, size))
+				return NULL;
+			memcpy(name, entry_data(ent, len + 1), size);
+			if(!objstore_valid(epoch))
+				return NULL;
+			len = size;
+			ent = find_entry(name, len, published, epoch);
+		}
+	}
+
+	return ent;
+}
+
+/*
+ * pass this to objstore_find(), then objstore_valid() tells you if the store was reset while you were using the entry
+ * if a reset is in progress, wait for it to finish, it only takes as long as clearing the hash buckets
+ */
+
+uint32_t
+objstore_epoch(void)
+{
+	uint32_t epoch;
+
+	if(_store == NULL)
+		return 0;
+
+	while(((epoch = __atomic_load_n(&_store->epoch, __ATOMIC_ACQUIRE)) & 1) != 0)
+		sched_yield();
+
+	return epoch;
+}
+
+/*
+ * returns false if the store has been reset, or is being reset, since objstore_epoch() returned epoch
+ */
+
+bool
+objstore_valid(uint32_t epoch)
+{
+	if(_store == NULL)
+		return false;
+
+	/* make sure anything we read from the store happens before we check */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	return __atomic_load_n(&_store->epoch, __ATOMIC_ACQUIRE) == epoch;
+}
+
+/*
+ * returns a counter that changes each time new objects are added
+ * pass it to objstore_wait() to wait for the next change
+ */
+
+uint32_t
+objstore_changes(void)
+{
+	if(_store == NULL)
+		return 0;
+
+	return __atomic_load_n(&_store->changes, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * wait until objstore_changes() is no longer seen, or for timeout milliseconds
+ * if there is no object store, we just wait for the timeout
+ */
+
+void
+objstore_wait(uint32_t seen, unsigned int timeout)
+{
+	struct timespec ts;
+
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+
+	if(_store == NULL)
+		nanosleep(&ts, NULL);
+	else
+		syscall(SYS_futex, &_store->changes, FUTEX_WAIT, seen, &ts, NULL, 0);
+
+	return;
+}
+
+/*
+ * returns a copy of the entry's data, with a \0 after it so empty files still get a buffer
+ * sets *size to the number of bytes of data
+ * returns NULL if the store has been reset since objstore_epoch() returned epoch, use the file system instead
+ * free the copy with safe_free()
+ */
+
+unsigned char *
+objstore_copy(struct objstore_entry *ent, uint32_t epoch, uint32_t *size)
+{
+	unsigned char *data;
+	uint16_t name_len;
+	uint32_t data_size;
+
+	/* only believe the sizes if the entry fits in the store */
+	name_len = ent->name_len;
+	data_size = ent->size;
+	if(!entry_fits(ent, name_len, data_size) || !objstore_valid(epoch))
+		return NULL;
+
+	data = safe_malloc(data_size + 1);
+	memcpy(data, entry_data(ent, name_len), data_size);
+	data[data_size] = '\0';
+
+	if(!objstore_valid(epoch))
+	{
+		safe_free(data);
+		return NULL;
+	}
+
+	*size = data_size;
+
+	return data;
+}
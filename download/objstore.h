@@ -0,0 +1,82 @@
+/*
+ * objstore.h
+ *
+ * in-memory copy of the carousel objects, shared with the command processes
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __OBJSTORE_H__
+#define __OBJSTORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * max bytes of objects we keep in memory
+ * the pages are only allocated as we use them
+ * if it fills up, we empty it and use the copy in the file system until the objects are added again
+ */
+#define OBJSTORE_SIZE		(64 * 1024 * 1024)
+
+/* number of hash buckets, must be a power of 2 */
+#define OBJSTORE_HASH_SIZE	4096
+
+/* entry types */
+#define OBJSTORE_FILE	1	/* data is the file contents */
+#define OBJSTORE_DIR	2	/* no data */
+#define OBJSTORE_LINK	3	/* data is the name of the entry it refers to */
+#define OBJSTORE_DELETED	4	/* no data, hides any older entry with the same name */
+
+/*
+ * each entry is named with the path it has in the file system
+ * eg "carousels/<PID>/<CID>/fil-<module>-<key>" or "services/<ServiceID>"
+ */
+struct objstore_entry
+{
+	uint32_t next;		/* offset of the next entry in this hash bucket, 0 => end of list */
+	uint32_t hash;		/* hash of the name */
+	uint32_t size;		/* bytes of data */
+	uint32_t generation;	/* readers can't see it until this generation is published */
+	uint16_t name_len;	/* includes the \0 terminator */
+	uint8_t type;		/* OBJSTORE_FILE etc */
+	/* char name[name_len] */
+	/* unsigned char data[size] */
+};
+
+bool objstore_init(void);
+void objstore_reset(void);
+
+void objstore_add(uint8_t, char *, unsigned char *, uint32_t);
+void objstore_remove(char *);
+
+void objstore_begin(void);
+void objstore_commit(void);
+void objstore_abort(void);
+
+uint32_t objstore_epoch(void);
+bool objstore_valid(uint32_t);
+
+struct objstore_entry *objstore_find(char *, uint32_t);
+unsigned char *objstore_copy(struct objstore_entry *, uint32_t, uint32_t *);
+
+uint32_t objstore_changes(void);
+void objstore_wait(uint32_t, unsigned int);
+
+#endif	/* __OBJSTORE_H__ */
@@ -1,10 +1,13 @@
 /*
- * rb-download [-v] [-a <adapter>] [-x <frontend>} [-y <demux>} [-z <dvr>] [-b <base_dir>] [-t <timeout>] [-f <channels_file>] [-l <listen_addr>] [-c <carousel_id>] [<service_id>]
+ * rb-download [-v] [-a <adapter>] [-x <frontend>} [-y <demux>} [-z <dvr>] [-i <ts_file>] [-b <base_dir>] [-t <timeout>] [-f <channels_file>] [-l <listen_addr>] [-w <workers>] [-m] [-s <seconds>] [-r <ring_kbytes>] [-c <carousel_id>] [<service_id>]
  *
  * Download the DVB Object Carousel for the given channel onto the local hard disc
  * files will be stored under the current dir if no -b option is given
  *
  * if no service_id is given, a list of possible channels (and their service_id) is printed
+ * this reads the SDTs for all the multiplexes on the network and saves them in ./services.idx
+ * the listener uses this file to answer the "available" command without reading channels.conf
+ * if there is no services.idx file, the listener creates one when it starts
  * the carousel ID is normally read from the PMT, use -c to explicitly set it
  *
  * the default timeout is 10 seconds
@@ -16,11 +19,21 @@
  * use the -a,-x,-y,-z options (defaults=0) to change the adapter, frontend, demux, dvr numbers
  * (eg "-a 2 -x 1 -y 1 -z 1" will use /dev/dvb/adapter2/demux1 etc)
  *
+ * any other DVB adapters are used as spare tuners,
+ * a stream for a service on a different multiplex is sent from one of them, so the carousel download is not disturbed
+ * a spare tuner is also used if a stream is wanted from our multiplex when our dvr device is already in use
+ *
+ * the -i option reads the tables from a file containing an MPEG Transport Stream instead of a DVB card
+ * (eg a capture of a whole multiplex), use "-i -" to read the Transport Stream from stdin
+ * no tuning is done, so no channels.conf file is needed
+ * the carousel is downloaded as fast as the file can be read, rb-download stops downloading at the end of the file
+ *
  * rb-download needs a "channels.conf" file which gives tuning parameters for service_id's
  * channels.conf files can be generated by the "scan" utility in the dvb-apps package at www.linuxtv.org
  * if not specified with -f, rb-download will search for:
  * ~/.tzap/channels.conf
  * /etc/channels.conf
+ * the file is read once, it is read again if it changes or if rb-download gets a SIGHUP
  *
  * rb-download listens on the network for commands from a remote rb-browser
  * the default IP to listen on is 0.0.0.0 (ie all interfaces), the default TCP port is 10101
@@ -29,6 +42,19 @@
  * eg, to listen on a different port, do "-l 8080"
  * to only listen on the loop back, do "-l 127.0.0.1" or on a different port too, do "-l 127.0.0.1:8080"
  *
+ * by default a new process is forked to handle each connection
+ * the -w option starts a fixed number of worker processes instead,
+ * each worker keeps its connections open and only forks for commands that send a stream
+ *
+ * the -m option downloads the carousels of all the MHEG services on the multiplex, not just service_id
+ * retuning to another service on the same multiplex is then instant, as its carousel is already on disk
+ *
+ * the -s option prints download statistics every <seconds> seconds
+ * (section rates, demux overflows, module progress etc), the "stats" command also returns them
+ *
+ * the *stream commands copy the transport stream through a ring buffer, so the client can stall without us losing packets
+ * the -r option sets its size in kbytes (default 8192), "-r 0" sends the stream without a ring buffer
+ *
  * -v is verbose/debug mode, use more v's for more verbosity
  *
  * the file structure will be:
@@ -68,11 +94,18 @@
 #include <netinet/in.h>
 
 #include "list.h"
+#include "scan.h"
 #include "findmheg.h"
 #include "carousel.h"
 #include "listen.h"
 #include "channels.h"
 #include "cache.h"
+#include "objstore.h"
+#include "wanted.h"
+#include "stats.h"
+#include "stream.h"
+#include "tuner.h"
+#include "tsfile.h"
 #include "utils.h"
 
 /* seconds before we assume no DSMCC data is available on this PID */
@@ -94,12 +127,17 @@ main(int argc, char *argv[])
 	unsigned int frontend;
 	unsigned int demux;
 	unsigned int dvr;
+	char *ts_file;
 	char *base_dir;
 	unsigned int timeout;
 	char *channels_file;
 	struct sockaddr_in listen_addr;
 	int carousel_id;
 	uint16_t service_id;
+	unsigned int nworkers;
+	bool all_services;
+	unsigned int stats_interval;
+	size_t ring_size;
 	int arg;
 
 	/* default values */
@@ -107,14 +145,20 @@ main(int argc, char *argv[])
 	frontend = 0;
 	demux = 0;
 	dvr = 0;
+	ts_file = NULL;
 	base_dir = NULL;
 	timeout = DEFAULT_TIMEOUT;
 	channels_file = NULL;
+	listen_addr.sin_family = AF_INET;
 	listen_addr.sin_addr.s_addr = htonl(DEFAULT_LISTEN_ADDR);
 	listen_addr.sin_port = htons(DEFAULT_LISTEN_PORT);
 	carousel_id = -1;	/* read it from the PMT */
+	nworkers = 0;		/* fork a process for each connection */
+	all_services = false;	/* only download service_id's carousel */
+	stats_interval = 0;	/* don't print the stats */
+	ring_size = DEFAULT_RING_SIZE;
 
-	while((arg = getopt(argc, argv, "a:x:y:z:b:f:t:l:c:v")) != EOF)
+	while((arg = getopt(argc, argv, "a:x:y:z:i:b:f:t:l:w:ms:r:c:v")) != EOF)
 	{
 		switch(arg)
 		{
@@ -134,6 +178,10 @@ main(int argc, char *argv[])
 			dvr = strtoul(optarg, NULL, 0);
 			break;
 
+		case 'i':
+			ts_file = optarg;
+			break;
+
 		case 'b':
 			/* don't chdir yet, in case we have a relative -f param */
 			base_dir = optarg;
@@ -152,6 +200,22 @@ main(int argc, char *argv[])
 				fatal("Unable to resolve host %s", optarg);
 			break;
 
+		case 'w':
+			nworkers = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'm':
+			all_services = true;
+			break;
+
+		case 's':
+			stats_interval = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'r':
+			ring_size = strtoul(optarg, NULL, 0) * 1024;
+			break;
+
 		case 'c':
 			carousel_id = strtoul(optarg, NULL, 0);
 			break;
@@ -166,9 +230,17 @@ main(int argc, char *argv[])
 		}
 	}
 
-	/* initialise channels.conf */
-	if(!init_channels_conf(zap_name(adapter, frontend), channels_file))
+	/* if we are reading from a file, we don't need to tune so we don't need channels.conf */
+	if(ts_file != NULL)
+	{
+		/* open it before we chdir, in case it is a relative path */
+		if(!tsfile_init(ts_file))
+			fatal("Unable to read Transport Stream from '%s'", ts_file);
+	}
+	else if(!init_channels_conf(zap_name(adapter, frontend), channels_file))
+	{
 		error("Unable to open channels.conf file");
+	}
 
 	/* do we need to change the base directory */
 	if(base_dir != NULL
@@ -178,6 +250,29 @@ main(int argc, char *argv[])
 	if(!cache_init())
 		fatal("Unable to initialise cache");
 
+	/* not fatal, the listener scans for them if we have not saved them before */
+	if(!scan_init())
+		verbose("No saved service index");
+
+	/* not fatal, we can still use the file system */
+	if(!objstore_init())
+		error("Unable to initialise object store");
+
+	/* not fatal, we just download the modules in the order they are broadcast */
+	if(!wanted_init())
+		error("Unable to initialise wanted modules list");
+
+	/* not fatal, we just can't report them */
+	if(!stats_init(stats_interval))
+		error("Unable to initialise download stats");
+
+	stream_init(ring_size);
+
+	/* not fatal, streams just come from the adapter we download the carousel with */
+	if(ts_file == NULL
+	&& !tuner_init(adapter, frontend, demux, dvr))
+		error("Unable to initialise tuner pool");
+
 	if(argc == optind)
 	{
 		list_channels(adapter, demux, timeout);
@@ -185,7 +280,7 @@ main(int argc, char *argv[])
 	else if(argc - optind == 1)
 	{
 		service_id = strtoul(argv[optind], NULL, 0);
-		start_listener(&listen_addr, adapter, frontend, demux, dvr, timeout, service_id, carousel_id);
+		start_listener(&listen_addr, adapter, frontend, demux, dvr, timeout, service_id, carousel_id, nworkers, all_services);
 	}
 	else
 	{
@@ -244,10 +339,15 @@ usage(char *prog_name)
 			"[-x <frontend>] "
 			"[-y <demux>] "
 			"[-z <dvr>] "
+			"[-i <ts_file>] "
 			"[-b <base_dir>] "
 			"[-t <timeout>] "
 			"[-f <channels_file>] "
 			"[-l <listen_addr>] "
+			"[-w <workers>] "
+			"[-m] "
+			"[-s <seconds>] "
+			"[-r <ring_kbytes>] "
 			"[-c carousel_id] "
 			"[<service_id>]", prog_name);
 }
@@ -0,0 +1,766 @@
+/*
+ * scan.c
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "scan.h"
+#include "table.h"
+#include "cache.h"
+#include "findmheg.h"
+#include "tsfile.h"
+#include "stats.h"
+#include "utils.h"
+
+/*
+ * a scan reads every section of the SDT for our multiplex, the SDTs for the other multiplexes and the NIT all at once
+ * the NIT tells us which other multiplexes there are, so we know when we have all their SDTs
+ * the PMTs tell us which services on our multiplex have an MHEG carousel
+ * we can't read the PMTs on the other multiplexes, so we keep what we knew about them from any previous scan
+ *
+ * the index is kept sorted by service_id and saved in SCAN_INDEX_FILE,
+ * so the next time we start we don't need to scan again
+ */
+
+/* service_descriptor tag */
+#define TAG_SERVICE_DESCRIPTOR	0x48
+
+/* the index is written to this file first, then renamed */
+#define NEW_SUFFIX	".new"
+
+/* each sub table we are collecting the sections of */
+struct scan_table
+{
+	uint8_t tid;
+	uint16_t id;			/* table_id_extension */
+	uint16_t original_network_id;	/* 0 for the NIT */
+	uint8_t version;
+	uint8_t last_sn;
+	uint8_t have[32];		/* bit map of the section_numbers we have */
+	bool complete;
+};
+
+/* a Transport Stream the NIT says is on the network */
+struct scan_ts
+{
+	uint16_t transport_stream_id;
+	uint16_t original_network_id;
+};
+
+struct scan_state
+{
+	unsigned int ntables;
+	struct scan_table *tables;
+	unsigned int nts;
+	struct scan_ts *ts;
+	bool nit_wanted;		/* false if we could not read the NIT */
+	bool have_actual;		/* true once we have a section of the SDT for our multiplex */
+	uint16_t actual_tsid;
+	uint16_t actual_onid;
+	uint16_t first_service;		/* a service on our multiplex */
+};
+
+static unsigned int _nservices = 0;
+static struct scan_service *_services = NULL;
+
+/* the index file we loaded, so we can tell if it has been saved again */
+static struct stat _index_stat;
+
+static void add_section(struct scan_state *, unsigned char *);
+static void parse_sdt(struct scan_state *, unsigned char *, uint16_t, bool);
+static void parse_nit(struct scan_state *, unsigned char *, uint16_t);
+static bool scan_complete(struct scan_state *);
+static struct scan_table *find_table(struct scan_state *, uint8_t, uint16_t, uint16_t);
+static void find_mheg_services(char *, unsigned int, struct scan_state *);
+static void drop_missing(struct scan_state *);
+static struct scan_service *add_service(uint16_t);
+static void copy_name(char *, unsigned char *, uint8_t);
+static bool load_index(void);
+static bool save_index(void);
+
+/*
+ * load the index we saved last time
+ * must be called after we have changed to the base directory
+ * returns false if we have not scanned before
+ */
+
+bool
+scan_init(void)
+{
+	return load_index();
+}
+
+/*
+ * read the SDTs and NIT from the given demux device and update the index
+ * returns false if we could not read the SDT for the multiplex we are tuned to
+ */
+
+bool
+scan_services(char *demux, unsigned int timeout)
+{
+	struct scan_state state;
+	struct pollfd pfd[3];
+	struct section_filter filter[3];
+	unsigned int nfilters;
+	unsigned char table[MAX_TABLE_LEN];
+	uint16_t pid;
+	uint64_t start;
+	uint64_t elapsed;
+	ssize_t n;
+	unsigned int i;
+
+	start = stats_now();
+
+	memset(&state, 0, sizeof(state));
+	state.nit_wanted = true;
+
+	for(i=0; i<_nservices; i++)
+	{
+		_services[i].actual = false;
+		_services[i].seen = false;
+	}
+
+	if(using_tsfile())
+	{
+		/* any section_number */
+		filter[0].pid = PID_NIT;
+		filter[0].tid = TID_NIT;
+		filter[1].pid = PID_SDT;
+		filter[1].tid = TID_SDT;
+		filter[2].pid = PID_SDT;
+		filter[2].tid = TID_SDT_OTHER;
+		for(i=0; i<3; i++)
+		{
+			filter[i].sn = 0;
+			filter[i].sn_mask = 0;
+		}
+		/* read the file once, stop at the end in case something is not in it */
+		tsfile_rewind();
+		while(!scan_complete(&state)
+		&& tsfile_read_section(filter, 3, table, &pid, false))
+			add_section(&state, table);
+	}
+	else
+	{
+		nfilters = 0;
+		if((pfd[nfilters].fd = open_table_filter(demux, PID_NIT, TID_NIT, -1, -1)) >= 0)
+			nfilters ++;
+		else
+			state.nit_wanted = false;
+		if((pfd[nfilters].fd = open_table_filter(demux, PID_SDT, TID_SDT, -1, -1)) >= 0)
+			nfilters ++;
+		if((pfd[nfilters].fd = open_table_filter(demux, PID_SDT, TID_SDT_OTHER, -1, -1)) >= 0)
+			nfilters ++;
+		while(nfilters > 0 && !scan_complete(&state))
+		{
+			elapsed = (stats_now() - start) / 1000000;
+			if(elapsed >= timeout * 1000)
+				break;
+			for(i=0; i<nfilters; i++)
+				pfd[i].events = POLLIN;
+			if(poll(pfd, nfilters, (timeout * 1000) - elapsed) < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				error("scan_services: poll: %s", strerror(errno));
+				break;
+			}
+			for(i=0; i<nfilters; i++)
+			{
+				if(pfd[i].revents == 0)
+					continue;
+				if((n = read(pfd[i].fd, table, MAX_TABLE_LEN)) > 0)
+					add_section(&state, table);
+				else if(n < 0 && errno != EINTR && errno != EAGAIN && errno != EOVERFLOW)
+					error("scan_services: read: %s", strerror(errno));
+			}
+		}
+		for(i=0; i<nfilters; i++)
+			close(pfd[i].fd);
+	}
+
+	if(!state.have_actual)
+	{
+		error("Unable to read SDT");
+		safe_free(state.tables);
+		safe_free(state.ts);
+		return false;
+	}
+
+	verbose("Read SDTs and NIT in %u ms%s", (unsigned int) ((stats_now() - start) / 1000000), scan_complete(&state) ? "" : " (incomplete)");
+
+	find_mheg_services(demux, timeout, &state);
+	drop_missing(&state);
+
+	safe_free(state.tables);
+	safe_free(state.ts);
+
+	/* not fatal, we just have to scan again next time */
+	if(!save_index())
+		error("Unable to save service index '%s'", SCAN_INDEX_FILE);
+
+	verbose("Scanned %u services", _nservices);
+
+	return true;
+}
+
+/*
+ * the listener scans in a separate process, so the processes it forks load the new index when it has been saved
+ * read it again if it has changed since we last loaded it
+ */
+
+void
+scan_reload(void)
+{
+	struct stat now;
+
+	if(stat(SCAN_INDEX_FILE, &now) < 0)
+		return;
+
+	if(now.st_ino != _index_stat.st_ino
+	|| now.st_size != _index_stat.st_size
+	|| now.st_mtime != _index_stat.st_mtime)
+	{
+		verbose("%s has changed", SCAN_INDEX_FILE);
+		safe_free(_services);
+		_services = NULL;
+		_nservices = 0;
+		load_index();
+	}
+
+	return;
+}
+
+/*
+ * returns true if we have no index, or it was saved more than SCAN_MAX_AGE seconds ago
+ */
+
+bool
+scan_stale(void)
+{
+	struct stat info;
+
+	if(stat(SCAN_INDEX_FILE, &info) < 0)
+		return true;
+
+	return (time(NULL) - info.st_mtime) > SCAN_MAX_AGE;
+}
+
+unsigned int
+scan_nservices(void)
+{
+	return _nservices;
+}
+
+struct scan_service *
+scan_service(unsigned int i)
+{
+	return (i < _nservices) ? &_services[i] : NULL;
+}
+
+/*
+ * returns NULL if service_id is not in the index
+ */
+
+struct scan_service *
+scan_find(uint16_t service_id)
+{
+	unsigned int lo, hi, mid;
+
+	lo = 0;
+	hi = _nservices;
+	while(lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if(_services[mid].service_id == service_id)
+			return &_services[mid];
+		else if(_services[mid].service_id < service_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+/*
+ * table is a complete NIT or SDT section
+ */
+
+static void
+add_section(struct scan_state *state, unsigned char *table)
+{
+	struct scan_table *sub;
+	uint8_t tid;
+	uint16_t size;
+	uint16_t id;
+	uint16_t onid;
+	uint8_t version;
+	uint8_t sn;
+	unsigned int i;
+
+	tid = table[0];
+	/* 12 bit section_length field */
+	size = 3 + (((table[1] & 0x0f) << 8) + table[2]);
+
+	/* ignore it if it is not current yet, or too short to have a CRC */
+	if((table[5] & 0x01) == 0 || size < 14)
+		return;
+
+	id = (table[3] << 8) + table[4];
+	version = (table[5] >> 1) & 0x1f;
+	sn = table[6];
+	onid = (tid == TID_NIT) ? 0 : (table[8] << 8) + table[9];
+
+	sub = find_table(state, tid, id, onid);
+
+	/* start again if it has changed */
+	if(sub->version != version)
+	{
+		memset(sub->have, 0, sizeof(sub->have));
+		sub->version = version;
+		sub->complete = false;
+	}
+	sub->last_sn = table[7];
+
+	if(sub->have[sn / 8] & (1 << (sn % 8)))
+		return;
+	sub->have[sn / 8] |= 1 << (sn % 8);
+
+	vverbose("scan: table 0x%x id %u section %u/%u", tid, id, sn, sub->last_sn);
+
+	if(tid == TID_NIT)
+	{
+		parse_nit(state, table, size);
+	}
+	else
+	{
+		/* find_mheg() will want this later */
+		if(tid == TID_SDT)
+			cache_save(TID_SDT, 0, sn, table);
+		parse_sdt(state, table, size, tid == TID_SDT);
+	}
+
+	sub->complete = true;
+	for(i=0; i<=sub->last_sn && sub->complete; i++)
+		sub->complete = (sub->have[i / 8] & (1 << (i % 8))) != 0;
+
+	return;
+}
+
+static void
+parse_sdt(struct scan_state *state, unsigned char *sdt, uint16_t size, bool actual)
+{
+	struct scan_service *svc;
+	uint16_t tsid;
+	uint16_t onid;
+	uint16_t service_id;
+	uint16_t offset;
+	uint16_t end;
+	uint16_t desc_loop_length;
+	uint8_t desc_tag;
+	uint8_t desc_length;
+	uint8_t provider_len;
+	uint8_t name_len;
+
+	tsid = (sdt[3] << 8) + sdt[4];
+	onid = (sdt[8] << 8) + sdt[9];
+
+	if(actual)
+	{
+		state->have_actual = true;
+		state->actual_tsid = tsid;
+		state->actual_onid = onid;
+	}
+
+	/* loop through the services, -4 for the CRC at the end */
+	offset = 11;
+	while(offset + 5 <= size - 4)
+	{
+		service_id = (sdt[offset] << 8) + sdt[offset+1];
+		desc_loop_length = ((sdt[offset+3] & 0x0f) << 8) + sdt[offset+4];
+		offset += 5;
+		end = MIN(offset + desc_loop_length, size - 4);
+		svc = add_service(service_id);
+		/* if it has moved, we no longer know if it has a carousel */
+		if(svc->transport_stream_id != tsid || svc->original_network_id != onid)
+			svc->mheg = SCAN_MHEG_UNKNOWN;
+		svc->transport_stream_id = tsid;
+		svc->original_network_id = onid;
+		svc->actual = actual;
+		svc->seen = true;
+		if(actual && state->first_service == 0)
+			state->first_service = service_id;
+		/* find the service_descriptor */
+		while(offset + 2 <= end)
+		{
+			desc_tag = sdt[offset];
+			desc_length = sdt[offset+1];
+			offset += 2;
+			if(desc_tag == TAG_SERVICE_DESCRIPTOR
+			&& desc_length >= 3
+			&& offset + desc_length <= end)
+			{
+				svc->service_type = sdt[offset];
+				provider_len = sdt[offset+1];
+				if(2 + provider_len < desc_length)
+				{
+					name_len = MIN(sdt[offset+2+provider_len], desc_length - (3 + provider_len));
+					copy_name(svc->name, &sdt[offset+3+provider_len], name_len);
+				}
+			}
+			offset += desc_length;
+		}
+		offset = end;
+	}
+
+	return;
+}
+
+static void
+parse_nit(struct scan_state *state, unsigned char *nit, uint16_t size)
+{
+	uint16_t offset;
+	uint16_t end;
+	uint16_t tsid;
+	uint16_t onid;
+	unsigned int i;
+
+	/* skip the network descriptors */
+	offset = 10 + (((nit[8] & 0x0f) << 8) + nit[9]);
+	if(offset + 2 > size - 4)
+		return;
+
+	/* transport_stream_loop_length, -4 for the CRC at the end */
+	end = MIN(offset + 2 + (((nit[offset] & 0x0f) << 8) + nit[offset+1]), size - 4);
+	offset += 2;
+
+	while(offset + 6 <= end)
+	{
+		tsid = (nit[offset] << 8) + nit[offset+1];
+		onid = (nit[offset+2] << 8) + nit[offset+3];
+		offset += 6 + (((nit[offset+4] & 0x0f) << 8) + nit[offset+5]);
+		for(i=0; i<state->nts; i++)
+		{
+			if(state->ts[i].transport_stream_id == tsid
+			&& state->ts[i].original_network_id == onid)
+				break;
+		}
+		if(i == state->nts)
+		{
+			state->ts = safe_realloc(state->ts, (state->nts + 1) * sizeof(struct scan_ts));
+			state->ts[state->nts].transport_stream_id = tsid;
+			state->ts[state->nts].original_network_id = onid;
+			state->nts ++;
+		}
+	}
+
+	return;
+}
+
+/*
+ * returns true if we have every section of every table we know about,
+ * and the SDTs for all the Transport Streams the NIT lists
+ */
+
+static bool
+scan_complete(struct scan_state *state)
+{
+	struct scan_table *sub;
+	bool have_nit;
+	unsigned int i, j;
+
+	if(!state->have_actual)
+		return false;
+
+	have_nit = false;
+	for(i=0; i<state->ntables; i++)
+	{
+		if(!state->tables[i].complete)
+			return false;
+		if(state->tables[i].tid == TID_NIT)
+			have_nit = true;
+	}
+
+	if(state->nit_wanted && !have_nit)
+		return false;
+
+	for(i=0; i<state->nts; i++)
+	{
+		if(state->ts[i].transport_stream_id == state->actual_tsid
+		&& state->ts[i].original_network_id == state->actual_onid)
+			continue;
+		sub = NULL;
+		for(j=0; j<state->ntables && sub==NULL; j++)
+		{
+			if(state->tables[j].tid == TID_SDT_OTHER
+			&& state->tables[j].id == state->ts[i].transport_stream_id
+			&& state->tables[j].original_network_id == state->ts[i].original_network_id)
+				sub = &state->tables[j];
+		}
+		if(sub == NULL)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * adds it if we have not seen it yet
+ */
+
+static struct scan_table *
+find_table(struct scan_state *state, uint8_t tid, uint16_t id, uint16_t onid)
+{
+	struct scan_table *sub;
+	unsigned int i;
+
+	for(i=0; i<state->ntables; i++)
+	{
+		sub = &state->tables[i];
+		if(sub->tid == tid && sub->id == id && sub->original_network_id == onid)
+			return sub;
+	}
+
+	state->tables = safe_realloc(state->tables, (state->ntables + 1) * sizeof(struct scan_table));
+	sub = &state->tables[state->ntables ++];
+
+	bzero(sub, sizeof(struct scan_table));
+	sub->tid = tid;
+	sub->id = id;
+	sub->original_network_id = onid;
+	/* version_number is only 5 bits, so this will never match */
+	sub->version = 0xff;
+
+	return sub;
+}
+
+/*
+ * read the PMTs for the services on our multiplex to see which ones have an MHEG carousel
+ */
+
+static void
+find_mheg_services(char *demux, unsigned int timeout, struct scan_state *state)
+{
+	unsigned char pat[MAX_TABLE_LEN];
+	unsigned char pmt[MAX_TABLE_LEN];
+	uint16_t services[CACHE_MAX_SERVICES];
+	unsigned int nservices;
+	struct scan_service *svc;
+	unsigned int i;
+
+	/* read all the PMTs at once, they are then in the cache */
+	read_psi(demux, timeout, state->first_service, true);
+
+	if(!read_pat(demux, timeout, pat))
+		return;
+
+	nservices = cache_services(services, CACHE_MAX_SERVICES);
+	for(i=0; i<nservices; i++)
+	{
+		if((svc = scan_find(services[i])) == NULL || !svc->actual)
+			continue;
+		/* read_psi() does nothing for a file, but reading a PMT from a file is quick */
+		if(using_tsfile() ? read_pmt(demux, services[i], timeout, pmt) : cache_load(TID_PMT, services[i], 0, pmt))
+			svc->mheg = pmt_has_mheg(pmt) ? SCAN_MHEG_YES : SCAN_MHEG_NO;
+	}
+
+	return;
+}
+
+/*
+ * remove any services on a multiplex we have a complete SDT for, that are no longer in the SDT
+ */
+
+static void
+drop_missing(struct scan_state *state)
+{
+	struct scan_table *sub;
+	unsigned int i, j;
+	unsigned int keep;
+
+	keep = 0;
+	for(i=0; i<_nservices; i++)
+	{
+		sub = NULL;
+		for(j=0; !_services[i].seen && j<state->ntables && sub==NULL; j++)
+		{
+			if(state->tables[j].tid != TID_NIT
+			&& state->tables[j].complete
+			&& state->tables[j].id == _services[i].transport_stream_id
+			&& state->tables[j].original_network_id == _services[i].original_network_id)
+				sub = &state->tables[j];
+		}
+		if(sub != NULL)
+		{
+			verbose("service_id %u has gone", _services[i].service_id);
+			continue;
+		}
+		if(keep != i)
+			_services[keep] = _services[i];
+		keep ++;
+	}
+
+	_nservices = keep;
+
+	return;
+}
+
+/*
+ * returns the entry for service_id, adds a new one if it is not already in the index
+ */
+
+static struct scan_service *
+add_service(uint16_t service_id)
+{
+	struct scan_service *svc;
+	unsigned int i;
+
+	/* keep it sorted */
+	for(i=0; i<_nservices && _services[i].service_id < service_id; i++)
+		;
+
+	if(i < _nservices && _services[i].service_id == service_id)
+		return &_services[i];
+
+	_services = safe_realloc(_services, (_nservices + 1) * sizeof(struct scan_service));
+	memmove(&_services[i + 1], &_services[i], (_nservices - i) * sizeof(struct scan_service));
+	_nservices ++;
+
+	svc = &_services[i];
+	bzero(svc, sizeof(struct scan_service));
+	svc->service_id = service_id;
+	svc->mheg = SCAN_MHEG_UNKNOWN;
+
+	return svc;
+}
+
+/*
+ * leaves out the control codes (eg the character table byte at the start)
+ * so the name can go on one line of the index file
+ */
+
+static void
+copy_name(char *dst, unsigned char *src, uint8_t len)
+{
+	unsigned int i;
+	unsigned int n;
+
+	n = 0;
+	for(i=0; i<len && n<SCAN_NAME_LEN-1; i++)
+	{
+		if(src[i] >= 0x20 && src[i] != 0x7f)
+			dst[n ++] = src[i];
+	}
+	dst[n] = '\0';
+
+	return;
+}
+
+/*
+ * each line of the file is:
+ * service_id transport_stream_id original_network_id service_type mheg name
+ * separated by tabs, mheg is 'y', 'n' or '?'
+ */
+
+static bool
+load_index(void)
+{
+	FILE *file;
+	char line[64 + SCAN_NAME_LEN];
+	char name[SCAN_NAME_LEN];
+	unsigned int service_id, tsid, onid, type;
+	char mheg;
+	struct scan_service *svc;
+
+	if((file = fopen(SCAN_INDEX_FILE, "r")) == NULL)
+		return false;
+
+	if(fstat(fileno(file), &_index_stat) < 0)
+		memset(&_index_stat, 0, sizeof(_index_stat));
+
+	while(fgets(line, sizeof(line), file) != NULL)
+	{
+		if(line[0] == '#')
+			continue;
+		name[0] = '\0';
+		if(sscanf(line, "%u\t%u\t%u\t%u\t%c\t%255[^\n]", &service_id, &tsid, &onid, &type, &mheg, name) < 5)
+			continue;
+		svc = add_service(service_id);
+		svc->transport_stream_id = tsid;
+		svc->original_network_id = onid;
+		svc->service_type = type;
+		svc->mheg = (mheg == 'y') ? SCAN_MHEG_YES : ((mheg == 'n') ? SCAN_MHEG_NO : SCAN_MHEG_UNKNOWN);
+		snprintf(svc->name, sizeof(svc->name), "%s", name);
+	}
+
+	fclose(file);
+
+	verbose("Loaded %u services from '%s'", _nservices, SCAN_INDEX_FILE);
+
+	return true;
+}
+
+/*
+ * write it to a new file and rename it, so no one sees a half written index
+ */
+
+static bool
+save_index(void)
+{
+	FILE *file;
+	char *mheg = "?ny";
+	struct scan_service *svc;
+	unsigned int i;
+	bool ok;
+
+	if((file = fopen(SCAN_INDEX_FILE NEW_SUFFIX, "w")) == NULL)
+		return false;
+
+	fprintf(file, "# service_id\ttransport_stream_id\toriginal_network_id\tservice_type\tmheg\tname\n");
+	for(i=0; i<_nservices; i++)
+	{
+		svc = &_services[i];
+		fprintf(file, "%u\t%u\t%u\t%u\t%c\t%s\n",
+			svc->service_id, svc->transport_stream_id, svc->original_network_id, svc->service_type, mheg[svc->mheg], svc->name);
+	}
+
+	ok = !ferror(file);
+	if(fclose(file) != 0)
+		ok = false;
+
+	if(!ok || rename(SCAN_INDEX_FILE NEW_SUFFIX, SCAN_INDEX_FILE) < 0)
+	{
+		unlink(SCAN_INDEX_FILE NEW_SUFFIX);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,66 @@
+/*
+ * scan.h
+ *
+ * index of all the services on the network, built from the SDTs and NIT
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* the index is saved in this file under the base directory */
+#define SCAN_INDEX_FILE		"services.idx"
+
+/* the listener scans again after a retune if the index is older than this many seconds */
+#define SCAN_MAX_AGE		(24 * 60 * 60)
+
+/* max bytes in a service name, including the \0 terminator */
+#define SCAN_NAME_LEN		256
+
+/* do we know if the service has an MHEG carousel */
+#define SCAN_MHEG_UNKNOWN	0	/* it is on a multiplex we did not read the PMTs for */
+#define SCAN_MHEG_NO		1
+#define SCAN_MHEG_YES		2
+
+struct scan_service
+{
+	uint16_t service_id;
+	uint16_t transport_stream_id;
+	uint16_t original_network_id;
+	uint8_t service_type;
+	uint8_t mheg;			/* SCAN_MHEG_UNKNOWN etc */
+	bool actual;			/* true if it is on the multiplex we last scanned, not saved in the file */
+	bool seen;			/* used while scanning */
+	char name[SCAN_NAME_LEN];
+};
+
+bool scan_init(void);
+bool scan_services(char *, unsigned int);
+void scan_reload(void);
+bool scan_stale(void);
+
+unsigned int scan_nservices(void);
+struct scan_service *scan_service(unsigned int);
+struct scan_service *scan_find(uint16_t);
+
+#endif	/* __SCAN_H__ */
@@ -0,0 +1,509 @@
+/*
+ * stats.c
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "stats.h"
+#include "utils.h"
+
+/*
+ * the downloader updates the stats in a shared mapping created before any processes are forked
+ * so the "stats" command can report them from a command process
+ * only the downloader writes to it, so there is no locking
+ * a reader may see a count that is half way through being updated, which is fine for stats
+ * everything is reset each time a new downloader starts (ie on retune)
+ *
+ * the stream counters are updated by every process sending a stream, so they use atomic operations
+ * they are not reset on retune, as streams can carry on across a retune
+ */
+
+struct stats
+{
+	uint32_t stream_overflows;	/* number of times the DVR buffer has overflowed */
+	uint64_t stream_dropped;	/* TS packets thrown away because the ring buffer was full */
+	uint64_t stream_blocks;		/* blocks sent from the ring buffers */
+	uint64_t stream_latency;	/* total ns those blocks were in the ring buffers */
+	uint64_t stream_max_latency;	/* longest ns a block was in a ring buffer */
+	/* stats_start() resets everything from here on */
+	uint64_t start;			/* ns when the downloader started, 0 => not started */
+	uint64_t end;			/* ns when the downloader finished, 0 => still going */
+	uint64_t inflate_time;		/* ns spent decompressing modules */
+	uint64_t inflated;		/* bytes of decompressed data */
+	uint32_t files_written;		/* files created by the downloader */
+	uint64_t written;		/* bytes written to those files */
+	uint32_t npids;
+	struct pid_stats pid[STATS_MAX_PIDS];
+	uint32_t ncarousels;
+	struct carousel_stats carousel[STATS_MAX_CAROUSELS];
+	uint32_t nmodules;		/* slots used so far, some may have been freed */
+	struct module_stats module[STATS_MAX_MODULES];
+};
+
+static struct stats *_stats = NULL;
+
+/* only used in the downloader process */
+static unsigned int _interval = 0;	/* seconds between stats_periodic() dumps, 0 => never */
+static uint64_t _next_dump = 0;		/* ns when stats_periodic() should next dump them */
+
+#define NS_PER_MS	((uint64_t) 1000000)
+#define NS_PER_SEC	((uint64_t) 1000000000)
+
+/*
+ * must be called before we fork the downloader and any command processes
+ * interval is the number of seconds between stats_periodic() dumps, 0 => never dump them
+ */
+
+bool
+stats_init(unsigned int interval)
+{
+	void *map;
+
+	_interval = interval;
+
+	map = mmap(NULL, sizeof(struct stats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED)
+	{
+		error("Unable to create download stats: %s", strerror(errno));
+		return false;
+	}
+
+	_stats = map;
+	bzero(_stats, sizeof(struct stats));
+
+	return true;
+}
+
+/*
+ * returns the current time in ns
+ * it is the same clock in all the processes
+ */
+
+uint64_t
+stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ts.tv_sec * NS_PER_SEC) + ts.tv_nsec;
+}
+
+/*
+ * called by the downloader process before it reads anything
+ */
+
+void
+stats_start(void)
+{
+	if(_stats == NULL)
+		return;
+
+	bzero(&_stats->start, sizeof(struct stats) - offsetof(struct stats, start));
+	_stats->start = stats_now();
+
+	_next_dump = _stats->start + (_interval * NS_PER_SEC);
+
+	return;
+}
+
+/*
+ * returns the stats for the given PID, or NULL if we have no room for it
+ */
+
+static struct pid_stats *
+find_pid(uint16_t pid)
+{
+	struct pid_stats *ps;
+	uint32_t i;
+
+	for(i=0; i<_stats->npids; i++)
+		if(_stats->pid[i].pid == pid)
+			return &_stats->pid[i];
+
+	if(_stats->npids == STATS_MAX_PIDS)
+		return NULL;
+
+	ps = &_stats->pid[_stats->npids];
+	bzero(ps, sizeof(struct pid_stats));
+	ps->pid = pid;
+	ps->window = stats_now() / NS_PER_MS;
+	_stats->npids ++;
+
+	return ps;
+}
+
+/*
+ * we have read a DSMCC section of length bytes from pid
+ */
+
+void
+stats_section(uint16_t pid, uint32_t length)
+{
+	struct pid_stats *ps;
+	uint64_t now;
+
+	if(_stats == NULL || (ps = find_pid(pid)) == NULL)
+		return;
+
+	ps->sections ++;
+	ps->bytes += length;
+	ps->window_sections ++;
+
+	/* start a new window each time the current one has finished */
+	now = stats_now() / NS_PER_MS;
+	if(now - ps->window >= STATS_RATE_WINDOW)
+	{
+		ps->rate = (ps->window_sections * (uint64_t) 1000) / (now - ps->window);
+		ps->window = now;
+		ps->window_sections = 0;
+	}
+
+	return;
+}
+
+/*
+ * the demux buffer for pid has overflowed
+ */
+
+void
+stats_overflow(uint16_t pid)
+{
+	struct pid_stats *ps;
+
+	if(_stats != NULL && (ps = find_pid(pid)) != NULL)
+		ps->overflows ++;
+
+	return;
+}
+
+/*
+ * returns NULL if we have no room for it
+ */
+
+struct carousel_stats *
+stats_add_carousel(uint16_t service_id, uint32_t carousel_id)
+{
+	struct carousel_stats *cs;
+
+	if(_stats == NULL || _stats->ncarousels == STATS_MAX_CAROUSELS)
+		return NULL;
+
+	cs = &_stats->carousel[_stats->ncarousels];
+	bzero(cs, sizeof(struct carousel_stats));
+	cs->service_id = service_id;
+	cs->carousel_id = carousel_id;
+	_stats->ncarousels ++;
+
+	return cs;
+}
+
+/*
+ * returns NULL if we have no room for it
+ */
+
+struct module_stats *
+stats_add_module(struct carousel_stats *cs, uint32_t download_id, uint16_t module_id, uint8_t version, uint16_t nblocks)
+{
+	struct module_stats *ms;
+	uint32_t i;
+
+	if(cs == NULL)
+		return NULL;
+
+	/* reuse a slot if one has been freed */
+	for(i=0; i<_stats->nmodules && _stats->module[i].carousel != 0; i++)
+		;
+	if(i == STATS_MAX_MODULES)
+		return NULL;
+
+	ms = &_stats->module[i];
+	ms->module_id = module_id;
+	ms->download_id = download_id;
+	ms->version = version;
+	ms->nblocks = nblocks;
+	ms->blocks_left = nblocks;
+	/* this marks the slot as used */
+	ms->carousel = (cs - _stats->carousel) + 1;
+
+	if(i == _stats->nmodules)
+		_stats->nmodules ++;
+
+	return ms;
+}
+
+void
+stats_del_module(struct module_stats *ms)
+{
+	if(ms != NULL)
+		ms->carousel = 0;
+
+	return;
+}
+
+/*
+ * we have all the modules in the carousel
+ * only the first time is remembered, not when it is complete again after an update
+ */
+
+void
+stats_complete(struct carousel_stats *cs)
+{
+	if(cs != NULL && cs->complete == 0)
+		cs->complete = stats_now() - _stats->start;
+
+	return;
+}
+
+/*
+ * we took ns to decompress some data into bytes
+ */
+
+void
+stats_inflate(uint64_t ns, uint32_t bytes)
+{
+	if(_stats != NULL)
+	{
+		_stats->inflate_time += ns;
+		_stats->inflated += bytes;
+	}
+
+	return;
+}
+
+/*
+ * we have written a file of the given size
+ */
+
+void
+stats_written(uint32_t bytes)
+{
+	if(_stats != NULL)
+	{
+		_stats->files_written ++;
+		_stats->written += bytes;
+	}
+
+	return;
+}
+
+/*
+ * called by the stream processes
+ * the DVR buffer has overflowed
+ */
+
+void
+stats_stream_overflow(void)
+{
+	if(_stats != NULL)
+		__atomic_add_fetch(&_stats->stream_overflows, 1, __ATOMIC_RELAXED);
+
+	return;
+}
+
+/*
+ * we threw away npackets TS packets because the ring buffer was full
+ */
+
+void
+stats_stream_dropped(uint32_t npackets)
+{
+	if(_stats != NULL)
+		__atomic_add_fetch(&_stats->stream_dropped, npackets, __ATOMIC_RELAXED);
+
+	return;
+}
+
+/*
+ * we have sent a block from the ring buffer, it was in there for latency ns
+ */
+
+void
+stats_stream_block(uint64_t latency)
+{
+	uint64_t max;
+
+	if(_stats == NULL)
+		return;
+
+	__atomic_add_fetch(&_stats->stream_blocks, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&_stats->stream_latency, latency, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&_stats->stream_max_latency, __ATOMIC_RELAXED);
+	while(latency > max
+	&& !__atomic_compare_exchange_n(&_stats->stream_max_latency, &max, latency, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	return;
+}
+
+/*
+ * write a human readable report of the stats to the given stream
+ */
+
+void
+stats_dump(FILE *out)
+{
+	uint64_t now;
+	uint64_t elapsed;
+	struct pid_stats *ps;
+	struct carousel_stats *cs;
+	struct module_stats *ms;
+	unsigned int nmodules;
+	unsigned int ncomplete;
+	uint64_t nblocks;
+	uint64_t nleft;
+	uint32_t i;
+	uint32_t j;
+
+	if(_stats == NULL || _stats->start == 0)
+	{
+		fprintf(out, "Not downloading\n");
+		return;
+	}
+
+	now = (_stats->end != 0) ? _stats->end : stats_now();
+	elapsed = (now - _stats->start) / NS_PER_MS;
+
+	fprintf(out, "Elapsed\t%" PRIu64 ".%03" PRIu64 "s\n", elapsed / 1000, elapsed % 1000);
+	fprintf(out, "Inflated\t%" PRIu64 " bytes in %" PRIu64 " ms\n", _stats->inflated, _stats->inflate_time / NS_PER_MS);
+	fprintf(out, "Written\t%u files, %" PRIu64 " bytes\n", _stats->files_written, _stats->written);
+	fprintf(out, "Streams\t%" PRIu64 " blocks sent, %" PRIu64 " TS packets dropped, %u DVR overflows\n",
+		_stats->stream_blocks, _stats->stream_dropped, _stats->stream_overflows);
+	fprintf(out, "Stream latency\taverage %" PRIu64 " ms, max %" PRIu64 " ms\n",
+		(_stats->stream_blocks != 0) ? (_stats->stream_latency / _stats->stream_blocks) / NS_PER_MS : 0,
+		_stats->stream_max_latency / NS_PER_MS);
+
+	fprintf(out, "\nPID\tSections\tBytes\tRate/s\tAverage/s\tOverflows\n");
+	fprintf(out, "===\t========\t=====\t======\t=========\t=========\n");
+	for(i=0; i<_stats->npids; i++)
+	{
+		ps = &_stats->pid[i];
+		fprintf(out, "%u\t%u\t%" PRIu64 "\t%u\t%" PRIu64 "\t%u\n",
+			ps->pid, ps->sections, ps->bytes,
+			/* nothing in the last couple of windows => it has stopped */
+			((now / NS_PER_MS) - ps->window < STATS_RATE_WINDOW * 2) ? ps->rate : 0,
+			(elapsed != 0) ? (ps->sections * (uint64_t) 1000) / elapsed : 0,
+			ps->overflows);
+	}
+
+	fprintf(out, "\nServiceID\tCarouselID\tModules\tComplete\tDuplicates\tFull after\n");
+	fprintf(out, "=========\t==========\t=======\t========\t==========\t==========\n");
+	for(i=0; i<_stats->ncarousels; i++)
+	{
+		cs = &_stats->carousel[i];
+		nmodules = 0;
+		ncomplete = 0;
+		nblocks = 0;
+		nleft = 0;
+		for(j=0; j<_stats->nmodules; j++)
+		{
+			ms = &_stats->module[j];
+			if(ms->carousel != i + 1)
+				continue;
+			nmodules ++;
+			if(ms->blocks_left == 0)
+				ncomplete ++;
+			nblocks += ms->nblocks;
+			nleft += ms->blocks_left;
+		}
+		fprintf(out, "%u\t%u\t%u/%u\t%" PRIu64 "%%\t%u\t",
+			cs->service_id, cs->carousel_id, ncomplete, nmodules,
+			(nblocks != 0) ? ((nblocks - nleft) * 100) / nblocks : 0,
+			cs->duplicates);
+		if(cs->complete != 0)
+			fprintf(out, "%" PRIu64 ".%03" PRIu64 "s\n", cs->complete / NS_PER_SEC, (cs->complete % NS_PER_SEC) / NS_PER_MS);
+		else
+			fprintf(out, "-\n");
+	}
+
+	fprintf(out, "\nServiceID\tDownloadID\tModule\tVersion\tBlocks\tComplete\n");
+	fprintf(out, "=========\t==========\t======\t=======\t======\t========\n");
+	for(i=0; i<_stats->nmodules; i++)
+	{
+		ms = &_stats->module[i];
+		if(ms->carousel == 0)
+			continue;
+		fprintf(out, "%u\t%u\t%u\t%u\t%u/%u\t%u%%\n",
+			_stats->carousel[ms->carousel - 1].service_id, ms->download_id, ms->module_id, ms->version,
+			ms->nblocks - ms->blocks_left, ms->nblocks,
+			(ms->nblocks != 0) ? ((ms->nblocks - ms->blocks_left) * 100) / ms->nblocks : 100);
+	}
+
+	return;
+}
+
+/*
+ * called by the downloader each time round its main loop
+ * dumps the stats to stdout if it is time to
+ */
+
+void
+stats_periodic(void)
+{
+	uint64_t now;
+
+	if(_stats == NULL || _interval == 0)
+		return;
+
+	now = stats_now();
+	if(now < _next_dump)
+		return;
+
+	_next_dump = now + (_interval * NS_PER_SEC);
+
+	printf("Download stats:\n");
+	stats_dump(stdout);
+	fflush(stdout);
+
+	return;
+}
+
+/*
+ * called by the downloader when it gets to the end of a Transport Stream file
+ * the rates etc are then reported up to this point
+ * dumps the stats to stdout if we are doing periodic dumps
+ */
+
+void
+stats_final(void)
+{
+	if(_stats == NULL)
+		return;
+
+	_stats->end = stats_now();
+
+	if(_interval == 0)
+		return;
+
+	printf("Final download stats:\n");
+	stats_dump(stdout);
+	fflush(stdout);
+
+	return;
+}
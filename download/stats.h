@@ -0,0 +1,93 @@
+/*
+ * stats.h
+ *
+ * download statistics, collected by the downloader and shared with the command processes
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* max number of things we keep stats for, anything after this is not counted */
+#define STATS_MAX_PIDS		64
+#define STATS_MAX_CAROUSELS	32
+#define STATS_MAX_MODULES	2048
+
+/* ms over which we measure the current section rate */
+#define STATS_RATE_WINDOW	1000
+
+struct pid_stats
+{
+	uint16_t pid;
+	uint32_t sections;		/* DSMCC sections read */
+	uint64_t bytes;			/* bytes in those sections */
+	uint32_t overflows;		/* number of times the demux buffer has overflowed */
+	uint64_t window;		/* ms when the current rate window started */
+	uint32_t window_sections;	/* sections read since then */
+	uint32_t rate;			/* sections per second over the last complete window */
+};
+
+struct carousel_stats
+{
+	uint16_t service_id;
+	uint32_t carousel_id;
+	uint32_t duplicates;		/* DDBs thrown away because we already had the block */
+	uint64_t complete;		/* ns after the start when we first had all the modules, 0 => not yet */
+};
+
+struct module_stats
+{
+	uint8_t carousel;		/* index in the carousel array + 1, 0 => unused */
+	uint16_t module_id;
+	uint32_t download_id;
+	uint8_t version;
+	uint16_t nblocks;
+	uint16_t blocks_left;
+};
+
+bool stats_init(unsigned int);
+void stats_start(void);
+
+void stats_section(uint16_t, uint32_t);
+void stats_overflow(uint16_t);
+
+struct carousel_stats *stats_add_carousel(uint16_t, uint32_t);
+struct module_stats *stats_add_module(struct carousel_stats *, uint32_t, uint16_t, uint8_t, uint16_t);
+void stats_del_module(struct module_stats *);
+void stats_complete(struct carousel_stats *);
+
+void stats_inflate(uint64_t, uint32_t);
+void stats_written(uint32_t);
+
+void stats_stream_overflow(void);
+void stats_stream_dropped(uint32_t);
+void stats_stream_block(uint64_t);
+
+uint64_t stats_now(void);
+
+void stats_dump(FILE *);
+void stats_periodic(void);
+void stats_final(void);
+
+#endif	/* __STATS_H__ */
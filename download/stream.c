@@ -2,15 +2,38 @@
  * stream.c
  */
 
+/* for splice() */
+#define _GNU_SOURCE
+
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 
 #include "stream.h"
+#include "stats.h"
 #include "utils.h"
 
+/* bytes in the ring buffer stream_ts() uses, 0 => don't use one */
+static size_t _ring_size = DEFAULT_RING_SIZE;
+
+/*
+ * called before any streams are started
+ * ring_size is the number of bytes to buffer between the DVR device and the client, 0 => don't buffer
+ */
+
+void
+stream_init(size_t ring_size)
+{
+	_ring_size = ring_size;
+
+	return;
+}
+
 int
 add_demux_filter(char *demux_dev, uint16_t pid, dmx_pes_type_t pes_type)
 {
@@ -50,6 +73,269 @@ add_demux_filter(char *demux_dev, uint16_t pid, dmx_pes_type_t pes_type)
 	return fd;
 }
 
+/*
+ * max bytes to move in each splice() call
+ * this is the default capacity of a pipe
+ */
+#define SPLICE_SIZE	(64 * 1024)
+
+/*
+ * move the transport stream from ts_fd to client_fd through a pipe with splice()
+ * the data never gets copied into user space
+ * returns false if the DVB device does not support splice() and nothing has been sent yet
+ * returns true when the client closes or we get an error
+ */
+
+static bool
+splice_ts(int ts_fd, int client_fd)
+{
+	int pipe_fd[2];
+	ssize_t nread;
+	ssize_t nwritten;
+	bool sent = false;
+	bool unsupported = false;
+
+	if(pipe(pipe_fd) < 0)
+		return false;
+
+	for(;;)
+	{
+		nread = splice(ts_fd, NULL, pipe_fd[1], NULL, SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if(nread < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if(nread <= 0)
+		{
+			unsupported = (nread < 0 && errno == EINVAL && !sent);
+			break;
+		}
+		sent = true;
+		/* empty the pipe */
+		while(nread > 0)
+		{
+			nwritten = splice(pipe_fd[0], NULL, client_fd, NULL, nread, SPLICE_F_MOVE | SPLICE_F_MORE);
+			if(nwritten < 0 && errno == EINTR)
+				continue;
+			if(nwritten <= 0)
+				break;
+			nread -= nwritten;
+		}
+		/* client closed or error */
+		if(nread > 0)
+			break;
+	}
+
+	close(pipe_fd[0]);
+	close(pipe_fd[1]);
+
+	/* if so, we can use read() and write() instead */
+	return !unsupported;
+}
+
+/*
+ * the ring buffer is made of blocks, the reader fills a block with as many reads as it takes
+ * a whole number of TS packets fit in each block, so if we have to drop one the stream stays packet aligned
+ * if the writer is waiting, a block is given to it straight away, even if it is not full
+ */
+#define TS_PACKET_SIZE		188
+#define RING_BLOCK_SIZE		(TS_PACKET_SIZE * 348)
+
+/* ms the reader waits for data before checking if the writer has stopped */
+#define RING_POLL_TIMEOUT	100
+
+struct ring_block
+{
+	size_t length;			/* bytes of data */
+	uint64_t stamp;			/* stats_now() when we read the first byte */
+	unsigned char data[RING_BLOCK_SIZE];
+};
+
+struct ts_ring
+{
+	int ts_fd;			/* the reader reads from this */
+	struct ring_block *block;	/* array, nblocks in length */
+	unsigned int nblocks;
+	unsigned int head;		/* total number of blocks the reader has added */
+	unsigned int tail;		/* total number of blocks the writer has taken out */
+	bool stop;			/* set by either thread when the other should finish */
+	pthread_mutex_t lock;
+	pthread_cond_t added;		/* signalled when the reader adds a block or stops */
+};
+
+/*
+ * the reader thread
+ * keeps reading from the DVR device, so the kernel buffer never overflows because the client is slow
+ * if the ring is full, the data we have just read is thrown away
+ */
+
+static void *
+ring_reader(void *arg)
+{
+	struct ts_ring *ring = (struct ts_ring *) arg;
+	struct ring_block *blk;
+	struct ring_block *spare;
+	struct pollfd pfd;
+	ssize_t nread;
+	bool full;
+	bool started;
+
+	spare = safe_malloc(sizeof(struct ring_block));
+
+	pfd.fd = ring->ts_fd;
+	pfd.events = POLLIN;
+
+	/* have we started filling the block at head yet */
+	started = false;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&ring->lock);
+		if(ring->stop)
+		{
+			pthread_mutex_unlock(&ring->lock);
+			break;
+		}
+		full = (ring->head - ring->tail == ring->nblocks);
+		pthread_mutex_unlock(&ring->lock);
+		/* only the reader changes head, so this block is ours until we add it */
+		if(full)
+		{
+			blk = spare;
+			blk->length = 0;
+		}
+		else
+		{
+			blk = &ring->block[ring->head % ring->nblocks];
+			if(!started)
+				blk->length = 0;
+		}
+		if(poll(&pfd, 1, RING_POLL_TIMEOUT) <= 0)
+			continue;
+		if((nread = read(ring->ts_fd, blk->data + blk->length, RING_BLOCK_SIZE - blk->length)) < 0)
+		{
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			/* we did not read it quick enough, the packets are lost but we can carry on */
+			if(errno == EOVERFLOW)
+			{
+				stats_stream_overflow();
+				continue;
+			}
+			error("read DVR: %s", strerror(errno));
+		}
+		if(nread <= 0)
+			break;
+		if(full)
+		{
+			stats_stream_dropped(nread / TS_PACKET_SIZE);
+			continue;
+		}
+		if(!started)
+			blk->stamp = stats_now();
+		blk->length += nread;
+		started = true;
+		/* add it if the writer is waiting for it or we have filled it */
+		pthread_mutex_lock(&ring->lock);
+		if(ring->head == ring->tail || RING_BLOCK_SIZE - blk->length < TS_PACKET_SIZE)
+		{
+			ring->head ++;
+			started = false;
+			pthread_cond_signal(&ring->added);
+		}
+		pthread_mutex_unlock(&ring->lock);
+	}
+
+	/* add anything we have read, and tell the writer there is nothing more coming */
+	pthread_mutex_lock(&ring->lock);
+	if(started)
+		ring->head ++;
+	ring->stop = true;
+	pthread_cond_signal(&ring->added);
+	pthread_mutex_unlock(&ring->lock);
+
+	safe_free(spare);
+
+	return NULL;
+}
+
+/*
+ * a reader thread copies the transport stream from ts_fd into a ring buffer
+ * and we write it from the ring buffer to client_fd
+ * so the client can stall for a while without us losing any packets
+ * returns false if we can't start the reader thread
+ * returns true when the client closes or we get an error
+ */
+
+static bool
+ring_ts(int ts_fd, int client_fd)
+{
+	struct ts_ring ring;
+	pthread_t reader;
+	struct ring_block *blk;
+	size_t sent;
+	ssize_t nwritten;
+
+	ring.ts_fd = ts_fd;
+	ring.nblocks = (_ring_size + RING_BLOCK_SIZE - 1) / RING_BLOCK_SIZE;
+	ring.block = safe_malloc(ring.nblocks * sizeof(struct ring_block));
+	ring.head = 0;
+	ring.tail = 0;
+	ring.stop = false;
+	pthread_mutex_init(&ring.lock, NULL);
+	pthread_cond_init(&ring.added, NULL);
+
+	if(pthread_create(&reader, NULL, ring_reader, &ring) != 0)
+	{
+		error("Unable to start DVR reader thread");
+		safe_free(ring.block);
+		return false;
+	}
+
+	for(;;)
+	{
+		pthread_mutex_lock(&ring.lock);
+		while(ring.head == ring.tail && !ring.stop)
+			pthread_cond_wait(&ring.added, &ring.lock);
+		/* send anything we have before we stop */
+		if(ring.head == ring.tail)
+		{
+			pthread_mutex_unlock(&ring.lock);
+			break;
+		}
+		pthread_mutex_unlock(&ring.lock);
+		/* only the writer changes tail, so the reader won't touch this block until we take it out */
+		blk = &ring.block[ring.tail % ring.nblocks];
+		sent = 0;
+		while(sent < blk->length)
+		{
+			nwritten = write(client_fd, blk->data + sent, blk->length - sent);
+			if(nwritten < 0 && errno == EINTR)
+				continue;
+			if(nwritten <= 0)
+				break;
+			sent += nwritten;
+		}
+		stats_stream_block(stats_now() - blk->stamp);
+		/* client closed or error */
+		if(sent < blk->length)
+			break;
+		pthread_mutex_lock(&ring.lock);
+		ring.tail ++;
+		pthread_mutex_unlock(&ring.lock);
+	}
+
+	/* tell the reader to stop, it checks at least every RING_POLL_TIMEOUT ms */
+	pthread_mutex_lock(&ring.lock);
+	ring.stop = true;
+	pthread_mutex_unlock(&ring.lock);
+	pthread_join(reader, NULL);
+
+	pthread_mutex_destroy(&ring.lock);
+	pthread_cond_destroy(&ring.added);
+	safe_free(ring.block);
+
+	return true;
+}
+
 /* don't want it on the stack */
 static unsigned char _ts_buf[8 * 1024];
 
@@ -59,6 +345,20 @@ stream_ts(int ts_fd, FILE *client)
 	ssize_t nread;
 	size_t nwritten;
 
+	/* send anything we have buffered before we start writing to the socket directly */
+	fflush(client);
+
+	/* the default kernel buffer overflows with HD services */
+	if(ioctl(ts_fd, DMX_SET_BUFFER_SIZE, DVR_BUFFER_SIZE) < 0)
+		verbose("ioctl DMX_SET_BUFFER_SIZE: %s", strerror(errno));
+
+	if(_ring_size != 0 && ring_ts(ts_fd, fileno(client)))
+		return;
+
+	if(splice_ts(ts_fd, fileno(client)))
+		return;
+
+	/* the DVB device can't do splice(), so copy it through user space */
 	do
 	{
 		nread = read(ts_fd, _ts_buf, sizeof(_ts_buf));
@@ -71,4 +371,3 @@ stream_ts(int ts_fd, FILE *client)
 
 	return;
 }
-
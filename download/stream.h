@@ -7,8 +7,17 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <linux/dvb/dmx.h>
 
+/* bytes in the kernel's DVR buffer, the default is too small for HD services */
+#define DVR_BUFFER_SIZE		(2 * 1024 * 1024)
+
+/* default bytes in the ring buffer between the DVR device and the client, 0 => don't use one */
+#define DEFAULT_RING_SIZE	(8 * 1024 * 1024)
+
+void stream_init(size_t);
+
 int add_demux_filter(char *, uint16_t, dmx_pes_type_t);
 
 void stream_ts(int, FILE *);
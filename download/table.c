@@ -25,8 +25,10 @@
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -43,23 +45,33 @@
 #include "carousel.h"
 #include "biop.h"
 #include "cache.h"
+#include "tsfile.h"
+#include "stats.h"
 #include "utils.h"
 
-/* Programme Association Table PID and TID */
-#define PID_PAT		0x0000
-#define TID_PAT		0x00
+/* max number of section filters read_psi() has open at once */
+#define PSI_MAX_FILTERS		16
 
-/* Programme Map Table TID */
-#define TID_PMT		0x02
-
-/* Service Description Table PID and TID */
-#define PID_SDT		0x0011
-#define TID_SDT		0x42
+/* how often the downloader checks for new versions of the PSI tables we have cached, in ns */
+#define PSI_WATCH_INTERVAL	(250 * 1000000ULL)
 
 /* DSMCC table ID's we want */
 #define TID_DSMCC_CONTROL	0x3b	/* DSI or DII */
 #define TID_DSMCC_DATA		0x3c	/* DDB */
 
+static void start_reactor(struct carousel *);
+static void watch_pid(struct carousel *, uint32_t);
+static bool fill_section_queue(struct carousel *);
+static bool read_section(struct carousel *, uint64_t);
+static int drop_section(struct section_queue *, unsigned int);
+static void dequeue_section(struct section_queue *, unsigned int);
+static bool group_reading_pid(struct carousel *, uint16_t);
+
+static bool read_tsfile_dsmcc_tables(struct carousel *, unsigned char *);
+
+static int open_section_filter(char *, uint16_t, uint8_t, int, int, int);
+
+
 /*
  * output buffer must be at least MAX_TABLE_LEN bytes
  * returns false if it timesout
@@ -69,7 +81,7 @@ bool
 read_pat(char *demux, unsigned int timeout, unsigned char *out)
 {
 	/* is it in the cache */
-	if(cache_load("pat", out))
+	if(cache_load(TID_PAT, 0, 0, out))
 		return true;
 
 	/* read it from the DVB card */
@@ -79,8 +91,8 @@ read_pat(char *demux, unsigned int timeout, unsigned char *out)
 		return false;
 	}
 
-	/* cache it */
-	cache_save("pat", out);
+	/* cache it, this also finds the PMT PIDs for us */
+	cache_save(TID_PAT, 0, 0, out);
 
 	return true;
 }
@@ -93,43 +105,20 @@ read_pat(char *demux, unsigned int timeout, unsigned char *out)
 bool
 read_pmt(char *demux, uint16_t service_id, unsigned int timeout, unsigned char *out)
 {
-	char cache_item[PATH_MAX];
 	unsigned char pat[MAX_TABLE_LEN];
-	uint16_t section_length;
-	uint16_t offset;
-	uint16_t map_pid = 0;
-	bool found;
+	uint16_t map_pid;
 	bool rc;
 
-	/* is it in the cache */
-	snprintf(cache_item, sizeof(cache_item), "pmt-%u", service_id);
-	if(cache_load(cache_item, out))
-		return true;
-
-	/* get the PAT */
+	/* make sure the cache has the current PAT, it may have changed if we have retuned */
 	if(!read_pat(demux, timeout, pat))
 		return false;
 
-	section_length = 3 + (((pat[1] & 0x0f) << 8) + pat[2]);
+	/* is it in the cache */
+	if(cache_load(TID_PMT, service_id, 0, out))
+		return true;
 
 	/* find the PMT for this service_id */
-	found = false;
-	offset = 8;
-	/* -4 for the CRC at the end */
-	while((offset < (section_length - 4)) && !found)
-	{
-		if((pat[offset] << 8) + pat[offset+1] == service_id)
-		{
-			map_pid = ((pat[offset+2] & 0x1f) << 8) + pat[offset+3];
-			found = true;
-		}
-		else
-		{
-			offset += 4;
-		}
-	}
-
-	if(!found)
+	if((map_pid = cache_pmt_pid(service_id)) == 0)
 		fatal("Unable to find PMT PID for service_id %u", service_id);
 
 	vverbose("PMT PID: %u", map_pid);
@@ -139,7 +128,7 @@ read_pmt(char *demux, uint16_t service_id, unsigned int timeout, unsigned char *
 
 	/* cache it */
 	if(rc)
-		cache_save(cache_item, out);
+		cache_save(TID_PMT, service_id, 0, out);
 	else
 		error("Unable to read PMT");
 
@@ -147,19 +136,62 @@ read_pmt(char *demux, uint16_t service_id, unsigned int timeout, unsigned char *
 }
 
 /*
+ * read the PMT for a service on a different multiplex to the one we are downloading the carousel from
+ * the cache only holds tables from our multiplex, so this does not use it
  * output buffer must be at least MAX_TABLE_LEN bytes
- * returns false if it timesout
+ * returns false if it timesout or service_id is not in the PAT
  */
 
 bool
-read_sdt(char *demux, unsigned int timeout, unsigned char *out, unsigned char sn)
+read_uncached_pmt(char *demux, uint16_t service_id, unsigned int timeout, unsigned char *out)
 {
-	char cache_item[PATH_MAX];
+	unsigned char pat[MAX_TABLE_LEN];
+	uint16_t length;
+	uint16_t offset;
+	uint16_t map_pid;
 
-	snprintf(cache_item, sizeof(cache_item), "sdt-%u", sn);
+	if(!read_table(demux, PID_PAT, TID_PAT, timeout, pat, 0))
+	{
+		error("Unable to read PAT");
+		return false;
+	}
+
+	/* find the PMT PID for this service_id, -4 for the CRC at the end */
+	length = 3 + (((pat[1] & 0x0f) << 8) + pat[2]);
+	map_pid = 0;
+	for(offset=8; offset + 4 <= length - 4 && map_pid == 0; offset+=4)
+	{
+		if(((pat[offset] << 8) + pat[offset+1]) == service_id)
+			map_pid = ((pat[offset+2] & 0x1f) << 8) + pat[offset+3];
+	}
+
+	if(map_pid == 0)
+	{
+		error("Unable to find PMT PID for service_id %u", service_id);
+		return false;
+	}
+
+	vverbose("PMT PID: %u", map_pid);
+
+	if(!read_table(demux, map_pid, TID_PMT, timeout, out, 0))
+	{
+		error("Unable to read PMT");
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * output buffer must be at least MAX_TABLE_LEN bytes
+ * returns false if it timesout
+ */
 
+bool
+read_sdt(char *demux, unsigned int timeout, unsigned char *out, unsigned char sn)
+{
 	/* is it in the cache */
-	if(cache_load(cache_item, out))
+	if(cache_load(TID_SDT, 0, sn, out))
 		return true;
 
 	/* read it from the DVB card */
@@ -170,31 +202,383 @@ read_sdt(char *demux, unsigned int timeout, unsigned char *out, unsigned char sn
 	}
 
 	/* cache it */
-	cache_save(cache_item, out);
+	cache_save(TID_SDT, 0, sn, out);
 
 	return true;
 }
 
 /*
- * read the given table (defined by pid and tid) from the given DVB device
- * sn is the section number
- * output buffer must be at least MAX_TABLE_LEN bytes
- * returns false if it timesout
+ * read the SDT, PAT and PMTs we need all at once and put them in the cache
+ * rather than one after another, each waiting for its own repetition interval
+ * the PMT PIDs come from the PAT, so the PMT filters are added as soon as we have it
+ * if all_services is true, we get the PMTs for every service in the PAT, otherwise just for service_id
+ * anything that is already in the cache is not read again
+ * returns false if we did not get all of them before the timeout
+ * read_sdt() and read_pmt() will then read anything we missed one at a time
  */
 
+struct psi_filter
+{
+	uint8_t tid;
+	uint16_t id;		/* service_id for a PMT, 0 otherwise */
+};
+
+static unsigned int psi_pmts_wanted(uint16_t, bool, uint16_t *);
+static unsigned int add_psi_pmt_filters(char *, struct pollfd *, struct psi_filter *, unsigned int, uint16_t *, unsigned int, unsigned int *);
+
 bool
-read_table(char *device, uint16_t pid, uint8_t tid, unsigned int secs, unsigned char *out, unsigned char sn)
+read_psi(char *demux, unsigned int timeout, uint16_t service_id, bool all_services)
 {
-	int fd_data;
+	struct pollfd pfd[PSI_MAX_FILTERS];
+	struct psi_filter filter[PSI_MAX_FILTERS];
+	unsigned int nfilters;
+	uint16_t wanted[CACHE_MAX_SERVICES];
+	unsigned int nwanted;
+	unsigned int next_wanted;
+	unsigned char table[MAX_TABLE_LEN];
+	unsigned char sdt[MAX_TABLE_LEN];
+	bool pat_pending;
+	bool sdt_pending;
+	uint64_t start;
+	uint64_t elapsed;
+	ssize_t n;
+	int fd;
+	unsigned int i;
+	bool ok;
+
+	/* reading a file is quick enough as it is */
+	if(using_tsfile())
+		return true;
+
+	start = stats_now();
+	nfilters = 0;
+	nwanted = 0;
+	next_wanted = 0;
+	pat_pending = false;
+	sdt_pending = false;
+
+	/* if we already have the PAT, we can ask for the PMTs straight away */
+	if(cache_load(TID_PAT, 0, 0, table))
+	{
+		nwanted = psi_pmts_wanted(service_id, all_services, wanted);
+	}
+	else if((fd = open_table_filter(demux, PID_PAT, TID_PAT, -1, 0)) >= 0)
+	{
+		pfd[nfilters].fd = fd;
+		filter[nfilters].tid = TID_PAT;
+		filter[nfilters].id = 0;
+		nfilters ++;
+		pat_pending = true;
+	}
+
+	if(!cache_load(TID_SDT, 0, 0, table)
+	&& (fd = open_table_filter(demux, PID_SDT, TID_SDT, -1, 0)) >= 0)
+	{
+		pfd[nfilters].fd = fd;
+		filter[nfilters].tid = TID_SDT;
+		filter[nfilters].id = 0;
+		nfilters ++;
+	}
+
+	nfilters = add_psi_pmt_filters(demux, pfd, filter, nfilters, wanted, nwanted, &next_wanted);
+
+	ok = true;
+	while(nfilters > 0)
+	{
+		elapsed = (stats_now() - start) / 1000000;
+		if(elapsed >= timeout * 1000)
+		{
+			ok = false;
+			break;
+		}
+		for(i=0; i<nfilters; i++)
+			pfd[i].events = POLLIN;
+		if(poll(pfd, nfilters, (timeout * 1000) - elapsed) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			error("read_psi: poll: %s", strerror(errno));
+			ok = false;
+			break;
+		}
+		/* go backwards, so we can move the last filter into the place of one we have finished with */
+		for(i=nfilters; i>0; i--)
+		{
+			if(pfd[i - 1].revents == 0)
+				continue;
+			if((n = read(pfd[i - 1].fd, table, MAX_TABLE_LEN)) < 0
+			&& (errno == EINTR || errno == EAGAIN || errno == EOVERFLOW))
+				continue;
+			if(n > 0 && table[0] == filter[i - 1].tid)
+			{
+				vverbose("read_psi: got table 0x%x id %u", filter[i - 1].tid, filter[i - 1].id);
+				/* a new PAT makes everything else in the cache out of date, so save the SDT after it */
+				if(filter[i - 1].tid == TID_SDT && pat_pending)
+				{
+					memcpy(sdt, table, n);
+					sdt_pending = true;
+				}
+				else
+				{
+					cache_save(filter[i - 1].tid, filter[i - 1].id, 0, table);
+				}
+				/* now we know the PMT PIDs */
+				if(filter[i - 1].tid == TID_PAT)
+				{
+					pat_pending = false;
+					if(sdt_pending)
+						cache_save(TID_SDT, 0, 0, sdt);
+					nwanted = psi_pmts_wanted(service_id, all_services, wanted);
+				}
+			}
+			else if(n < 0)
+			{
+				error("read_psi: read: %s", strerror(errno));
+				ok = false;
+			}
+			else
+			{
+				/* not the table we asked for, wait for the next one */
+				continue;
+			}
+			close(pfd[i - 1].fd);
+			nfilters --;
+			pfd[i - 1] = pfd[nfilters];
+			filter[i - 1] = filter[nfilters];
+		}
+		nfilters = add_psi_pmt_filters(demux, pfd, filter, nfilters, wanted, nwanted, &next_wanted);
+	}
+
+	/* close the filters for anything we did not get in time */
+	for(i=0; i<nfilters; i++)
+		close(pfd[i].fd);
+
+	verbose("Read PSI tables in %u ms%s", (unsigned int) ((stats_now() - start) / 1000000), ok ? "" : " (incomplete)");
+
+	return ok;
+}
+
+/*
+ * the PAT must be in the cache
+ * fills in the services we want the PMTs for, service_id first
+ * returns how many there are
+ */
+
+static unsigned int
+psi_pmts_wanted(uint16_t service_id, bool all_services, uint16_t *wanted)
+{
+	uint16_t services[CACHE_MAX_SERVICES];
+	unsigned int nservices;
+	unsigned int nwanted;
+	unsigned int i;
+
+	nwanted = 0;
+	wanted[nwanted ++] = service_id;
+
+	if(all_services)
+	{
+		nservices = cache_services(services, CACHE_MAX_SERVICES);
+		for(i=0; i<nservices && nwanted<CACHE_MAX_SERVICES; i++)
+		{
+			if(services[i] != service_id)
+				wanted[nwanted ++] = services[i];
+		}
+	}
+
+	return nwanted;
+}
+
+/*
+ * add filters for the PMTs we still want until we have PSI_MAX_FILTERS open
+ * skips any that are already in the cache
+ * returns the new number of filters
+ */
+
+static unsigned int
+add_psi_pmt_filters(char *demux, struct pollfd *pfd, struct psi_filter *filter, unsigned int nfilters, uint16_t *wanted, unsigned int nwanted, unsigned int *next_wanted)
+{
+	unsigned char table[MAX_TABLE_LEN];
+	uint16_t pmt_pid;
+	uint16_t id;
+	int fd;
+
+	while(nfilters < PSI_MAX_FILTERS && *next_wanted < nwanted)
+	{
+		id = wanted[(*next_wanted) ++];
+		if(cache_load(TID_PMT, id, 0, table)
+		|| (pmt_pid = cache_pmt_pid(id)) == 0
+		|| (fd = open_table_filter(demux, pmt_pid, TID_PMT, id, 0)) < 0)
+			continue;
+		pfd[nfilters].fd = fd;
+		filter[nfilters].tid = TID_PMT;
+		filter[nfilters].id = id;
+		nfilters ++;
+	}
+
+	return nfilters;
+}
+
+/*
+ * the cached PMTs and SDT are used straight away after a retune, we don't wait to read them again
+ * so the downloader keeps a section filter open for each of them that only matches a different version number
+ * when one turns up, it replaces the cached copy
+ */
+
+struct psi_watch
+{
+	int fd;
+	uint16_t pid;
+	uint8_t tid;
+	uint16_t id;		/* service_id for a PMT, 0 otherwise */
+};
+
+static struct psi_watch _psi_watch[PSI_MAX_FILTERS];
+static unsigned int _npsi_watches = 0;
+static bool _psi_watching = false;
+static uint64_t _psi_checked = 0;
+
+/*
+ * returns the version number of the cached section, -1 if it is not cached
+ */
+
+static int
+cached_version(uint8_t tid, uint16_t id)
+{
+	unsigned char table[MAX_TABLE_LEN];
+
+	if(!cache_load(tid, id, 0, table))
+		return -1;
+
+	return (table[5] >> 1) & 0x1f;
+}
+
+static void
+add_psi_watch(char *demux, uint16_t pid, uint8_t tid, uint16_t id)
+{
+	struct psi_watch *w;
+	int fd;
+
+	if(_npsi_watches == PSI_MAX_FILTERS
+	|| (fd = open_section_filter(demux, pid, tid, (tid == TID_PMT) ? id : -1, 0, cached_version(tid, id))) < 0)
+		return;
+
+	w = &_psi_watch[_npsi_watches ++];
+	w->fd = fd;
+	w->pid = pid;
+	w->tid = tid;
+	w->id = id;
+
+	return;
+}
+
+/*
+ * called by the downloader process while it reads the carousel
+ * car is the first carousel in the group, we watch the SDT and the PMTs of all the services in the group
+ * never blocks, and only looks at the filters every PSI_WATCH_INTERVAL
+ */
+
+void
+check_psi_versions(struct carousel *car)
+{
+	struct pollfd pfd[PSI_MAX_FILTERS];
+	unsigned char table[MAX_TABLE_LEN];
+	struct carousel *member;
+	struct psi_watch *w;
+	uint16_t pid;
+	uint64_t now;
+	unsigned int i;
+	ssize_t n;
+
+	/* the downloader reads the PSI tables from the file as it comes to them */
+	if(using_tsfile())
+		return;
+
+	now = stats_now();
+	if(_psi_watching && (now - _psi_checked) < PSI_WATCH_INTERVAL)
+		return;
+	_psi_checked = now;
+
+	/* first time */
+	if(!_psi_watching)
+	{
+		_psi_watching = true;
+		add_psi_watch(car->demux_device, PID_SDT, TID_SDT, 0);
+		for(member=car; member!=NULL; member=member->next)
+		{
+			if((pid = cache_pmt_pid(member->service_id)) != 0)
+				add_psi_watch(car->demux_device, pid, TID_PMT, member->service_id);
+			for(i=0; i<member->nservices; i++)
+			{
+				if((pid = cache_pmt_pid(member->services[i])) != 0)
+					add_psi_watch(car->demux_device, pid, TID_PMT, member->services[i]);
+			}
+		}
+	}
+
+	if(_npsi_watches == 0)
+		return;
+
+	for(i=0; i<_npsi_watches; i++)
+	{
+		pfd[i].fd = _psi_watch[i].fd;
+		pfd[i].events = POLLIN;
+	}
+	if(poll(pfd, _npsi_watches, 0) <= 0)
+		return;
+
+	for(i=0; i<_npsi_watches; i++)
+	{
+		w = &_psi_watch[i];
+		/* the filter only matches new versions, but some demuxes can't do that */
+		if(pfd[i].revents == 0
+		|| (n = read(w->fd, table, MAX_TABLE_LEN)) <= 0
+		|| table[0] != w->tid
+		|| ((table[5] >> 1) & 0x1f) == cached_version(w->tid, w->id))
+			continue;
+		verbose("New version of table 0x%x id %u: %u", w->tid, w->id, (table[5] >> 1) & 0x1f);
+		cache_save(w->tid, w->id, 0, table);
+		/* wait for the version after this one */
+		close(w->fd);
+		if((w->fd = open_section_filter(car->demux_device, w->pid, w->tid, (w->tid == TID_PMT) ? w->id : -1, 0, cached_version(w->tid, w->id))) < 0)
+		{
+			/* don't look at it again */
+			_npsi_watches --;
+			_psi_watch[i] = _psi_watch[_npsi_watches];
+			pfd[i] = pfd[_npsi_watches];
+			i --;
+		}
+	}
+
+	return;
+}
+
+/*
+ * returns a demux fd that reads the given table (defined by pid and tid) from the given DVB device
+ * if id is not -1, only sections with that table_id_extension are read (eg the service_id of a PMT)
+ * sn is the section number, -1 => any section
+ * returns -1 on error
+ */
+
+int
+open_table_filter(char *device, uint16_t pid, uint8_t tid, int id, int sn)
+{
+	return open_section_filter(device, pid, tid, id, sn, -1);
+}
+
+/*
+ * as open_table_filter(), but if version is not -1, only sections with a different version_number are read
+ */
+
+static int
+open_section_filter(char *device, uint16_t pid, uint8_t tid, int id, int sn, int version)
+{
+	int fd;
 	struct dmx_sct_filter_params sctFilterParams;
-	fd_set readfds;
-	struct timeval timeout;
-	int n;
 
-	if((fd_data = open(device, O_RDWR)) < 0)
+	if((fd = open(device, O_RDWR)) < 0)
 	{
 		error("open '%s': %s", device, strerror(errno));
-		return false;
+		return -1;
 	}
 
 	memset(&sctFilterParams, 0, sizeof(sctFilterParams));
@@ -203,16 +587,74 @@ read_table(char *device, uint16_t pid, uint8_t tid, unsigned int secs, unsigned
 	sctFilterParams.flags = DMX_IMMEDIATE_START;
 	sctFilterParams.filter.filter[0] = tid;
 	sctFilterParams.filter.mask[0] = 0xff;
-	sctFilterParams.filter.filter[4] = sn;
-	sctFilterParams.filter.mask[4] = 0xff;
+	/* the filter skips the section_length bytes, so [1] and [2] are the table_id_extension */
+	if(id != -1)
+	{
+		sctFilterParams.filter.filter[1] = (id >> 8) & 0xff;
+		sctFilterParams.filter.mask[1] = 0xff;
+		sctFilterParams.filter.filter[2] = id & 0xff;
+		sctFilterParams.filter.mask[2] = 0xff;
+	}
+	if(sn != -1)
+	{
+		sctFilterParams.filter.filter[4] = sn;
+		sctFilterParams.filter.mask[4] = 0xff;
+	}
+#if !defined(HAVE_DREAMBOX_HARDWARE)
+	/* a 1 in the mode means the bit must be different */
+	if(version != -1)
+	{
+		sctFilterParams.filter.filter[3] = (version & 0x1f) << 1;
+		sctFilterParams.filter.mask[3] = 0x3e;
+		sctFilterParams.filter.mode[3] = 0x3e;
+	}
+#endif
 
-	if(ioctl(fd_data, DMX_SET_FILTER, &sctFilterParams) < 0)
+	if(ioctl(fd, DMX_SET_FILTER, &sctFilterParams) < 0)
 	{
 		error("ioctl DMX_SET_FILTER: %s", strerror(errno));
-		close(fd_data);
-		return false;
+		close(fd);
+		return -1;
 	}
 
+	return fd;
+}
+
+/*
+ * read the given table (defined by pid and tid) from the given DVB device
+ * sn is the section number
+ * output buffer must be at least MAX_TABLE_LEN bytes
+ * returns false if it timesout
+ */
+
+bool
+read_table(char *device, uint16_t pid, uint8_t tid, unsigned int secs, unsigned char *out, unsigned char sn)
+{
+	int fd_data;
+	fd_set readfds;
+	struct timeval timeout;
+	struct section_filter filter;
+	int n;
+
+	/* are we reading from a file rather than a DVB card */
+	if(using_tsfile())
+	{
+		filter.pid = pid;
+		filter.tid = tid;
+		filter.sn = sn;
+		filter.sn_mask = 0xff;
+		/* true => go back to the start of the file if we need to */
+		if(!tsfile_read_section(&filter, 1, out, &pid, true))
+		{
+			error("Unable to find table 0x%x on PID %u in Transport Stream", tid, pid);
+			return false;
+		}
+		return true;
+	}
+
+	if((fd_data = open_table_filter(device, pid, tid, -1, sn)) < 0)
+		return false;
+
 	timeout.tv_sec = secs;
 	timeout.tv_usec = 0;
 	do
@@ -252,6 +694,59 @@ read_table(char *device, uint16_t pid, uint8_t tid, unsigned int secs, unsigned
 	return true;
 }
 
+/*
+ * we read DSMCC sections from all the PIDs in batches
+ * each time epoll says some fds are ready, we read upto SECTIONS_PER_FD sections from each of them
+ * we take one section from each ready fd in turn, so a busy PID can't starve the others
+ * (and we start with a different fd each time, so low numbered PIDs don't always go first)
+ * the sections are queued up and read_dsmcc_tables() returns them one at a time
+ *
+ * each section is given a priority when we read it (see module.h)
+ * read_dsmcc_tables() returns the oldest section with the highest priority
+ * so the DSI, DII and the blocks the browser needs to start get processed first
+ * if the queue is full, we keep reading so the demux doesn't overflow,
+ * and throw away the lowest priority sections (they will be broadcast again)
+ */
+
+/* max number of ready fds epoll tells us about in one go */
+#define MAX_READY_FDS		64
+
+/* max sections we read from one fd each time epoll wakes us up */
+#define SECTIONS_PER_FD		8
+
+/* max sections we queue up */
+#define SECTION_QUEUE_LEN	64
+
+struct queued_section
+{
+	uint16_t pid;			/* PID it came from */
+	unsigned int priority;		/* PRIORITY_NORMAL etc */
+	size_t length;			/* number of bytes in data[] */
+	unsigned char data[MAX_TABLE_LEN];
+};
+
+struct section_queue
+{
+	unsigned int count;		/* number of sections in the queue */
+	unsigned int next_fd;		/* which ready fd we start reading from next time */
+	unsigned int dropped;		/* number of sections we have thrown away */
+	uint8_t order[SECTION_QUEUE_LEN];	/* slots in use, oldest first */
+	uint8_t nfree;			/* number of slots not in use */
+	uint8_t free[SECTION_QUEUE_LEN + 1];	/* slots not in use */
+	/* one more than we queue, so we always have somewhere to read the next section into */
+	struct queued_section section[SECTION_QUEUE_LEN + 1];
+};
+
+static void
+dequeue_section(struct section_queue *q, unsigned int n)
+{
+	q->free[q->nfree ++] = q->order[n];
+	q->count --;
+	memmove(&q->order[n], &q->order[n + 1], q->count - n);
+
+	return;
+}
+
 /*
  * output buffer must be at least MAX_TABLE_LEN bytes
  * returns false if it timesout
@@ -260,70 +755,317 @@ read_table(char *device, uint16_t pid, uint8_t tid, unsigned int secs, unsigned
 bool
 read_dsmcc_tables(struct carousel *car, unsigned char *out)
 {
-	struct timeval timeout;
+	struct section_queue *q;
+	struct queued_section *sec;
+	unsigned int best;
 	unsigned int i;
-	fd_set readfds;
-	int max;
-	int fd;
-	int n;
 
-	timeout.tv_sec = car->timeout;
-	timeout.tv_usec = 0;
-	do
+	if(using_tsfile())
 	{
-		out[0] = 0;
-		/* work out the max fd number and set the fds we want to read from */
-		max = 0;
-		FD_ZERO(&readfds);
-		for(i=0; i<car->npids; i++)
-		{
-			max = MAX(max, car->pids[i].fd_ctrl);
-			max = MAX(max, car->pids[i].fd_data);
-			FD_SET(car->pids[i].fd_ctrl, &readfds);
-			FD_SET(car->pids[i].fd_data, &readfds);
-		}
-		/* wait for some data to be ready */
-		if(select(max + 1, &readfds, NULL, NULL, &timeout) < 0)
-		{
-			error("read_dsmcc_tables: select: %s", strerror(errno));
+		if(!read_tsfile_dsmcc_tables(car, out))
+			return false;
+		stats_section(car->current_pid, 3 + (((out[1] & 0x0f) << 8) | out[2]));
+		return true;
+	}
+
+	/* first time we have been called */
+	if(car->epoll_fd == -1)
+		start_reactor(car);
+
+	/* wait for some more data if we have returned everything we had */
+	q = car->sections;
+	while(q->count == 0)
+	{
+		if(!fill_section_queue(car))
 			return false;
+	}
+
+	/* the oldest section with the highest priority */
+	best = 0;
+	for(i=1; i<q->count; i++)
+	{
+		if(q->section[q->order[i]].priority > q->section[q->order[best]].priority)
+			best = i;
+	}
+
+	sec = &q->section[q->order[best]];
+	memcpy(out, sec->data, sec->length);
+	/* remember where we got the data from */
+	car->current_pid = sec->pid;
+
+	dequeue_section(q, best);
+
+	return true;
+}
+
+/*
+ * called by the downloader process the first time it reads the DSMCC tables
+ * (so the listener process never has the epoll fd open)
+ * car is the first carousel in the group, we read the PIDs for all the carousels in its group
+ */
+
+static void
+start_reactor(struct carousel *car)
+{
+	struct carousel *member;
+	int32_t i;
+
+	if((car->epoll_fd = epoll_create(MAX_READY_FDS)) < 0)
+		fatal("epoll_create: %s", strerror(errno));
+
+	car->sections = safe_malloc(sizeof(struct section_queue));
+	car->sections->count = 0;
+	car->sections->next_fd = 0;
+	car->sections->dropped = 0;
+	car->sections->nfree = SECTION_QUEUE_LEN + 1;
+	for(i=0; i<=SECTION_QUEUE_LEN; i++)
+		car->sections->free[i] = i;
+
+	/* wait for data on all the PIDs we have so far, if another carousel is reading it, its fds are -1 */
+	for(member=car; member!=NULL; member=member->next)
+	{
+		for(i=0; i<member->npids; i++)
+		{
+			if(member->pids[i].fd_ctrl != -1)
+				watch_pid(member, i);
 		}
-		/* see which fd is ready */
-		fd = -1;
-		for(i=0; fd==-1 && i<car->npids; i++)
+	}
+
+	return;
+}
+
+/*
+ * add the fds for car->pids[n] to the epoll set of car's group
+ * we store the index rather than a ptr, because car->pids may get realloc'ed
+ * top 32 bits of the epoll data are car's group_index
+ * bottom bit of the epoll data is 0 for fd_ctrl, 1 for fd_data
+ */
+
+static void
+watch_pid(struct carousel *car, uint32_t n)
+{
+	struct epoll_event ev;
+	uint64_t which = ((uint64_t) car->group_index << 32) | (n << 1);
+
+	ev.events = EPOLLIN;
+
+	ev.data.u64 = which;
+	if(epoll_ctl(car->group->epoll_fd, EPOLL_CTL_ADD, car->pids[n].fd_ctrl, &ev) < 0)
+		fatal("epoll_ctl: %s", strerror(errno));
+
+	ev.data.u64 = which | 1;
+	if(epoll_ctl(car->group->epoll_fd, EPOLL_CTL_ADD, car->pids[n].fd_data, &ev) < 0)
+		fatal("epoll_ctl: %s", strerror(errno));
+
+	return;
+}
+
+/*
+ * wait for some of the PIDs to have data, then read as much as we can into the queue
+ * returns false if it times out
+ */
+
+static bool
+fill_section_queue(struct carousel *car)
+{
+	struct section_queue *q = car->sections;
+	struct epoll_event ready[MAX_READY_FDS];
+	bool drained[MAX_READY_FDS];
+	int nready;
+	int ndrained;
+	int round;
+	int i, j;
+
+	do
+		nready = epoll_wait(car->epoll_fd, ready, MAX_READY_FDS, car->timeout * 1000);
+	while(nready < 0 && errno == EINTR);
+
+	if(nready < 0)
+	{
+		error("read_dsmcc_tables: epoll_wait: %s", strerror(errno));
+		return false;
+	}
+	else if(nready == 0)
+	{
+		error("Timeout reading %s", car->demux_device);
+		return false;
+	}
+
+	for(i=0; i<nready; i++)
+		drained[i] = false;
+	ndrained = 0;
+
+	/* take one section from each fd in turn until they are all empty */
+	for(round=0; round<SECTIONS_PER_FD && ndrained<nready; round++)
+	{
+		for(j=0; j<nready; j++)
 		{
-			if(FD_ISSET(car->pids[i].fd_ctrl, &readfds))
-			{
-				fd = car->pids[i].fd_ctrl;
-				/* remember where we got the data from */
-				car->current_pid = car->pids[i].pid;
-			}
-			else if(FD_ISSET(car->pids[i].fd_data, &readfds))
+			i = (q->next_fd + j) % nready;
+			if(!drained[i] && !read_section(car, ready[i].data.u64))
 			{
-				fd = car->pids[i].fd_data;
-				/* remember where we got the data from */
-				car->current_pid = car->pids[i].pid;
+				drained[i] = true;
+				ndrained ++;
 			}
 		}
-		if(fd == -1)
-		{
-			error("Timeout reading %s", car->demux_device);
+	}
+
+	/* start with a different fd next time */
+	q->next_fd ++;
+
+	return true;
+}
+
+/*
+ * read a section from the fd epoll told us about and add it to the end of the queue
+ * returns false if there is nothing left to read from the fd
+ */
+
+static bool
+read_section(struct carousel *car, uint64_t which)
+{
+	struct carousel *member;
+	struct pid_fds *fds;
+	int fd;
+	struct section_queue *q = car->sections;
+	uint8_t slot;
+	int victim;
+	struct queued_section *sec;
+	ssize_t n;
+
+	/* find the carousel that owns the fd */
+	member = car;
+	while(member->group_index != (which >> 32))
+		member = member->next;
+
+	fds = &member->pids[(which & 0xffffffff) >> 1];
+	fd = (which & 1) ? fds->fd_data : fds->fd_ctrl;
+
+	/* there is always at least one free slot */
+	slot = q->free[q->nfree - 1];
+	sec = &q->section[slot];
+
+	if((n = read(fd, sec->data, MAX_TABLE_LEN)) < 0)
+	{
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
 			return false;
+		/*
+		 * may get EOVERFLOW if we don't read quick enough,
+		 * so just count it and have another go
+		 */
+		if(errno == EOVERFLOW)
+		{
+			fds->overflows ++;
+			stats_overflow(fds->pid);
+			error("PID %u: demux buffer overflow (%u so far)", fds->pid, fds->overflows);
+			return true;
 		}
-		/* read the table */
-		if((n = read(fd, out, MAX_TABLE_LEN)) < 0)
+		error("read: %s", strerror(errno));
+		return false;
+	}
+
+	/* we only want the DSI, DII and DDB tables */
+	if(n > 0 && (sec->data[0] == TID_DSMCC_CONTROL || sec->data[0] == TID_DSMCC_DATA))
+	{
+		/* count it even if we have to drop it below */
+		stats_section(fds->pid, n);
+		sec->pid = fds->pid;
+		sec->length = n;
+		if(sec->data[0] == TID_DSMCC_CONTROL)
+			sec->priority = PRIORITY_CONTROL;
+		else
+			sec->priority = ddb_priority(car, fds->pid, (struct dsmccMessageHeader *) &sec->data[8]);
+		/* if the queue is full, throw away a lower priority section to make room, or this one */
+		if(q->count == SECTION_QUEUE_LEN
+		&& (victim = drop_section(q, sec->priority)) < 0)
+			return true;
+		/* take our slot off the free list before the victim's goes on it */
+		q->nfree --;
+		if(q->count == SECTION_QUEUE_LEN)
+			dequeue_section(q, victim);
+		q->order[q->count ++] = slot;
+	}
+
+	return (n > 0);
+}
+
+/*
+ * the queue is full and we want to add a section with the given priority
+ * returns the position in the queue of the newest of the lowest priority sections, if it is lower than priority
+ * returns -1 if the new section should be thrown away instead
+ */
+
+static int
+drop_section(struct section_queue *q, unsigned int priority)
+{
+	unsigned int victim;
+	unsigned int i;
+
+	victim = q->count - 1;
+	for(i=victim; i>0; i--)
+	{
+		if(q->section[q->order[i - 1]].priority < q->section[q->order[victim]].priority)
+			victim = i - 1;
+	}
+
+	q->dropped ++;
+	if((q->dropped % 100) == 1)
+		verbose("Can't keep up with the demux, %u sections dropped", q->dropped);
+
+	if(q->section[q->order[victim]].priority >= priority)
+		return -1;
+
+	return victim;
+}
+
+/*
+ * read_dsmcc_tables() for when we are reading from a file
+ * returns false when we get to the end of the file
+ */
+
+static struct section_filter *_dsmcc_filters = NULL;
+static unsigned int _ndsmcc_filters = 0;
+static unsigned int _ngroup_pids = 0;
+
+static bool
+read_tsfile_dsmcc_tables(struct carousel *car, unsigned char *out)
+{
+	struct carousel *member;
+	unsigned int npids;
+	int32_t i;
+	unsigned int j;
+
+	/* we only ever add PIDs, so we only need to rebuild the filters when that happens */
+	npids = 0;
+	for(member=car; member!=NULL; member=member->next)
+		npids += member->npids;
+
+	if(_ngroup_pids != npids)
+	{
+		_ngroup_pids = npids;
+		_dsmcc_filters = safe_realloc(_dsmcc_filters, npids * 2 * sizeof(struct section_filter));
+		_ndsmcc_filters = 0;
+		for(member=car; member!=NULL; member=member->next)
 		{
-			/*
-			 * may get EOVERFLOW if we don't read quick enough,
-			 * so just report it and have another go
-			 */
-			error("read: %s", strerror(errno));
-			out[0] = 0;
+			for(i=0; i<member->npids; i++)
+			{
+				/* only need one filter if several carousels use the PID */
+				for(j=0; j<_ndsmcc_filters && _dsmcc_filters[j].pid != member->pids[i].pid; j+=2)
+					;
+				if(j < _ndsmcc_filters)
+					continue;
+				_dsmcc_filters[_ndsmcc_filters].pid = member->pids[i].pid;
+				_dsmcc_filters[_ndsmcc_filters].tid = TID_DSMCC_CONTROL;
+				_dsmcc_filters[_ndsmcc_filters].sn_mask = 0;
+				_dsmcc_filters[_ndsmcc_filters + 1].pid = member->pids[i].pid;
+				_dsmcc_filters[_ndsmcc_filters + 1].tid = TID_DSMCC_DATA;
+				_dsmcc_filters[_ndsmcc_filters + 1].sn_mask = 0;
+				_ndsmcc_filters += 2;
+			}
 		}
 	}
-	while(out[0] != TID_DSMCC_CONTROL && out[0] != TID_DSMCC_DATA);
 
-	return out;
+	/* false => stop at the end of the file */
+	return tsfile_read_section(_dsmcc_filters, _ndsmcc_filters, out, &car->current_pid, false);
 }
 
 void
@@ -346,9 +1088,22 @@ add_dsmcc_pid(struct carousel *car, uint16_t pid)
 	fds = &car->pids[car->npids - 1];
 
 	fds->pid = pid;
+	fds->overflows = 0;
+
+	/*
+	 * if we are reading from a file, read_dsmcc_tables() does the filtering
+	 * if another carousel in our group is reading the PID, it passes the sections on to us
+	 */
+	if(using_tsfile()
+	|| group_reading_pid(car, pid))
+	{
+		fds->fd_ctrl = -1;
+		fds->fd_data = -1;
+		return;
+	}
 
 	/* open an fd to read the DSMCC control tables (DSI and DII) */
-	if((fds->fd_ctrl = open(car->demux_device, O_RDWR)) < 0)
+	if((fds->fd_ctrl = open(car->demux_device, O_RDWR | O_NONBLOCK)) < 0)
 		fatal("open '%s': %s", car->demux_device, strerror(errno));
 
 	/* set the table filter */
@@ -362,7 +1117,7 @@ add_dsmcc_pid(struct carousel *car, uint16_t pid)
 		fatal("ioctl DMX_SET_FILTER: %s", strerror(errno));
 
 	/* open an fd to read the DSMCC data table (DDB) */
-	if((fds->fd_data = open(car->demux_device, O_RDWR)) < 0)
+	if((fds->fd_data = open(car->demux_device, O_RDWR | O_NONBLOCK)) < 0)
 		fatal("open '%s': %s", car->demux_device, strerror(errno));
 
 	/* set the table filter */
@@ -375,6 +1130,78 @@ add_dsmcc_pid(struct carousel *car, uint16_t pid)
 	if(ioctl(fds->fd_data, DMX_SET_FILTER, &sctFilterParams) < 0)
 		fatal("ioctl DMX_SET_FILTER: %s", strerror(errno));
 
+	/* if the downloader is already running, start reading from the new PID */
+	if(car->group->epoll_fd != -1)
+		watch_pid(car, car->npids - 1);
+
+	return;
+}
+
+/*
+ * returns true if another carousel in car's group has a filter on the given PID
+ */
+
+static bool
+group_reading_pid(struct carousel *car, uint16_t pid)
+{
+	struct carousel *member;
+	int32_t i;
+
+	for(member=car->group; member!=NULL; member=member->next)
+	{
+		if(member == car)
+			continue;
+		for(i=0; i<member->npids; i++)
+		{
+			if(member->pids[i].pid == pid
+			&& member->pids[i].fd_ctrl != -1)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * returns true if car wants the sections from the given PID
+ */
+
+bool
+carousel_has_pid(struct carousel *car, uint16_t pid)
+{
+	int32_t i;
+
+	for(i=0; i<car->npids; i++)
+	{
+		if(car->pids[i].pid == pid)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * close the section filters for all the PIDs car is reading
+ * used by the listener, only the downloader process needs them
+ */
+
+void
+close_dsmcc_pids(struct carousel *car)
+{
+	int32_t i;
+
+	for(i=0; i<car->npids; i++)
+	{
+		if(car->pids[i].fd_ctrl != -1)
+			close(car->pids[i].fd_ctrl);
+		if(car->pids[i].fd_data != -1)
+			close(car->pids[i].fd_data);
+	}
+
+	safe_free(car->pids);
+	car->pids = NULL;
+	car->npids = 0;
+
 	return;
 }
 
@@ -31,15 +31,39 @@
 /* max size of a DVB table */
 #define MAX_TABLE_LEN   4096
 
+/* PIDs of the tables we read */
+#define PID_PAT		0x0000
+#define PID_NIT		0x0010
+#define PID_SDT		0x0011
+
+/* Programme Association Table TID */
+#define TID_PAT		0x00
+
+/* Programme Map Table TID */
+#define TID_PMT		0x02
+
+/* Network Information Table (actual network) TID */
+#define TID_NIT		0x40
+
+/* Service Description Table TIDs */
+#define TID_SDT		0x42	/* actual Transport Stream */
+#define TID_SDT_OTHER	0x46	/* other Transport Streams */
+
 bool read_pat(char *, unsigned int, unsigned char *);
 bool read_pmt(char *, uint16_t, unsigned int, unsigned char *);
+bool read_uncached_pmt(char *, uint16_t, unsigned int, unsigned char *);
 bool read_sdt(char *, unsigned int, unsigned char *, unsigned char);
+bool read_psi(char *, unsigned int, uint16_t, bool);
+void check_psi_versions(struct carousel *);
 
 bool read_table(char *, uint16_t, uint8_t, unsigned int, unsigned char *, unsigned char);
+int open_table_filter(char *, uint16_t, uint8_t, int, int);
 
 bool read_dsmcc_tables(struct carousel *, unsigned char *);
 
 void add_dsmcc_pid(struct carousel *, uint16_t);
+bool carousel_has_pid(struct carousel *, uint16_t);
+void close_dsmcc_pids(struct carousel *);
 
 #endif	/* __TABLE_H__ */
 
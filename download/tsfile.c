@@ -0,0 +1,484 @@
+/*
+ * tsfile.c
+ *
+ * read DVB tables from an MPEG Transport Stream file (or stdin) instead of a DVB card
+ * we do the job of the demux section filter ourselves, ie:
+ * pick out the TS packets on the PIDs we want,
+ * reassemble them into sections,
+ * check the CRC and match the table_id (and section_number)
+ *
+ * regular files are read with pread() and our own offset
+ * so processes we fork off do not move each other's position in the file
+ * if we are reading from a pipe there is only one position,
+ * so only the carousel downloader should be reading from it
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "tsfile.h"
+#include "table.h"
+#include "utils.h"
+
+/* MPEG Transport Stream packets */
+#define TS_PACKET_SIZE	188
+#define TS_SYNC_BYTE	0x47
+
+/* PIDs are 13 bits */
+#define MAX_PIDS	8192
+
+/* number of TS packets we read from the file in one go */
+#define TS_READ_PACKETS	512
+
+/* section reassembly state for each PID */
+struct ts_section
+{
+	bool active;		/* true if data[] holds the start of a section */
+	bool complete;		/* true if data[] holds a whole section */
+	int cc;			/* last continuity_counter, -1 => none seen yet */
+	uint32_t len;		/* bytes of data[] filled in so far */
+	unsigned char data[MAX_TABLE_LEN];
+};
+
+/* internal functions */
+static unsigned char *next_packet(void);
+static bool start_packet(unsigned char *, struct section_filter *, unsigned int);
+static bool next_section(void);
+static bool section_wanted(uint16_t, struct ts_section *, struct section_filter *, unsigned int);
+static uint32_t section_length(unsigned char *);
+static uint32_t mpeg_crc32(unsigned char *, uint32_t);
+
+static int _ts_fd = -1;
+static bool _seekable = false;
+static off_t _offset = 0;
+
+/* data read from the file but not processed yet */
+static unsigned char _ts_buf[TS_PACKET_SIZE * TS_READ_PACKETS];
+static size_t _buf_len = 0;
+static size_t _buf_pos = 0;
+
+/* the TS packet we are currently taking sections from */
+static unsigned char _pkt[TS_PACKET_SIZE];
+static uint16_t _pkt_pid;
+static unsigned int _pkt_pos = TS_PACKET_SIZE;	/* next byte to process, TS_PACKET_SIZE => finished */
+static int _pkt_start;				/* where the pointer_field says a section starts, -1 => none */
+static bool _pkt_new;				/* true if we are past the pointer_field start */
+
+/* lazily allocated, indexed by PID */
+static struct ts_section *_sections[MAX_PIDS];
+
+static uint32_t _crc_table[256];
+
+/*
+ * filename "-" means stdin
+ * returns false if the file can't be opened
+ */
+
+bool
+tsfile_init(char *filename)
+{
+	struct stat info;
+	uint32_t i, j, crc;
+
+	if(strcmp(filename, "-") == 0)
+	{
+		_ts_fd = STDIN_FILENO;
+	}
+	else if((_ts_fd = open(filename, O_RDONLY)) < 0)
+	{
+		error("open '%s': %s", filename, strerror(errno));
+		return false;
+	}
+
+	/* we can only rewind regular files */
+	_seekable = (fstat(_ts_fd, &info) == 0 && S_ISREG(info.st_mode));
+
+	verbose("Reading Transport Stream from %s", (_ts_fd == STDIN_FILENO) ? "stdin" : filename);
+
+	/* MPEG-2 CRC32 lookup table */
+	for(i=0; i<256; i++)
+	{
+		crc = i << 24;
+		for(j=0; j<8; j++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+		_crc_table[i] = crc;
+	}
+
+	return true;
+}
+
+/*
+ * returns true if we are reading tables from a file rather than a DVB card
+ */
+
+bool
+using_tsfile(void)
+{
+	return (_ts_fd != -1);
+}
+
+/*
+ * start reading from the beginning of the file again
+ * does nothing if we are reading from a pipe
+ */
+
+void
+tsfile_rewind(void)
+{
+	unsigned int i;
+
+	if(!_seekable)
+		return;
+
+	_offset = 0;
+	_buf_len = 0;
+	_buf_pos = 0;
+	_pkt_pos = TS_PACKET_SIZE;
+
+	/* forget any partial sections */
+	for(i=0; i<MAX_PIDS; i++)
+	{
+		if(_sections[i] != NULL)
+		{
+			_sections[i]->active = false;
+			_sections[i]->complete = false;
+			_sections[i]->cc = -1;
+		}
+	}
+
+	return;
+}
+
+/*
+ * read the next section that matches one of the filters
+ * output buffer must be at least MAX_TABLE_LEN bytes
+ * the PID the section was on is returned in *pid
+ * if wrap is true, we go back to the start of the file (once) if we get to the end
+ * returns false if we get to the end of the file without finding one
+ */
+
+bool
+tsfile_read_section(struct section_filter *filters, unsigned int nfilters, unsigned char *out, uint16_t *pid, bool wrap)
+{
+	unsigned char *pkt;
+	bool wrapped = false;
+
+	while(true)
+	{
+		/* do we need a new packet */
+		if(_pkt_pos >= TS_PACKET_SIZE)
+		{
+			if((pkt = next_packet()) == NULL)
+			{
+				if(!wrap || wrapped || !_seekable)
+					return false;
+				tsfile_rewind();
+				wrapped = true;
+				continue;
+			}
+			/* is it a PID we want */
+			if(!start_packet(pkt, filters, nfilters))
+				continue;
+		}
+		/* did we complete a section that matches the filters */
+		if(next_section()
+		&& section_wanted(_pkt_pid, _sections[_pkt_pid], filters, nfilters))
+		{
+			memcpy(out, _sections[_pkt_pid]->data, _sections[_pkt_pid]->len);
+			*pid = _pkt_pid;
+			return true;
+		}
+	}
+
+	/* not reached */
+	return false;
+}
+
+/*
+ * returns the next TS packet from the file
+ * returns NULL at the end of the file
+ */
+
+static unsigned char *
+next_packet(void)
+{
+	ssize_t nread;
+	unsigned char *pkt;
+
+	while(true)
+	{
+		/* do we need to read some more */
+		if(_buf_len - _buf_pos < TS_PACKET_SIZE)
+		{
+			/* keep any partial packet */
+			memmove(_ts_buf, &_ts_buf[_buf_pos], _buf_len - _buf_pos);
+			_buf_len -= _buf_pos;
+			_buf_pos = 0;
+			do
+			{
+				if(_seekable)
+					nread = pread(_ts_fd, &_ts_buf[_buf_len], sizeof(_ts_buf) - _buf_len, _offset);
+				else
+					nread = read(_ts_fd, &_ts_buf[_buf_len], sizeof(_ts_buf) - _buf_len);
+			}
+			while(nread < 0 && errno == EINTR);
+			if(nread < 0)
+				error("read Transport Stream: %s", strerror(errno));
+			if(nread <= 0)
+				return NULL;
+			_offset += nread;
+			_buf_len += nread;
+			continue;
+		}
+		/* resync if we have lost our place */
+		if(_ts_buf[_buf_pos] != TS_SYNC_BYTE)
+		{
+			_buf_pos ++;
+			continue;
+		}
+		pkt = &_ts_buf[_buf_pos];
+		_buf_pos += TS_PACKET_SIZE;
+		return pkt;
+	}
+
+	/* not reached */
+	return NULL;
+}
+
+/*
+ * make pkt the current packet if it is on one of the PIDs in the filters
+ * returns false if we are not interested in it
+ */
+
+static bool
+start_packet(unsigned char *pkt, struct section_filter *filters, unsigned int nfilters)
+{
+	uint16_t pid;
+	uint8_t adaption;
+	uint8_t cc;
+	unsigned int pos;
+	unsigned int i;
+	bool wanted;
+	struct ts_section *sec;
+
+	/* skip it if the transport_error_indicator is set */
+	if(pkt[1] & 0x80)
+		return false;
+
+	pid = ((pkt[1] & 0x1f) << 8) + pkt[2];
+	wanted = false;
+	for(i=0; !wanted && i<nfilters; i++)
+		wanted = (filters[i].pid == pid);
+	if(!wanted)
+		return false;
+
+	/* adaption_field_control, bit 0 => has a payload */
+	adaption = (pkt[3] >> 4) & 0x03;
+	if((adaption & 0x01) == 0)
+		return false;
+
+	if((sec = _sections[pid]) == NULL)
+	{
+		sec = safe_malloc(sizeof(struct ts_section));
+		sec->active = false;
+		sec->complete = false;
+		sec->cc = -1;
+		sec->len = 0;
+		_sections[pid] = sec;
+	}
+
+	/* same continuity_counter => duplicate packet */
+	cc = pkt[3] & 0x0f;
+	if(sec->cc == cc)
+		return false;
+	/* lost some packets, so lose any partial section */
+	if(sec->cc != -1 && cc != ((sec->cc + 1) & 0x0f))
+		sec->active = false;
+	sec->cc = cc;
+
+	/* skip the adaption_field */
+	pos = 4;
+	if(adaption & 0x02)
+		pos += 1 + pkt[4];
+	if(pos >= TS_PACKET_SIZE)
+		return false;
+
+	/* payload_unit_start_indicator => a pointer_field says where the next section starts */
+	if(pkt[1] & 0x40)
+	{
+		_pkt_start = pos + 1 + pkt[pos];
+		pos += 1;
+		if(_pkt_start >= TS_PACKET_SIZE)
+			_pkt_start = -1;
+	}
+	else
+	{
+		_pkt_start = -1;
+	}
+
+	memcpy(_pkt, pkt, TS_PACKET_SIZE);
+	_pkt_pid = pid;
+	_pkt_pos = pos;
+	_pkt_new = false;
+
+	return true;
+}
+
+/*
+ * add the rest of the current packet to the section we are reassembling
+ * returns true if it completes a section
+ * any data left in the packet is processed on the next call
+ */
+
+static bool
+next_section(void)
+{
+	struct ts_section *sec = _sections[_pkt_pid];
+	unsigned int end;
+	uint32_t need;
+	uint32_t avail;
+
+	/* another section may follow straight on from the one we returned last time */
+	if(sec->complete)
+	{
+		sec->complete = false;
+		sec->len = 0;
+	}
+
+	while(_pkt_pos < TS_PACKET_SIZE)
+	{
+		/* a new section starts here */
+		if(_pkt_start != -1 && _pkt_pos == (unsigned int) _pkt_start)
+		{
+			sec->active = true;
+			sec->len = 0;
+			_pkt_start = -1;
+			_pkt_new = true;
+		}
+		/* skip to the start of the next section, or the end of the packet */
+		if(!sec->active)
+		{
+			_pkt_pos = (_pkt_start != -1) ? _pkt_start : TS_PACKET_SIZE;
+			continue;
+		}
+		/* stuffing bytes after the last section in this packet */
+		if(sec->len == 0 && _pkt[_pkt_pos] == 0xff)
+		{
+			sec->active = false;
+			continue;
+		}
+		/* only take data up to the start of the next section */
+		end = (_pkt_start != -1) ? _pkt_start : TS_PACKET_SIZE;
+		need = (sec->len < 3) ? 3 : section_length(sec->data);
+		if(need > MAX_TABLE_LEN)
+		{
+			sec->active = false;
+			continue;
+		}
+		avail = MIN(end - _pkt_pos, need - sec->len);
+		memcpy(&sec->data[sec->len], &_pkt[_pkt_pos], avail);
+		sec->len += avail;
+		_pkt_pos += avail;
+		/* got it all yet */
+		if(sec->len >= 3 && sec->len == section_length(sec->data))
+		{
+			/* if we are past the pointer_field start, the next byte may start another section */
+			sec->active = _pkt_new;
+			sec->complete = true;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * returns true if the section matches one of the filters and has a valid CRC
+ */
+
+static bool
+section_wanted(uint16_t pid, struct ts_section *sec, struct section_filter *filters, unsigned int nfilters)
+{
+	unsigned int i;
+	bool match;
+
+	/* make sure it has a section_number */
+	if(sec->len < 8)
+		return false;
+
+	match = false;
+	for(i=0; !match && i<nfilters; i++)
+	{
+		match = (filters[i].pid == pid
+		      && filters[i].tid == sec->data[0]
+		      && (filters[i].sn & filters[i].sn_mask) == (sec->data[6] & filters[i].sn_mask));
+	}
+
+	/*
+	 * section_syntax_indicator => there is a CRC32 at the end
+	 * (DSMCC sections may have a checksum instead, we don't check those)
+	 */
+	if(match
+	&& (sec->data[1] & 0x80) != 0
+	&& mpeg_crc32(sec->data, sec->len) != 0)
+	{
+		vverbose("CRC error in section on PID %u", pid);
+		match = false;
+	}
+
+	return match;
+}
+
+/*
+ * returns the size of the whole section, including the header
+ */
+
+static uint32_t
+section_length(unsigned char *data)
+{
+	return 3 + (((data[1] & 0x0f) << 8) + data[2]);
+}
+
+/*
+ * MPEG-2 CRC32, returns 0 if the data includes a valid CRC at the end
+ */
+
+static uint32_t
+mpeg_crc32(unsigned char *data, uint32_t len)
+{
+	uint32_t crc = 0xffffffff;
+
+	while(len != 0)
+	{
+		crc = (crc << 8) ^ _crc_table[((crc >> 24) ^ *data) & 0xff];
+		data ++;
+		len --;
+	}
+
+	return crc;
+}
@@ -0,0 +1,44 @@
+/*
+ * tsfile.h
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __TSFILE_H__
+#define __TSFILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* software equivalent of a demux section filter */
+struct section_filter
+{
+	uint16_t pid;		/* PID the section must arrive on */
+	uint8_t tid;		/* table_id the section must have */
+	uint8_t sn;		/* section_number the section must have ... */
+	uint8_t sn_mask;	/* ... if this is 0xff, 0 => any section_number */
+};
+
+bool tsfile_init(char *);
+bool using_tsfile(void);
+
+bool tsfile_read_section(struct section_filter *, unsigned int, unsigned char *, uint16_t *, bool);
+void tsfile_rewind(void);
+
+#endif	/* __TSFILE_H__ */
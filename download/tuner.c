@@ -0,0 +1,203 @@
+/*
+ * tuner.c
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "tuner.h"
+#include "channels.h"
+#include "cache.h"
+#include "utils.h"
+
+/*
+ * the carousel is always downloaded with the adapter given on the command line (the main tuner)
+ * any other adapters we find are spare tuners, they are only used to send streams
+ *
+ * each stream command runs in its own process, so which tuners are in use is kept in a shared mapping
+ * a tuner is owned by the process streaming from it, as only one process can read the dvr device
+ * a stream for a service on the multiplex we are downloading from uses the main tuner if it is free
+ * a stream for any other service gets a spare tuner, so the carousel download is not disturbed
+ */
+
+struct tuner_slot
+{
+	struct tuner tuner;		/* must be first */
+	pid_t owner;			/* process using it, 0 => free */
+};
+
+struct tuner_pool
+{
+	unsigned int ntuners;
+	struct tuner_slot slot[TUNER_MAX_ADAPTERS];	/* slot[0] is the main tuner */
+};
+
+static struct tuner_pool *_pool = NULL;
+
+/* used if we have no tuners, eg we are reading from a Transport Stream file */
+static struct tuner _carousel_tuner;
+
+static void
+init_slot(struct tuner_slot *slot, bool main, unsigned int adapter, unsigned int frontend, unsigned int demux, unsigned int dvr)
+{
+	slot->tuner.main = main;
+	slot->tuner.adapter = adapter;
+	slot->tuner.frontend = frontend;
+	snprintf(slot->tuner.demux_device, sizeof(slot->tuner.demux_device), DEMUX_DEVICE, adapter, demux);
+	snprintf(slot->tuner.dvr_device, sizeof(slot->tuner.dvr_device), DVR_DEVICE, adapter, dvr);
+	slot->owner = 0;
+
+	return;
+}
+
+/*
+ * must be called before we fork the downloader and any command processes
+ * the main tuner is the one we download the carousel with
+ * any other adapters we find are used as spare tuners (using frontend, demux and dvr 0)
+ */
+
+bool
+tuner_init(unsigned int adapter, unsigned int frontend, unsigned int demux, unsigned int dvr)
+{
+	void *map;
+	char fe_dev[PATH_MAX];
+	unsigned int i;
+
+	map = mmap(NULL, sizeof(struct tuner_pool), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED)
+	{
+		error("Unable to create tuner pool: %s", strerror(errno));
+		return false;
+	}
+
+	_pool = map;
+
+	init_slot(&_pool->slot[0], true, adapter, frontend, demux, dvr);
+	_pool->ntuners = 1;
+
+	for(i=0; i<TUNER_MAX_ADAPTERS && _pool->ntuners<TUNER_MAX_ADAPTERS; i++)
+	{
+		snprintf(fe_dev, sizeof(fe_dev), FE_DEVICE, i, 0);
+		if(i == adapter || access(fe_dev, F_OK) < 0)
+			continue;
+		verbose("Adapter %u is a spare tuner", i);
+		init_slot(&_pool->slot[_pool->ntuners], false, i, 0, 0, 0);
+		_pool->ntuners ++;
+	}
+
+	return true;
+}
+
+/*
+ * returns true if we now own the tuner
+ */
+
+static bool
+claim_tuner(struct tuner_slot *slot)
+{
+	pid_t owner = 0;
+	pid_t self = getpid();
+
+	if(__atomic_compare_exchange_n(&slot->owner, &owner, self, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return true;
+
+	/* take it over if the process using it has gone away without releasing it */
+	if(owner != self
+	&& kill(owner, 0) < 0 && errno == ESRCH
+	&& __atomic_compare_exchange_n(&slot->owner, &owner, self, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return true;
+
+	return false;
+}
+
+/*
+ * returns a tuner that is receiving the multiplex service_id is on
+ * if service_id is -1, use the service we are downloading the carousel from
+ * returns NULL if they are all in use or we can't tune to service_id
+ * call tuner_release() when you have finished with it
+ */
+
+struct tuner *
+tuner_acquire(struct carousel *car, int service_id)
+{
+	struct tuner_slot *slot;
+	unsigned int i;
+
+	/* no tuners, so just use the carousel's devices as we always have */
+	if(_pool == NULL)
+	{
+		_carousel_tuner.main = true;
+		memcpy(_carousel_tuner.demux_device, car->demux_device, sizeof(_carousel_tuner.demux_device));
+		memcpy(_carousel_tuner.dvr_device, car->dvr_device, sizeof(_carousel_tuner.dvr_device));
+		return &_carousel_tuner;
+	}
+
+	if(service_id == -1)
+		service_id = car->service_id;
+
+	/*
+	 * no need for another tuner if it is on the multiplex we are downloading from
+	 * ie channels.conf says it is, or it is in the PAT we have read from the main tuner
+	 */
+	slot = &_pool->slot[0];
+	if((service_tuned(slot->tuner.adapter, slot->tuner.frontend, service_id) || cache_pmt_pid(service_id) != 0)
+	&& claim_tuner(slot))
+		return &slot->tuner;
+
+	/* the main tuner stays on our multiplex, so tune a spare one */
+	for(i=1; i<_pool->ntuners; i++)
+	{
+		slot = &_pool->slot[i];
+		if(!claim_tuner(slot))
+			continue;
+		verbose("Using adapter %u for service_id %u", slot->tuner.adapter, service_id);
+		if(tune_service_id(slot->tuner.adapter, slot->tuner.frontend, car->timeout, service_id))
+			return &slot->tuner;
+		/* not in channels.conf, so no point trying another tuner */
+		tuner_release(&slot->tuner);
+		return NULL;
+	}
+
+	error("No tuner available for service_id %u", service_id);
+
+	return NULL;
+}
+
+void
+tuner_release(struct tuner *tuner)
+{
+	struct tuner_slot *slot;
+	pid_t self = getpid();
+
+	if(_pool == NULL || tuner == &_carousel_tuner)
+		return;
+
+	slot = (struct tuner_slot *) tuner;
+	__atomic_compare_exchange_n(&slot->owner, &self, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+	return;
+}
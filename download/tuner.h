@@ -0,0 +1,50 @@
+/*
+ * tuner.h
+ *
+ * the DVB adapters we can send streams from, shared by all the processes
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __TUNER_H__
+#define __TUNER_H__
+
+#include <stdbool.h>
+#include <limits.h>
+
+#include "module.h"
+
+/* we look for adapters 0 to TUNER_MAX_ADAPTERS-1 */
+#define TUNER_MAX_ADAPTERS	8
+
+struct tuner
+{
+	bool main;			/* true if it is the adapter we download the carousel with */
+	unsigned int adapter;
+	unsigned int frontend;
+	char demux_device[PATH_MAX];
+	char dvr_device[PATH_MAX];
+};
+
+bool tuner_init(unsigned int, unsigned int, unsigned int, unsigned int);
+
+struct tuner *tuner_acquire(struct carousel *, int);
+void tuner_release(struct tuner *);
+
+#endif	/* __TUNER_H__ */
@@ -31,6 +31,10 @@
 #define MAX(a, b)	((a) > (b) ? (a) : (b))
 #endif
 
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
 /* DVB demux device - %u is card number */
 #if defined(HAVE_DREAMBOX_HARDWARE)
 #define DEMUX_DEVICE "/dev/dvb/card%u/demux%u"
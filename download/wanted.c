@@ -0,0 +1,140 @@
+/*
+ * wanted.c
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "wanted.h"
+#include "utils.h"
+
+/*
+ * when the browser asks for a file we have not downloaded yet,
+ * the command process adds the module it is in to a ring buffer in a shared mapping
+ * the downloader takes them out and downloads those modules before any others
+ * each request is packed into a single uint64_t so it can be written atomically
+ * if the downloader does not keep up, the oldest requests are overwritten
+ *
+ * a writer reserves a slot by incrementing next, then fills it in
+ * so the downloader may see next change before the slot has been written
+ * each request includes the bottom bits of its sequence number (+ 1, so an empty slot never matches)
+ * if a slot does not have the sequence number the downloader expects, it has not been written yet
+ */
+
+struct wanted
+{
+	uint32_t next;			/* total number of requests ever added */
+	uint64_t req[WANTED_LEN];	/* WANTED_SEQ(n) << 48 | download_id << 16 | module_id */
+};
+
+#define WANTED_SEQ(N)	(((uint64_t) ((N) + 1)) & 0xffff)
+
+static struct wanted *_wanted = NULL;
+
+/* only used in the downloader process, the next request it has not looked at yet */
+static bool _reading = false;
+static uint32_t _read = 0;
+
+/*
+ * must be called before we fork the downloader and any command processes
+ */
+
+bool
+wanted_init(void)
+{
+	void *map;
+
+	map = mmap(NULL, sizeof(struct wanted), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED)
+	{
+		error("Unable to create wanted modules list: %s", strerror(errno));
+		return false;
+	}
+
+	_wanted = map;
+	_wanted->next = 0;
+
+	return true;
+}
+
+/*
+ * called by the command processes
+ */
+
+void
+wanted_add(uint32_t download_id, uint16_t module_id)
+{
+	uint32_t n;
+
+	if(_wanted == NULL)
+		return;
+
+	n = __atomic_fetch_add(&_wanted->next, 1, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&_wanted->req[n & (WANTED_LEN - 1)], (WANTED_SEQ(n) << 48) | ((uint64_t) download_id << 16) | module_id, __ATOMIC_RELEASE);
+
+	return;
+}
+
+/*
+ * called by the downloader process
+ * returns false if there are no new requests
+ */
+
+bool
+wanted_next(uint32_t *download_id, uint16_t *module_id)
+{
+	uint32_t next;
+	uint64_t req;
+
+	if(_wanted == NULL)
+		return false;
+
+	next = __atomic_load_n(&_wanted->next, __ATOMIC_ACQUIRE);
+
+	/* ignore anything asked for before this downloader started */
+	if(!_reading)
+	{
+		_reading = true;
+		_read = next;
+	}
+
+	if(_read == next)
+		return false;
+
+	/* skip any we have already overwritten */
+	if(next - _read > WANTED_LEN)
+		_read = next - WANTED_LEN;
+
+	req = __atomic_load_n(&_wanted->req[_read & (WANTED_LEN - 1)], __ATOMIC_ACQUIRE);
+
+	/* not written yet, try again next time (if the writer never finishes, the ring will wrap past it) */
+	if((req >> 48) != WANTED_SEQ(_read))
+		return false;
+
+	_read ++;
+
+	*download_id = (req >> 16) & 0xffffffff;
+	*module_id = req & 0xffff;
+
+	return true;
+}
@@ -0,0 +1,39 @@
+/*
+ * wanted.h
+ *
+ * modules the browser is waiting for, passed from the command processes to the downloader
+ */
+
+/*
+ * Copyright (C) 2010, Simon Kilvington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __WANTED_H__
+#define __WANTED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* number of requests we remember, must be a power of 2 */
+#define WANTED_LEN	64
+
+bool wanted_init(void);
+
+void wanted_add(uint32_t, uint16_t);
+bool wanted_next(uint32_t *, uint16_t *);
+
+#endif	/* __WANTED_H__ */